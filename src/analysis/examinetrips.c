@@ -47,10 +47,9 @@ double haversine_dist(double latA, double lonA, double latB, double lonB) {
 double petrolusage(sqlite3 *db, int trip) {
 	int rc;
 
-	const char mafselect_sql[] = "SELECT SUM(a.maf*(a.time-b.time)), count(a.maf), max(a.time) - min(a.time) "
-			"FROM obd a LEFT JOIN obd b "
-			"ON a.rowid=b.rowid+1 "
-			"WHERE a.trip=? AND b.trip=a.trip";
+	// In time order; blackbox rows aren't in rowid order
+	const char mafselect_sql[] = "SELECT maf,time FROM obd "
+			"WHERE trip=? ORDER BY time";
 
 	sqlite3_stmt *mafstmt;
 
@@ -64,13 +63,40 @@ double petrolusage(sqlite3 *db, int trip) {
 	printf("Trip %i ", trip);
 
 	double trip_dist = tripdist(db, trip);
-	double total_maf;
-	double delta_time;
-	int maf_count;
-	if(SQLITE_ROW == sqlite3_step(mafstmt)) {
-		total_maf = sqlite3_column_double(mafstmt,0);
-		maf_count = sqlite3_column_int(mafstmt,1);
-		delta_time = sqlite3_column_double(mafstmt,2);
+	double total_maf = 0;
+	double delta_time = 0;
+
+	// The logger keeps these in the trip table as it goes; older logs
+	//   still need to add it up
+	sqlite3_stmt *summarystmt;
+	int havesummary = 0;
+	if(SQLITE_OK == sqlite3_prepare_v2(db, "SELECT air, duration FROM trip "
+			"WHERE tripid=? AND air IS NOT NULL AND duration IS NOT NULL",
+			-1, &summarystmt, NULL)) {
+		sqlite3_bind_int(summarystmt, 1, trip);
+		if(SQLITE_ROW == sqlite3_step(summarystmt)) {
+			total_maf = sqlite3_column_double(summarystmt,0);
+			delta_time = sqlite3_column_double(summarystmt,1);
+			havesummary = 1;
+		}
+		sqlite3_finalize(summarystmt);
+	}
+
+	if(!havesummary) {
+		// Each row's maf times the time since the row before
+		int rows = 0;
+		double prevtime = 0;
+		double secondtime = 0;
+		while(SQLITE_ROW == sqlite3_step(mafstmt)) {
+			double t = sqlite3_column_double(mafstmt,1);
+			if(rows > 0 && SQLITE_NULL != sqlite3_column_type(mafstmt,0)) {
+				total_maf += sqlite3_column_double(mafstmt,0) * (t - prevtime);
+			}
+			if(1 == rows) secondtime = t;
+			if(rows > 0) delta_time = t - secondtime;
+			prevtime = t;
+			rows++;
+		}
 	}
 
 	/* const float ratio = 0.147;
@@ -109,10 +135,21 @@ double tripdist(sqlite3 *db, int trip) {
 
 	double total_dst = 0;
 
-	const char dstselect_sql[] = "SELECT a.lat,a.lon,b.lat,b.lon "
-			"FROM gps a LEFT JOIN gps b "
-			"ON b.rowid=a.rowid+1 "
-			"WHERE a.trip=? AND b.trip=a.trip";
+	sqlite3_stmt *summarystmt;
+	if(SQLITE_OK == sqlite3_prepare_v2(db, "SELECT distance FROM trip "
+			"WHERE tripid=? AND distance IS NOT NULL", -1, &summarystmt, NULL)) {
+		sqlite3_bind_int(summarystmt, 1, trip);
+		if(SQLITE_ROW == sqlite3_step(summarystmt)) {
+			total_dst = sqlite3_column_double(summarystmt, 0);
+			sqlite3_finalize(summarystmt);
+			return total_dst;
+		}
+		sqlite3_finalize(summarystmt);
+	}
+
+	// In time order; blackbox rows aren't in rowid order
+	const char dstselect_sql[] = "SELECT lat,lon FROM gps "
+			"WHERE trip=? ORDER BY time";
 
 	sqlite3_stmt *dststmt;
 
@@ -124,11 +161,17 @@ double tripdist(sqlite3 *db, int trip) {
 
 	sqlite3_bind_int(dststmt, 1, trip);
 
+	int havelast = 0;
+	double lastlat = 0, lastlon = 0;
 	while(SQLITE_ROW == sqlite3_step(dststmt)) {
-		total_dst += haversine_dist( sqlite3_column_double(dststmt, 0),
-							sqlite3_column_double(dststmt, 1),
-							sqlite3_column_double(dststmt, 2),
-							sqlite3_column_double(dststmt, 3) );
+		double lat = sqlite3_column_double(dststmt, 0);
+		double lon = sqlite3_column_double(dststmt, 1);
+		if(havelast) {
+			total_dst += haversine_dist( lastlat, lastlon, lat, lon );
+		}
+		lastlat = lat;
+		lastlon = lon;
+		havelast = 1;
 	}
 
 	sqlite3_finalize(dststmt);
@@ -141,10 +184,9 @@ int tripmeanmedian(sqlite3 *db, int trip, double *meanlat, double *meanlon,
 
 	int rc;
 
-	const char dstselect_sql[] = "SELECT a.lat,a.lon,b.lat,b.lon "
-			"FROM gps a LEFT JOIN gps b "
-			"ON b.rowid=a.rowid+1 "
-			"WHERE a.trip=? AND b.trip=a.trip";
+	// In time order; blackbox rows aren't in rowid order
+	const char dstselect_sql[] = "SELECT lat,lon FROM gps "
+			"WHERE trip=? ORDER BY time";
 
 	sqlite3_stmt *dststmt;
 
@@ -163,11 +205,17 @@ int tripmeanmedian(sqlite3 *db, int trip, double *meanlat, double *meanlon,
 
 	double total_len = 0;
 
+	int havelast = 0;
+	double latA = 0, lonA = 0;
 	while(SQLITE_ROW == sqlite3_step(dststmt)) {
-		double latA = sqlite3_column_double(dststmt, 0);
-		double lonA = sqlite3_column_double(dststmt, 1);
-		double latB = sqlite3_column_double(dststmt, 2);
-		double lonB = sqlite3_column_double(dststmt, 3);
+		double latB = sqlite3_column_double(dststmt, 0);
+		double lonB = sqlite3_column_double(dststmt, 1);
+		if(!havelast) {
+			latA = latB;
+			lonA = lonB;
+			havelast = 1;
+			continue;
+		}
 
 		double delta = haversine_dist( latA, lonA, latB, lonB );
 
@@ -177,16 +225,23 @@ int tripmeanmedian(sqlite3 *db, int trip, double *meanlat, double *meanlon,
 		total_lon += delta * lonA;
 
 		count++;
+		latA = latB;
+		lonA = lonB;
 	}
 
 	sqlite3_reset(dststmt);
 
 	double half_len = total_len / 2;
+	havelast = 0;
 	while(SQLITE_ROW == sqlite3_step(dststmt)) {
-		double latA = sqlite3_column_double(dststmt, 0);
-		double lonA = sqlite3_column_double(dststmt, 1);
-		double latB = sqlite3_column_double(dststmt, 2);
-		double lonB = sqlite3_column_double(dststmt, 3);
+		double latB = sqlite3_column_double(dststmt, 0);
+		double lonB = sqlite3_column_double(dststmt, 1);
+		if(!havelast) {
+			latA = latB;
+			lonA = lonB;
+			havelast = 1;
+			continue;
+		}
 
 		double delta = haversine_dist( latA, lonA, latB, lonB );
 
@@ -197,6 +252,8 @@ int tripmeanmedian(sqlite3 *db, int trip, double *meanlat, double *meanlon,
 			*medianlon = lonA;
 			break;
 		}
+		latA = latB;
+		lonA = lonB;
 	}
 
 	sqlite3_finalize(dststmt);
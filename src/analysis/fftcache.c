@@ -0,0 +1,625 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Columnar trip cache for obdfft
+ */
+
+#include "fftcache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <fftw3.h>
+
+#include "sqlite3.h"
+
+/// Most frames in a spectrogram. Longer trips get a bigger hop
+#define FFTCACHE_MAXFRAMES 4096
+
+/// How often the loader and transform check for a newer request
+#define FFTCACHE_CHECKEVERY 65536
+
+/// One column of one trip, resampled
+struct fftcache_series {
+	long trip; ///< Trip, or FFTCACHE_ALLTRIPS
+	char *column; ///< Column or expression
+	int n; ///< Number of samples
+	double t0; ///< Time of the first sample
+	double dt; ///< Time between samples
+	float *samples; ///< The samples
+	unsigned long lastused; ///< For evicting the least recently used
+};
+
+/// Spectra for one column of one trip with one window
+struct fftcache_spectra {
+	long trip; ///< Trip, or FFTCACHE_ALLTRIPS
+	char *column; ///< Column or expression
+	int window; ///< FFT window length
+	int bins; ///< window/2+1
+	float *spectrum; ///< Averaged magnitude spectrum
+	int frames; ///< Frames in the spectrogram
+	int hop; ///< Samples between frame starts
+	float *spectrogram; ///< frames*bins magnitudes
+	unsigned long lastused; ///< For evicting the least recently used
+};
+
+struct fftcache {
+	sqlite3 *db; ///< Where the data comes from
+	void (*done)(void *arg); ///< Called when a request finishes
+	void *arg; ///< Passed to done
+
+	pthread_t thread; ///< The worker
+	pthread_mutex_t lock; ///< Protects everything below
+	pthread_cond_t cond; ///< Signalled when there's a request, or on quit
+	int quit; ///< Set to ask the worker to exit
+
+	char *req_column; ///< Most recent request
+	long req_trip; ///< Most recent request
+	int req_window; ///< Most recent request
+	unsigned long req_gen; ///< Bumped on every request
+	unsigned long done_gen; ///< The request that result_* belongs to
+	int done_status; ///< 0 for success, -1 for failure
+
+	struct fftcache_series *result_series; ///< Answer to done_gen
+	struct fftcache_spectra *result_spectra; ///< Answer to done_gen
+
+	struct fftcache_series *series[FFTCACHE_MAXSERIES]; ///< Cached columns
+	struct fftcache_spectra *spectra[FFTCACHE_MAXSPECTRA]; ///< Cached spectra
+	unsigned long usecount; ///< Clock for lastused
+};
+
+/// Serialises FFTW planner calls across threads
+static pthread_mutex_t fftcache_plannerlock = PTHREAD_MUTEX_INITIALIZER;
+
+void fftcache_lockplanner() {
+	pthread_mutex_lock(&fftcache_plannerlock);
+}
+
+void fftcache_unlockplanner() {
+	pthread_mutex_unlock(&fftcache_plannerlock);
+}
+
+static void fftcache_freeseries(struct fftcache_series *s) {
+	if(NULL == s) return;
+	free(s->column);
+	free(s->samples);
+	free(s);
+}
+
+static void fftcache_freespectra(struct fftcache_spectra *sp) {
+	if(NULL == sp) return;
+	free(sp->column);
+	free(sp->spectrum);
+	free(sp->spectrogram);
+	free(sp);
+}
+
+/// Find a cached column. Call with the lock held
+static struct fftcache_series *fftcache_findseries(struct fftcache *c, const char *column, long trip) {
+	int i;
+	for(i=0; i<FFTCACHE_MAXSERIES; i++) {
+		struct fftcache_series *s = c->series[i];
+		if(NULL != s && trip == s->trip && 0 == strcmp(column, s->column)) {
+			s->lastused = ++c->usecount;
+			return s;
+		}
+	}
+	return NULL;
+}
+
+/// Find cached spectra. Call with the lock held
+static struct fftcache_spectra *fftcache_findspectra(struct fftcache *c, const char *column, long trip, int window) {
+	int i;
+	for(i=0; i<FFTCACHE_MAXSPECTRA; i++) {
+		struct fftcache_spectra *sp = c->spectra[i];
+		if(NULL != sp && trip == sp->trip && window == sp->window && 0 == strcmp(column, sp->column)) {
+			sp->lastused = ++c->usecount;
+			return sp;
+		}
+	}
+	return NULL;
+}
+
+/// Put a column in the cache, evicting the least recently used. Call with the lock held
+static void fftcache_addseries(struct fftcache *c, struct fftcache_series *s) {
+	int i;
+	int victim = -1;
+	for(i=0; i<FFTCACHE_MAXSERIES; i++) {
+		if(NULL == c->series[i]) {
+			victim = i;
+			break;
+		}
+		if(c->series[i] == c->result_series) continue;
+		if(-1 == victim || c->series[i]->lastused < c->series[victim]->lastused) victim = i;
+	}
+	fftcache_freeseries(c->series[victim]);
+	s->lastused = ++c->usecount;
+	c->series[victim] = s;
+}
+
+/// Put spectra in the cache, evicting the least recently used. Call with the lock held
+static void fftcache_addspectra(struct fftcache *c, struct fftcache_spectra *sp) {
+	int i;
+	int victim = -1;
+	for(i=0; i<FFTCACHE_MAXSPECTRA; i++) {
+		if(NULL == c->spectra[i]) {
+			victim = i;
+			break;
+		}
+		if(c->spectra[i] == c->result_spectra) continue;
+		if(-1 == victim || c->spectra[i]->lastused < c->spectra[victim]->lastused) victim = i;
+	}
+	fftcache_freespectra(c->spectra[victim]);
+	sp->lastused = ++c->usecount;
+	c->spectra[victim] = sp;
+}
+
+/// Has a newer request, or a quit, come in since gen
+static int fftcache_stale(struct fftcache *c, unsigned long gen) {
+	pthread_mutex_lock(&c->lock);
+	int stale = c->quit || gen != c->req_gen;
+	pthread_mutex_unlock(&c->lock);
+	return stale;
+}
+
+static int fftcache_comparedouble(const void *a, const void *b) {
+	double x = *(const double *)a;
+	double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/// Does the obd table have a time column. CSV files opened in obdfft might not
+static int fftcache_hastime(sqlite3 *db) {
+	sqlite3_stmt *stmt;
+	int found = 0;
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "PRAGMA table_info(obd)", -1, &stmt, NULL)) {
+		return 0;
+	}
+	while(SQLITE_ROW == sqlite3_step(stmt)) {
+		if(0 == strcmp("time", (const char *)sqlite3_column_text(stmt, 1))) found = 1;
+	}
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+/// Pull a column out of the database and resample it onto a uniform grid
+/** \return the series, or NULL on failure or if it went stale */
+static struct fftcache_series *fftcache_load(struct fftcache *c, unsigned long gen,
+	const char *column, long trip) {
+
+	int hastime = fftcache_hastime(c->db);
+	double tripstart = 0, tripend = 0;
+	sqlite3_stmt *stmt;
+	int rc;
+
+	if(FFTCACHE_ALLTRIPS != trip) {
+		if(SQLITE_OK != sqlite3_prepare_v2(c->db, "SELECT start,end FROM trip WHERE tripid=?", -1, &stmt, NULL)) {
+			fprintf(stderr, "Couldn't prepare trip select: %s\n", sqlite3_errmsg(c->db));
+			return NULL;
+		}
+		sqlite3_bind_int64(stmt, 1, trip);
+		rc = sqlite3_step(stmt);
+		if(SQLITE_ROW == rc) {
+			tripstart = sqlite3_column_double(stmt, 0);
+			tripend = sqlite3_column_double(stmt, 1);
+		}
+		sqlite3_finalize(stmt);
+		if(SQLITE_ROW != rc) {
+			fprintf(stderr, "No such trip %li\n", trip);
+			return NULL;
+		}
+	}
+
+	// The trip restriction is on time, so it uses the time index
+	char sql[1024];
+	if(!hastime) {
+		snprintf(sql, sizeof(sql), "SELECT rowid,(%s) FROM obd ORDER BY rowid", column);
+	} else if(FFTCACHE_ALLTRIPS == trip) {
+		snprintf(sql, sizeof(sql), "SELECT time,(%s) FROM obd ORDER BY time", column);
+	} else {
+		snprintf(sql, sizeof(sql), "SELECT time,(%s) FROM obd WHERE time>? AND time<? ORDER BY time", column);
+	}
+
+	if(SQLITE_OK != sqlite3_prepare_v2(c->db, sql, -1, &stmt, NULL)) {
+		fprintf(stderr, "Couldn't prepare statement \"%s\": %s\n", sql, sqlite3_errmsg(c->db));
+		return NULL;
+	}
+	if(hastime && FFTCACHE_ALLTRIPS != trip) {
+		sqlite3_bind_double(stmt, 1, tripstart);
+		sqlite3_bind_double(stmt, 2, tripend);
+	}
+
+	int count = 0;
+	int allocated = 0;
+	double *t = NULL;
+	float *v = NULL;
+	int stale = 0;
+
+	while(SQLITE_ROW == sqlite3_step(stmt)) {
+		if(SQLITE_NULL == sqlite3_column_type(stmt, 0) ||
+			SQLITE_NULL == sqlite3_column_type(stmt, 1)) continue;
+
+		if(count >= allocated) {
+			int newallocated = (0 == allocated)?4096:allocated*2;
+			double *newt = (double *)realloc(t, newallocated * sizeof(double));
+			float *newv = (float *)realloc(v, newallocated * sizeof(float));
+			if(NULL != newt) t = newt;
+			if(NULL != newv) v = newv;
+			if(NULL == newt || NULL == newv) break;
+			allocated = newallocated;
+		}
+		t[count] = sqlite3_column_double(stmt, 0);
+		v[count] = (float)sqlite3_column_double(stmt, 1);
+		count++;
+
+		if(0 == count % FFTCACHE_CHECKEVERY && fftcache_stale(c, gen)) {
+			stale = 1;
+			break;
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	if(stale || 0 == count) {
+		if(!stale) fprintf(stderr, "No data for %s\n", column);
+		free(t);
+		free(v);
+		return NULL;
+	}
+
+	struct fftcache_series *s = (struct fftcache_series *)malloc(sizeof(struct fftcache_series));
+	if(NULL == s) {
+		free(t);
+		free(v);
+		return NULL;
+	}
+	s->trip = trip;
+	s->column = strdup(column);
+	s->t0 = t[0];
+
+	// Grid spacing is the median gap, so the odd dropout doesn't skew it
+	double dt = 1.0;
+	if(count > 1) {
+		double *gaps = (double *)malloc((count-1) * sizeof(double));
+		int numgaps = 0;
+		int i;
+		if(NULL != gaps) {
+			for(i=1; i<count; i++) {
+				if(t[i] > t[i-1]) gaps[numgaps++] = t[i] - t[i-1];
+			}
+			if(numgaps > 0) {
+				qsort(gaps, numgaps, sizeof(double), fftcache_comparedouble);
+				dt = gaps[numgaps/2];
+			}
+			free(gaps);
+		}
+	}
+
+	double span = t[count-1] - t[0];
+	double n = span/dt + 1;
+	if(n > FFTCACHE_MAXSAMPLES) {
+		n = FFTCACHE_MAXSAMPLES;
+		dt = span / (n-1);
+	}
+	s->n = (int)n;
+	s->dt = dt;
+	s->samples = (float *)malloc(s->n * sizeof(float));
+	if(NULL == s->samples) {
+		fftcache_freeseries(s);
+		free(t);
+		free(v);
+		return NULL;
+	}
+
+	// Linear interpolation, walking forward through the raw samples
+	int i;
+	int j = 0;
+	for(i=0; i<s->n; i++) {
+		double when = s->t0 + i*dt;
+		while(j < count-2 && t[j+1] <= when) j++;
+		if(j+1 >= count || t[j+1] <= t[j]) {
+			s->samples[i] = v[j];
+		} else {
+			double frac = (when - t[j]) / (t[j+1] - t[j]);
+			if(frac < 0) frac = 0;
+			if(frac > 1) frac = 1;
+			s->samples[i] = (float)(v[j] + frac * (v[j+1] - v[j]));
+		}
+	}
+
+	free(t);
+	free(v);
+	return s;
+}
+
+/// Work out the spectrum and spectrogram for a series
+/** \return the spectra, or NULL on failure or if it went stale */
+static struct fftcache_spectra *fftcache_transform(struct fftcache *c, unsigned long gen,
+	const struct fftcache_series *s, int window) {
+
+	if(window < 2) return NULL;
+
+	struct fftcache_spectra *sp = (struct fftcache_spectra *)malloc(sizeof(struct fftcache_spectra));
+	if(NULL == sp) return NULL;
+	memset(sp, 0, sizeof(struct fftcache_spectra));
+	sp->trip = s->trip;
+	sp->column = strdup(s->column);
+	sp->window = window;
+	sp->bins = window/2 + 1;
+
+	// Short series get one zero-padded frame
+	int hop = window/2;
+	if(s->n <= window) {
+		sp->frames = 1;
+	} else {
+		sp->frames = 1 + (s->n - window) / hop;
+		if(sp->frames > FFTCACHE_MAXFRAMES) {
+			hop = (s->n - window) / (FFTCACHE_MAXFRAMES - 1);
+			sp->frames = 1 + (s->n - window) / hop;
+		}
+	}
+	sp->hop = hop;
+
+	sp->spectrum = (float *)malloc(sp->bins * sizeof(float));
+	sp->spectrogram = (float *)malloc((size_t)sp->frames * sp->bins * sizeof(float));
+	double *in = (double *)fftw_malloc(window * sizeof(double));
+	fftw_complex *out = (fftw_complex *)fftw_malloc(sp->bins * sizeof(fftw_complex));
+	double *hann = (double *)malloc(window * sizeof(double));
+
+	if(NULL == sp->spectrum || NULL == sp->spectrogram || NULL == in || NULL == out || NULL == hann) {
+		fftw_free(in);
+		fftw_free(out);
+		free(hann);
+		fftcache_freespectra(sp);
+		return NULL;
+	}
+
+	int i, f;
+	double hannsum = 0;
+	for(i=0; i<window; i++) {
+		hann[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / (window - 1));
+		hannsum += hann[i];
+	}
+
+	// Take out the mean, or bin zero swamps everything else
+	double mean = 0;
+	for(i=0; i<s->n; i++) mean += s->samples[i];
+	mean /= s->n;
+
+	fftcache_lockplanner();
+	fftw_plan plan = fftw_plan_dft_r2c_1d(window, in, out, FFTW_ESTIMATE);
+	fftcache_unlockplanner();
+
+	memset(sp->spectrum, 0, sp->bins * sizeof(float));
+	int stale = 0;
+	for(f=0; f<sp->frames; f++) {
+		int start = f * hop;
+		for(i=0; i<window; i++) {
+			in[i] = (start+i < s->n)?(s->samples[start+i] - mean) * hann[i]:0;
+		}
+		fftw_execute(plan);
+
+		float *row = sp->spectrogram + (size_t)f * sp->bins;
+		for(i=0; i<sp->bins; i++) {
+			row[i] = (float)(2.0 * sqrt(out[i][0]*out[i][0] + out[i][1]*out[i][1]) / hannsum);
+			sp->spectrum[i] += row[i] / sp->frames;
+		}
+
+		if(0 == (f+1) % 256 && fftcache_stale(c, gen)) {
+			stale = 1;
+			break;
+		}
+	}
+
+	fftcache_lockplanner();
+	fftw_destroy_plan(plan);
+	fftcache_unlockplanner();
+
+	fftw_free(in);
+	fftw_free(out);
+	free(hann);
+
+	if(stale) {
+		fftcache_freespectra(sp);
+		return NULL;
+	}
+	return sp;
+}
+
+/// The worker
+static void *fftcache_worker(void *arg) {
+	struct fftcache *c = (struct fftcache *)arg;
+
+	pthread_mutex_lock(&c->lock);
+	for(;;) {
+		while(!c->quit && c->done_gen == c->req_gen) {
+			pthread_cond_wait(&c->cond, &c->lock);
+		}
+		if(c->quit) break;
+
+		unsigned long gen = c->req_gen;
+		char *column = strdup(c->req_column);
+		long trip = c->req_trip;
+		int window = c->req_window;
+
+		// Only this thread changes the cache, so what it finds stays put
+		struct fftcache_series *s = fftcache_findseries(c, column, trip);
+		pthread_mutex_unlock(&c->lock);
+
+		if(NULL == s && NULL != column) {
+			s = fftcache_load(c, gen, column, trip);
+			if(NULL != s) {
+				pthread_mutex_lock(&c->lock);
+				fftcache_addseries(c, s);
+				pthread_mutex_unlock(&c->lock);
+			}
+		}
+
+		struct fftcache_spectra *sp = NULL;
+		if(NULL != s) {
+			pthread_mutex_lock(&c->lock);
+			sp = fftcache_findspectra(c, column, trip, window);
+			pthread_mutex_unlock(&c->lock);
+
+			if(NULL == sp) {
+				sp = fftcache_transform(c, gen, s, window);
+				if(NULL != sp) {
+					pthread_mutex_lock(&c->lock);
+					fftcache_addspectra(c, sp);
+					pthread_mutex_unlock(&c->lock);
+				}
+			}
+		}
+		free(column);
+
+		pthread_mutex_lock(&c->lock);
+		if(gen != c->req_gen) continue; // Superseded; start on the new one
+
+		c->result_series = s;
+		c->result_spectra = sp;
+		c->done_status = (NULL == s || NULL == sp)?-1:0;
+		c->done_gen = gen;
+
+		pthread_mutex_unlock(&c->lock);
+		if(NULL != c->done) c->done(c->arg);
+		pthread_mutex_lock(&c->lock);
+	}
+	pthread_mutex_unlock(&c->lock);
+	return NULL;
+}
+
+struct fftcache *fftcache_create(sqlite3 *db, void (*done)(void *arg), void *arg) {
+	struct fftcache *c = (struct fftcache *)malloc(sizeof(struct fftcache));
+	if(NULL == c) return NULL;
+	memset(c, 0, sizeof(struct fftcache));
+
+	c->db = db;
+	c->done = done;
+	c->arg = arg;
+	pthread_mutex_init(&c->lock, NULL);
+	pthread_cond_init(&c->cond, NULL);
+
+	if(0 != pthread_create(&c->thread, NULL, fftcache_worker, c)) {
+		perror("Couldn't create fft worker thread");
+		pthread_mutex_destroy(&c->lock);
+		pthread_cond_destroy(&c->cond);
+		free(c);
+		return NULL;
+	}
+	return c;
+}
+
+void fftcache_destroy(struct fftcache *c) {
+	if(NULL == c) return;
+
+	pthread_mutex_lock(&c->lock);
+	c->quit = 1;
+	pthread_cond_signal(&c->cond);
+	pthread_mutex_unlock(&c->lock);
+	pthread_join(c->thread, NULL);
+
+	int i;
+	for(i=0; i<FFTCACHE_MAXSERIES; i++) fftcache_freeseries(c->series[i]);
+	for(i=0; i<FFTCACHE_MAXSPECTRA; i++) fftcache_freespectra(c->spectra[i]);
+	free(c->req_column);
+
+	pthread_mutex_destroy(&c->lock);
+	pthread_cond_destroy(&c->cond);
+	free(c);
+}
+
+int fftcache_request(struct fftcache *c, const char *column, long trip, int window) {
+	int cached = 0;
+
+	pthread_mutex_lock(&c->lock);
+	free(c->req_column);
+	c->req_column = strdup(column);
+	c->req_trip = trip;
+	c->req_window = window;
+	c->req_gen++;
+
+	struct fftcache_series *s = fftcache_findseries(c, column, trip);
+	struct fftcache_spectra *sp = fftcache_findspectra(c, column, trip, window);
+	if(NULL != s && NULL != sp) {
+		c->result_series = s;
+		c->result_spectra = sp;
+		c->done_status = 0;
+		c->done_gen = c->req_gen;
+		cached = 1;
+	} else {
+		pthread_cond_signal(&c->cond);
+	}
+	pthread_mutex_unlock(&c->lock);
+
+	return cached;
+}
+
+/// malloc and copy
+static float *fftcache_copyfloats(const float *src, size_t n) {
+	float *dst = (float *)malloc(n * sizeof(float));
+	if(NULL != dst) memcpy(dst, src, n * sizeof(float));
+	return dst;
+}
+
+int fftcache_take(struct fftcache *c, struct fftcache_result *r) {
+	memset(r, 0, sizeof(struct fftcache_result));
+
+	pthread_mutex_lock(&c->lock);
+	if(c->done_gen != c->req_gen) {
+		pthread_mutex_unlock(&c->lock);
+		return 1;
+	}
+	if(0 != c->done_status) {
+		pthread_mutex_unlock(&c->lock);
+		return -1;
+	}
+
+	const struct fftcache_series *s = c->result_series;
+	const struct fftcache_spectra *sp = c->result_spectra;
+
+	r->trip = s->trip;
+	r->column = strdup(s->column);
+	r->window = sp->window;
+	r->n = s->n;
+	r->t0 = s->t0;
+	r->dt = s->dt;
+	r->samples = fftcache_copyfloats(s->samples, s->n);
+	r->bins = sp->bins;
+	r->spectrum = fftcache_copyfloats(sp->spectrum, sp->bins);
+	r->frames = sp->frames;
+	r->hop = sp->hop;
+	r->spectrogram = fftcache_copyfloats(sp->spectrogram, (size_t)sp->frames * sp->bins);
+	pthread_mutex_unlock(&c->lock);
+
+	if(NULL == r->column || NULL == r->samples || NULL == r->spectrum || NULL == r->spectrogram) {
+		fftcache_freeresult(r);
+		return -1;
+	}
+	return 0;
+}
+
+void fftcache_freeresult(struct fftcache_result *r) {
+	free(r->column);
+	free(r->samples);
+	free(r->spectrum);
+	free(r->spectrogram);
+	memset(r, 0, sizeof(struct fftcache_result));
+}
+
@@ -0,0 +1,109 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Columnar trip cache for obdfft
+ A column for one trip is pulled out of the database once, resampled
+  onto a uniform time grid, and windowed spectra and a spectrogram are
+  worked out from it. All of that happens on a worker thread, and the
+  results are kept per (trip, column, window) so flicking back and forth
+  between choices doesn't redo any of it.
+ */
+
+#ifndef __FFTCACHE_H
+#define __FFTCACHE_H
+
+#include "sqlite3.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif //  __cplusplus
+
+/// Most resampled columns kept around
+#define FFTCACHE_MAXSERIES 8
+
+/// Most sets of spectra kept around
+#define FFTCACHE_MAXSPECTRA 16
+
+/// Most samples we'll resample a single column to
+#define FFTCACHE_MAXSAMPLES (1<<24)
+
+/// Pass as the trip to get every row
+#define FFTCACHE_ALLTRIPS -1
+
+/// Opaque cache and worker
+struct fftcache;
+
+/// A finished request, copied out of the cache
+struct fftcache_result {
+	long trip; ///< Trip, or FFTCACHE_ALLTRIPS
+	char *column; ///< Column or expression
+	int window; ///< FFT window length
+
+	int n; ///< Number of samples
+	double t0; ///< Time of the first sample
+	double dt; ///< Time between samples
+	float *samples; ///< The column, resampled
+
+	int bins; ///< Number of frequency bins [window/2+1]
+	float *spectrum; ///< Hann-windowed magnitude spectrum, averaged over all frames
+	int frames; ///< Number of frames in the spectrogram
+	int hop; ///< Samples between frame starts
+	float *spectrogram; ///< frames*bins magnitudes; frame f starts at sample f*hop
+};
+
+/// Create a cache and start its worker
+/** \param db the database to load from. Must stay open until fftcache_destroy
+ \param done called on the worker thread when a request is finished. Use it
+     to wake the UI; don't touch the cache from inside it
+ \param arg passed to done
+ \return the cache, or NULL on failure */
+struct fftcache *fftcache_create(sqlite3 *db, void (*done)(void *arg), void *arg);
+
+/// Stop the worker and free everything
+void fftcache_destroy(struct fftcache *c);
+
+/// Ask for a column of a trip with spectra for a window length
+/** Replaces any request that hasn't been started yet; a request in
+     progress is abandoned at the next opportunity
+ \param column column name or SQL expression over the obd table
+ \param trip tripid, or FFTCACHE_ALLTRIPS
+ \param window FFT window length
+ \return 1 if it was already cached, in which case fftcache_take will succeed
+     straight away and done isn't called. 0 if it was queued */
+int fftcache_request(struct fftcache *c, const char *column, long trip, int window);
+
+/// Take a copy of the result of the most recent request
+/** \return 0 on success, 1 if it isn't finished, -1 if it failed */
+int fftcache_take(struct fftcache *c, struct fftcache_result *r);
+
+/// Free the contents of a result filled by fftcache_take
+void fftcache_freeresult(struct fftcache_result *r);
+
+/// FFTW's planner isn't thread-safe. Hold this around any plan creation
+void fftcache_lockplanner();
+
+/// Release the planner lock
+void fftcache_unlockplanner();
+
+#ifdef __cplusplus
+}
+#endif //  __cplusplus
+
+#endif //__FFTCACHE_H
+
@@ -20,6 +20,9 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include "fftwindow.h"
 
 int main(int argc, char **argv) {
+	// Lets the cache's worker wake us with Fl::awake
+	Fl::lock();
+
 	FFTOBD mainwindow;
 
 	if(argc > 1) {
@@ -0,0 +1,649 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Minimal Arrow IPC file writer
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arrowipc.h"
+
+/// The "ARROW1" magic, padded to eight bytes at the start of the file
+static const char arrow_magic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+/// MetadataVersion V5
+#define ARROW_METADATA_V5 4
+
+/// MessageHeader union member for a Schema
+#define ARROW_HEADER_SCHEMA 1
+/// MessageHeader union member for a DictionaryBatch
+#define ARROW_HEADER_DICTIONARYBATCH 2
+/// MessageHeader union member for a RecordBatch
+#define ARROW_HEADER_RECORDBATCH 3
+
+/// Type union member for Int
+#define ARROW_TYPE_INT 2
+/// Type union member for FloatingPoint
+#define ARROW_TYPE_FLOATINGPOINT 3
+
+/// FloatingPoint precision for double
+#define ARROW_PRECISION_DOUBLE 2
+
+/// Most fields in any flatbuffer table we write
+#define FB_MAXSLOTS 8
+
+/// A flatbuffer, built front-to-back
+/** Flatbuffers are normally built back-to-front, but the format only
+ needs offsets to point forwards. Writing each parent before its
+ children and patching the offsets in afterwards keeps this tiny */
+struct fbbuf {
+	unsigned char *data; ///< The buffer
+	size_t len; ///< Bytes used
+	size_t cap; ///< Bytes allocated
+	int failed; ///< Set if an allocation failed
+};
+
+/// A table whose vtable hasn't been written yet
+struct fbtable {
+	size_t start; ///< Where the table starts
+	int nslots; ///< Fields in the vtable
+	uint16_t slot[FB_MAXSLOTS]; ///< Offset of each field in the table, or zero if absent
+};
+
+/// Where a message landed in the file; the footer lists these
+struct arrow_block {
+	int64_t offset; ///< File offset of the message
+	int32_t metalen; ///< Length of the prefix and metadata
+	int64_t bodylen; ///< Length of the body
+};
+
+/// One buffer in a message body
+struct arrow_part {
+	const void *p; ///< Data
+	size_t len; ///< Length, before padding
+};
+
+struct arrow_writer {
+	FILE *f; ///< Output file
+	int64_t pos; ///< Bytes written so far
+	const struct arrow_column *cols; ///< Schema
+	int ncols; ///< Number of columns in the schema
+	struct arrow_block *dicts; ///< Dictionary batches written
+	int ndicts; ///< Number of dictionary batches
+	struct arrow_block *batches; ///< Record batches written
+	int nbatches; ///< Number of record batches
+	int failed; ///< Set if any write failed
+};
+
+static void fb_grow(struct fbbuf *b, size_t n) {
+	if(b->failed || b->len + n <= b->cap) return;
+	size_t newcap = b->cap?b->cap:1024;
+	while(newcap < b->len + n) newcap *= 2;
+	unsigned char *d = (unsigned char *)realloc(b->data, newcap);
+	if(NULL == d) {
+		b->failed = 1;
+		return;
+	}
+	b->data = d;
+	b->cap = newcap;
+}
+
+/// Append bytes; NULL appends zeroes
+static void fb_bytes(struct fbbuf *b, const void *p, size_t n) {
+	fb_grow(b, n);
+	if(b->failed) return;
+	if(NULL == p) {
+		memset(b->data + b->len, 0, n);
+	} else {
+		memcpy(b->data + b->len, p, n);
+	}
+	b->len += n;
+}
+
+/// Zero-pad to a multiple of align
+static void fb_pad(struct fbbuf *b, size_t align) {
+	if(0 != b->len % align) {
+		fb_bytes(b, NULL, align - b->len % align);
+	}
+}
+
+/// Append a little-endian scalar, aligned to its size
+/** \return position it was written at */
+static size_t fb_le(struct fbbuf *b, uint64_t v, int size) {
+	unsigned char tmp[8];
+	int i;
+	fb_pad(b, size);
+	for(i=0;i<size;i++) {
+		tmp[i] = (v >> (8*i)) & 0xff;
+	}
+	size_t pos = b->len;
+	fb_bytes(b, tmp, size);
+	return pos;
+}
+
+/// Point the offset at from to the object at to
+static void fb_link(struct fbbuf *b, size_t from, size_t to) {
+	if(b->failed) return;
+	uint32_t v = (uint32_t)(to - from);
+	int i;
+	for(i=0;i<4;i++) {
+		b->data[from + i] = (v >> (8*i)) & 0xff;
+	}
+}
+
+static void fb_table_start(struct fbbuf *b, struct fbtable *t, int nslots) {
+	fb_pad(b, 8);
+	t->start = fb_le(b, 0, 4);
+	t->nslots = nslots;
+	memset(t->slot, 0, sizeof(t->slot));
+}
+
+static size_t fb_table_scalar(struct fbbuf *b, struct fbtable *t, int slot, uint64_t v, int size) {
+	size_t pos = fb_le(b, v, size);
+	t->slot[slot] = pos - t->start;
+	return pos;
+}
+
+/// Reserve an offset field, to be filled in with fb_link
+static size_t fb_table_offset(struct fbbuf *b, struct fbtable *t, int slot) {
+	return fb_table_scalar(b, t, slot, 0, 4);
+}
+
+/// Write the vtable, just after the table
+static size_t fb_table_end(struct fbbuf *b, struct fbtable *t) {
+	size_t tablesize = b->len - t->start;
+	size_t vt = fb_le(b, 4 + 2*t->nslots, 2);
+	fb_le(b, tablesize, 2);
+	int i;
+	for(i=0;i<t->nslots;i++) {
+		fb_le(b, t->slot[i], 2);
+	}
+
+	// vtable is at table - soffset
+	fb_link(b, t->start, t->start + (t->start - vt));
+	return t->start;
+}
+
+static size_t fb_string(struct fbbuf *b, const char *s) {
+	size_t len = strlen(s);
+	size_t pos = fb_le(b, len, 4);
+	fb_bytes(b, s, len);
+	fb_bytes(b, NULL, 1);
+	return pos;
+}
+
+/// Start a vector of structs that contain 64 bit members
+static size_t fb_structvec(struct fbbuf *b, int count) {
+	fb_pad(b, 4);
+	if(0 != (b->len + 4) % 8) {
+		fb_bytes(b, NULL, 4);
+	}
+	return fb_le(b, count, 4);
+}
+
+static size_t fb_int(struct fbbuf *b, int bits, int is_signed) {
+	struct fbtable t;
+	fb_table_start(b, &t, 2);
+	fb_table_scalar(b, &t, 0, bits, 4);
+	fb_table_scalar(b, &t, 1, is_signed, 1);
+	return fb_table_end(b, &t);
+}
+
+static size_t fb_field(struct fbbuf *b, const struct arrow_column *c) {
+	struct fbtable t;
+	size_t dict = 0;
+
+	fb_table_start(b, &t, 6);
+	size_t name = fb_table_offset(b, &t, 0);
+	fb_table_scalar(b, &t, 1, 1, 1); // nullable
+	fb_table_scalar(b, &t, 2, (ARROW_FLOAT64 == c->type)?ARROW_TYPE_FLOATINGPOINT:ARROW_TYPE_INT, 1);
+	size_t type = fb_table_offset(b, &t, 3);
+	if(ARROW_DICTINT64 == c->type) {
+		dict = fb_table_offset(b, &t, 4);
+	}
+	size_t children = fb_table_offset(b, &t, 5);
+	fb_table_end(b, &t);
+
+	fb_link(b, name, fb_string(b, c->name));
+
+	// Dictionary columns are typed by their values, not their indices
+	if(ARROW_FLOAT64 == c->type) {
+		struct fbtable fp;
+		fb_table_start(b, &fp, 1);
+		fb_table_scalar(b, &fp, 0, ARROW_PRECISION_DOUBLE, 2);
+		fb_link(b, type, fb_table_end(b, &fp));
+	} else {
+		fb_link(b, type, fb_int(b, 64, 1));
+	}
+
+	if(0 != dict) {
+		struct fbtable d;
+		fb_table_start(b, &d, 3);
+		fb_table_scalar(b, &d, 0, c->dictid, 8);
+		size_t indextype = fb_table_offset(b, &d, 1);
+		fb_table_scalar(b, &d, 2, 0, 1); // isOrdered
+		fb_link(b, dict, fb_table_end(b, &d));
+		fb_link(b, indextype, fb_int(b, 32, 1));
+	}
+
+	fb_link(b, children, fb_le(b, 0, 4));
+
+	return t.start;
+}
+
+static size_t fb_schema(struct fbbuf *b, const struct arrow_column *cols, int ncols) {
+	struct fbtable t;
+	int i;
+
+	fb_table_start(b, &t, 2);
+	fb_table_scalar(b, &t, 0, 0, 2); // Little endian
+	size_t fields = fb_table_offset(b, &t, 1);
+	fb_table_end(b, &t);
+
+	size_t vec = fb_le(b, ncols, 4);
+	fb_link(b, fields, vec);
+	for(i=0;i<ncols;i++) {
+		fb_le(b, 0, 4);
+	}
+	for(i=0;i<ncols;i++) {
+		fb_link(b, vec + 4 + 4*i, fb_field(b, &cols[i]));
+	}
+	return t.start;
+}
+
+/// Write the root offset and a Message table
+/** \return position of the header offset, to be linked to the header table */
+static size_t fb_message(struct fbbuf *b, int headertype, int64_t bodylen) {
+	struct fbtable t;
+	size_t root = fb_le(b, 0, 4);
+
+	fb_table_start(b, &t, 4);
+	fb_table_scalar(b, &t, 0, ARROW_METADATA_V5, 2);
+	fb_table_scalar(b, &t, 1, headertype, 1);
+	size_t header = fb_table_offset(b, &t, 2);
+	fb_table_scalar(b, &t, 3, bodylen, 8);
+	fb_link(b, root, fb_table_end(b, &t));
+
+	return header;
+}
+
+/// Write a RecordBatch table
+/** \param nodes length and null count for each column
+ \param bufs offset and length for each buffer
+ */
+static size_t fb_recordbatch(struct fbbuf *b, int64_t length,
+		int nnodes, const int64_t *nodes, int nbufs, const int64_t *bufs) {
+	struct fbtable t;
+	int i;
+
+	fb_table_start(b, &t, 3);
+	fb_table_scalar(b, &t, 0, length, 8);
+	size_t nodevec = fb_table_offset(b, &t, 1);
+	size_t bufvec = fb_table_offset(b, &t, 2);
+	fb_table_end(b, &t);
+
+	fb_link(b, nodevec, fb_structvec(b, nnodes));
+	for(i=0;i<2*nnodes;i++) {
+		fb_le(b, nodes[i], 8);
+	}
+	fb_link(b, bufvec, fb_structvec(b, nbufs));
+	for(i=0;i<2*nbufs;i++) {
+		fb_le(b, bufs[i], 8);
+	}
+	return t.start;
+}
+
+static void fb_blocks(struct fbbuf *b, size_t link, const struct arrow_block *blocks, int n) {
+	int i;
+	fb_link(b, link, fb_structvec(b, n));
+	for(i=0;i<n;i++) {
+		fb_le(b, blocks[i].offset, 8);
+		fb_le(b, blocks[i].metalen, 4);
+		fb_le(b, 0, 4);
+		fb_le(b, blocks[i].bodylen, 8);
+	}
+}
+
+static void aw_write(struct arrow_writer *w, const void *p, size_t n) {
+	if(w->failed || 0 == n) return;
+	if(n != fwrite(p, 1, n, w->f)) {
+		perror("Error writing arrow file");
+		w->failed = 1;
+		return;
+	}
+	w->pos += n;
+}
+
+static void aw_pad(struct arrow_writer *w) {
+	static const char zeroes[8] = { 0 };
+	if(0 != w->pos % 8) {
+		aw_write(w, zeroes, 8 - w->pos % 8);
+	}
+}
+
+static void aw_le32(struct arrow_writer *w, uint32_t v) {
+	unsigned char tmp[4];
+	int i;
+	for(i=0;i<4;i++) {
+		tmp[i] = (v >> (8*i)) & 0xff;
+	}
+	aw_write(w, tmp, 4);
+}
+
+/// Body length once every part is padded to eight bytes
+static int64_t aw_bodylen(const struct arrow_part *parts, int nparts) {
+	int64_t len = 0;
+	int i;
+	for(i=0;i<nparts;i++) {
+		len += (parts[i].len + 7) & ~(size_t)7;
+	}
+	return len;
+}
+
+/// Write an encapsulated message
+static int aw_message(struct arrow_writer *w, struct fbbuf *meta,
+		const struct arrow_part *parts, int nparts, struct arrow_block *blk) {
+	int i;
+
+	fb_pad(meta, 8);
+	if(meta->failed) {
+		fprintf(stderr, "Couldn't allocate arrow metadata\n");
+		w->failed = 1;
+		return 1;
+	}
+
+	aw_pad(w);
+	if(NULL != blk) {
+		blk->offset = w->pos;
+		blk->metalen = 8 + meta->len;
+		blk->bodylen = aw_bodylen(parts, nparts);
+	}
+
+	aw_le32(w, 0xFFFFFFFF);
+	aw_le32(w, meta->len);
+	aw_write(w, meta->data, meta->len);
+	for(i=0;i<nparts;i++) {
+		aw_write(w, parts[i].p, parts[i].len);
+		aw_pad(w);
+	}
+	return w->failed;
+}
+
+/// Add a block to a growing list
+static int aw_addblock(struct arrow_block **blocks, int *n, const struct arrow_block *blk) {
+	struct arrow_block *b = (struct arrow_block *)realloc(*blocks, (*n + 1) * sizeof(struct arrow_block));
+	if(NULL == b) return 1;
+	b[*n] = *blk;
+	*blocks = b;
+	(*n)++;
+	return 0;
+}
+
+/// Write a record batch or dictionary batch
+/** \param dictid dictionary id, or -1 for a plain record batch
+ */
+static int aw_batch(struct arrow_writer *w, long dictid, int64_t length, int ncols,
+		const void * const *data, const size_t *elemsize,
+		const uint8_t * const *valid, const int *nullcount) {
+	struct fbbuf meta;
+	struct arrow_block blk;
+	int i;
+	int rc = 1;
+
+	int64_t *nodes = (int64_t *)malloc(2 * ncols * sizeof(int64_t));
+	int64_t *bufs = (int64_t *)malloc(4 * ncols * sizeof(int64_t));
+	struct arrow_part *parts = (struct arrow_part *)malloc(2 * ncols * sizeof(struct arrow_part));
+	memset(&meta, 0, sizeof(meta));
+	if(NULL == nodes || NULL == bufs || NULL == parts) {
+		fprintf(stderr, "Couldn't allocate arrow batch\n");
+		goto done;
+	}
+
+	int64_t offset = 0;
+	for(i=0;i<ncols;i++) {
+		nodes[2*i] = length;
+		nodes[2*i+1] = nullcount[i];
+
+		// Validity bitmap can be left out when there are no nulls
+		parts[2*i].p = valid[i];
+		parts[2*i].len = (0 < nullcount[i])?(length + 7) / 8:0;
+		parts[2*i+1].p = data[i];
+		parts[2*i+1].len = length * elemsize[i];
+
+		bufs[4*i] = offset;
+		bufs[4*i+1] = parts[2*i].len;
+		offset += (parts[2*i].len + 7) & ~(size_t)7;
+		bufs[4*i+2] = offset;
+		bufs[4*i+3] = parts[2*i+1].len;
+		offset += (parts[2*i+1].len + 7) & ~(size_t)7;
+	}
+
+	if(dictid < 0) {
+		size_t header = fb_message(&meta, ARROW_HEADER_RECORDBATCH, offset);
+		fb_link(&meta, header, fb_recordbatch(&meta, length, ncols, nodes, 2*ncols, bufs));
+	} else {
+		struct fbtable t;
+		size_t header = fb_message(&meta, ARROW_HEADER_DICTIONARYBATCH, offset);
+		fb_table_start(&meta, &t, 3);
+		fb_table_scalar(&meta, &t, 0, dictid, 8);
+		size_t rb = fb_table_offset(&meta, &t, 1);
+		fb_table_scalar(&meta, &t, 2, 0, 1); // isDelta
+		fb_link(&meta, header, fb_table_end(&meta, &t));
+		fb_link(&meta, rb, fb_recordbatch(&meta, length, ncols, nodes, 2*ncols, bufs));
+	}
+
+	if(0 != aw_message(w, &meta, parts, 2*ncols, &blk)) {
+		goto done;
+	}
+
+	if(dictid < 0) {
+		rc = aw_addblock(&w->batches, &w->nbatches, &blk);
+	} else {
+		rc = aw_addblock(&w->dicts, &w->ndicts, &blk);
+	}
+
+done:
+	free(meta.data);
+	free(nodes);
+	free(bufs);
+	free(parts);
+	if(0 != rc) w->failed = 1;
+	return rc;
+}
+
+struct arrow_writer *arrow_open(const char *filename, const struct arrow_column *cols, int ncols) {
+	struct arrow_writer *w = (struct arrow_writer *)calloc(1, sizeof(struct arrow_writer));
+	if(NULL == w) return NULL;
+
+	if(NULL == (w->f = fopen(filename, "wb"))) {
+		perror(filename);
+		free(w);
+		return NULL;
+	}
+	w->cols = cols;
+	w->ncols = ncols;
+
+	aw_write(w, arrow_magic, sizeof(arrow_magic));
+
+	struct fbbuf meta;
+	memset(&meta, 0, sizeof(meta));
+	size_t header = fb_message(&meta, ARROW_HEADER_SCHEMA, 0);
+	fb_link(&meta, header, fb_schema(&meta, cols, ncols));
+	aw_message(w, &meta, NULL, 0, NULL);
+	free(meta.data);
+
+	if(w->failed) {
+		fclose(w->f);
+		free(w);
+		return NULL;
+	}
+	return w;
+}
+
+int arrow_writedictionary(struct arrow_writer *w, long id, const int64_t *values, int n) {
+	const void *data[1] = { values };
+	const size_t elemsize[1] = { sizeof(int64_t) };
+	const uint8_t *valid[1] = { NULL };
+	const int nullcount[1] = { 0 };
+	return aw_batch(w, id, n, 1, data, elemsize, valid, nullcount);
+}
+
+int arrow_writebatch(struct arrow_writer *w, const struct arrow_batch *b) {
+	size_t *elemsize = (size_t *)malloc(b->ncols * sizeof(size_t));
+	int i;
+	if(NULL == elemsize) return 1;
+	for(i=0;i<b->ncols;i++) {
+		elemsize[i] = (ARROW_DICTINT64 == b->cols[i].type)?sizeof(int32_t):8;
+	}
+	int rc = aw_batch(w, -1, b->length, b->ncols,
+		(const void * const *)b->data, elemsize,
+		(const uint8_t * const *)b->valid, b->nullcount);
+	free(elemsize);
+	return rc;
+}
+
+int arrow_close(struct arrow_writer *w) {
+	struct fbbuf footer;
+	struct fbtable t;
+	int rc;
+
+	// End-of-stream marker, so the file also reads as a stream
+	aw_pad(w);
+	aw_le32(w, 0xFFFFFFFF);
+	aw_le32(w, 0);
+
+	memset(&footer, 0, sizeof(footer));
+	size_t root = fb_le(&footer, 0, 4);
+	fb_table_start(&footer, &t, 4);
+	fb_table_scalar(&footer, &t, 0, ARROW_METADATA_V5, 2);
+	size_t schema = fb_table_offset(&footer, &t, 1);
+	size_t dicts = fb_table_offset(&footer, &t, 2);
+	size_t batches = fb_table_offset(&footer, &t, 3);
+	fb_link(&footer, root, fb_table_end(&footer, &t));
+	fb_link(&footer, schema, fb_schema(&footer, w->cols, w->ncols));
+	fb_blocks(&footer, dicts, w->dicts, w->ndicts);
+	fb_blocks(&footer, batches, w->batches, w->nbatches);
+
+	if(footer.failed) {
+		fprintf(stderr, "Couldn't allocate arrow footer\n");
+		w->failed = 1;
+	}
+	aw_write(w, footer.data, footer.len);
+	aw_le32(w, footer.len);
+	aw_write(w, arrow_magic, 6);
+	free(footer.data);
+
+	if(0 != fclose(w->f)) {
+		perror("Error closing arrow file");
+		w->failed = 1;
+	}
+
+	rc = w->failed;
+	free(w->dicts);
+	free(w->batches);
+	free(w);
+	return rc;
+}
+
+struct arrow_batch *arrow_batch_create(const struct arrow_column *cols, int ncols, int capacity) {
+	struct arrow_batch *b = (struct arrow_batch *)calloc(1, sizeof(struct arrow_batch));
+	int i;
+	if(NULL == b) return NULL;
+
+	b->cols = cols;
+	b->ncols = ncols;
+	b->capacity = capacity;
+	b->data = (void **)calloc(ncols, sizeof(void *));
+	b->valid = (uint8_t **)calloc(ncols, sizeof(uint8_t *));
+	b->nullcount = (int *)calloc(ncols, sizeof(int));
+	if(NULL == b->data || NULL == b->valid || NULL == b->nullcount) {
+		arrow_batch_free(b);
+		return NULL;
+	}
+
+	for(i=0;i<ncols;i++) {
+		size_t elemsize = (ARROW_DICTINT64 == cols[i].type)?sizeof(int32_t):8;
+		b->data[i] = calloc(capacity, elemsize);
+		b->valid[i] = (uint8_t *)calloc((capacity + 7) / 8, 1);
+		if(NULL == b->data[i] || NULL == b->valid[i]) {
+			arrow_batch_free(b);
+			return NULL;
+		}
+	}
+	return b;
+}
+
+void arrow_batch_reset(struct arrow_batch *b) {
+	int i;
+	for(i=0;i<b->ncols;i++) {
+		memset(b->valid[i], 0, (b->capacity + 7) / 8);
+		b->nullcount[i] = 0;
+	}
+	b->length = 0;
+}
+
+void arrow_batch_free(struct arrow_batch *b) {
+	int i;
+	if(NULL == b) return;
+	for(i=0;i<b->ncols;i++) {
+		if(NULL != b->data) free(b->data[i]);
+		if(NULL != b->valid) free(b->valid[i]);
+	}
+	free(b->data);
+	free(b->valid);
+	free(b->nullcount);
+	free(b);
+}
+
+/// Mark a cell as valid and extend the batch to cover it
+static void arrow_batch_touch(struct arrow_batch *b, int col, int row) {
+	b->valid[col][row / 8] |= (1 << (row % 8));
+	if(row >= b->length) b->length = row + 1;
+}
+
+void arrow_batch_setdouble(struct arrow_batch *b, int col, int row, double val) {
+	((double *)b->data[col])[row] = val;
+	arrow_batch_touch(b, col, row);
+}
+
+void arrow_batch_setint64(struct arrow_batch *b, int col, int row, int64_t val) {
+	((int64_t *)b->data[col])[row] = val;
+	arrow_batch_touch(b, col, row);
+}
+
+void arrow_batch_setindex(struct arrow_batch *b, int col, int row, int32_t idx) {
+	((int32_t *)b->data[col])[row] = idx;
+	arrow_batch_touch(b, col, row);
+}
+
+void arrow_batch_setnull(struct arrow_batch *b, int col, int row) {
+	// Arrow wants something defined in the slot even though it's ignored
+	if(ARROW_DICTINT64 == b->cols[col].type) {
+		((int32_t *)b->data[col])[row] = 0;
+	} else {
+		((int64_t *)b->data[col])[row] = 0;
+	}
+	b->valid[col][row / 8] &= ~(1 << (row % 8));
+	b->nullcount[col]++;
+	if(row >= b->length) b->length = row + 1;
+}
+
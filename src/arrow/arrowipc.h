@@ -0,0 +1,121 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Minimal Arrow IPC file writer
+ Writes the Arrow IPC file format [aka Feather v2] without needing the
+ arrow or flatbuffers libraries. Only the handful of types obd2arrow
+ needs are supported.
+ */
+#ifndef __ARROWIPC_H
+#define __ARROWIPC_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/// Column types we know how to write
+enum arrow_type {
+	ARROW_FLOAT64, ///< double
+	ARROW_INT64, ///< signed 64 bit integer
+	ARROW_DICTINT64 ///< int32 indices into a dictionary of int64s
+};
+
+/// Describes one column
+struct arrow_column {
+	const char *name; ///< Column name
+	enum arrow_type type; ///< Column type
+	long dictid; ///< Dictionary id for ARROW_DICTINT64 columns
+};
+
+/// A record batch being filled
+struct arrow_batch {
+	const struct arrow_column *cols; ///< Column descriptions
+	int ncols; ///< Number of columns
+	int capacity; ///< Most rows this batch can hold
+	int length; ///< Rows currently in the batch
+	void **data; ///< Per-column values
+	uint8_t **valid; ///< Per-column validity bitmaps
+	int *nullcount; ///< Per-column count of nulls
+};
+
+/// Opaque file writer
+struct arrow_writer;
+
+/// Open a file and write the schema
+/** \param filename file to create
+ \param cols column descriptions. Must outlive the writer
+ \param ncols number of columns
+ \return writer, or NULL on error
+ */
+struct arrow_writer *arrow_open(const char *filename, const struct arrow_column *cols, int ncols);
+
+/// Write a dictionary
+/** All dictionaries must be written before the first record batch
+ \param id dictionary id, matching arrow_column.dictid
+ \param values the dictionary
+ \param n number of values
+ \return 0 on success
+ */
+int arrow_writedictionary(struct arrow_writer *w, long id, const int64_t *values, int n);
+
+/// Write a record batch
+/** \return 0 on success
+ */
+int arrow_writebatch(struct arrow_writer *w, const struct arrow_batch *b);
+
+/// Write the footer and close the file
+/** \return 0 on success
+ */
+int arrow_close(struct arrow_writer *w);
+
+/// Allocate a record batch
+/** \return batch, or NULL on error
+ */
+struct arrow_batch *arrow_batch_create(const struct arrow_column *cols, int ncols, int capacity);
+
+/// Empty a batch for reuse
+void arrow_batch_reset(struct arrow_batch *b);
+
+/// Free a batch
+void arrow_batch_free(struct arrow_batch *b);
+
+/// Set a float64 cell
+void arrow_batch_setdouble(struct arrow_batch *b, int col, int row, double val);
+
+/// Set an int64 cell
+void arrow_batch_setint64(struct arrow_batch *b, int col, int row, int64_t val);
+
+/// Set a dictionary-encoded cell
+/** \param idx index into the dictionary
+ */
+void arrow_batch_setindex(struct arrow_batch *b, int col, int row, int32_t idx);
+
+/// Set a cell to null
+void arrow_batch_setnull(struct arrow_batch *b, int col, int row);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //__ARROWIPC_H
+
@@ -0,0 +1,378 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief obd2arrow main entrypoint
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "obd2arrow.h"
+#include "arrowipc.h"
+#include "obdconfig.h"
+
+#include "sqlite3.h"
+
+int main(int argc, char **argv) {
+	/// Database to dump
+	sqlite3 *db;
+
+	/// obd outfile filename
+	char *outfilename = strdup(DEFAULT_OUTFILENAME);
+
+	/// gps outfile filename
+	char *gpsfilename = strdup(DEFAULT_GPSOUTFILENAME);
+
+	/// Database file to open
+	char *databasename = strdup(OBD_DEFAULT_DATABASE);
+
+	/// Most rows per record batch
+	int batchrows = DEFAULT_BATCHROWS;
+
+	/// getopt's current option
+	int optc;
+
+	/// might get set during option parsing. Exit when done parsing
+	int mustexit = 0;
+
+	while ((optc = getopt_long (argc, argv, arrowshortopts, arrowlongopts, NULL)) != -1) {
+		switch (optc) {
+			case 'h':
+				arrowprinthelp(argv[0]);
+				mustexit = 1;
+				break;
+			case 'v':
+				arrowprintversion();
+				mustexit = 1;
+				break;
+			case 'd':
+				if(NULL != databasename) {
+					free(databasename);
+				}
+				databasename = strdup(optarg);
+				break;
+			case 'o':
+				if(NULL != outfilename) {
+					free(outfilename);
+				}
+				outfilename = strdup(optarg);
+				break;
+			case 'g':
+				if(NULL != gpsfilename) {
+					free(gpsfilename);
+				}
+				gpsfilename = strdup(optarg);
+				break;
+			case 'b':
+				batchrows = atoi(optarg);
+				if(batchrows <= 0) {
+					fprintf(stderr, "Batch size must be positive\n");
+					mustexit = 1;
+				}
+				break;
+			default:
+				arrowprinthelp(argv[0]);
+				mustexit = 1;
+				break;
+		}
+	}
+	if(mustexit) exit(0);
+
+	int rc;
+	rc = sqlite3_open_v2(databasename, &db, SQLITE_OPEN_READONLY, NULL);
+	if( SQLITE_OK != rc ) {
+		fprintf(stderr, "Can't open database %s: %s\n", databasename, sqlite3_errmsg(db));
+		sqlite3_close(db);
+		exit(1);
+	}
+
+	// The trip and ecu tables' keys become the dictionaries. Logs that
+	//   haven't been repaired have rows pointing at ids those don't have
+	const char *trip_sqls[] = { "SELECT tripid FROM trip",
+		"SELECT DISTINCT trip FROM obd", "SELECT DISTINCT trip FROM gps", NULL };
+	const char *ecu_sqls[] = { "SELECT ecuid FROM ecu",
+		"SELECT DISTINCT ecu FROM obd", NULL };
+	struct arrowdict trips;
+	struct arrowdict ecus;
+	arrowdict_load(db, trip_sqls, 0, &trips);
+	arrowdict_load(db, ecu_sqls, 1, &ecus);
+
+	int failed = 0;
+	if(0 != arrowexporttable(db, "obd", outfilename, &trips, &ecus, batchrows)) {
+		failed = 1;
+	}
+	if(0 != arrowexporttable(db, "gps", gpsfilename, &trips, &ecus, batchrows)) {
+		failed = 1;
+	}
+
+	free(trips.values);
+	free(ecus.values);
+
+	sqlite3_close(db);
+
+	free(outfilename);
+	free(gpsfilename);
+	free(databasename);
+
+	return failed;
+}
+
+static int arrowdict_compare(const void *a, const void *b) {
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+	return (x > y) - (x < y);
+}
+
+int arrowdict_load(sqlite3 *db, const char **sqls, int addzero, struct arrowdict *d) {
+	sqlite3_stmt *stmt;
+	const char *dbend;
+	int alloced = 64;
+	int i, j;
+
+	d->n = 0;
+	d->values = (int64_t *)malloc(alloced * sizeof(int64_t));
+	if(NULL == d->values) return 1;
+
+	if(addzero) {
+		d->values[d->n++] = 0;
+	}
+
+	for(i=0; NULL != sqls[i]; i++) {
+		if(SQLITE_OK != sqlite3_prepare_v2(db, sqls[i], -1, &stmt, &dbend)) {
+			continue;
+		}
+
+		while(SQLITE_ROW == sqlite3_step(stmt)) {
+			if(SQLITE_NULL == sqlite3_column_type(stmt, 0)) continue;
+
+			if(d->n == alloced) {
+				int64_t *nv = (int64_t *)realloc(d->values, 2 * alloced * sizeof(int64_t));
+				if(NULL == nv) break;
+				d->values = nv;
+				alloced *= 2;
+			}
+			d->values[d->n++] = sqlite3_column_int64(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	// Sorted and without repeats, for arrowdict_lookup
+	qsort(d->values, d->n, sizeof(int64_t), arrowdict_compare);
+	for(i=0, j=0; i<d->n; i++) {
+		if(0 == j || d->values[i] != d->values[j-1]) {
+			d->values[j++] = d->values[i];
+		}
+	}
+	d->n = j;
+	return 0;
+}
+
+int32_t arrowdict_lookup(const struct arrowdict *d, int64_t v) {
+	int lo = 0;
+	int hi = d->n - 1;
+	while(lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if(d->values[mid] == v) return mid;
+		if(d->values[mid] < v) {
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return -1;
+}
+
+int arrowexporttable(sqlite3 *db, const char *table, const char *filename,
+		const struct arrowdict *trips, const struct arrowdict *ecus, int batchrows) {
+	char sql[4096];
+	sqlite3_stmt *stmt;
+	const char *dbend;
+	int rc;
+	int i;
+
+	struct arrow_column cols[0x6C];
+	int ncols = 0;
+	int tripcol = -1;
+	int timecol = -1;
+
+	snprintf(sql, sizeof(sql), "PRAGMA table_info(%s)", table);
+	if(SQLITE_OK != sqlite3_prepare_v2(db, sql, -1, &stmt, &dbend)) {
+		fprintf(stderr, "Couldn't get table info for %s: %s\n", table, sqlite3_errmsg(db));
+		return 1;
+	}
+
+	snprintf(sql, sizeof(sql), "SELECT ");
+	while(SQLITE_ROW == sqlite3_step(stmt) && ncols < (int)(sizeof(cols)/sizeof(cols[0]))) {
+		const char *name = (const char *)sqlite3_column_text(stmt, 1);
+		const char *decltype = (const char *)sqlite3_column_text(stmt, 2);
+		if(NULL == name) continue;
+
+		cols[ncols].name = strdup(name);
+		cols[ncols].dictid = -1;
+		if(0 == strcmp(name, "trip")) {
+			cols[ncols].type = ARROW_DICTINT64;
+			cols[ncols].dictid = ARROWDICT_TRIP;
+			tripcol = ncols;
+		} else if(0 == strcmp(name, "ecu")) {
+			cols[ncols].type = ARROW_DICTINT64;
+			cols[ncols].dictid = ARROWDICT_ECU;
+		} else if(NULL != decltype && NULL != strstr(decltype, "INT")) {
+			cols[ncols].type = ARROW_INT64;
+		} else {
+			cols[ncols].type = ARROW_FLOAT64;
+		}
+
+		if(0 == strcmp(name, "time")) {
+			timecol = ncols;
+		}
+
+		if(ncols > 0) {
+			strncat(sql, ", ", sizeof(sql)-strlen(sql)-1);
+		}
+		strncat(sql, "\"", sizeof(sql)-strlen(sql)-1);
+		strncat(sql, name, sizeof(sql)-strlen(sql)-1);
+		strncat(sql, "\"", sizeof(sql)-strlen(sql)-1);
+		ncols++;
+	}
+	sqlite3_finalize(stmt);
+
+	if(0 == ncols) {
+		fprintf(stderr, "Not Fatal: No %s table to export\n", table);
+		return 0;
+	}
+
+	strncat(sql, " FROM ", sizeof(sql)-strlen(sql)-1);
+	strncat(sql, table, sizeof(sql)-strlen(sql)-1);
+	// Each trip's rows together, in time order. The blackbox writes
+	//   rows after ones sampled later, so rowid order isn't enough
+	if(tripcol >= 0 && timecol >= 0) {
+		strncat(sql, " ORDER BY trip,time", sizeof(sql)-strlen(sql)-1);
+	} else if(tripcol >= 0) {
+		strncat(sql, " ORDER BY trip", sizeof(sql)-strlen(sql)-1);
+	} else if(timecol >= 0) {
+		strncat(sql, " ORDER BY time", sizeof(sql)-strlen(sql)-1);
+	}
+
+	int failed = 1;
+	struct arrow_writer *w = NULL;
+	struct arrow_batch *b = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, &dbend);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Error attempting to select:\n%s\n%s\n", sql, sqlite3_errmsg(db));
+		goto done;
+	}
+
+	if(NULL == (w = arrow_open(filename, cols, ncols))) {
+		goto done;
+	}
+	if(NULL == (b = arrow_batch_create(cols, ncols, batchrows))) {
+		fprintf(stderr, "Couldn't allocate a batch of %i rows\n", batchrows);
+		goto done;
+	}
+
+	int wrotetrip = 0, wroteecu = 0;
+	for(i=0;i<ncols;i++) {
+		if(ARROWDICT_TRIP == cols[i].dictid && !wrotetrip) {
+			arrow_writedictionary(w, ARROWDICT_TRIP, trips->values, trips->n);
+			wrotetrip = 1;
+		} else if(ARROWDICT_ECU == cols[i].dictid && !wroteecu) {
+			arrow_writedictionary(w, ARROWDICT_ECU, ecus->values, ecus->n);
+			wroteecu = 1;
+		}
+	}
+
+	int batchtripnull = 0;
+	sqlite3_int64 batchtrip = 0;
+	while(SQLITE_ROW == sqlite3_step(stmt)) {
+		if(tripcol >= 0) {
+			int tripnull = (SQLITE_NULL == sqlite3_column_type(stmt, tripcol));
+			sqlite3_int64 trip = sqlite3_column_int64(stmt, tripcol);
+			if(b->length > 0 && (tripnull != batchtripnull || trip != batchtrip)) {
+				if(0 != arrow_writebatch(w, b)) goto done;
+				arrow_batch_reset(b);
+			}
+			batchtripnull = tripnull;
+			batchtrip = trip;
+		}
+
+		int row = b->length;
+		for(i=0;i<ncols;i++) {
+			if(SQLITE_NULL == sqlite3_column_type(stmt, i)) {
+				arrow_batch_setnull(b, i, row);
+				continue;
+			}
+			switch(cols[i].type) {
+				case ARROW_FLOAT64:
+					arrow_batch_setdouble(b, i, row, sqlite3_column_double(stmt, i));
+					break;
+				case ARROW_INT64:
+					arrow_batch_setint64(b, i, row, sqlite3_column_int64(stmt, i));
+					break;
+				case ARROW_DICTINT64: {
+					const struct arrowdict *d = (ARROWDICT_TRIP == cols[i].dictid)?trips:ecus;
+					int32_t idx = arrowdict_lookup(d, sqlite3_column_int64(stmt, i));
+					if(idx < 0) {
+						arrow_batch_setnull(b, i, row);
+					} else {
+						arrow_batch_setindex(b, i, row, idx);
+					}
+					break;
+				}
+			}
+		}
+
+		if(b->length == batchrows) {
+			if(0 != arrow_writebatch(w, b)) goto done;
+			arrow_batch_reset(b);
+		}
+	}
+
+	if(b->length > 0) {
+		if(0 != arrow_writebatch(w, b)) goto done;
+	}
+	failed = 0;
+
+done:
+	if(NULL != w) {
+		if(0 != arrow_close(w)) failed = 1;
+	}
+	arrow_batch_free(b);
+	sqlite3_finalize(stmt);
+	for(i=0;i<ncols;i++) {
+		free((char *)cols[i].name);
+	}
+	return failed;
+}
+
+void arrowprinthelp(const char *argv0) {
+	printf("Usage: %s [params]\n"
+		"   [-o|--out<=" DEFAULT_OUTFILENAME ">]\n"
+		"   [-g|--gps<=" DEFAULT_GPSOUTFILENAME ">]\n"
+		"   [-d|--db<=" OBD_DEFAULT_DATABASE ">]\n"
+		"   [-b|--batch<=%i>]\n"
+		"   [-v|--version] [-h|--help]\n", argv0, DEFAULT_BATCHROWS);
+}
+
+void arrowprintversion() {
+	printf("Version: %i.%i\n", OBDGPSLOGGER_MAJOR_VERSION, OBDGPSLOGGER_MINOR_VERSION);
+}
+
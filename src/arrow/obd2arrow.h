@@ -0,0 +1,104 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief obd2arrow main headers
+ */
+#ifndef __OBD2ARROW_H
+#define __OBD2ARROW_H
+
+#include <getopt.h>
+#include <stdint.h>
+
+#include "sqlite3.h"
+
+/// Default obd out filename
+#define DEFAULT_OUTFILENAME "./obdlogger.arrow"
+
+/// Default gps out filename
+#define DEFAULT_GPSOUTFILENAME "./obdlogger-gps.arrow"
+
+/// Default most rows in one record batch
+#define DEFAULT_BATCHROWS 65536
+
+/// Dictionary id used for trip columns
+#define ARROWDICT_TRIP 0
+
+/// Dictionary id used for ecu columns
+#define ARROWDICT_ECU 1
+
+/// getopt_long long options
+static const struct option arrowlongopts[] = {
+	{ "help", no_argument, NULL, 'h' }, ///< Print the help text
+	{ "version", no_argument, NULL, 'v' }, ///< Print the version text
+	{ "db", required_argument, NULL, 'd' }, ///< Database file
+	{ "out", required_argument, NULL, 'o' }, ///< obd output file
+	{ "gps", required_argument, NULL, 'g' }, ///< gps output file
+	{ "batch", required_argument, NULL, 'b' }, ///< Most rows per record batch
+	{ NULL, 0, NULL, 0 } ///< End
+};
+
+
+/// getopt() short options
+static const char arrowshortopts[] = "hvd:o:g:b:";
+
+/// Sorted values of a dictionary-encoded column
+struct arrowdict {
+	int64_t *values; ///< The dictionary
+	int n; ///< Number of values
+};
+
+/// Fill a dictionary with every value a set of queries returns
+/** Queries that don't prepare, say for a column an older log doesn't
+     have, are skipped. NULLs are left out
+ \param sqls queries returning one integer column, ending with NULL
+ \param addzero also put zero in the dictionary
+ \return 0 on success
+ */
+int arrowdict_load(sqlite3 *db, const char **sqls, int addzero, struct arrowdict *d);
+
+/// Find a value's index in a dictionary
+/** \return the index, or -1 if it's not there
+ */
+int32_t arrowdict_lookup(const struct arrowdict *d, int64_t v);
+
+/// Write one table out as an arrow file
+/** One or more record batches per trip; none spans two trips
+ \param table table to dump
+ \param filename file to write
+ \param trips dictionary for trip columns
+ \param ecus dictionary for ecu columns
+ \param batchrows most rows per record batch
+ \return 0 on success
+ */
+int arrowexporttable(sqlite3 *db, const char *table, const char *filename,
+	const struct arrowdict *trips, const struct arrowdict *ecus, int batchrows);
+
+/// Print Help for --help
+/** \param argv0 your program's argv[0]
+ */
+void arrowprinthelp(const char *argv0);
+
+/// Print the version string
+void arrowprintversion();
+
+
+#endif //__OBD2ARROW_H
+
@@ -42,6 +42,16 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #define OBDCONF_SAMPLERATE "samplerate"
 #define OBDCONF_BAUDRATE "baudrate"
 #define OBDCONF_BAUDRATEUPGRADE "baudrate_upgrade"
+#define OBDCONF_DECODEFILE "decode_file"
+#define OBDCONF_BACKGROUNDINTERVAL "background_interval"
+#define OBDCONF_COMPRESS "compress"
+#define OBDCONF_COMPRESSHEARTBEAT "compress_heartbeat"
+#define OBDCONF_DEADBANDS "deadbands"
+#define OBDCONF_TRIPCOLUMNS "trip_columns"
+#define OBDCONF_BLACKBOX "blackbox"
+#define OBDCONF_BLACKBOXDECIMATE "blackbox_decimate"
+#define OBDCONF_BLACKBOXPOST "blackbox_post"
+#define OBDCONF_BLACKBOXTRIGGERS "blackbox_triggers"
 ///@}
 
 /// Get "a" valid home dir in which to store a dotfile
@@ -79,6 +89,7 @@ static int obd_parseConfig(FILE *f, struct OBDGPSConfig *c, int verbose) {
 		char singleval_s[1024];
 		int singleval_i;
 		long singleval_l;
+		float singleval_f;
 
 		char *firstnonspace = line;
 		while(*firstnonspace != '\0' &&
@@ -116,6 +127,34 @@ static int obd_parseConfig(FILE *f, struct OBDGPSConfig *c, int verbose) {
 			c->log_columns = strdup(singleval_s);
 			if(verbose) printf("Conf Found log_columns: %s\n", singleval_s);
 		}
+		if(1 == sscanf(line, OBDCONF_DECODEFILE "=%1023s", singleval_s)) {
+			if(NULL != c->decode_file) {
+				free((void *)c->decode_file);
+			}
+			c->decode_file = strdup(singleval_s);
+			if(verbose) printf("Conf Found decode_file: %s\n", singleval_s);
+		}
+		if(1 == sscanf(line, OBDCONF_DEADBANDS "=%1023s", singleval_s)) {
+			if(NULL != c->deadbands) {
+				free((void *)c->deadbands);
+			}
+			c->deadbands = strdup(singleval_s);
+			if(verbose) printf("Conf Found deadbands: %s\n", singleval_s);
+		}
+		if(1 == sscanf(line, OBDCONF_TRIPCOLUMNS "=%1023s", singleval_s)) {
+			if(NULL != c->trip_columns) {
+				free((void *)c->trip_columns);
+			}
+			c->trip_columns = strdup(singleval_s);
+			if(verbose) printf("Conf Found trip_columns: %s\n", singleval_s);
+		}
+		if(1 == sscanf(line, OBDCONF_BLACKBOXTRIGGERS "=%1023s", singleval_s)) {
+			if(NULL != c->blackbox_triggers) {
+				free((void *)c->blackbox_triggers);
+			}
+			c->blackbox_triggers = strdup(singleval_s);
+			if(verbose) printf("Conf Found blackbox_triggers: %s\n", singleval_s);
+		}
 		if(1 == sscanf(line, OBDCONF_BAUDRATE "=%li", &singleval_l)) {
 			c->baudrate = singleval_l;
 			if(verbose) printf("Conf Found baudrate: %li\n", singleval_l);
@@ -128,10 +167,34 @@ static int obd_parseConfig(FILE *f, struct OBDGPSConfig *c, int verbose) {
 			c->samplerate = singleval_i;
 			if(verbose) printf("Conf Found samplerate: %i\n", singleval_i);
 		}
+		if(1 == sscanf(line, OBDCONF_BACKGROUNDINTERVAL "=%f", &singleval_f)) {
+			c->background_interval = singleval_f;
+			if(verbose) printf("Conf Found background_interval: %f\n", singleval_f);
+		}
 		if(1 == sscanf(line, OBDCONF_OPTIMISATIONS "=%i", &singleval_i)) {
 			c->optimisations = singleval_i;
 			if(verbose) printf("Conf Found optimisations: %i\n", singleval_i);
 		}
+		if(1 == sscanf(line, OBDCONF_COMPRESS "=%i", &singleval_i)) {
+			c->compress = singleval_i;
+			if(verbose) printf("Conf Found compress: %i\n", singleval_i);
+		}
+		if(1 == sscanf(line, OBDCONF_COMPRESSHEARTBEAT "=%f", &singleval_f)) {
+			c->compress_heartbeat = singleval_f;
+			if(verbose) printf("Conf Found compress_heartbeat: %f\n", singleval_f);
+		}
+		if(1 == sscanf(line, OBDCONF_BLACKBOX "=%f", &singleval_f)) {
+			c->blackbox = singleval_f;
+			if(verbose) printf("Conf Found blackbox: %f\n", singleval_f);
+		}
+		if(1 == sscanf(line, OBDCONF_BLACKBOXDECIMATE "=%i", &singleval_i)) {
+			c->blackbox_decimate = singleval_i;
+			if(verbose) printf("Conf Found blackbox_decimate: %i\n", singleval_i);
+		}
+		if(1 == sscanf(line, OBDCONF_BLACKBOXPOST "=%f", &singleval_f)) {
+			c->blackbox_post = singleval_f;
+			if(verbose) printf("Conf Found blackbox_post: %f\n", singleval_f);
+		}
 	}
 	return 0;
 }
@@ -143,10 +206,20 @@ struct OBDGPSConfig *obd_loadConfig(int verbose) {
 	c->gps_device = strdup(OBD_DEFAULT_GPSPORT);
 	c->log_columns = strdup(OBD_DEFAULT_COLUMNS);
 	c->log_file = strdup(OBD_DEFAULT_DATABASE);
+	c->decode_file = NULL;
 	c->samplerate = 1;
+	c->background_interval = 1.0;
 	c->optimisations = 0;
 	c->baudrate = -1;
 	c->baudrate_upgrade = -1;
+	c->compress = 0;
+	c->compress_heartbeat = 30.0;
+	c->deadbands = NULL;
+	c->trip_columns = strdup(OBD_DEFAULT_TRIPCOLUMNS);
+	c->blackbox = 0;
+	c->blackbox_decimate = 10;
+	c->blackbox_post = 30.0;
+	c->blackbox_triggers = NULL;
 
 	char fullfilename[MAX_PATH];
 
@@ -248,10 +321,27 @@ struct OBDGPSConfig *obd_loadConfig(int verbose) {
 					 "	" OBDCONF_SAMPLERATE ":%i\n"
 					 "	" OBDCONF_BAUDRATE ":%li\n"
 					 "	" OBDCONF_BAUDRATEUPGRADE ":%li\n"
-					 "	" OBDCONF_LOGFILE ":%s\n",
+					 "	" OBDCONF_LOGFILE ":%s\n"
+					 "	" OBDCONF_DECODEFILE ":%s\n"
+					 "	" OBDCONF_BACKGROUNDINTERVAL ":%f\n"
+					 "	" OBDCONF_COMPRESS ":%i\n"
+					 "	" OBDCONF_COMPRESSHEARTBEAT ":%f\n"
+					 "	" OBDCONF_DEADBANDS ":%s\n"
+					 "	" OBDCONF_TRIPCOLUMNS ":%s\n"
+					 "	" OBDCONF_BLACKBOX ":%f\n"
+					 "	" OBDCONF_BLACKBOXDECIMATE ":%i\n"
+					 "	" OBDCONF_BLACKBOXPOST ":%f\n"
+					 "	" OBDCONF_BLACKBOXTRIGGERS ":%s\n",
 					 	c->obd_device, c->gps_device, c->log_columns,
 						c->optimisations, c->samplerate, c->baudrate,
-						c->baudrate_upgrade, c->log_file);
+						c->baudrate_upgrade, c->log_file,
+						NULL==c->decode_file?"":c->decode_file,
+						c->background_interval, c->compress,
+						c->compress_heartbeat,
+						NULL==c->deadbands?"":c->deadbands,
+						c->trip_columns, c->blackbox,
+						c->blackbox_decimate, c->blackbox_post,
+						NULL==c->blackbox_triggers?"":c->blackbox_triggers);
 	}
 	return c;
 }
@@ -277,6 +367,22 @@ int obd_writeConfig(struct OBDGPSConfig *c) {
 	fprintf(f, OBDCONF_SAMPLERATE "=%i\n", c->samplerate);
 	fprintf(f, OBDCONF_BAUDRATE "=%li\n", c->baudrate);
 	fprintf(f, OBDCONF_BAUDRATEUPGRADE "=%li\n", c->baudrate_upgrade);
+	if(NULL != c->decode_file) {
+		fprintf(f, OBDCONF_DECODEFILE "=%s\n", c->decode_file);
+	}
+	fprintf(f, OBDCONF_BACKGROUNDINTERVAL "=%f\n", c->background_interval);
+	fprintf(f, OBDCONF_COMPRESS "=%i\n", c->compress);
+	fprintf(f, OBDCONF_COMPRESSHEARTBEAT "=%f\n", c->compress_heartbeat);
+	if(NULL != c->deadbands) {
+		fprintf(f, OBDCONF_DEADBANDS "=%s\n", c->deadbands);
+	}
+	fprintf(f, OBDCONF_TRIPCOLUMNS "=%s\n", c->trip_columns);
+	fprintf(f, OBDCONF_BLACKBOX "=%f\n", c->blackbox);
+	fprintf(f, OBDCONF_BLACKBOXDECIMATE "=%i\n", c->blackbox_decimate);
+	fprintf(f, OBDCONF_BLACKBOXPOST "=%f\n", c->blackbox_post);
+	if(NULL != c->blackbox_triggers) {
+		fprintf(f, OBDCONF_BLACKBOXTRIGGERS "=%s\n", c->blackbox_triggers);
+	}
 
 	fclose(f);
 
@@ -290,6 +396,10 @@ void obd_freeConfig(struct OBDGPSConfig *c) {
 	if(NULL != c->gps_device) free((void *)c->gps_device);
 	if(NULL != c->log_columns) free((void *)c->log_columns);
 	if(NULL != c->log_file) free((void *)c->log_file);
+	if(NULL != c->decode_file) free((void *)c->decode_file);
+	if(NULL != c->deadbands) free((void *)c->deadbands);
+	if(NULL != c->trip_columns) free((void *)c->trip_columns);
+	if(NULL != c->blackbox_triggers) free((void *)c->blackbox_triggers);
 	free(c);
 }
 
@@ -350,6 +460,44 @@ int obd_configCmds(const char *log_columns, struct obdservicecmd ***cmds) {
 	return cols;
 }
 
+int obd_configDeadband(const char *deadbands, const char *column, double *absolute, double *relative) {
+	int found = 0;
+	*absolute = 0;
+	*relative = 0;
+	if(NULL == deadbands || NULL == column) return 0;
+
+	char *list = strdup(deadbands);
+	if(NULL == list) return 0;
+
+	char *entry = strtok(list, ",");
+	while(entry && !found) {
+		char name[64];
+		double a = 0, r = 0;
+		int n = sscanf(entry, "%63[^:]:%lf:%lf", name, &a, &r);
+
+		struct obdservicecmd *c = NULL;
+		unsigned int cmdpid;
+		if(n < 2) {
+			printf("Warning: Couldn't understand deadband '%s'. Possible config file problem\n", entry);
+		} else if(NULL != (c = obdGetCmdForColumn(name))) {
+			found = (0 == strcmp(c->db_column, column));
+		} else if(1 == sscanf(name, "%2X", &cmdpid) &&
+				NULL != (c = obdGetCmdForPID(cmdpid))) {
+			found = (0 == strcmp(c->db_column, column));
+		} else {
+			found = (0 == strcmp(name, column));
+		}
+
+		if(found) {
+			*absolute = a;
+			*relative = (n > 2)?r:0;
+		}
+		entry = strtok(NULL, ",");
+	}
+	free(list);
+	return found;
+}
+
 void obd_freeConfigCmds(struct obdservicecmd **cmds) {
 	free((void *)cmds);
 }
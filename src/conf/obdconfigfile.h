@@ -28,6 +28,9 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 extern "C" {
 #endif //  __cplusplus
 
+/// Columns the trip table keeps the max and mean of, unless configured
+#define OBD_DEFAULT_TRIPCOLUMNS "temp,rpm,vss,throttlepos"
+
 /// This is the config we create
 struct OBDGPSConfig {
 	const char *obd_device; //< Full path to the obd device
@@ -38,6 +41,16 @@ struct OBDGPSConfig {
 	long baudrate; //< Baudrate
 	long baudrate_upgrade; //< Upgrade Baudrate
 	const char *log_file; //< Log to this file
+	const char *decode_file; //< Extra PID decodes. See obddecode.h
+	float background_interval; //< Seconds between mode 06/22 requests. <= 0 disables them
+	int compress; //< Only log values that moved past their deadband
+	float compress_heartbeat; //< Seconds after which a value is logged even if it hasn't moved
+	const char *deadbands; //< Per-column deadbands [column:absolute[:relative],...]
+	const char *trip_columns; //< Columns to keep the max and mean of per trip [comma-separated]
+	float blackbox; //< Minutes of full-rate samples kept in memory. 0 logs everything as it comes
+	int blackbox_decimate; //< With blackbox, only log every this many samples until something triggers it
+	float blackbox_post; //< With blackbox, seconds to log everything for after a trigger
+	const char *blackbox_triggers; //< Thresholds that trigger the blackbox [column<op>value,...]
 };
 
 /// Load a config, return a struct. Must be free'd using freeOBDGPSConfig
@@ -58,6 +71,16 @@ int obd_writeConfig(struct OBDGPSConfig *c);
  */
 int obd_configCmds(const char *log_columns, struct obdservicecmd ***cmds);
 
+/// Find a column's deadband
+/** Columns not listed get zero for both, so any change at all is logged
+ \param deadbands comma-separated list of column:absolute[:relative]. May be NULL
+ \param column db_column of the column to look for
+ \param absolute when returned, the smallest change in the column's units that counts
+ \param relative when returned, the smallest change as a fraction of the last value that counts
+ \return 1 if the column was listed, 0 if not
+ */
+int obd_configDeadband(const char *deadbands, const char *column, double *absolute, double *relative);
+
 /// Free a list of service commands allocated by obd_configCmds
 void obd_freeConfigCmds(struct obdservicecmd **cmds);
 
@@ -24,6 +24,9 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
 
 #ifdef HAVE_ZLIB
 #include "zlib.h"
@@ -37,7 +40,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 int main(int argc, char **argv) {
 
 	/// Output file
-	FILE *outfile;
+	int outfd = -1;
 
 	/// Database to dump
 	sqlite3 *db;
@@ -61,12 +64,18 @@ int main(int argc, char **argv) {
 	double starttime = -1;
 	double endtime = -1;
 
+	/// Only dump this trip. Turned into start and end times
+	long onlytrip = -1;
+
+	/// How to fill values left out by compression. -1 to decide from the log
+	int reconstruct = -1;
+
 #ifdef HAVE_ZLIB
 	/// Set if we should actually compress
 	int compress_output = 0;
 
 	/// gzip handle
-	gzFile *gz_outfile;
+	gzFile gz_outfile;
 #endif //HAVE_ZLIB
 
 	while ((optc = getopt_long (argc, argv, csvshortopts, csvlongopts, NULL)) != -1) {
@@ -88,6 +97,15 @@ int main(int argc, char **argv) {
 			case 's':
 				starttime = atof(optarg);
 				break;
+			case 't':
+				onlytrip = atol(optarg);
+				break;
+			case 'r':
+				if(-1 == (reconstruct = obdreconstruct_parsemode(optarg))) {
+					fprintf(stderr, "Unknown reconstruction '%s'. Use none, step or linear\n", optarg);
+					mustexit = 1;
+				}
+				break;
 #ifdef HAVE_ZLIB
 			case 'z':
 				compress_output = 1;
@@ -169,7 +187,11 @@ column, "mpg", that is the miles per gallon
 	int have_maf = 0; // have a column named "maf" [mass air flow]
 
 	const char *columnnames[0x6C]; // Given we only have 0x4C definitions, I'd hope this is enough...
+	const char *tablecolumns[0x6C]; // The same without the "obd."
 	int col_count = 0;
+	int vsscol = -1;
+	int mafcol = -1;
+	int tripcol = -1;
 
 	while(SQLITE_ROW == sqlite3_step(pragma_stmt)) {
 		const char *columnname = sqlite3_column_text(pragma_stmt, 1);
@@ -178,13 +200,28 @@ column, "mpg", that is the miles per gallon
 
 		snprintf(obdcolumn, sizeof(obdcolumn), "obd.%s", columnname);
 
-		columnnames[col_count++] = strdup(obdcolumn);
+		if(0 == strcmp(columnname,"vss")) {
+			have_vss = 1;
+			vsscol = col_count;
+		}
+		if(0 == strcmp(columnname,"maf")) {
+			have_maf = 1;
+			mafcol = col_count;
+		}
+		if(0 == strcmp(columnname,"trip")) {
+			tripcol = col_count;
+		}
 
-		if(0 == strcmp(columnname,"vss")) have_vss = 1;
-		if(0 == strcmp(columnname,"maf")) have_maf = 1;
+		columnnames[col_count] = strdup(obdcolumn);
+		tablecolumns[col_count] = columnnames[col_count] + strlen("obd.");
+		col_count++;
 	}
+	int obd_col_count = col_count; // Columns that come out of the obd SELECT
 	if(have_vss && have_maf) {
+		// Worked out after any gaps are filled, so not part of the SELECT
 		columnnames[col_count++] = strdup("(7.107*obd.vss/obd.maf) as mpg");
+	} else {
+		vsscol = mafcol = -1;
 	}
 	columnnames[col_count++] = strdup("gps.lon");
 	columnnames[col_count++] = strdup("gps.lat");
@@ -193,34 +230,83 @@ column, "mpg", that is the miles per gallon
 
 	sqlite3_finalize(pragma_stmt);
 
-// If progress is requested, then calculate [roughly] number of rows we expect
-	long num_expected_rows = 0;
-	if(show_progress) {
-		char progress_sql[] = "SELECT count(*) AS c FROM obd";
-		sqlite3_stmt *progress_stmt;
-
-		rc = sqlite3_prepare_v2(db, progress_sql, -1, &progress_stmt, &dbend);
+	int i;
 
-		if(SQLITE_OK != rc) {
-			fprintf(stderr,"Couldn't get progress info in database %s: %s\n", databasename, sqlite3_errmsg(db));
-		} else {
-			while(SQLITE_ROW == sqlite3_step(progress_stmt)) {
-				num_expected_rows = (long)sqlite3_column_double(progress_stmt,0);
+// Logs written with compression have NULLs where values hadn't moved
+	unsigned char compressed[0x6C];
+	double heartbeat = csvloaddeadbands(db, tablecolumns, obd_col_count, compressed);
+	if(-1 == reconstruct) {
+		reconstruct = (heartbeat < 0)?OBDRECONSTRUCT_NONE:OBDRECONSTRUCT_STEP;
+	}
+	if(heartbeat < 0) {
+		// Not compressed, but asked to fill gaps anyway. Leave the bookkeeping alone
+		const char *bookkeeping[] = { "time", "trip", "ecu", "monotime", "lat", "lon", "alt" };
+		int j;
+		for(i=0;i<obd_col_count;i++) {
+			compressed[i] = 1;
+			for(j=0;j<sizeof(bookkeeping)/sizeof(bookkeeping[0]);j++) {
+				if(0 == strcmp(tablecolumns[i], bookkeeping[j])) compressed[i] = 0;
 			}
 		}
+	}
+
+// Read the trips into memory. There's only ever a handful, and it
+//   saves doing a range join against the trip table for every row
+	struct csvtrip *trips = NULL;
+	int numtrips = csvloadtrips(db, &trips);
 
-		sqlite3_finalize(progress_stmt);
+	if(onlytrip >= 0) {
+		for(i=0;i<numtrips;i++) {
+			if(trips[i].tripid == onlytrip) break;
+		}
+		if(i == numtrips) {
+			fprintf(stderr, "Couldn't find trip %li in database %s\n", onlytrip, databasename);
+			sqlite3_close(db);
+			exit(1);
+		}
+		// Same test as the trip join; trips that never ended have no rows
+		if(trips[i].start > starttime) starttime = trips[i].start;
+		if(endtime <= 0 || trips[i].end < endtime) endtime = trips[i].end;
+		if(endtime <= starttime) endtime = starttime;
 	}
 
+// Second, find the span of rowids we're going to walk. With a time
+//   filter this is the only query that touches the time index
 
-// Second, build the SQL SELECT statement to pull the columns we just found
+	char bounds_sql[256];
+	if(starttime>0 && endtime>0) {
+		snprintf(bounds_sql, sizeof(bounds_sql), "SELECT min(rowid), max(rowid) FROM obd WHERE time>%f AND time<%f", starttime, endtime);
+	} else if(endtime>0) { // Didn't set a starttime
+		snprintf(bounds_sql, sizeof(bounds_sql), "SELECT min(rowid), max(rowid) FROM obd WHERE time<%f", endtime);
+	} else if(starttime>0) { // Didn't set an endtime
+		snprintf(bounds_sql, sizeof(bounds_sql), "SELECT min(rowid), max(rowid) FROM obd WHERE time>%f", starttime);
+	} else {
+		snprintf(bounds_sql, sizeof(bounds_sql), "SELECT min(rowid), max(rowid) FROM obd");
+	}
+
+	sqlite3_int64 minrowid = 0;
+	sqlite3_int64 maxrowid = -1;
+	sqlite3_stmt *bounds_stmt;
+	rc = sqlite3_prepare_v2(db, bounds_sql, -1, &bounds_stmt, &dbend);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Couldn't get rowid range in database %s: %s\n", databasename, sqlite3_errmsg(db));
+		sqlite3_close(db);
+		exit(1);
+	}
+	if(SQLITE_ROW == sqlite3_step(bounds_stmt) &&
+			SQLITE_NULL != sqlite3_column_type(bounds_stmt, 0)) {
+		minrowid = sqlite3_column_int64(bounds_stmt, 0);
+		maxrowid = sqlite3_column_int64(bounds_stmt, 1);
+	}
+	sqlite3_finalize(bounds_stmt);
+
+// Third, build the SQL SELECT statement to pull one chunk of the columns we just found
 
 	char select_sql[4096] = "SELECT ";
-	// Would rather do a full outer join, but sqlite doesn't support that yet
-	char end_select_sql[] = " FROM obd LEFT JOIN gps ON obd.time=gps.time LEFT JOIN trip ON obd.time>trip.start AND obd.time<trip.end ";
+	// Unary + on time stops sqlite picking the time index over the rowid range
+	char end_select_sql[] = ", obd.time FROM obd WHERE obd.rowid>=? AND obd.rowid<? ";
 
-	int i;
-	for(i=0;i<col_count-1;i++) {
+	for(i=0;i<obd_col_count-1;i++) {
 		strncat(select_sql, columnnames[i], sizeof(select_sql)-strlen(columnnames[i])-strlen(select_sql)-1);
 		strncat(select_sql, ", ", sizeof(select_sql)-strlen(", ")-strlen(select_sql)-1);
 		// Yay C ...
@@ -230,13 +316,21 @@ column, "mpg", that is the miles per gallon
 
 	char where_clause[1024] = "\0";
 	if(starttime>0 && endtime>0) {
-		snprintf(where_clause, sizeof(where_clause), " WHERE obd.time>%f AND obd.time<%f ", starttime, endtime);
+		snprintf(where_clause, sizeof(where_clause), " AND +obd.time>%f AND +obd.time<%f ", starttime, endtime);
 	} else if(endtime>0) { // Didn't set a starttime
-		snprintf(where_clause, sizeof(where_clause), " WHERE obd.time<%f ", endtime);
+		snprintf(where_clause, sizeof(where_clause), " AND +obd.time<%f ", endtime);
 	} else if(starttime>0) { // Didn't set an endtime
-		snprintf(where_clause, sizeof(where_clause), " WHERE obd.time>%f ", starttime);
+		snprintf(where_clause, sizeof(where_clause), " AND +obd.time>%f ", starttime);
 	}
 	strncat(select_sql, where_clause, sizeof(select_sql)-strlen(where_clause)-strlen(select_sql)-1);
+	// Rows out of order have to be sorted, so they're walked in one go
+	int outoforder = csvoutoforder(db);
+	const char *order_sql = outoforder?" ORDER BY obd.time, obd.rowid":" ORDER BY obd.rowid";
+	strncat(select_sql, order_sql, sizeof(select_sql)-strlen(order_sql)-strlen(select_sql)-1);
+	sqlite3_int64 chunkrows = CSV_CHUNKROWS;
+	if(outoforder && maxrowid >= minrowid) {
+		chunkrows = maxrowid - minrowid + 1;
+	}
 
 	// printf("Select: \n %s\n", select_sql);
 
@@ -250,6 +344,14 @@ column, "mpg", that is the miles per gallon
 		exit(1);
 	}
 
+	// GPS is walked alongside obd rather than joined per-row
+	struct csvgpsmerge gps;
+	if(0 != csvgpsmerge_init(db, &gps)) {
+		fprintf(stderr, "Error preparing gps select: %s\n", sqlite3_errmsg(db));
+		sqlite3_finalize(select_stmt);
+		sqlite3_close(db);
+		exit(1);
+	}
 
 #ifdef HAVE_ZLIB
 	if(compress_output) {
@@ -260,7 +362,7 @@ column, "mpg", that is the miles per gallon
 		}
 	} else {
 #endif // HAVE_ZLIB
-		if(NULL == (outfile = fopen(outfilename, "w"))) {
+		if(-1 == (outfd = open(outfilename, O_WRONLY|O_CREAT|O_TRUNC, 0666))) {
 			perror(outfilename);
 			sqlite3_close(db);
 			exit(1);
@@ -274,61 +376,104 @@ column, "mpg", that is the miles per gallon
 	the output file is open for writing, and columnnames[] is packed with
 	col_count columns */
 
-	// Line of output
-	char out_line[4096] = "\0";
-	char out_item[64] = "\0";
-	for(i=0;i<col_count;i++) {
-		snprintf(out_item, sizeof(out_item), "%s,", columnnames[i]);
-		strncat(out_line, out_item, sizeof(out_line)-strlen(out_item)-strlen(out_line)-1);
-	}
-	strncat(out_line, "\n", sizeof(out_line)-strlen("\n")-strlen(out_line)-1);
-
+	static struct csvbuf out; // Too big for the stack
+	out.fd = outfd;
 #ifdef HAVE_ZLIB
-	if(compress_output) {
-		gzwrite(gz_outfile, out_line, strlen(out_line));
-	} else {
+	out.gz = compress_output?gz_outfile:NULL;
 #endif //HAVE_ZLIB
-		fprintf(outfile,"%s", out_line);
-#ifdef HAVE_ZLIB
+	out.len = 0;
+	out.failed = 0;
+
+	// A row can't be longer than this, so flush before we get that close to the end
+	size_t max_line = col_count * CSV_MAXCELL + 2;
+
+	struct csvrowwriter writer;
+	writer.out = &out;
+	writer.gps = &gps;
+	writer.max_line = max_line;
+	writer.numcols = obd_col_count;
+	writer.vsscol = vsscol;
+	writer.mafcol = mafcol;
+
+	// A gap longer than a heartbeat and a half means the PID wasn't answering
+	struct obdreconstruct *recon = obdreconstruct_create(obd_col_count, reconstruct,
+		(heartbeat > 0)?1.5*heartbeat:0, 0, csvwriterow, &writer);
+	if(NULL == recon) {
+		fprintf(stderr, "Couldn't allocate memory for reconstruction\n");
+		sqlite3_close(db);
+		exit(1);
 	}
-#endif //HAVE_ZLIB
+	double values[obd_col_count>0?obd_col_count:1];
+	unsigned char present[obd_col_count>0?obd_col_count:1];
+	struct obdreconstruct_row row;
+	row.values = values;
+	row.present = present;
+	sqlite3_int64 lasttrip = -1;
 
-// Thirdly, iterate through the whole database dumping to CSV
-	long current_row = 0;
-	while(SQLITE_ROW == sqlite3_step(select_stmt)) {
-		out_line[0] = '\0';
-		for(i=0;i<col_count;i++) {
-			snprintf(out_item, sizeof(out_item), "%f,", sqlite3_column_double(select_stmt, i));
-			strncat(out_line, out_item, sizeof(out_line)-strlen(out_item)-strlen(out_line)-1);
-		}
-		strncat(out_line, "\n", sizeof(out_line)-strlen("\n")-strlen(out_line)-1);
+	for(i=0;i<col_count;i++) {
+		out.len += snprintf(out.buf + out.len, sizeof(out.buf) - out.len, "%s,", columnnames[i]);
+	}
+	out.buf[out.len++] = '\n';
+
+// Fourthly, walk the rowid range a chunk at a time dumping to CSV
+	int tripidx = 0;
+	sqlite3_int64 chunkstart;
+	for(chunkstart = minrowid; chunkstart <= maxrowid && !out.failed; chunkstart += chunkrows) {
+		sqlite3_bind_int64(select_stmt, 1, chunkstart);
+		sqlite3_bind_int64(select_stmt, 2, chunkstart + chunkrows);
+
+		while(SQLITE_ROW == sqlite3_step(select_stmt)) {
+			for(i=0;i<obd_col_count;i++) {
+				// NULLs come out as zero unless something fills them
+				values[i] = sqlite3_column_double(select_stmt, i);
+				present[i] = !compressed[i] ||
+					SQLITE_NULL != sqlite3_column_type(select_stmt, i);
+			}
 
-#ifdef HAVE_ZLIB
-		if(compress_output) {
-			gzwrite(gz_outfile, out_line, strlen(out_line));
-		} else {
-#endif //HAVE_ZLIB
-			fprintf(outfile,"%s", out_line);
-#ifdef HAVE_ZLIB
+			row.time = sqlite3_column_double(select_stmt, obd_col_count);
+			row.id = (sqlite3_int64)csvfindtrip(trips, numtrips, &tripidx, row.time);
+
+			// Every trip stands on its own. Go by the row's own trip; a trip's
+			//   first row is at exactly trip.start, which csvfindtrip misses
+			sqlite3_int64 rowtrip = row.id;
+			if(tripcol >= 0) {
+				rowtrip = (SQLITE_NULL == sqlite3_column_type(select_stmt, tripcol))?
+					-1:sqlite3_column_int64(select_stmt, tripcol);
+			}
+			if(rowtrip != lasttrip) {
+				obdreconstruct_flush(recon);
+				lasttrip = rowtrip;
+			}
+			obdreconstruct_add(recon, &row);
 		}
-#endif //HAVE_ZLIB
+		sqlite3_reset(select_stmt);
+
+		csvbuf_flush(&out);
 
 		if(show_progress) {
-			current_row++;
-			if(0 == current_row%50) {
-				printf("%f\n", 100.0f * current_row/num_expected_rows);
-				fflush(stdout);
-			}
+			sqlite3_int64 done = chunkstart + chunkrows - minrowid;
+			sqlite3_int64 total = maxrowid - minrowid + 1;
+			if(done > total) done = total;
+			printf("%f\n", 100.0f * done/total);
+			fflush(stdout);
 		}
 	}
+	obdreconstruct_flush(recon);
+	obdreconstruct_free(recon);
+
+	// Header still needs writing if there were no rows
+	csvbuf_flush(&out);
+
 	sqlite3_finalize(select_stmt);
+	csvgpsmerge_finalize(&gps);
+	free(trips);
 
 #ifdef HAVE_ZLIB
 	if(compress_output) {
 		gzclose(gz_outfile);
 	} else {
 #endif //HAVE_ZLIB
-		fclose(outfile);
+		close(outfd);
 #ifdef HAVE_ZLIB
 	}
 #endif //HAVE_ZLIB
@@ -338,9 +483,259 @@ column, "mpg", that is the miles per gallon
 	free(outfilename);
 	free(databasename);
 
+	return out.failed?1:0;
+}
+
+void csvwriterow(const struct obdreconstruct_row *r, void *arg) {
+	struct csvrowwriter *w = (struct csvrowwriter *)arg;
+	struct csvbuf *out = w->out;
+	int i;
+
+	if(sizeof(out->buf) - out->len < w->max_line) {
+		csvbuf_flush(out);
+	}
+
+	char *p = out->buf + out->len;
+	for(i=0;i<w->numcols;i++) {
+		p += csvformatcell(p, r->present[i]?r->values[i]:0);
+	}
+
+	if(w->vsscol >= 0 && w->mafcol >= 0) {
+		double mpg = 0;
+		if(r->present[w->vsscol] && r->present[w->mafcol] && 0 != r->values[w->mafcol]) {
+			mpg = 7.107*r->values[w->vsscol]/r->values[w->mafcol];
+		}
+		p += csvformatcell(p, mpg);
+	}
+
+	double lon = 0, lat = 0, alt = 0;
+	csvgpsmerge_find(w->gps, r->time, &lon, &lat, &alt);
+	p += csvformatcell(p, lon);
+	p += csvformatcell(p, lat);
+	p += csvformatcell(p, alt);
+
+	p += csvformatcell(p, (double)r->id);
+	*p++ = '\n';
+
+	out->len = p - out->buf;
+}
+
+double csvloaddeadbands(sqlite3 *db, const char **columns, int numcols, unsigned char *compressed) {
+	sqlite3_stmt *stmt;
+	const char *dbend;
+	double heartbeat = -1;
+	int i;
+
+	memset(compressed, 0, numcols);
+
+	// Most logs won't have the table at all
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "SELECT column, heartbeat FROM deadband", -1, &stmt, &dbend)) {
+		return -1;
+	}
+
+	while(SQLITE_ROW == sqlite3_step(stmt)) {
+		const char *column = (const char *)sqlite3_column_text(stmt, 0);
+		double h = sqlite3_column_double(stmt, 1);
+		if(NULL == column) continue;
+
+		for(i=0;i<numcols;i++) {
+			if(0 == strcmp(column, columns[i])) {
+				compressed[i] = 1;
+				if(h > heartbeat) heartbeat = h;
+			}
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	// A heartbeat of zero means values could be held indefinitely
+	for(i=0;i<numcols;i++) {
+		if(compressed[i] && heartbeat < 0) heartbeat = 0;
+	}
+
+	return heartbeat;
+}
+
+int csvbuf_flush(struct csvbuf *b) {
+	if(b->failed) {
+		b->len = 0;
+		return 1;
+	}
+
+#ifdef HAVE_ZLIB
+	if(NULL != b->gz) {
+		if(b->len > 0 && 0 >= gzwrite(b->gz, b->buf, b->len)) {
+			fprintf(stderr, "Error writing gzip output\n");
+			b->failed = 1;
+		}
+		b->len = 0;
+		return b->failed;
+	}
+#endif //HAVE_ZLIB
+
+	size_t written = 0;
+	while(written < b->len) {
+		ssize_t w = write(b->fd, b->buf + written, b->len - written);
+		if(w < 0) {
+			if(EINTR == errno) continue;
+			perror("Error writing output");
+			b->failed = 1;
+			break;
+		}
+		written += w;
+	}
+	b->len = 0;
+	return b->failed;
+}
+
+int csvformatcell(char *p, double val) {
+	// Exactly what "%f," would print, minus the trip through printf
+	//   for the integers and NULLs that make up most of a log
+	if(val > -1e15 && val < 1e15 && val == (double)(long)val) {
+		char tmp[24];
+		int n = 0;
+		long l = (long)val;
+		int neg = (l < 0) || (0 == l && signbit(val));
+		unsigned long u = (l<0)?-(unsigned long)l:(unsigned long)l;
+		do {
+			tmp[n++] = '0' + (u % 10);
+			u /= 10;
+		} while(u > 0);
+
+		char *start = p;
+		if(neg) *p++ = '-';
+		while(n > 0) *p++ = tmp[--n];
+		memcpy(p, ".000000,", 8);
+		p += 8;
+		return p - start;
+	}
+	int n = snprintf(p, CSV_MAXCELL, "%f,", val);
+	if(n >= CSV_MAXCELL) {
+		// Too big for %f to fit in a cell; %g always does
+		n = snprintf(p, CSV_MAXCELL, "%g,", val);
+	}
+	return (n >= CSV_MAXCELL)?CSV_MAXCELL-1:n;
+}
+
+int csvoutoforder(sqlite3 *db) {
+	sqlite3_stmt *stmt;
+	const char *dbend;
+	int outoforder = 0;
+
+	// Most logs won't have the table at all
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "SELECT 1 FROM blackbox WHERE obdrows>0 LIMIT 1", -1, &stmt, &dbend)) {
+		return 0;
+	}
+	if(SQLITE_ROW == sqlite3_step(stmt)) {
+		outoforder = 1;
+	}
+	sqlite3_finalize(stmt);
+	return outoforder;
+}
+
+int csvloadtrips(sqlite3 *db, struct csvtrip **trips) {
+	sqlite3_stmt *stmt;
+	const char *dbend;
+	int count = 0;
+	int alloced = 0;
+
+	*trips = NULL;
+
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "SELECT tripid, start, end FROM trip ORDER BY start", -1, &stmt, &dbend)) {
+		fprintf(stderr, "Not Fatal: Couldn't read trips: %s\n", sqlite3_errmsg(db));
+		return 0;
+	}
+
+	while(SQLITE_ROW == sqlite3_step(stmt)) {
+		if(count == alloced) {
+			alloced = alloced?alloced*2:64;
+			struct csvtrip *t = (struct csvtrip *)realloc(*trips, alloced * sizeof(struct csvtrip));
+			if(NULL == t) break;
+			*trips = t;
+		}
+		(*trips)[count].tripid = sqlite3_column_int64(stmt, 0);
+		(*trips)[count].start = sqlite3_column_double(stmt, 1);
+		(*trips)[count].end = sqlite3_column_double(stmt, 2);
+		count++;
+	}
+	sqlite3_finalize(stmt);
+
+	return count;
+}
+
+double csvfindtrip(const struct csvtrip *trips, int numtrips, int *hint, double t) {
+	// Rows mostly arrive in time order, so the last trip is usually right
+	if(*hint < numtrips && t > trips[*hint].start && t < trips[*hint].end) {
+		return trips[*hint].tripid;
+	}
+
+	int i;
+	for(i=0;i<numtrips;i++) {
+		if(t > trips[i].start && t < trips[i].end) {
+			*hint = i;
+			return trips[i].tripid;
+		}
+	}
+	return 0;
+}
+
+int csvgpsmerge_init(sqlite3 *db, struct csvgpsmerge *m) {
+	const char *dbend;
+	memset(m, 0, sizeof(*m));
+	m->valid = 0;
+	m->lastt = -1;
+	if(SQLITE_OK != sqlite3_prepare_v2(db,
+			"SELECT time, lon, lat, alt FROM gps WHERE time>=? ORDER BY time",
+			-1, &m->stmt, &dbend)) {
+		m->stmt = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+/// Step the gps cursor once
+static void csvgpsmerge_step(struct csvgpsmerge *m) {
+	if(SQLITE_ROW == sqlite3_step(m->stmt)) {
+		m->time = sqlite3_column_double(m->stmt, 0);
+		m->lon = sqlite3_column_double(m->stmt, 1);
+		m->lat = sqlite3_column_double(m->stmt, 2);
+		m->alt = sqlite3_column_double(m->stmt, 3);
+		m->valid = 1;
+	} else {
+		m->valid = 0;
+	}
+}
+
+int csvgpsmerge_find(struct csvgpsmerge *m, double t, double *lon, double *lat, double *alt) {
+	if(NULL == m->stmt) return 0;
+
+	// Time went backwards [or this is the first row]; seek with the index
+	if(m->lastt < 0 || t < m->lastt) {
+		sqlite3_reset(m->stmt);
+		sqlite3_bind_double(m->stmt, 1, t);
+		csvgpsmerge_step(m);
+	}
+	m->lastt = t;
+
+	while(m->valid && m->time < t) {
+		csvgpsmerge_step(m);
+	}
+
+	if(m->valid && m->time == t) {
+		*lon = m->lon;
+		*lat = m->lat;
+		*alt = m->alt;
+		return 1;
+	}
 	return 0;
 }
 
+void csvgpsmerge_finalize(struct csvgpsmerge *m) {
+	if(NULL != m->stmt) {
+		sqlite3_finalize(m->stmt);
+		m->stmt = NULL;
+	}
+}
+
 void csvprinthelp(const char *argv0) {
 	printf("Usage: %s [params]\n"
 		"   [-o|--out<=" DEFAULT_OUTFILENAME ">]\n"
@@ -348,6 +743,8 @@ void csvprinthelp(const char *argv0) {
 		"   [-d|--db<=" OBD_DEFAULT_DATABASE ">]\n"
 		"   [-s|--start=<time>]\n"
 		"   [-e|--end=<time>]\n"
+		"   [-t|--trip=<tripid>]\n"
+		"   [-r|--reconstruct=<none|step|linear>]\n"
 #ifdef HAVE_ZLIB
 		"   [-z|--gzip]\n"
 #endif //HAVE_ZLIB
@@ -24,19 +24,38 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #define __OBDGPSCSV_H
 
 #include <getopt.h>
+#include <stddef.h>
+
+#include "sqlite3.h"
+#include "obdreconstruct.h"
+
+#ifdef HAVE_ZLIB
+#include "zlib.h"
+#endif //HAVE_ZLIB
 
 /// Default out filename
 #define DEFAULT_OUTFILENAME "./obdlogger.csv"
 
+/// Rows of obd pulled per SELECT
+#define CSV_CHUNKROWS 8192
+
+/// Output is formatted into a buffer this big and written in one go
+#define CSV_BUFSIZE (1<<20)
+
+/// Longest single formatted cell, including the comma
+#define CSV_MAXCELL 64
+
 /// getopt_long long options
 static const struct option csvlongopts[] = {
 	{ "help", no_argument, NULL, 'h' }, ///< Print the help text
 	{ "start", required_argument, NULL, 's' }, ///< Dump starting with this time
 	{ "end", required_argument, NULL, 'e' }, ///< Dump ending with this time
+	{ "trip", required_argument, NULL, 't' }, ///< Only dump this trip
 	{ "version", no_argument, NULL, 'v' }, ///< Print the version text
 	{ "progress", no_argument, NULL, 'p' }, ///< Print parsable progress
 	{ "db", required_argument, NULL, 'd' }, ///< Database file
 	{ "out", required_argument, NULL, 'o' }, ///< Output file
+	{ "reconstruct", required_argument, NULL, 'r' }, ///< How to fill values left out by compression
 #ifdef HAVE_ZLIB
 	{ "gzip", no_argument, NULL, 'z' }, ///< gzip output file with zlib
 #endif //HAVE_ZLIB
@@ -45,12 +64,105 @@ static const struct option csvlongopts[] = {
 
 
 /// getopt() short options
-static const char csvshortopts[] = "hs:e:vpd:o:"
+static const char csvshortopts[] = "hs:e:t:vpd:o:r:"
 #ifdef HAVE_ZLIB
 	"z"
 #endif //HAVE_ZLIB
 ;
 
+/// Output buffer
+struct csvbuf {
+	char buf[CSV_BUFSIZE]; ///< Formatted rows waiting to be written
+	size_t len; ///< Bytes used in buf
+	int fd; ///< Plain output file
+#ifdef HAVE_ZLIB
+	gzFile gz; ///< Compressed output file, or NULL to use fd
+#endif //HAVE_ZLIB
+	int failed; ///< Set once a write fails
+};
+
+/// One row of the trip table
+struct csvtrip {
+	sqlite3_int64 tripid; ///< tripid
+	double start; ///< Start time
+	double end; ///< End time
+};
+
+/// Cursor over the gps table, walked forward alongside obd
+struct csvgpsmerge {
+	sqlite3_stmt *stmt; ///< SELECT in time order
+	int valid; ///< Set if the fields below hold a row
+	double lastt; ///< Last time asked for
+	double time; ///< Current gps row's time
+	double lon; ///< Current gps row's longitude
+	double lat; ///< Current gps row's latitude
+	double alt; ///< Current gps row's altitude
+};
+
+/// Everything needed to write a row once its gaps are filled
+struct csvrowwriter {
+	struct csvbuf *out; ///< Where rows go
+	struct csvgpsmerge *gps; ///< gps cursor
+	size_t max_line; ///< Longest a row can be
+	int numcols; ///< obd table columns in each row
+	int vsscol; ///< Index of vss, or -1 if there's no mpg column
+	int mafcol; ///< Index of maf, or -1 if there's no mpg column
+};
+
+/// Write out everything in the buffer
+/** \return 0 on success, nonzero if this or an earlier write failed
+ */
+int csvbuf_flush(struct csvbuf *b);
+
+/// Format one cell exactly as printf("%f,") would
+/** Values too big for that to fit in CSV_MAXCELL are written with "%g,"
+ \param p where to write. Must have CSV_MAXCELL bytes available
+ \return number of characters written, never more than CSV_MAXCELL-1
+ */
+int csvformatcell(char *p, double val);
+
+/// Read every trip, ordered by start
+/** \param trips filled with a malloc'd array. Caller frees
+ \return number of trips
+ */
+int csvloadtrips(sqlite3 *db, struct csvtrip **trips);
+
+/// Find the trip containing a time
+/** \param hint index of the last trip found. Updated
+ \return the tripid, or zero if no trip matches
+ */
+double csvfindtrip(const struct csvtrip *trips, int numtrips, int *hint, double t);
+
+/// Prepare a gps merge cursor
+/** \return 0 on success
+ */
+int csvgpsmerge_init(sqlite3 *db, struct csvgpsmerge *m);
+
+/// Find the gps fix logged at exactly time t
+/** Cheap as long as t mostly increases between calls
+ \return 1 and fill lon, lat, alt if found. 0 otherwise
+ */
+int csvgpsmerge_find(struct csvgpsmerge *m, double t, double *lon, double *lat, double *alt);
+
+/// Release a gps merge cursor
+void csvgpsmerge_finalize(struct csvgpsmerge *m);
+
+/// Format one row. An obdreconstruct_emit; arg is a csvrowwriter
+/** The row's id is its trip */
+void csvwriterow(const struct obdreconstruct_row *r, void *arg);
+
+/// Find which obd columns were written with deadband compression
+/** \param columns obd table column names
+ \param compressed set for each column listed in the deadband table
+ \return the longest heartbeat in seconds, or -1 if the log isn't compressed
+ */
+double csvloaddeadbands(sqlite3 *db, const char **columns, int numcols, unsigned char *compressed);
+
+/// Find out if obd rows are out of time order
+/** A blackbox writes out rows after ones sampled later. See obdgpslogger(1)
+ \return 1 if rowid order isn't time order, 0 if it is */
+int csvoutoforder(sqlite3 *db);
+
 /// Print Help for --help
 /** \param argv0 your program's argv[0]
  */
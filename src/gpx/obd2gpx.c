@@ -44,6 +44,9 @@ int main(int argc, char **argv) {
 	/// Database file to open
 	char *databasename = strdup(OBD_DEFAULT_DATABASE);
 
+	/// Simplify tracks to within this many meters
+	double simplify = 0;
+
 	/// getopt's current option
 	int optc;
 
@@ -72,6 +75,9 @@ int main(int argc, char **argv) {
 				}
 				outfilename = strdup(optarg);
 				break;
+			case 's':
+				simplify = atof(optarg);
+				break;
 			default:
 				gpxprinthelp(argv[0]);
 				mustexit = 1;
@@ -109,7 +115,16 @@ int main(int argc, char **argv) {
 
 	gpx_writeheader(outfile, basename(outfilename));
 
+	struct tracksimplify *simp = tracksimplify_create(simplify, 0, gpx_writepoint, outfile);
+	if(NULL == simp) {
+		fprintf(stderr, "Couldn't allocate simplifier\n");
+		fclose(outfile);
+		sqlite3_close(db);
+		exit(1);
+	}
+
 	int currtrip = -1;
+	double lastalt = 0;
 
 	while(SQLITE_ROW == sqlite3_step(select_stmt)) {
 		double lat = sqlite3_column_double(select_stmt, 0);
@@ -119,31 +134,34 @@ int main(int argc, char **argv) {
 		int trip = sqlite3_column_int64(select_stmt, 4);
 
 		if(currtrip != trip) {
-			if(currtrip > -1) gpx_endtrip(outfile);
+			if(currtrip > -1) {
+				tracksimplify_flush(simp);
+				gpx_endtrip(outfile);
+			}
 			printf("Writing trip %i\n", trip);
 			gpx_starttrip(outfile, trip);
 		}
 
-		fprintf(outfile, "\t\t\t<trkpt lat=\"%f\" lon=\"%f\">\n", lat, lon);
-		if(alt > -900) { // -1000 is a crappy way to tell if we had a 3d fix
-			fprintf(outfile, "\t\t\t\t<ele>%f</ele>\n", alt);
-			fprintf(outfile, "\t\t\t\t<fix>3d</fix>\n");
-		} else {
-			fprintf(outfile, "\t\t\t\t<fix>2d</fix>\n");
-		}
+		// -1000 is a crappy way to tell if we had a 3d fix
+		int have3d = (alt > -900);
+		if(have3d) lastalt = alt;
 
-		// xsd:dateTime format: CCYY-MM-DDThh:mm:ss 
-		char timestring[128] = "\0";
-		struct tm *tostr = localtime(&datatime);
-		if(0 < strftime(timestring, sizeof(timestring), "%FT%T", tostr)) {
-			fprintf(outfile, "\t\t\t\t<time>%s</time>\n", timestring);
-		}
+		// 2d fixes keep the last altitude so they don't look like a 1km drop
+		struct trackpoint tp = { lon, lat, lastalt, alt, datatime, have3d };
+		tracksimplify_add(simp, &tp);
 
-		fprintf(outfile, "\t\t\t</trkpt>\n");
 		currtrip = trip;
 	}
+	tracksimplify_flush(simp);
 	gpx_endtrip(outfile);
 
+	if(simplify > 0) {
+		long in, out;
+		tracksimplify_stats(simp, &in, &out);
+		printf("Simplified %li points to %li\n", in, out);
+	}
+	tracksimplify_free(simp);
+
 	gpx_writetail(outfile);
 	sqlite3_finalize(select_stmt);
 
@@ -176,6 +194,28 @@ void gpx_writeheader(FILE *outfile, const char *filename) {
 			"\t</metadata>\n", filename, filename);
 }
 
+void gpx_writepoint(const struct trackpoint *p, void *arg) {
+	FILE *outfile = (FILE *)arg;
+
+	fprintf(outfile, "\t\t\t<trkpt lat=\"%f\" lon=\"%f\">\n", p->lat, p->lon);
+	if(p->flags) {
+		fprintf(outfile, "\t\t\t\t<ele>%f</ele>\n", p->val);
+		fprintf(outfile, "\t\t\t\t<fix>3d</fix>\n");
+	} else {
+		fprintf(outfile, "\t\t\t\t<fix>2d</fix>\n");
+	}
+
+	// xsd:dateTime format: CCYY-MM-DDThh:mm:ss 
+	char timestring[128] = "\0";
+	time_t datatime = (time_t)p->time;
+	struct tm *tostr = localtime(&datatime);
+	if(0 < strftime(timestring, sizeof(timestring), "%FT%T", tostr)) {
+		fprintf(outfile, "\t\t\t\t<time>%s</time>\n", timestring);
+	}
+
+	fprintf(outfile, "\t\t\t</trkpt>\n");
+}
+
 void gpx_writetail(FILE *outfile) {
 	fprintf(outfile, "</gpx>\n");
 }
@@ -195,6 +235,7 @@ void gpxprinthelp(const char *argv0) {
 	printf("Usage: %s [params]\n"
 		"   [-o|--out=<" DEFAULT_OUTFILENAME ">]\n"
 		"   [-d|--db=<" OBD_DEFAULT_DATABASE ">]\n"
+		"   [-s|--simplify=<meters>]\n"
 		"   [-v|--version] [-h|--help]\n", argv0);
 }
 
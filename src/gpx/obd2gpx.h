@@ -24,6 +24,9 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #define __OBD2GPX_H
 
 #include <getopt.h>
+#include <stdio.h>
+
+#include "tracksimplify.h"
 
 /// Default out filename
 #define DEFAULT_OUTFILENAME "./obdgpslogger.gpx"
@@ -34,6 +37,7 @@ static const struct option gpxlongopts[] = {
 	{ "version", no_argument, NULL, 'v' }, ///< Print the version text
 	{ "db", required_argument, NULL, 'd' }, ///< Database file
 	{ "out", required_argument, NULL, 'o' }, ///< Output file
+	{ "simplify", required_argument, NULL, 's' }, ///< Simplify tracks to within this many meters
 	{ NULL, 0, NULL, 0 } ///< End
 };
 
@@ -54,6 +58,12 @@ void gpx_starttrip(FILE *outfile, int tripnum);
 /// Print gpx track tail component
 void gpx_endtrip(FILE *outfile);
 
+/// tracksimplify_emit that prints one gpx trkpt
+/** Point flags are set for a 3d fix
+ \param arg the FILE * to write to
+ */
+void gpx_writepoint(const struct trackpoint *p, void *arg);
+
 /// Print Help for --help
 /** \param argv0 your program's argv[0]
  */
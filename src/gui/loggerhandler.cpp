@@ -27,15 +27,24 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/time.h>
 
 
+#include "obdconfig.h"
 #include "maindisplay.h"
 #include "loggerhandler.h"
+#include "obdservicecommands.h"
 
 loggerhandler::loggerhandler(OBDUI *mainui) {
 	mMainui = mainui;
 	mUsable = false;
 	mStarted = false;
+#ifdef HAVE_LIVEBUS
+	mLivebus = NULL;
+	mLastFrame = 0;
+	mHaveFrame = false;
+	mLastRefresh = 0;
+#endif //HAVE_LIVEBUS
 
 	if(NULL == mMainui) return;
 
@@ -74,7 +83,10 @@ loggerhandler::loggerhandler(OBDUI *mainui) {
 
 		int ret = execlp("obdgpslogger",
 			"obdgpslogger",
+#ifndef HAVE_LIVEBUS
+			// Values come over the live bus, if we have it
 			"--spam-stdout", // Spam all values to stdout
+#endif //HAVE_LIVEBUS
 
 			"--db", // write to...
 			logfilename, // this logfile
@@ -111,6 +123,10 @@ loggerhandler::loggerhandler(OBDUI *mainui) {
 }
 
 loggerhandler::~loggerhandler() {
+#ifdef HAVE_LIVEBUS
+	obdlivebus_close(mLivebus);
+#endif //HAVE_LIVEBUS
+
 	if(!mUsable) return;
 
 	// Only the parent will do this stuff
@@ -170,9 +186,67 @@ void loggerhandler::updateUI(const char *line) {
 	}
 }
 
+#ifdef HAVE_LIVEBUS
+void loggerhandler::updateUI(const struct obdlive_frame *f) {
+	for(int i=0; i<f->numvalues; i++) {
+		struct obdservicecmd *cmd = obdGetCmdForPID(f->pid[i]);
+		if(NULL == cmd || NULL == cmd->db_column) continue;
+
+		float val = f->value[i];
+		if(0 == strcmp(cmd->db_column, "vss")) {
+			mMainui->setvss(val);
+		} else if(0 == strcmp(cmd->db_column, "rpm")) {
+			mMainui->setrpm(val);
+		} else if(0 == strcmp(cmd->db_column, "maf")) {
+			mMainui->setmaf(val);
+		} else if(0 == strcmp(cmd->db_column, "throttlepos")) {
+			mMainui->setthrottlepos(val);
+		} else if(0 == strcmp(cmd->db_column, "temp")) {
+			mMainui->settemp(val);
+		}
+	}
+
+	if(0 <= f->gpsstatus) {
+		mMainui->setgps(f->lat, f->lon, f->gpsstatus>=1?f->alt:-1000.0);
+	}
+}
+
+void loggerhandler::updateLive() {
+	if(NULL == mLivebus) {
+		// The logger creates it once it's finished starting up
+		if(NULL == (mLivebus = obdlivebus_attach(OBD_LIVEBUS_NAME))) return;
+	}
+
+	// The logger may sample much faster than anyone can watch. Only
+	//  look at the newest frame, and only at the display refresh rate
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	double nowf = (double)now.tv_sec + (double)now.tv_usec/1000000.0;
+	if(nowf - mLastRefresh < 1.0/OBDGUI_REFRESHRATE &&
+		nowf >= mLastRefresh) return;
+
+	struct obdlive_frame f;
+	if(0 != obdlivebus_latest(mLivebus, &f)) return;
+	if(mHaveFrame && f.index == mLastFrame) return;
+
+	mLastFrame = f.index;
+	mHaveFrame = true;
+	mLastRefresh = nowf;
+
+	updateUI(&f);
+	if(0 < f.numvalues || 0 <= f.gpsstatus) {
+		mStarted = true;
+	}
+}
+#endif //HAVE_LIVEBUS
+
 void loggerhandler::pulse() {
 	if(!mUsable) return;
 
+#ifdef HAVE_LIVEBUS
+	updateLive();
+#endif //HAVE_LIVEBUS
+
 	fd_set mask;
 	timeval timeout;
 
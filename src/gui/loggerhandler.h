@@ -28,8 +28,15 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <unistd.h>
 #include <signal.h>
 
+#ifdef HAVE_LIVEBUS
+#include "obdlivebus.h"
+#endif //HAVE_LIVEBUS
+
 class OBDUI;
 
+/// Most times a second we'll update the dials
+#define OBDGUI_REFRESHRATE 30
+
 /// Class to launch obdgpslogger and use the data from it
 /** Drinks excessively from the Stevens kool-aid */
 class loggerhandler {
@@ -67,6 +74,26 @@ protected:
 	/// Check the line, update the UI if we find something good
 	void updateUI(const char *line);
 
+#ifdef HAVE_LIVEBUS
+	/// Update the UI from the most recent live frame, if it's time to
+	void updateLive();
+
+	/// Update the UI with everything in this frame
+	void updateUI(const struct obdlive_frame *f);
+
+	/// The logger's live data bus. NULL until it's been created
+	struct obdlivebus *mLivebus;
+
+	/// Index of the last frame we displayed
+	unsigned int mLastFrame;
+
+	/// Set once we've displayed any frame
+	bool mHaveFrame;
+
+	/// Time we last updated the dials
+	double mLastRefresh;
+#endif //HAVE_LIVEBUS
+
 	/// Handle to the main ui window
 	OBDUI *mMainui;
 
@@ -38,18 +38,40 @@ void kmlvalueheightcolor(sqlite3 *db, FILE *f, const char *name, const char *des
 
 	char select_sql[2048]; // the select statement
 
+	// Heights are normalised to the trip's largest value
+	double columnmax;
+	if(0 != kmlcolumnmax(db, columnname, trip, &columnmax)) {
+		return;
+	}
+	double normalfactor = (0 != columnmax)?height/columnmax:0;
+
+	// Samples carry their own position. Rows logged before they did
+	//   only match up with gps rows logged at the same time
 	snprintf(select_sql,sizeof(select_sql),
-					"SELECT %i*%s/(SELECT MAX(%s) FROM obd "
-						"WHERE trip=%i) "
-					"AS height,gps.lat, gps.lon, %s "
-					"FROM obd INNER JOIN gps ON obd.time=gps.time "
-					"WHERE obd.trip=%i",
-					height, columnname, columnname, trip, col, trip);
+					"SELECT %.17g*%s "
+					"AS height,COALESCE(obd.lat,gps.lat), COALESCE(obd.lon,gps.lon), %s, obd.time "
+					"FROM obd LEFT JOIN gps ON obd.time=gps.time "
+					"WHERE obd.trip=%i AND COALESCE(obd.lat,gps.lat) IS NOT NULL "
+					"ORDER BY obd.time",
+					normalfactor, columnname, col, trip);
 
 	// printf("select sql:\n%s\n", select_sql);
 
 	rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, &dbend);
 
+	if(rc != SQLITE_OK) {
+		// Older logs don't have positions in the obd table
+		snprintf(select_sql,sizeof(select_sql),
+						"SELECT %.17g*%s "
+						"AS height,gps.lat, gps.lon, %s, obd.time "
+						"FROM obd INNER JOIN gps ON obd.time=gps.time "
+						"WHERE obd.trip=%i "
+						"ORDER BY obd.time",
+						normalfactor, columnname, col, trip);
+
+		rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, &dbend);
+	}
+
 	if(rc != SQLITE_OK) {
 		printf("SQL Error in valueheightcolor: %i, %s\n", rc, sqlite3_errmsg(db));
 		return;
@@ -63,11 +85,11 @@ void kmlvalueheightcolor(sqlite3 *db, FILE *f, const char *name, const char *des
 			char percentile_sql[2048]; // the actual sql
 			snprintf(percentile_sql, sizeof(percentile_sql),
 				"SELECT %s AS ckobd FROM obd "
-				"WHERE vss>0 AND obd.trip=%i "
+				"WHERE vss>0 AND obd.trip=%i AND %s IS NOT NULL "
 				"ORDER BY ckobd "
-				"LIMIT 1 OFFSET (SELECT %i*COUNT(*)/100 FROM obd "
+				"LIMIT 1 OFFSET (SELECT %i*COUNT(%s)/100 FROM obd "
 					"WHERE vss>0 AND obd.trip=%i)",
-				col, trip, i*100/numcols, trip);
+				col, trip, col, i*100/numcols, col, trip);
 
 			// printf("Percentile sql:\n%s\n", percentile_sql);
 
@@ -135,14 +157,21 @@ void kmlvalueheightcolor(sqlite3 *db, FILE *f, const char *name, const char *des
 
 		fprintf(f, placehead, styleprefix, 0);
 
+		// Compressed logs leave values out until they move
+		struct kmlhold heighthold, colorhold;
+		kmlhold_init(&heighthold, db);
+		kmlhold_init(&colorhold, db);
+
 		while(SQLITE_DONE != sqlite3_step(stmt)) {
+			double t = sqlite3_column_double(stmt, 4);
+			double value = kmlhold_value(&heighthold, stmt, 0, t);
 			if(0 == have_firstpos) {
 				firstpos[2] = sqlite3_column_double(stmt, 2);
 				firstpos[1] = sqlite3_column_double(stmt, 1);
-				firstpos[0] = sqlite3_column_double(stmt, 0);
+				firstpos[0] = value;
 				have_firstpos = 1;
 			}
-			double perc = sqlite3_column_double(stmt, 3);
+			double perc = kmlhold_value(&colorhold, stmt, 3, t);
 			for(i=0;i<numcols;i++) {
 				if(percentileposition[i] > perc) break;
 			}
@@ -155,10 +184,10 @@ void kmlvalueheightcolor(sqlite3 *db, FILE *f, const char *name, const char *des
 					fprintf(f, "%f,%f,%f\n", lastpos[2], lastpos[1], lastpos[0]);
 				}
 			}
-			fprintf(f, "%f,%f,%f\n", sqlite3_column_double(stmt, 2),sqlite3_column_double(stmt, 1),sqlite3_column_double(stmt, 0));
+			fprintf(f, "%f,%f,%f\n", sqlite3_column_double(stmt, 2),sqlite3_column_double(stmt, 1),value);
 			lastpos[2] = sqlite3_column_double(stmt, 2);
 			lastpos[1] = sqlite3_column_double(stmt, 1);
-			lastpos[0] = sqlite3_column_double(stmt, 0);
+			lastpos[0] = value;
 
 			lastpercentile = i;
 		}
@@ -31,7 +31,11 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "sqlite3.h"
 
-void gpsposvel(sqlite3 *db, FILE *f, int height, int defaultvis, double start, double end, int trip) {
+void kmlwritecoord(const struct trackpoint *p, void *arg) {
+	fprintf((FILE *)arg, "%f,%f,%f\n", p->lon, p->lat, p->z);
+}
+
+void gpsposvel(sqlite3 *db, FILE *f, int height, int defaultvis, double start, double end, int trip, double simplify) {
 	int rc; // return from sqlite
 	sqlite3_stmt *stmt; // sqlite statement
 	const char *dbend; // ignored handle for sqlite
@@ -78,6 +82,11 @@ void gpsposvel(sqlite3 *db, FILE *f, int height, int defaultvis, double start, d
 		double currspeed = 0;
 		double currtime = 0;
 
+		struct tracksimplify *simp = tracksimplify_create(simplify, 0, kmlwritecoord, f);
+		if(NULL == simp) {
+			fprintf(stderr, "Not Fatal: Couldn't allocate simplifier, writing every point\n");
+		}
+
 		int rowcount = 0;
 		while(SQLITE_ROW == sqlite3_step(stmt)) {
 			currpos[0] = sqlite3_column_double(stmt, 0);
@@ -91,7 +100,12 @@ void gpsposvel(sqlite3 *db, FILE *f, int height, int defaultvis, double start, d
 				firstpos[2] = currpos[2];
 			}
 
-			fprintf(f, "%f,%f,%f\n", currpos[0],currpos[1],currspeed * 100);
+			struct trackpoint tp = { currpos[0], currpos[1], currspeed * 100, 0, currtime, 0 };
+			if(NULL != simp) {
+				tracksimplify_add(simp, &tp);
+			} else {
+				kmlwritecoord(&tp, f);
+			}
 
 			lastpos[1] = currpos[1];
 			lastpos[0] = currpos[0];
@@ -100,6 +114,16 @@ void gpsposvel(sqlite3 *db, FILE *f, int height, int defaultvis, double start, d
 			rowcount++;
 		}
 
+		if(NULL != simp) {
+			tracksimplify_flush(simp);
+			if(simplify > 0) {
+				long in, out;
+				tracksimplify_stats(simp, &in, &out);
+				printf("Trip %i: simplified %li points to %li\n", trip, in, out);
+			}
+			tracksimplify_free(simp);
+		}
+
 		fprintf(f,"</coordinates>\n"
 			"</LineString>\n"
 			"</Placemark>\n");
@@ -28,6 +28,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 
 #include "sqlite3.h"
+#include "tracksimplify.h"
 
 
 /// print single db column as height in kml, normalised to maximum height
@@ -38,8 +39,14 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
  \param defaultvis the default visilibity [1 for on, 0 for off]
  \param start the start time we want to pull data for
  \param end the end time we want to pull data for
+ \param simplify most error allowed when simplifying the track, meters. <= 0 for every point
  */
-void gpsposvel(sqlite3 *db, FILE *f, int height, int defaultvis, double start, double end, int trip);
+void gpsposvel(sqlite3 *db, FILE *f, int height, int defaultvis, double start, double end, int trip, double simplify);
+
+/// tracksimplify_emit that writes one kml coordinate
+/** \param arg the FILE * to write to
+ */
+void kmlwritecoord(const struct trackpoint *p, void *arg);
 
 
 #endif //__JUSTGPS_H
@@ -30,6 +30,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include "justgps.h"
 #include "singleheight.h"
 #include "heightandcolor.h"
+#include "tiledkml.h"
 
 #include "sqlite3.h"
 
@@ -64,6 +65,12 @@ int main(int argc, char **argv) {
 	/// Max altitiude to chart to
 	int maxaltitude = DEFAULT_MAXALTITUDE;
 
+	/// Simplify tracks to within this many meters
+	double simplify = 0;
+
+	/// Directory to write tiles to, if any
+	char *tiledir = NULL;
+
 	/// getopt's current option
 	int optc;
 
@@ -104,6 +111,15 @@ int main(int argc, char **argv) {
 			case 'a':
 				maxaltitude = atoi(optarg);
 				break;
+			case 's':
+				simplify = atof(optarg);
+				break;
+			case 't':
+				if(NULL != tiledir) {
+					free(tiledir);
+				}
+				tiledir = strdup(optarg);
+				break;
 			default:
 				kmlprinthelp(argv[0]);
 				mustexit = 1;
@@ -140,6 +156,13 @@ int main(int argc, char **argv) {
 		exit(1);
 	}
 
+	if(NULL != tiledir) {
+		rc = writetiledkml(db, tiledir, kmlfoldername);
+		sqlite3_close(db);
+		free(tiledir);
+		return rc?1:0;
+	}
+
 	outfile = fopen(outfilename, "w");
 	if(NULL == outfile) {
 		perror(outfilename);
@@ -153,7 +176,7 @@ int main(int argc, char **argv) {
 		"<description>OBD GPS Logger [http://icculus.org/obdgpslogger] was used to log a car journey and export this kml file</description>\n",
 		kmlfoldername);
 
-	writekmlgraphs(db,outfile,maxaltitude);
+	writekmlgraphs(db,outfile,maxaltitude,simplify);
 
 
 	fprintf(outfile,"</Folder>\n</kml>\n\n");
@@ -164,7 +187,7 @@ int main(int argc, char **argv) {
 	return 0;
 }
 
-void writekmlgraphs(sqlite3 *db, FILE *f, int maxaltitude) {
+void writekmlgraphs(sqlite3 *db, FILE *f, int maxaltitude, double simplify) {
 	// Before entering this function, you should have written all the xml fluff
 	//  that comes at the top of the kml file, and be ready to dump the other fluff afterwards
 	
@@ -207,7 +230,7 @@ void writekmlgraphs(sqlite3 *db, FILE *f, int maxaltitude) {
 	
 				gpsposvel(db,f, maxaltitude, 0,
 					sqlite3_column_double(trip_stmt, 1), sqlite3_column_double(trip_stmt, 2),
-					sqlite3_column_int(trip_stmt, 0));
+					sqlite3_column_int(trip_stmt, 0), simplify);
 			}
 		}
 		if(rc != SQLITE_ROW && rc != SQLITE_DONE && rc != SQLITE_OK) {
@@ -236,7 +259,7 @@ void writekmlgraphs(sqlite3 *db, FILE *f, int maxaltitude) {
 
 			kmlvalueheight(db,f, graphname, "", "rpm", maxaltitude, 0,
 				sqlite3_column_double(trip_stmt, 1), sqlite3_column_double(trip_stmt, 2),
-				sqlite3_column_int(trip_stmt, 0));
+				sqlite3_column_int(trip_stmt, 0), simplify);
 		}
 	}
 	if(rc != SQLITE_ROW && rc != SQLITE_DONE && rc != SQLITE_OK) {
@@ -296,7 +319,7 @@ void writekmlgraphs(sqlite3 *db, FILE *f, int maxaltitude) {
 
 			kmlvalueheight(db,f, graphname, "", "(vss/rpm)", maxaltitude, 0,
 				sqlite3_column_double(trip_stmt, 1), sqlite3_column_double(trip_stmt, 2),
-				sqlite3_column_int(trip_stmt,0));
+				sqlite3_column_int(trip_stmt,0), simplify);
 		}
 	}
 	if(rc != SQLITE_ROW && rc != SQLITE_DONE && rc != SQLITE_OK) {
@@ -390,6 +413,8 @@ void kmlprinthelp(const char *argv0) {
 		"   [-d|--db[=" OBD_DEFAULT_DATABASE "]]\n"
 		"   [-n|--name[=" DEFAULT_KMLFOLDERNAME "]]\n"
 		"   [-a|--altitude[=%i]]\n"
+		"   [-s|--simplify[=<meters>]]\n"
+		"   [-t|--tiles[=<directory>]]\n"
 		"   [-p|--progress]\n"
 		"   [-v|--version] [-h|--help]\n", argv0, DEFAULT_MAXALTITUDE);
 }
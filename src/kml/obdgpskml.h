@@ -44,20 +44,23 @@ static const struct option kmllongopts[] = {
 	{ "out", required_argument, NULL, 'o' }, ///< Output file
 	{ "name", required_argument, NULL, 'n' }, ///< The "name" for this kml file
 	{ "altitude", required_argument, NULL, 'a' }, ///< Max altitude
+	{ "simplify", required_argument, NULL, 's' }, ///< Simplify tracks to within this many meters
+	{ "tiles", required_argument, NULL, 't' }, ///< Write level-of-detail tiles to this directory
 	{ NULL, 0, NULL, 0 } ///< End
 };
 
 
 /// getopt() short options
-static const char kmlshortopts[] = "hvpd:o:a:n:";
+static const char kmlshortopts[] = "hvpd:o:a:n:s:t:";
 
 
 /// Write the actual graphs
 /** \param db a valid, open, sqlite3 database
  \param f an open file handle, ready to fprintf() KML folders
  \param maxaltitude altitude to normalise to
+ \param simplify most error allowed when simplifying tracks, meters. <= 0 for every point
 */
-void writekmlgraphs(sqlite3 *db, FILE *f, int maxaltitude);
+void writekmlgraphs(sqlite3 *db, FILE *f, int maxaltitude, double simplify);
 
 /// Print Help for --help
 /** \param argv0 your program's argv[0]
@@ -26,56 +26,139 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <math.h>
 #include <time.h>
+#include <string.h>
+#include <ctype.h>
 
 #include "singleheight.h"
+#include "justgps.h"
 
 #include "sqlite3.h"
 
 /// A distance greater than this is considered to be not zero
 #define EPSILONDIST 0.000001
 
-void kmlvalueheight(sqlite3 *db, FILE *f, const char *name, const char *desc, const char *columnname, int height, int defaultvis, double start, double end, int trip) {
+int kmlcolumnmax(sqlite3 *db, const char *columnname, int trip, double *max) {
+	int rc;
+	sqlite3_stmt *stmt;
+	char max_sql[1024];
+	const char *c;
+
+	*max = 0;
+
+	// Only plain columns have rollups
+	int isplain = 1;
+	for(c = columnname; '\0' != *c; c++) {
+		if(!isalnum((unsigned char)*c) && '_' != *c) isplain = 0;
+	}
+
+	if(isplain) {
+		snprintf(max_sql, sizeof(max_sql),
+				"SELECT MAX(%s_max) FROM obdrollup WHERE resolution=%i AND trip=%i",
+				columnname, KML_ROLLUPRESOLUTION, trip);
+		// Logs without rollups fail to prepare; fall through to the obd table
+		if(SQLITE_OK == sqlite3_prepare_v2(db, max_sql, -1, &stmt, NULL)) {
+			int found = 0;
+			if(SQLITE_ROW == sqlite3_step(stmt) && SQLITE_NULL != sqlite3_column_type(stmt, 0)) {
+				*max = sqlite3_column_double(stmt, 0);
+				found = 1;
+			}
+			sqlite3_finalize(stmt);
+			if(found) return 0;
+		}
+	}
+
+	snprintf(max_sql, sizeof(max_sql),
+			"SELECT MAX(%s) FROM obd WHERE trip=%i",
+			columnname, trip);
+	rc = sqlite3_prepare_v2(db, max_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		printf("SQL Error finding maximum: %i, %s\n", rc, sqlite3_errmsg(db));
+		printf("SQL: %s\n", max_sql);
+		return -1;
+	}
+	if(SQLITE_ROW != (rc = sqlite3_step(stmt))) {
+		printf("SQL Error stepping: %i, %s\n", rc, sqlite3_errmsg(db));
+		printf("SQL: %s\n", max_sql);
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+	*max = sqlite3_column_double(stmt, 0);
+	sqlite3_finalize(stmt);
+	return 0;
+}
+
+void kmlhold_init(struct kmlhold *h, sqlite3 *db) {
+	sqlite3_stmt *stmt;
+
+	memset(h, 0, sizeof(struct kmlhold));
+	h->maxhold = -1;
+
+	// Most logs won't have the table at all
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "SELECT MAX(heartbeat) FROM deadband", -1, &stmt, NULL)) {
+		return;
+	}
+	if(SQLITE_ROW == sqlite3_step(stmt) && SQLITE_NULL != sqlite3_column_type(stmt, 0)) {
+		// A gap longer than a heartbeat and a half means the PID wasn't answering
+		h->maxhold = 1.5 * sqlite3_column_double(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+}
+
+double kmlhold_value(struct kmlhold *h, sqlite3_stmt *stmt, int col, double time) {
+	if(SQLITE_NULL != sqlite3_column_type(stmt, col)) {
+		h->value = sqlite3_column_double(stmt, col);
+		h->time = time;
+		h->have = 1;
+		return h->value;
+	}
+	if(h->have && (0 == h->maxhold || (h->maxhold > 0 && time - h->time <= h->maxhold))) {
+		return h->value;
+	}
+	return 0;
+}
+
+void kmlvalueheight(sqlite3 *db, FILE *f, const char *name, const char *desc, const char *columnname, int height, int defaultvis, double start, double end, int trip, double simplify) {
 	int rc; // return from sqlite
 	sqlite3_stmt *stmt; // sqlite statement
 	const char *dbend; // ignored handle for sqlite
 
 	// For normalising the data
-	float normalfactor = 1;
-	sqlite3_stmt *normal_stmt;
-	char normal_sql[1024];
-	
-	snprintf(normal_sql, sizeof(normal_sql),
-			"SELECT %i/(SELECT MAX(%s) FROM obd WHERE trip=%i)",
-			height, columnname, trip
-			);
-	rc = sqlite3_prepare_v2(db, normal_sql, -1, &normal_stmt, &dbend);
-	if(SQLITE_OK != rc) {
-		printf("SQL Error in valueheight: %i, %s\n", rc, sqlite3_errmsg(db));
-		printf("SQL: %s\n", normal_sql);
+	double columnmax;
+	if(0 != kmlcolumnmax(db, columnname, trip, &columnmax)) {
 		return;
-	} else {
-		if(SQLITE_ROW != sqlite3_step(normal_stmt)) {
-			printf("SQL Error stepping: %i, %s\n", rc, sqlite3_errmsg(db));
-			printf("SQL: %s\n", normal_sql);
-			return;
-		}
-		normalfactor=sqlite3_column_double(normal_stmt, 0);
 	}
-	sqlite3_finalize(normal_stmt);
+	float normalfactor = (0 != columnmax)?height/columnmax:0;
 	
 	// And the actual output
 	char select_sql[2048]; // the select statement
 
+	// Samples carry their own position. Rows logged before they did
+	//   only match up with gps rows logged at the same time
 	snprintf(select_sql,sizeof(select_sql),
-					"SELECT T1.obdkmlthing AS height,gps.lat,gps.lon "
-					"FROM (SELECT %s AS obdkmlthing,time FROM obd WHERE trip=%i) AS T1 "
-					"INNER JOIN gps "
+					"SELECT T1.obdkmlthing AS height,COALESCE(T1.lat,gps.lat),COALESCE(T1.lon,gps.lon),T1.time "
+					"FROM (SELECT %s AS obdkmlthing,time,lat,lon FROM obd WHERE trip=%i) AS T1 "
+					"LEFT JOIN gps "
 					"ON T1.time=gps.time "
-					"WHERE gps.trip=%i ",
-					columnname, trip, trip);
+					"WHERE COALESCE(T1.lat,gps.lat) IS NOT NULL "
+					"ORDER BY T1.time",
+					columnname, trip);
 
 	rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, &dbend);
 
+	if(SQLITE_OK != rc) {
+		// Older logs don't have positions in the obd table
+		snprintf(select_sql,sizeof(select_sql),
+						"SELECT T1.obdkmlthing AS height,gps.lat,gps.lon,T1.time "
+						"FROM (SELECT %s AS obdkmlthing,time FROM obd WHERE trip=%i) AS T1 "
+						"INNER JOIN gps "
+						"ON T1.time=gps.time "
+						"WHERE gps.trip=%i "
+						"ORDER BY T1.time",
+						columnname, trip, trip);
+
+		rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, &dbend);
+	}
+
 	if(SQLITE_OK != rc) {
 		printf("SQL Error in valueheight: %i, %s\n", rc, sqlite3_errmsg(db));
 		printf("SQL: %s\n", select_sql);
@@ -110,31 +193,47 @@ void kmlvalueheight(sqlite3 *db, FILE *f, const char *name, const char *desc, co
 		// Number of rows output to kml
 		long outputcount = 0;
 
+		struct tracksimplify *simp = tracksimplify_create(simplify, 0, kmlwritecoord, f);
+		if(NULL == simp) {
+			fprintf(stderr, "Not Fatal: Couldn't allocate simplifier, writing every point\n");
+		}
+
+		// Compressed logs leave values out until they move
+		struct kmlhold hold;
+		kmlhold_init(&hold, db);
+
 		double totalheight = 0;
 		while(SQLITE_ROW == sqlite3_step(stmt)) {
 			rowcount++;
 
+			double value = kmlhold_value(&hold, stmt, 0, sqlite3_column_double(stmt, 3));
+
 			if(0 == have_firstpos) {
 				firstpos[2] = sqlite3_column_double(stmt, 2);
 				firstpos[1] = sqlite3_column_double(stmt, 1);
-				firstpos[0] = sqlite3_column_double(stmt, 0);
+				firstpos[0] = value;
 				have_firstpos = 1;
 			}
 
 			double currpos[3];
 			currpos[2] = sqlite3_column_double(stmt, 2);
 			currpos[1] = sqlite3_column_double(stmt, 1);
-			currpos[0] = sqlite3_column_double(stmt, 0);
+			currpos[0] = value;
 
 			float delta = sqrt((currpos[2] - lastpos[2]) * (currpos[2] - lastpos[2]) +
 					(currpos[1] - lastpos[1]) * (currpos[1] - lastpos[1]));
-			float height = normalfactor * sqlite3_column_double(stmt, 0);
+			float height = normalfactor * value;
 			if(delta > EPSILONDIST) {
 				ismoving = 1;
 			}
 			if(ismoving) {
 				outputcount++;
-				fprintf(f, "%f,%f,%f\n", currpos[2],currpos[1],height);
+				struct trackpoint tp = { currpos[2], currpos[1], height, currpos[0], 0, 0 };
+				if(NULL != simp) {
+					tracksimplify_add(simp, &tp);
+				} else {
+					kmlwritecoord(&tp, f);
+				}
 				totalheight += height;
 			}
 			if(delta < EPSILONDIST) {
@@ -150,6 +249,16 @@ void kmlvalueheight(sqlite3 *db, FILE *f, const char *name, const char *desc, co
 		printf("Total db rows: %li. KML rows: %li. Ignored rows: %li %s\n", rowcount, outputcount,
 						rowcount - outputcount,
 						outputcount<(rowcount-outputcount)?"\nOutput rows seems low":"");
+
+		if(NULL != simp) {
+			tracksimplify_flush(simp);
+			if(simplify > 0) {
+				long out;
+				tracksimplify_stats(simp, NULL, &out);
+				printf("Simplified %li KML rows to %li\n", outputcount, out);
+			}
+			tracksimplify_free(simp);
+		}
 		fprintf(f,"</coordinates>\n"
 			"</LineString>\n"
 			"</Placemark>\n");
@@ -30,6 +30,34 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include "sqlite3.h"
 
 
+/// Coarsest rollup level the logger keeps, seconds per interval
+#define KML_ROLLUPRESOLUTION 3600
+
+/// Find the largest value of a column or expression during a trip
+/** Plain columns come from the obdrollup table where the trip has
+     rollups, which saves scanning every sample
+ \param max filled with the largest value, or zero if there isn't one
+ \return 0 on success, -1 on error
+ */
+int kmlcolumnmax(sqlite3 *db, const char *columnname, int trip, double *max);
+
+/// Holds a compressed log's last value across the NULLs after it
+/** The same step hold obd2csv does by default */
+struct kmlhold {
+	double maxhold; ///< Longest gap held across, seconds. 0 for no limit, -1 to never hold
+	int have; ///< Set once value is valid
+	double value; ///< Last value written
+	double time; ///< When value was written
+};
+
+/// Set up a hold for a database
+/** Logs without a deadband table weren't compressed, and never hold */
+void kmlhold_init(struct kmlhold *h, sqlite3 *db);
+
+/// A column of the current row, or the value held over if it's NULL
+/** eturn the value, or zero if it's NULL and there's nothing to hold */
+double kmlhold_value(struct kmlhold *h, sqlite3_stmt *stmt, int col, double time);
+
 /// print single db column as height in kml, normalised to maximum height
 /** 
  \param db the sqlite3 database the data is in
@@ -41,8 +69,9 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
  \param defaultvis the default visilibity [1 for on, 0 for off]
  \param start the start time we want to pull data for
  \param end the end time we want to pull data for
+ \param simplify most error allowed when simplifying the track, meters. <= 0 for every point
  */
-void kmlvalueheight(sqlite3 *db, FILE *f, const char *name, const char *desc, const char *columnname, int height, int defaultvis, double start, double end, int trip);
+void kmlvalueheight(sqlite3 *db, FILE *f, const char *name, const char *desc, const char *columnname, int height, int defaultvis, double start, double end, int trip, double simplify);
 
 
 #endif //__SINGLEHEIGHT_H
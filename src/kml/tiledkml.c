@@ -0,0 +1,578 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Write gps tracks as a tree of level-of-detail KML tiles
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "tiledkml.h"
+#include "tracksimplify.h"
+
+#include "sqlite3.h"
+
+/// Closes a LineString in a tile
+static const char kmltile_lineend[] = "</coordinates></LineString></Placemark>\n";
+
+/// One tile
+struct kmltile {
+	int z; ///< Level
+	long x; ///< Column
+	long y; ///< Row
+	char *buf; ///< KML not yet appended to disk
+	size_t len; ///< Bytes used in buf
+	size_t cap; ///< Bytes allocated for buf
+	int ondisk; ///< Set once some of this tile is in its .part file
+	int open; ///< Set while a LineString is open
+	int segment; ///< Track segment the open LineString belongs to
+	double lastlon; ///< Last point in the open LineString
+	double lastlat; ///< Last point in the open LineString
+	unsigned char children; ///< Bitmask of child tiles that exist
+	struct kmltile *next; ///< Hash chain
+};
+
+/// The whole set of tiles
+struct tiledkml {
+	const char *dir; ///< Output directory
+	struct kmltile **hash; ///< Tiles, hashed on z,x,y
+	size_t hashsize; ///< Buckets in hash
+	size_t ntiles; ///< Tiles in hash
+	size_t buffered; ///< Bytes held in tile buffers
+	int failed; ///< Set if anything went wrong
+};
+
+/// Per-level state while reading the gps table
+struct tilelevel {
+	struct tiledkml *t; ///< Where tiles go
+	int z; ///< Level
+	int haveprev; ///< Set once prev* are valid
+	int prevsegment; ///< Track segment of the previous point
+	double prevlon; ///< Previous simplified point
+	double prevlat; ///< Previous simplified point
+	struct tracksimplify *simp; ///< Simplifier at this level's tolerance
+};
+
+/// Great circle distance in meters
+static double kml_haversine(double latA, double lonA, double latB, double lonB) {
+	double dlat = (latB - latA) * M_PI / 180.0;
+	double dlon = (lonB - lonA) * M_PI / 180.0;
+	double a = sin(dlat/2) * sin(dlat/2) +
+		cos(latA * M_PI / 180.0) * cos(latB * M_PI / 180.0) * sin(dlon/2) * sin(dlon/2);
+	return 6371000.0 * 2 * atan2(sqrt(a), sqrt(1-a));
+}
+
+/// Width and height of a tile at level z, in degrees
+static double kmltile_size(int z) {
+	return 180.0 / (double)(1L << z);
+}
+
+static size_t kmltile_hash(int z, long x, long y, size_t size) {
+	return ((size_t)z * 73856093u ^ (size_t)x * 19349663u ^ (size_t)y * 83492791u) % size;
+}
+
+/// Double the hash table
+static int kmltile_rehash(struct tiledkml *t) {
+	size_t newsize = t->hashsize?t->hashsize*2:1024;
+	struct kmltile **newhash = (struct kmltile **)calloc(newsize, sizeof(struct kmltile *));
+	size_t i;
+	if(NULL == newhash) return 1;
+
+	for(i=0;i<t->hashsize;i++) {
+		struct kmltile *tile = t->hash[i];
+		while(NULL != tile) {
+			struct kmltile *next = tile->next;
+			size_t h = kmltile_hash(tile->z, tile->x, tile->y, newsize);
+			tile->next = newhash[h];
+			newhash[h] = tile;
+			tile = next;
+		}
+	}
+	free(t->hash);
+	t->hash = newhash;
+	t->hashsize = newsize;
+	return 0;
+}
+
+/// Find a tile, optionally creating it
+static struct kmltile *kmltile_get(struct tiledkml *t, int z, long x, long y, int create) {
+	struct kmltile *tile;
+
+	if(t->hashsize > 0) {
+		for(tile = t->hash[kmltile_hash(z, x, y, t->hashsize)]; NULL != tile; tile = tile->next) {
+			if(tile->z == z && tile->x == x && tile->y == y) return tile;
+		}
+	}
+	if(!create) return NULL;
+
+	if(t->ntiles >= t->hashsize && 0 != kmltile_rehash(t)) {
+		t->failed = 1;
+		return NULL;
+	}
+
+	tile = (struct kmltile *)calloc(1, sizeof(struct kmltile));
+	if(NULL == tile) {
+		t->failed = 1;
+		return NULL;
+	}
+	tile->z = z;
+	tile->x = x;
+	tile->y = y;
+
+	size_t h = kmltile_hash(z, x, y, t->hashsize);
+	tile->next = t->hash[h];
+	t->hash[h] = tile;
+	t->ntiles++;
+	return tile;
+}
+
+/// Create a directory and any parents it needs
+static int kml_mkdirs(const char *path) {
+	char tmp[1024];
+	char *p;
+	snprintf(tmp, sizeof(tmp), "%s", path);
+	for(p = tmp + 1; *p; p++) {
+		if('/' == *p) {
+			*p = '\0';
+			if(0 != mkdir(tmp, 0777) && EEXIST != errno) return 1;
+			*p = '/';
+		}
+	}
+	if(0 != mkdir(tmp, 0777) && EEXIST != errno) return 1;
+	return 0;
+}
+
+/// Filename for a tile
+/** \param suffix appended, so the same name can be used for the .part file */
+static void kmltile_filename(const struct tiledkml *t, const struct kmltile *tile,
+		const char *suffix, char *fn, size_t fnlen) {
+	snprintf(fn, fnlen, "%s/%i/%li/%li.kml%s", t->dir, tile->z, tile->x, tile->y, suffix);
+}
+
+/// Make sure the directory for a tile exists
+static int kmltile_mkdir(const struct tiledkml *t, const struct kmltile *tile) {
+	char dn[1024];
+	snprintf(dn, sizeof(dn), "%s/%i/%li", t->dir, tile->z, tile->x);
+	if(0 != kml_mkdirs(dn)) {
+		perror(dn);
+		return 1;
+	}
+	return 0;
+}
+
+/// Append every tile's buffer to its .part file
+static void kmltile_spill(struct tiledkml *t) {
+	size_t i;
+	for(i=0;i<t->hashsize;i++) {
+		struct kmltile *tile;
+		for(tile = t->hash[i]; NULL != tile; tile = tile->next) {
+			if(0 == tile->len) continue;
+
+			char fn[1024];
+			kmltile_filename(t, tile, ".part", fn, sizeof(fn));
+			FILE *f = NULL;
+			if(0 == kmltile_mkdir(t, tile)) {
+				f = fopen(fn, "a");
+			}
+			if(NULL == f || tile->len != fwrite(tile->buf, 1, tile->len, f)) {
+				perror(fn);
+				t->failed = 1;
+			}
+			if(NULL != f) fclose(f);
+			tile->ondisk = 1;
+			tile->len = 0;
+		}
+	}
+	t->buffered = 0;
+}
+
+static void kmltile_append(struct tiledkml *t, struct kmltile *tile, const char *s) {
+	size_t n = strlen(s);
+	if(tile->len + n > tile->cap) {
+		size_t newcap = tile->cap?tile->cap*2:4096;
+		while(newcap < tile->len + n) newcap *= 2;
+		char *b = (char *)realloc(tile->buf, newcap);
+		if(NULL == b) {
+			t->failed = 1;
+			return;
+		}
+		tile->buf = b;
+		tile->cap = newcap;
+	}
+	memcpy(tile->buf + tile->len, s, n);
+	tile->len += n;
+	t->buffered += n;
+}
+
+/// Add a segment to one tile, continuing its LineString if it can
+static void kmltile_addsegment(struct tiledkml *t, struct kmltile *tile, int segment,
+		double lon0, double lat0, double lon1, double lat1) {
+	char line[256];
+
+	if(!(tile->open && tile->segment == segment && tile->lastlon == lon0 && tile->lastlat == lat0)) {
+		if(tile->open) {
+			kmltile_append(t, tile, kmltile_lineend);
+		}
+		snprintf(line, sizeof(line), "<Placemark><styleUrl>#tiledtrack</styleUrl>"
+			"<LineString><tessellate>1</tessellate><coordinates>%f,%f,0\n", lon0, lat0);
+		kmltile_append(t, tile, line);
+		tile->open = 1;
+		tile->segment = segment;
+	}
+
+	snprintf(line, sizeof(line), "%f,%f,0\n", lon1, lat1);
+	kmltile_append(t, tile, line);
+	tile->lastlon = lon1;
+	tile->lastlat = lat1;
+}
+
+/// Tile column and row containing a point
+static void kmltile_locate(int z, double lon, double lat, long *x, long *y) {
+	double size = kmltile_size(z);
+	long maxx = (2L << z) - 1;
+	long maxy = (1L << z) - 1;
+	*x = (long)floor((lon + 180.0) / size);
+	*y = (long)floor((lat + 90.0) / size);
+	if(*x < 0) *x = 0;
+	if(*x > maxx) *x = maxx;
+	if(*y < 0) *y = 0;
+	if(*y > maxy) *y = maxy;
+}
+
+/// tracksimplify_emit; the point's flags are its track segment
+static void tilelevel_emit(const struct trackpoint *p, void *arg) {
+	struct tilelevel *l = (struct tilelevel *)arg;
+
+	double size = kmltile_size(l->z);
+	double span = fmax(fabs(p->lon - l->prevlon), fabs(p->lat - l->prevlat));
+	int steps = 1 + (int)ceil(2.0 * span / size);
+
+	// A segment too long to draw at this level is left to the coarser ones
+	if(l->haveprev && l->prevsegment == p->flags && steps <= 2 * TILEDKML_MAXSEGMENTTILES) {
+		// Walk along the segment so every tile it crosses gets it,
+		//   even ones with no simplified point inside
+		long lastx = -1, lasty = -1;
+		int i;
+		for(i=0;i<=steps;i++) {
+			double f = (double)i / steps;
+			long x, y;
+			kmltile_locate(l->z, l->prevlon + f * (p->lon - l->prevlon),
+				l->prevlat + f * (p->lat - l->prevlat), &x, &y);
+			if(x == lastx && y == lasty) continue;
+			lastx = x;
+			lasty = y;
+
+			struct kmltile *tile = kmltile_get(l->t, l->z, x, y, 1);
+			if(NULL != tile) {
+				kmltile_addsegment(l->t, tile, p->flags, l->prevlon, l->prevlat, p->lon, p->lat);
+			}
+		}
+	}
+
+	l->haveprev = 1;
+	l->prevsegment = p->flags;
+	l->prevlon = p->lon;
+	l->prevlat = p->lat;
+
+	if(l->t->buffered > TILEDKML_MAXBUFFERED) {
+		kmltile_spill(l->t);
+	}
+}
+
+/// Write a Region element for a tile
+static void kmltile_region(FILE *f, int z, long x, long y, int maxlod) {
+	double size = kmltile_size(z);
+	double west = -180.0 + x * size;
+	double south = -90.0 + y * size;
+	fprintf(f, "<Region><LatLonAltBox>"
+		"<north>%f</north><south>%f</south><east>%f</east><west>%f</west>"
+		"</LatLonAltBox><Lod><minLodPixels>%i</minLodPixels><maxLodPixels>%i</maxLodPixels></Lod></Region>\n",
+		south + size, south, west + size, west, TILEDKML_MINLODPIXELS, maxlod);
+}
+
+/// Write a NetworkLink to a tile
+/** \param prefix path from the linking file to the output directory */
+static void kmltile_link(FILE *f, const char *prefix, int z, long x, long y) {
+	fprintf(f, "<NetworkLink><name>%i/%li/%li</name>\n", z, x, y);
+	kmltile_region(f, z, x, y, -1);
+	fprintf(f, "<Link><href>%s%i/%li/%li.kml</href><viewRefreshMode>onRegion</viewRefreshMode></Link>\n"
+		"</NetworkLink>\n", prefix, z, x, y);
+}
+
+/// Write a tile's final file
+static void kmltile_finish(struct tiledkml *t, struct kmltile *tile) {
+	char fn[1024];
+	char partfn[1024];
+	int i;
+
+	if(0 != kmltile_mkdir(t, tile)) {
+		t->failed = 1;
+		return;
+	}
+
+	kmltile_filename(t, tile, "", fn, sizeof(fn));
+	FILE *f = fopen(fn, "w");
+	if(NULL == f) {
+		perror(fn);
+		t->failed = 1;
+		return;
+	}
+
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+		"<Document>\n"
+		"<name>%i/%li/%li</name>\n", tile->z, tile->x, tile->y);
+
+	// Hand over to the children once they're detailed enough
+	kmltile_region(f, tile->z, tile->x, tile->y, tile->children?TILEDKML_MAXLODPIXELS:-1);
+
+	fprintf(f, "<Style id=\"tiledtrack\"><LineStyle><color>ff0000ff</color><width>3</width></LineStyle></Style>\n");
+
+	if(tile->ondisk) {
+		kmltile_filename(t, tile, ".part", partfn, sizeof(partfn));
+		FILE *part = fopen(partfn, "r");
+		if(NULL == part) {
+			perror(partfn);
+			t->failed = 1;
+		} else {
+			char buf[8192];
+			size_t n;
+			while(0 < (n = fread(buf, 1, sizeof(buf), part))) {
+				fwrite(buf, 1, n, f);
+			}
+			fclose(part);
+			unlink(partfn);
+		}
+	}
+	fwrite(tile->buf, 1, tile->len, f);
+	if(tile->open) {
+		fputs(kmltile_lineend, f);
+	}
+
+	for(i=0;i<4;i++) {
+		if(tile->children & (1<<i)) {
+			kmltile_link(f, "../../", tile->z + 1, 2*tile->x + (i&1), 2*tile->y + (i>>1));
+		}
+	}
+
+	fprintf(f, "</Document>\n</kml>\n");
+	if(0 != fclose(f)) {
+		perror(fn);
+		t->failed = 1;
+	}
+}
+
+/// Collect every tile into an array
+static struct kmltile **kmltile_all(struct tiledkml *t) {
+	struct kmltile **all = (struct kmltile **)malloc((t->ntiles + 1) * sizeof(struct kmltile *));
+	size_t i, n = 0;
+	if(NULL == all) return NULL;
+	for(i=0;i<t->hashsize;i++) {
+		struct kmltile *tile;
+		for(tile = t->hash[i]; NULL != tile; tile = tile->next) {
+			all[n++] = tile;
+		}
+	}
+	return all;
+}
+
+/// Write every tile, plus the parents needed to reach them, and doc.kml
+static void kmltile_finishall(struct tiledkml *t, const char *name) {
+	size_t i, n;
+	struct kmltile **all;
+
+	// A simplified track can wander into a tile whose parent saw nothing
+	if(NULL == (all = kmltile_all(t))) {
+		t->failed = 1;
+		return;
+	}
+	n = t->ntiles;
+	for(i=0;i<n;i++) {
+		struct kmltile *tile = all[i];
+		while(tile->z > 0) {
+			struct kmltile *parent = kmltile_get(t, tile->z - 1, tile->x / 2, tile->y / 2, 1);
+			if(NULL == parent) break;
+			int bit = (tile->x & 1) | ((tile->y & 1) << 1);
+			int had = parent->children;
+			parent->children |= (1 << bit);
+			if(0 != had) break; // Already linked in further up
+			tile = parent;
+		}
+	}
+	free(all);
+
+	if(NULL == (all = kmltile_all(t))) {
+		t->failed = 1;
+		return;
+	}
+	for(i=0;i<t->ntiles;i++) {
+		kmltile_finish(t, all[i]);
+	}
+	free(all);
+
+	char fn[1024];
+	snprintf(fn, sizeof(fn), "%s/doc.kml", t->dir);
+	FILE *f = fopen(fn, "w");
+	if(NULL == f) {
+		perror(fn);
+		t->failed = 1;
+		return;
+	}
+	fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+		"<Folder>\n"
+		"<name>%s</name>\n"
+		"<description>OBD GPS Logger [http://icculus.org/obdgpslogger] was used to log a car journey and export this kml file</description>\n",
+		name);
+	long x;
+	for(x=0;x<2;x++) {
+		if(NULL != kmltile_get(t, 0, x, 0, 0)) {
+			kmltile_link(f, "", 0, x, 0);
+		}
+	}
+	fprintf(f, "</Folder>\n</kml>\n");
+	if(0 != fclose(f)) {
+		perror(fn);
+		t->failed = 1;
+	}
+}
+
+static void kmltile_freeall(struct tiledkml *t) {
+	size_t i;
+	for(i=0;i<t->hashsize;i++) {
+		struct kmltile *tile = t->hash[i];
+		while(NULL != tile) {
+			struct kmltile *next = tile->next;
+			free(tile->buf);
+			free(tile);
+			tile = next;
+		}
+	}
+	free(t->hash);
+}
+
+int writetiledkml(sqlite3 *db, const char *dir, const char *name) {
+	struct tiledkml t;
+	struct tilelevel levels[TILEDKML_MAXLEVEL + 1];
+	sqlite3_stmt *stmt;
+	int z;
+	int rc;
+
+	memset(&t, 0, sizeof(t));
+	t.dir = dir;
+
+	if(0 != kml_mkdirs(dir)) {
+		perror(dir);
+		return 1;
+	}
+
+	const char select_sql[] = "SELECT lon,lat,trip,time FROM gps "
+		"WHERE trip IS NOT NULL AND lat IS NOT NULL AND lon IS NOT NULL "
+		"ORDER BY trip,time";
+	rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "SQL Error in tiled kml (%i): %s\n", rc, sqlite3_errmsg(db));
+		return 1;
+	}
+
+	memset(levels, 0, sizeof(levels));
+	for(z=0;z<=TILEDKML_MAXLEVEL;z++) {
+		// A tile's width is ~TILEDKML_PIXELS px on screen while it's visible
+		double tolerance = kmltile_size(z) * 111320.0 / TILEDKML_PIXELS;
+		levels[z].t = &t;
+		levels[z].z = z;
+		levels[z].simp = tracksimplify_create(tolerance, 0, tilelevel_emit, &levels[z]);
+		if(NULL == levels[z].simp) {
+			fprintf(stderr, "Couldn't allocate simplifier\n");
+			t.failed = 1;
+			goto done;
+		}
+	}
+
+	// One pass over the data, feeding every level at once
+	int currtrip = -1;
+	int segment = 0;
+	struct trackpoint prev;
+	long rows = 0;
+	long jumps = 0;
+	memset(&prev, 0, sizeof(prev));
+	while(SQLITE_ROW == sqlite3_step(stmt)) {
+		struct trackpoint tp;
+		memset(&tp, 0, sizeof(tp));
+		tp.lon = sqlite3_column_double(stmt, 0);
+		tp.lat = sqlite3_column_double(stmt, 1);
+		tp.time = sqlite3_column_double(stmt, 3);
+		int trip = sqlite3_column_int(stmt, 2);
+
+		if(tp.lat < -90 || tp.lat > 90 || tp.lon < -180 || tp.lon > 180) continue;
+
+		// Start a new segment for each trip, and wherever the fix jumps
+		//   further than the car could have gone, so glitches aren't drawn
+		int newsegment = (currtrip != trip);
+		if(!newsegment) {
+			double dist = kml_haversine(prev.lat, prev.lon, tp.lat, tp.lon);
+			double dt = tp.time - prev.time;
+			if(dist > TILEDKML_MAXJUMP && (dt <= 0 || dist / dt > TILEDKML_MAXSPEED)) {
+				newsegment = 1;
+				jumps++;
+			}
+		}
+		if(newsegment) {
+			for(z=0;z<=TILEDKML_MAXLEVEL;z++) {
+				tracksimplify_flush(levels[z].simp);
+			}
+			currtrip = trip;
+			segment++;
+		}
+		tp.flags = segment;
+		prev = tp;
+
+		for(z=0;z<=TILEDKML_MAXLEVEL;z++) {
+			tracksimplify_add(levels[z].simp, &tp);
+		}
+		rows++;
+	}
+	for(z=0;z<=TILEDKML_MAXLEVEL;z++) {
+		tracksimplify_flush(levels[z].simp);
+	}
+
+	kmltile_finishall(&t, name);
+
+	if(jumps > 0) {
+		printf("Broke the track at %li implausible gps jumps\n", jumps);
+	}
+	printf("Wrote %li gps rows into %lu tiles in %s\n", rows, (unsigned long)t.ntiles, dir);
+
+done:
+	for(z=0;z<=TILEDKML_MAXLEVEL;z++) {
+		tracksimplify_free(levels[z].simp);
+	}
+	sqlite3_finalize(stmt);
+	kmltile_freeall(&t);
+
+	return t.failed;
+}
+
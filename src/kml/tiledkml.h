@@ -0,0 +1,66 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Write gps tracks as a tree of level-of-detail KML tiles
+ */
+#ifndef __TILEDKML_H
+#define __TILEDKML_H
+
+#include "sqlite3.h"
+
+/// Deepest tile level. Level z tiles are 180/2^z degrees square
+#define TILEDKML_MAXLEVEL 14
+
+/// A tile's track is simplified to its width divided by this
+#define TILEDKML_PIXELS 256
+
+/// A tile appears once its region is this many pixels across
+#define TILEDKML_MINLODPIXELS 128
+
+/// A tile with children hides once its region is this many pixels across
+#define TILEDKML_MAXLODPIXELS 512
+
+/// Consecutive fixes further apart than this, in meters, and faster
+///   than TILEDKML_MAXSPEED apart aren't joined
+#define TILEDKML_MAXJUMP 1000.0
+
+/// Fastest plausible speed between fixes, in meters per second
+#define TILEDKML_MAXSPEED 100.0
+
+/// A segment crossing more tiles than this at a level is left to the coarser levels
+#define TILEDKML_MAXSEGMENTTILES 64
+
+/// Most tile data held in memory before appending it to disk
+#define TILEDKML_MAXBUFFERED (4*1024*1024)
+
+/// Write every trip's gps track as a directory of tiled KML
+/** Reads the gps table once. dir/doc.kml is the file to open; it
+  links to dir/z/x/y.kml tiles using Region and NetworkLink, so
+  Earth only loads the tiles in view at a detail to suit the zoom.
+ \param db the sqlite3 database the data is in
+ \param dir directory to write to. Created if needed
+ \param name name of the top level folder
+ \return 0 on success
+ */
+int writetiledkml(sqlite3 *db, const char *dir, const char *name);
+
+#endif //__TILEDKML_H
+
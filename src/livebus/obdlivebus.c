@@ -0,0 +1,220 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Shared memory live data bus
+ */
+
+#include "obdlivebus.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/// Readers give up on a slot after racing the writer this many times
+#define OBDLIVEBUS_MAXTRIES 16
+
+/// One slot in the ring
+struct obdlive_slot {
+	volatile unsigned int seq; ///< Odd while the writer is in the middle of updating frame
+	struct obdlive_frame frame; ///< The frame itself
+};
+
+/// Layout of the shared memory
+struct obdlive_shm {
+	unsigned int magic; ///< OBDLIVEBUS_MAGIC once initialised
+	unsigned int version; ///< OBDLIVEBUS_VERSION
+	unsigned int ringsize; ///< OBDLIVEBUS_RINGSIZE
+	unsigned int framesize; ///< sizeof(struct obdlive_frame)
+	volatile unsigned int head; ///< Index of the next frame to be published
+	struct obdlive_slot slots[OBDLIVEBUS_RINGSIZE]; ///< The ring
+};
+
+/// Opened live bus
+struct obdlivebus {
+	struct obdlive_shm *shm; ///< Mapped shared memory
+	char *name; ///< Name of the shared memory object
+	int writer; ///< Set if we created it
+};
+
+/// Map name into memory
+static struct obdlivebus *obdlivebus_map(const char *name, int writer) {
+	int fd;
+	if(writer) {
+		fd = shm_open(name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	} else {
+		fd = shm_open(name, O_RDONLY, 0);
+	}
+	if(-1 == fd) {
+		if(writer) perror("Couldn't open live bus shared memory");
+		return NULL;
+	}
+
+	if(writer) {
+		if(-1 == ftruncate(fd, sizeof(struct obdlive_shm))) {
+			perror("Couldn't size live bus shared memory");
+			close(fd);
+			return NULL;
+		}
+	} else {
+		struct stat st;
+		if(-1 == fstat(fd, &st) || st.st_size < sizeof(struct obdlive_shm)) {
+			close(fd);
+			return NULL;
+		}
+	}
+
+	void *map = mmap(NULL, sizeof(struct obdlive_shm),
+		writer?(PROT_READ | PROT_WRITE):PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(MAP_FAILED == map) {
+		perror("Couldn't map live bus shared memory");
+		return NULL;
+	}
+
+	struct obdlivebus *b = (struct obdlivebus *)malloc(sizeof(struct obdlivebus));
+	if(NULL == b) {
+		munmap(map, sizeof(struct obdlive_shm));
+		return NULL;
+	}
+	b->shm = (struct obdlive_shm *)map;
+	b->name = strdup(name);
+	b->writer = writer;
+	return b;
+}
+
+struct obdlivebus *obdlivebus_create(const char *name) {
+	struct obdlivebus *b = obdlivebus_map(name, 1);
+	if(NULL == b) return NULL;
+
+	// Readers left over from a previous run see the bad magic and go away
+	b->shm->magic = 0;
+	__sync_synchronize();
+
+	memset(b->shm->slots, 0, sizeof(b->shm->slots));
+	b->shm->version = OBDLIVEBUS_VERSION;
+	b->shm->ringsize = OBDLIVEBUS_RINGSIZE;
+	b->shm->framesize = sizeof(struct obdlive_frame);
+	b->shm->head = 0;
+
+	__sync_synchronize();
+	b->shm->magic = OBDLIVEBUS_MAGIC;
+	return b;
+}
+
+struct obdlivebus *obdlivebus_attach(const char *name) {
+	struct obdlivebus *b = obdlivebus_map(name, 0);
+	if(NULL == b) return NULL;
+
+	if(OBDLIVEBUS_MAGIC != b->shm->magic ||
+		OBDLIVEBUS_VERSION != b->shm->version ||
+		OBDLIVEBUS_RINGSIZE != b->shm->ringsize ||
+		sizeof(struct obdlive_frame) != b->shm->framesize) {
+
+		obdlivebus_close(b);
+		return NULL;
+	}
+	return b;
+}
+
+void obdlivebus_close(struct obdlivebus *b) {
+	if(NULL == b) return;
+	munmap(b->shm, sizeof(struct obdlive_shm));
+	if(b->writer) {
+		shm_unlink(b->name);
+	}
+	free(b->name);
+	free(b);
+}
+
+void obdlivebus_publish(struct obdlivebus *b, struct obdlive_frame *f) {
+	unsigned int index = b->shm->head;
+	struct obdlive_slot *slot = &b->shm->slots[index % OBDLIVEBUS_RINGSIZE];
+
+	f->index = index;
+
+	unsigned int seq = slot->seq;
+	slot->seq = seq + 1;
+	__sync_synchronize();
+
+	memcpy(&slot->frame, f, sizeof(struct obdlive_frame));
+
+	__sync_synchronize();
+	slot->seq = seq + 2;
+	__sync_synchronize();
+	b->shm->head = index + 1;
+}
+
+/// Copy out the frame with this index
+/** \return 0 on success, -1 if it's been overwritten or we kept racing */
+static int obdlivebus_readslot(struct obdlivebus *b, unsigned int index, struct obdlive_frame *f) {
+	struct obdlive_slot *slot = &b->shm->slots[index % OBDLIVEBUS_RINGSIZE];
+
+	int tries;
+	for(tries=0; tries<OBDLIVEBUS_MAXTRIES; tries++) {
+		unsigned int seq = slot->seq;
+		__sync_synchronize();
+		if(seq & 1) continue;
+
+		memcpy(f, &slot->frame, sizeof(struct obdlive_frame));
+
+		__sync_synchronize();
+		if(seq == slot->seq) {
+			return (index == f->index)?0:-1;
+		}
+	}
+	return -1;
+}
+
+unsigned int obdlivebus_head(struct obdlivebus *b) {
+	return b->shm->head;
+}
+
+int obdlivebus_latest(struct obdlivebus *b, struct obdlive_frame *f) {
+	int tries;
+	for(tries=0; tries<OBDLIVEBUS_MAXTRIES; tries++) {
+		unsigned int head = b->shm->head;
+		if(0 == head) return 1;
+		if(0 == obdlivebus_readslot(b, head-1, f)) return 0;
+	}
+	return -1;
+}
+
+int obdlivebus_next(struct obdlivebus *b, unsigned int *cursor, struct obdlive_frame *f) {
+	for(;;) {
+		unsigned int head = b->shm->head;
+		if(head == *cursor) return 1;
+
+		// Fell more than a ring behind; skip to the oldest frame still there
+		if(head - *cursor > OBDLIVEBUS_RINGSIZE) {
+			*cursor = head - OBDLIVEBUS_RINGSIZE;
+		}
+
+		int ret = obdlivebus_readslot(b, *cursor, f);
+		(*cursor)++;
+		if(0 == ret) return 0;
+	}
+}
+
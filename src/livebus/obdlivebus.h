@@ -0,0 +1,105 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Shared memory live data bus
+ The logger publishes one frame per sample into a ring in POSIX shared
+  memory. Any number of readers can attach and read it without making
+  any syscalls. Each slot in the ring is guarded by a seqlock, so the
+  writer never waits on readers; readers just retry if they raced it.
+ */
+
+#ifndef __OBDLIVEBUS_H
+#define __OBDLIVEBUS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif //  __cplusplus
+
+/// Magic number at the start of the shared memory
+#define OBDLIVEBUS_MAGIC 0x4F42444CU
+
+/// Bump this whenever the layout of the shared memory changes
+#define OBDLIVEBUS_VERSION 1
+
+/// Number of frames kept in the ring
+#define OBDLIVEBUS_RINGSIZE 64
+
+/// Most values a single frame can carry
+#define OBDLIVEBUS_MAXVALUES 128
+
+/// One complete sample
+struct obdlive_frame {
+	unsigned int index; ///< Sequence number of this frame. Set by obdlivebus_publish
+	double time; ///< Time the sample was taken
+	long long trip; ///< Trip this sample is part of
+	int numvalues; ///< Number of entries in pid and value
+	unsigned int pid[OBDLIVEBUS_MAXVALUES]; ///< mode 01 PIDs sampled
+	float value[OBDLIVEBUS_MAXVALUES]; ///< Converted value for each PID
+	int gpsstatus; ///< -1 for no fix, 0 for lat,lon, 1 for lat,lon,alt
+	double lat; ///< Latitude
+	double lon; ///< Longitude
+	double alt; ///< Altitude
+	double speed; ///< GPS speed
+	double course; ///< GPS course
+	double gpstime; ///< Time according to the GPS
+};
+
+/// Opaque handle to an opened live bus
+struct obdlivebus;
+
+/// Create the live bus. For the writer
+/** \param name shared memory object name, eg OBD_LIVEBUS_NAME
+ \return a handle, or NULL on error
+ */
+struct obdlivebus *obdlivebus_create(const char *name);
+
+/// Attach to an existing live bus. For readers
+/** \return a handle, or NULL if it doesn't exist or isn't compatible */
+struct obdlivebus *obdlivebus_attach(const char *name);
+
+/// Detach from the bus. The writer also removes it
+void obdlivebus_close(struct obdlivebus *b);
+
+/// Publish a frame. Only one process may do this
+void obdlivebus_publish(struct obdlivebus *b, struct obdlive_frame *f);
+
+/// Get the most recently published frame
+/** \return 0 on success, 1 if nothing has been published yet, -1 if we
+     kept racing the writer */
+int obdlivebus_latest(struct obdlivebus *b, struct obdlive_frame *f);
+
+/// Get the next frame after cursor
+/** If the reader has fallen more than a ring behind, frames are skipped
+ \param cursor index of the next frame wanted. Start at zero, or at
+    obdlivebus_head() to only see new frames. Updated on return
+ \return 0 on success, 1 if there's no new frame yet
+ */
+int obdlivebus_next(struct obdlivebus *b, unsigned int *cursor, struct obdlive_frame *f);
+
+/// Index the next published frame will have
+unsigned int obdlivebus_head(struct obdlivebus *b);
+
+#ifdef __cplusplus
+}
+#endif //  __cplusplus
+
+#endif // __OBDLIVEBUS_H
+
@@ -20,6 +20,10 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 
 # Live updates for obdgpslogger via google earth
 
+# This reads the logger's database, which competes with the logger
+#  writing it. If you're viewing on the same machine as the logger,
+#  obdgpslogger --http-port serves the same thing from memory.
+
 # This works in three stages:
 #  Stage 0: Present UI and options in HTML. Submitting triggers Stage 1
 #  Stage 1: Download seed KML containing options and link to stage 2
@@ -0,0 +1,248 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/** \file
+ \brief Black box: the last few minutes of samples, kept in memory
+ */
+
+#include "blackbox.h"
+#include "obdservicecommands.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int blackbox_init(struct blackbox *b, int numcols, double seconds, int samplerate,
+	int decimate, double post) {
+
+	memset(b, 0, sizeof(struct blackbox));
+	b->numcols = numcols;
+	b->decimate = (decimate>0)?decimate:1;
+	b->post = post;
+	b->fullrate = -1;
+
+	b->capacity = (int)(seconds * ((samplerate>0)?samplerate:BLACKBOX_FASTRATE)) + 1;
+	b->gpscapacity = (int)(seconds * BLACKBOX_GPSRATE) + 1;
+
+	int cols = (numcols>0)?numcols:1;
+	b->time = (double *)malloc(b->capacity * sizeof(double));
+	b->mono = (double *)malloc(b->capacity * sizeof(double));
+	b->trip = (sqlite3_int64 *)malloc(b->capacity * sizeof(sqlite3_int64));
+	b->values = (double *)malloc(b->capacity * cols * sizeof(double));
+	b->present = (unsigned char *)malloc(b->capacity * cols);
+	b->written = (unsigned char *)malloc(b->capacity);
+	b->fixes = (struct gpsfix *)malloc(b->gpscapacity * sizeof(struct gpsfix));
+	b->fixtrip = (sqlite3_int64 *)malloc(b->gpscapacity * sizeof(sqlite3_int64));
+	b->fixwritten = (unsigned char *)malloc(b->gpscapacity);
+
+	if(NULL == b->time || NULL == b->mono || NULL == b->trip ||
+		NULL == b->values || NULL == b->present || NULL == b->written ||
+		NULL == b->fixes || NULL == b->fixtrip || NULL == b->fixwritten) {
+
+		blackbox_close(b);
+		return -1;
+	}
+	return 0;
+}
+
+int blackbox_settriggers(struct blackbox *b, const char **columns, int numcolumns, const char *triggers) {
+	b->numtriggers = 0;
+	if(NULL == triggers) return 0;
+
+	char *list = strdup(triggers);
+	if(NULL == list) return 0;
+
+	char *t = strtok(list, ",");
+	while(NULL != t && b->numtriggers < BLACKBOX_MAXTRIGGERS) {
+		struct blackboxtrigger *trig = &b->triggers[b->numtriggers];
+		char *op = strpbrk(t, "<>");
+		if(NULL == op || op == t) {
+			fprintf(stderr, "Not Fatal: Couldn't parse blackbox trigger %s\n", t);
+			t = strtok(NULL, ",");
+			continue;
+		}
+
+		snprintf(trig->name, sizeof(trig->name), "%s", t);
+		char *value = op+1;
+		if('=' == *value) {
+			trig->op = ('<' == *op)?BLACKBOX_LESSEQUAL:BLACKBOX_GREATEREQUAL;
+			value++;
+		} else {
+			trig->op = ('<' == *op)?BLACKBOX_LESS:BLACKBOX_GREATER;
+		}
+		trig->value = strtod(value, NULL);
+		trig->crossed = 0;
+		*op = '\0';
+
+		int i;
+		trig->index = -1;
+		for(i=0;i<numcolumns;i++) {
+			if(0 == strcmp(columns[i], t)) trig->index = i;
+		}
+		if(0 <= trig->index) {
+			b->numtriggers++;
+		} else {
+			fprintf(stderr, "Not Fatal: Not logging %s, so it can't trigger the blackbox\n", t);
+		}
+		t = strtok(NULL, ",");
+	}
+	free(list);
+	return b->numtriggers;
+}
+
+void blackbox_trigger(struct blackbox *b, double mono, const char *reason) {
+	// Everything's already being written; this is the same event
+	if(mono < b->fullrate) {
+		b->fullrate = mono + b->post;
+		return;
+	}
+	b->fullrate = mono + b->post;
+	if(NULL == b->reason) {
+		b->reason = reason;
+	}
+}
+
+/// Set if value is past the trigger's threshold
+static int blackbox_crossed(const struct blackboxtrigger *trig, double value) {
+	switch(trig->op) {
+		case BLACKBOX_LESS: return value < trig->value;
+		case BLACKBOX_LESSEQUAL: return value <= trig->value;
+		case BLACKBOX_GREATER: return value > trig->value;
+		case BLACKBOX_GREATEREQUAL: return value >= trig->value;
+	}
+	return 0;
+}
+
+int blackbox_addsample(struct blackbox *b, double time, double mono, sqlite3_int64 trip,
+	const double *values, const unsigned char *present) {
+
+	int i;
+	for(i=0;i<b->numtriggers;i++) {
+		struct blackboxtrigger *trig = &b->triggers[i];
+		if(!present[trig->index]) continue;
+
+		int crossed = blackbox_crossed(trig, values[trig->index]);
+		if(crossed && !trig->crossed) {
+			blackbox_trigger(b, mono, trig->name);
+		}
+		trig->crossed = crossed;
+	}
+
+	// Overwrite the oldest once the ring is full
+	int slot;
+	if(b->count < b->capacity) {
+		slot = (b->first + b->count) % b->capacity;
+		b->count++;
+	} else {
+		slot = b->first;
+		b->first = (b->first + 1) % b->capacity;
+	}
+
+	b->time[slot] = time;
+	b->mono[slot] = mono;
+	b->trip[slot] = trip;
+	memcpy(b->values + slot*b->numcols, values, b->numcols * sizeof(double));
+	memcpy(b->present + slot*b->numcols, present, b->numcols);
+
+	b->written[slot] = (mono < b->fullrate || 0 == b->samples % b->decimate);
+	b->samples++;
+	return b->written[slot];
+}
+
+int blackbox_addfix(struct blackbox *b, const struct gpsfix *fix, sqlite3_int64 trip) {
+	int slot;
+	if(b->gpscount < b->gpscapacity) {
+		slot = (b->gpsfirst + b->gpscount) % b->gpscapacity;
+		b->gpscount++;
+	} else {
+		slot = b->gpsfirst;
+		b->gpsfirst = (b->gpsfirst + 1) % b->gpscapacity;
+	}
+
+	b->fixes[slot] = *fix;
+	b->fixtrip[slot] = trip;
+
+	b->fixwritten[slot] = (fix->mono < b->fullrate || 0 == b->fixcount % b->decimate);
+	b->fixcount++;
+	return b->fixwritten[slot];
+}
+
+int blackbox_position(const struct blackbox *b, double mono, struct gpsfix *fix) {
+	int i;
+	for(i=1;i<b->gpscount;i++) {
+		const struct gpsfix *before = &b->fixes[(b->gpsfirst + i - 1) % b->gpscapacity];
+		const struct gpsfix *after = &b->fixes[(b->gpsfirst + i) % b->gpscapacity];
+		if(before->mono <= mono && mono <= after->mono) {
+			if(after->mono - before->mono > GPSREADER_MAXGAP) return 0;
+			gpsreader_interpolate(fix, before, after, mono);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int blackbox_checkdtcs(struct blackbox *b, double mono, const unsigned int *retvals, int numbytes) {
+	unsigned int dtcs[BLACKBOX_MAXDTCS];
+	int numdtcs = 0;
+	int newdtcs = 0;
+
+	int i, j;
+	for(i=0; i+1<numbytes && numdtcs<BLACKBOX_MAXDTCS; i+=2) {
+		// Answers are padded out with zeroes
+		if(0 == retvals[i] && 0 == retvals[i+1]) continue;
+
+		unsigned int code = (retvals[i] << 8) | retvals[i+1];
+		dtcs[numdtcs++] = code;
+
+		int known = 0;
+		for(j=0;j<b->numdtcs;j++) {
+			if(b->dtcs[j] == code) known = 1;
+		}
+		if(!known && b->checkeddtcs) {
+			if(0 == newdtcs) {
+				char dtc[16];
+				obderrconvert_r(dtc, sizeof(dtc), retvals[i], retvals[i+1]);
+				snprintf(b->dtcreason, sizeof(b->dtcreason), "dtc %s", dtc);
+				blackbox_trigger(b, mono, b->dtcreason);
+			}
+			newdtcs++;
+		}
+	}
+
+	memcpy(b->dtcs, dtcs, numdtcs * sizeof(unsigned int));
+	b->numdtcs = numdtcs;
+	b->checkeddtcs = 1;
+	return newdtcs;
+}
+
+void blackbox_close(struct blackbox *b) {
+	if(NULL != b->time) free(b->time);
+	if(NULL != b->mono) free(b->mono);
+	if(NULL != b->trip) free(b->trip);
+	if(NULL != b->values) free(b->values);
+	if(NULL != b->present) free(b->present);
+	if(NULL != b->written) free(b->written);
+	if(NULL != b->fixes) free(b->fixes);
+	if(NULL != b->fixtrip) free(b->fixtrip);
+	if(NULL != b->fixwritten) free(b->fixwritten);
+	memset(b, 0, sizeof(struct blackbox));
+}
+
@@ -0,0 +1,158 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/** \file
+ \brief Black box: the last few minutes of samples, kept in memory
+ In blackbox mode every sample and fix goes in a preallocated ring, but
+ only every Nth is written to the database as it comes. When something
+ triggers the blackbox, the rest of what's in the ring is written, and
+ everything is written as it comes for a while afterwards. That keeps
+ full-rate data around events while writing a fraction as much the rest
+ of the time.
+ */
+
+#ifndef __BLACKBOX_H
+#define __BLACKBOX_H
+
+#include "sqlite3.h"
+#include "gpsreader.h"
+
+/// Samples per second to make room for when sampling as fast as possible
+#define BLACKBOX_FASTRATE 10
+
+/// gps fixes per second to make room for
+#define BLACKBOX_GPSRATE 10
+
+/// Most threshold triggers
+#define BLACKBOX_MAXTRIGGERS 16
+
+/// Most trouble codes remembered between checks
+#define BLACKBOX_MAXDTCS 32
+
+/// Seconds between checks for new trouble codes
+#define BLACKBOX_DTCINTERVAL 30
+
+/// Comparisons a threshold trigger can make
+enum blackboxop {
+	BLACKBOX_LESS, ///< <
+	BLACKBOX_LESSEQUAL, ///< <=
+	BLACKBOX_GREATER, ///< >
+	BLACKBOX_GREATEREQUAL ///< >=
+};
+
+/// Trigger when a column crosses a threshold
+struct blackboxtrigger {
+	char name[64]; ///< As written in the config, eg rpm>6000
+	int index; ///< Index into a sample's values
+	enum blackboxop op; ///< Comparison
+	double value; ///< Threshold
+	int crossed; ///< Set while the last value was past the threshold
+};
+
+/// The ring, and what's waiting to be written from it
+struct blackbox {
+	int numcols; ///< Values in a sample
+
+	int capacity; ///< Samples the ring holds
+	int first; ///< Oldest sample
+	int count; ///< Samples in the ring
+	double *time; ///< Wall clock time of each sample
+	double *mono; ///< Monotonic time of each sample
+	sqlite3_int64 *trip; ///< Trip of each sample
+	double *values; ///< numcols values per sample
+	unsigned char *present; ///< numcols flags per sample. Set where values holds something
+	unsigned char *written; ///< Set for samples already in the database
+
+	int gpscapacity; ///< Fixes the ring holds
+	int gpsfirst; ///< Oldest fix
+	int gpscount; ///< Fixes in the ring
+	struct gpsfix *fixes; ///< The fixes
+	sqlite3_int64 *fixtrip; ///< Trip of each fix
+	unsigned char *fixwritten; ///< Set for fixes already in the database
+
+	int decimate; ///< Write every this many samples and fixes as they come
+	long samples; ///< Samples seen
+	long fixcount; ///< Fixes seen
+
+	double post; ///< Seconds to write everything for after a trigger
+	double fullrate; ///< Monotonic time everything is written until
+	const char *reason; ///< Why it was triggered, until saved. NULL if it hasn't been
+	char dtcreason[32]; ///< reason, for a trouble code
+
+	int numtriggers; ///< Thresholds in triggers
+	struct blackboxtrigger triggers[BLACKBOX_MAXTRIGGERS]; ///< Thresholds
+
+	int checkeddtcs; ///< Set once dtcs holds the codes set at the last check
+	int numdtcs; ///< Codes in dtcs
+	unsigned int dtcs[BLACKBOX_MAXDTCS]; ///< Codes set at the last check, A<<8|B
+};
+
+/// Set up a blackbox, allocating the whole ring
+/** \param numcols values in a sample
+ \param seconds how much to keep
+ \param samplerate samples per second. <= 0 for as fast as possible
+ \param decimate write every this many samples as they come
+ \param post seconds to write everything for after a trigger
+ \return 0 on success, -1 on error */
+int blackbox_init(struct blackbox *b, int numcols, double seconds, int samplerate,
+	int decimate, double post);
+
+/// Set threshold triggers
+/** \param columns db_column of each value in a sample
+ \param triggers comma-separated list of column<op>value, where op is
+     one of <, <=, > or >=. Unknown columns are skipped
+ \return number of triggers set */
+int blackbox_settriggers(struct blackbox *b, const char **columns, int numcolumns, const char *triggers);
+
+/// Trigger the blackbox
+/** If it's already writing everything, that just goes on for longer
+ \param mono now, monotonic seconds
+ \param reason why, for the blackbox table */
+void blackbox_trigger(struct blackbox *b, double mono, const char *reason);
+
+/// Add a sample, checking it against the threshold triggers
+/** \param present one per column. Set where values holds something
+ \return 1 if the sample should be written now, 0 if it's only in the ring */
+int blackbox_addsample(struct blackbox *b, double time, double mono, sqlite3_int64 trip,
+	const double *values, const unsigned char *present);
+
+/// Add a gps fix
+/** \return 1 if the fix should be written now, 0 if it's only in the ring */
+int blackbox_addfix(struct blackbox *b, const struct gpsfix *fix, sqlite3_int64 trip);
+
+/// Get the position at a given time from the fixes in the ring
+/** Only if there are fixes either side no more than GPSREADER_MAXGAP apart
+ \param fix where to store the position
+ \return 1 if found, 0 if not */
+int blackbox_position(const struct blackbox *b, double mono, struct gpsfix *fix);
+
+/// Check trouble codes, triggering on any that weren't set last time
+/** The first check only learns what's already set
+ \param mono now, monotonic seconds
+ \param retvals bytes returned by getobderrorcodes, two per code
+ \return number of new codes */
+int blackbox_checkdtcs(struct blackbox *b, double mono, const unsigned int *retvals, int numbytes);
+
+/// Free anything blackbox_init allocated
+void blackbox_close(struct blackbox *b);
+
+#endif //__BLACKBOX_H
+
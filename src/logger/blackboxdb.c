@@ -0,0 +1,142 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/** \file
+ \brief Blackbox database stuff
+ */
+
+#include "blackboxdb.h"
+
+#include <stdio.h>
+
+#include "sqlite3.h"
+
+int createblackboxtable(sqlite3 *db) {
+	const char create_sql[] = "CREATE TABLE IF NOT EXISTS blackbox (time REAL, trip INTEGER, "
+		"reason TEXT, start REAL, obdrows INTEGER, gpsrows INTEGER)";
+
+	/// sqlite3 return status
+	int rc;
+	/// sqlite3 error message
+	char *errmsg;
+
+	if(SQLITE_OK != (rc = sqlite3_exec(db, create_sql, NULL, NULL, &errmsg))) {
+		fprintf(stderr, "sqlite error on statement %s: %s\n", create_sql, errmsg);
+		sqlite3_free(errmsg);
+		return 1;
+	}
+	return 0;
+}
+
+int saveblackbox(sqlite3 *db, struct blackbox *b, sqlite3_stmt *obdinsert,
+	sqlite3_stmt *gpsinsert, struct gpstagqueue *gpstags, double time) {
+
+	if(NULL == b->reason) return 0;
+
+	int rc;
+	int obdrows = 0;
+	int gpsrows = 0;
+	int i, j;
+
+	for(i=0;i<b->count;i++) {
+		int slot = (b->first + i) % b->capacity;
+		if(b->written[slot]) continue;
+
+		const double *values = b->values + slot*b->numcols;
+		const unsigned char *present = b->present + slot*b->numcols;
+		for(j=0;j<b->numcols;j++) {
+			if(present[j]) {
+				sqlite3_bind_double(obdinsert, j+1, values[j]);
+			} else {
+				sqlite3_bind_null(obdinsert, j+1);
+			}
+		}
+		sqlite3_bind_double(obdinsert, j+1, b->time[slot]);
+		sqlite3_bind_int64(obdinsert, j+2, b->trip[slot]);
+		sqlite3_bind_double(obdinsert, j+3, b->mono[slot]);
+
+		rc = sqlite3_step(obdinsert);
+		if(SQLITE_DONE != rc) {
+			printf("sqlite3 obd insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+			sqlite3_reset(obdinsert);
+			b->reason = NULL;
+			return -1;
+		}
+		sqlite3_reset(obdinsert);
+
+		// The gps reader only remembers the last few fixes, but the ring has more
+		struct gpsfix fix;
+		if(blackbox_position(b, b->mono[slot], &fix)) {
+			setgpstag(gpstags, sqlite3_last_insert_rowid(db), &fix);
+		} else {
+			queuegpstag(gpstags, sqlite3_last_insert_rowid(db), b->mono[slot]);
+		}
+		b->written[slot] = 1;
+		obdrows++;
+	}
+
+	for(i=0;i<b->gpscount;i++) {
+		int slot = (b->gpsfirst + i) % b->gpscapacity;
+		if(b->fixwritten[slot]) continue;
+
+		if(0 != insertgpsfix(gpsinsert, &b->fixes[slot], b->fixtrip[slot])) {
+			b->reason = NULL;
+			return -1;
+		}
+		b->fixwritten[slot] = 1;
+		gpsrows++;
+	}
+
+	const char event_sql[] = "INSERT INTO blackbox (time,trip,reason,start,obdrows,gpsrows) "
+		"VALUES (?,?,?,?,?,?)";
+	sqlite3_stmt *stmt;
+
+	rc = sqlite3_prepare_v2(db, event_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", event_sql, sqlite3_errmsg(db));
+		b->reason = NULL;
+		return -1;
+	}
+
+	sqlite3_bind_double(stmt, 1, time);
+	if(0 < b->count) {
+		sqlite3_bind_int64(stmt, 2, b->trip[(b->first + b->count - 1) % b->capacity]);
+		sqlite3_bind_double(stmt, 4, b->time[b->first]);
+	} else {
+		sqlite3_bind_null(stmt, 2);
+		sqlite3_bind_null(stmt, 4);
+	}
+	sqlite3_bind_text(stmt, 3, b->reason, -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int(stmt, 5, obdrows);
+	sqlite3_bind_int(stmt, 6, gpsrows);
+
+	rc = sqlite3_step(stmt);
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "sqlite3 blackbox insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+	}
+	sqlite3_finalize(stmt);
+
+	printf("Blackbox triggered by %s. Wrote %i obd and %i gps rows\n", b->reason, obdrows, gpsrows);
+	b->reason = NULL;
+
+	return obdrows;
+}
+
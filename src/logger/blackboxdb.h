@@ -0,0 +1,51 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/** \file
+ \brief Blackbox database stuff
+ When the blackbox is triggered, whatever's still only in the ring goes
+ into the obd and gps tables, and the blackbox table gets a row saying
+ why and how far back the ring went.
+ */
+
+#ifndef __BLACKBOXDB_H
+#define __BLACKBOXDB_H
+
+#include "sqlite3.h"
+#include "blackbox.h"
+#include "gpsdb.h"
+
+/// Create the blackbox table in the database
+int createblackboxtable(sqlite3 *db);
+
+/// Write everything in the ring that hasn't been written yet
+/** Rows go in after ones sampled later, so order by time rather than rowid.
+ Does nothing if the blackbox hasn't been triggered since the last save
+ \param obdinsert statement from createobdinsertstmt
+ \param gpsinsert statement from creategpsinsertstmt
+ \param gpstags obd rows written are queued here to be given a position
+ \param time wall clock time now
+ \return number of obd rows written, or -1 on error */
+int saveblackbox(sqlite3 *db, struct blackbox *b, sqlite3_stmt *obdinsert,
+	sqlite3_stmt *gpsinsert, struct gpstagqueue *gpstags, double time);
+
+#endif //__BLACKBOXDB_H
+
@@ -0,0 +1,109 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Sample clock statistics database stuff
+ */
+
+#include "clockdb.h"
+
+#include <stdio.h>
+
+#include "sqlite3.h"
+
+int createclocktables(sqlite3 *db) {
+	const char *create_sql[] = {
+		"CREATE TABLE IF NOT EXISTS tripclock (trip INTEGER PRIMARY KEY, period REAL, "
+			"samples INTEGER, skipped INTEGER, maxlate REAL)",
+		"CREATE TABLE IF NOT EXISTS triplateness (trip INTEGER, late REAL, samples INTEGER, "
+			"PRIMARY KEY (trip,late))"
+	};
+
+	/// sqlite3 return status
+	int rc;
+	/// sqlite3 error message
+	char *errmsg;
+
+	int i;
+	for(i=0; i<sizeof(create_sql)/sizeof(create_sql[0]); i++) {
+		if(SQLITE_OK != (rc = sqlite3_exec(db, create_sql[i], NULL, NULL, &errmsg))) {
+			fprintf(stderr, "sqlite error on statement %s: %s\n", create_sql[i], errmsg);
+			sqlite3_free(errmsg);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int saveclockstats(sqlite3 *db, sqlite3_int64 trip, const struct sampleclock *c) {
+	char clock_sql[] = "INSERT OR REPLACE INTO tripclock (trip,period,samples,skipped,maxlate) "
+		"VALUES (?,?,?,?,?)";
+	char late_sql[] = "INSERT OR REPLACE INTO triplateness (trip,late,samples) VALUES (?,?,?)";
+	sqlite3_stmt *stmt;
+	int rc;
+	int retvalue = 0;
+
+	rc = sqlite3_prepare_v2(db, clock_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", clock_sql, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	sqlite3_bind_int64(stmt, 1, trip);
+	sqlite3_bind_double(stmt, 2, (double)c->period/1000000.0);
+	sqlite3_bind_int64(stmt, 3, c->samples);
+	sqlite3_bind_int64(stmt, 4, c->skipped);
+	sqlite3_bind_double(stmt, 5, (double)c->maxlate/1000000.0);
+
+	rc = sqlite3_step(stmt);
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "sqlite3 tripclock insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+		retvalue = -1;
+	}
+	sqlite3_finalize(stmt);
+
+	rc = sqlite3_prepare_v2(db, late_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", late_sql, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	// Each bucket is keyed on its lower edge, in seconds
+	int i;
+	for(i=0; i<SAMPLECLOCK_LATEBUCKETS; i++) {
+		if(0 == c->lateness[i]) continue;
+
+		sqlite3_bind_int64(stmt, 1, trip);
+		sqlite3_bind_double(stmt, 2, (double)sampleclock_bucketedge(i)/1000000.0);
+		sqlite3_bind_int64(stmt, 3, c->lateness[i]);
+
+		rc = sqlite3_step(stmt);
+		if(SQLITE_DONE != rc) {
+			fprintf(stderr, "sqlite3 triplateness insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+			retvalue = -1;
+			break;
+		}
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	return retvalue;
+}
+
@@ -0,0 +1,41 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Sample clock statistics database stuff
+ */
+
+#ifndef __CLOCKDB_H
+#define __CLOCKDB_H
+
+#include "sqlite3.h"
+#include "sampleclock.h"
+
+/// Create the tripclock and triplateness tables in the database
+int createclocktables(sqlite3 *db);
+
+/// Save a trip's sample clock statistics, replacing any already saved
+/** \param trip the trip the stats were collected during
+ \param c the clock; its stats should cover the whole trip so far
+ \return 0 on success, -1 on error */
+int saveclockstats(sqlite3 *db, sqlite3_int64 trip, const struct sampleclock *c);
+
+#endif //__CLOCKDB_H
+
@@ -53,4 +53,36 @@ void closedb(sqlite3 *db) {
 	sqlite3_close(db);
 }
 
+int addcolumnifmissing(sqlite3 *db, const char *table, const char *column, const char *decl) {
+	char sql[512];
+	sqlite3_stmt *pragma_stmt;
+	int rc;
+
+	snprintf(sql, sizeof(sql), "PRAGMA table_info(%s)", table);
+	rc = sqlite3_prepare_v2(db, sql, -1, &pragma_stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", sql, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	int found = 0;
+	while(SQLITE_ROW == sqlite3_step(pragma_stmt)) {
+		const char *name = (const char *)sqlite3_column_text(pragma_stmt, 1);
+		if(NULL != name && 0 == strcmp(name, column)) found = 1;
+	}
+	sqlite3_finalize(pragma_stmt);
+
+	if(found) return 0;
+
+	char *errmsg;
+	snprintf(sql, sizeof(sql), "ALTER TABLE %s ADD %s %s", table, column, decl);
+	if(SQLITE_OK != (rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg))) {
+		fprintf(stderr, "Unable to add column %s to %s (%i): %s\n", column, table, rc, errmsg);
+		sqlite3_free(errmsg);
+		return -1;
+	}
+	printf("Added column %s to %s\n", column, table);
+	return 0;
+}
+
 
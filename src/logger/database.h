@@ -35,6 +35,12 @@ sqlite3 *opendb(const char *dbfilename);
 /// Close the sqlite database
 void closedb(sqlite3 *db);
 
+/// Add a column to a table, if it doesn't already have it
+/** For tables that gained columns after older logs were written
+ \param decl the column's type and any constraints, eg "REAL"
+ \return 0 if the column is there now, -1 on error */
+int addcolumnifmissing(sqlite3 *db, const char *table, const char *column, const char *decl);
+
 
 #endif //__DATABASE_H
 
@@ -0,0 +1,91 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Decide which sampled values are worth logging
+ */
+
+#include "deadband.h"
+
+#include <stdlib.h>
+
+/// Absolute value, without needing libm
+#define DEADBAND_ABS(x) ((x)<0?-(x):(x))
+
+int deadband_init(struct deadband *d, int numcols, double heartbeat) {
+	d->numcols = numcols;
+	d->heartbeat = heartbeat;
+	d->cols = (struct deadbandcolumn *)calloc(numcols>0?numcols:1, sizeof(struct deadbandcolumn));
+	if(NULL == d->cols) {
+		d->numcols = 0;
+		return -1;
+	}
+	return 0;
+}
+
+void deadband_setcolumn(struct deadband *d, int col, double absolute, double relative) {
+	if(col < 0 || col >= d->numcols) return;
+	d->cols[col].absolute = absolute;
+	d->cols[col].relative = relative;
+}
+
+int deadband_filter(struct deadband *d, const double *values, unsigned char *write, double mono) {
+	int i;
+	int count = 0;
+
+	for(i=0;i<d->numcols;i++) {
+		struct deadbandcolumn *c = &d->cols[i];
+		if(!write[i]) continue;
+
+		// Always against the last value written, so slow drift still shows up
+		if(c->written) {
+			double change = DEADBAND_ABS(values[i] - c->last);
+			double band = c->absolute;
+			if(c->relative * DEADBAND_ABS(c->last) > band) band = c->relative * DEADBAND_ABS(c->last);
+
+			int moved = (change > band);
+			int stale = (d->heartbeat > 0 && mono - c->lastmono >= d->heartbeat);
+			if(!moved && !stale) {
+				write[i] = 0;
+				continue;
+			}
+		}
+
+		c->written = 1;
+		c->last = values[i];
+		c->lastmono = mono;
+		count++;
+	}
+	return count;
+}
+
+void deadband_reset(struct deadband *d) {
+	int i;
+	for(i=0;i<d->numcols;i++) {
+		d->cols[i].written = 0;
+	}
+}
+
+void deadband_close(struct deadband *d) {
+	free(d->cols);
+	d->cols = NULL;
+	d->numcols = 0;
+}
+
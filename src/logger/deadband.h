@@ -0,0 +1,70 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Decide which sampled values are worth logging
+ With compression on, a value is only written when it has moved past
+ its column's deadband since the last value written, or when nothing
+ has been written for that column in a while. Everything else is NULL.
+ */
+
+#ifndef __DEADBAND_H
+#define __DEADBAND_H
+
+/// One column's deadband and what was last written for it
+struct deadbandcolumn {
+	double absolute; ///< Smallest change that counts, in the column's units
+	double relative; ///< Smallest change that counts, as a fraction of the last value
+	int written; ///< Set once a value has been written
+	double last; ///< Last value written
+	double lastmono; ///< When it was written, monotonic seconds
+};
+
+/// Deadbands for every column in a row
+struct deadband {
+	int numcols; ///< Columns in cols
+	double heartbeat; ///< Seconds after which a value is written regardless. <= 0 for never
+	struct deadbandcolumn *cols; ///< Per-column state
+};
+
+/// Set up deadbands for a row. Every column starts out logging any change
+/** \return 0 on success, -1 on error */
+int deadband_init(struct deadband *d, int numcols, double heartbeat);
+
+/// Set one column's deadband
+void deadband_setcolumn(struct deadband *d, int col, double absolute, double relative);
+
+/// Decide which values in a row get written
+/** \param values one per column
+ \param write one per column. Set where values holds something; cleared
+     on return where it isn't worth writing
+ \param mono when the row was sampled, monotonic seconds
+ \return number of columns still to be written */
+int deadband_filter(struct deadband *d, const double *values, unsigned char *write, double mono);
+
+/// Forget what was written, so every column is written next time
+/** Call at the start of each trip, so every trip stands on its own */
+void deadband_reset(struct deadband *d);
+
+/// Free anything deadband_init allocated
+void deadband_close(struct deadband *d);
+
+#endif //__DEADBAND_H
+
@@ -0,0 +1,80 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Deadband settings database stuff
+ */
+
+#include "deadbanddb.h"
+
+#include <stdio.h>
+
+#include "sqlite3.h"
+
+int createdeadbandtable(sqlite3 *db) {
+	const char create_sql[] = "CREATE TABLE IF NOT EXISTS deadband (column TEXT PRIMARY KEY, "
+		"absolute REAL, relative REAL, heartbeat REAL)";
+
+	/// sqlite3 return status
+	int rc;
+	/// sqlite3 error message
+	char *errmsg;
+
+	if(SQLITE_OK != (rc = sqlite3_exec(db, create_sql, NULL, NULL, &errmsg))) {
+		fprintf(stderr, "sqlite error on statement %s: %s\n", create_sql, errmsg);
+		sqlite3_free(errmsg);
+		return 1;
+	}
+	return 0;
+}
+
+int savedeadbands(sqlite3 *db, const struct deadband *d, const char **columns) {
+	char deadband_sql[] = "INSERT OR REPLACE INTO deadband (column,absolute,relative,heartbeat) "
+		"VALUES (?,?,?,?)";
+	sqlite3_stmt *stmt;
+	int rc;
+	int retvalue = 0;
+
+	rc = sqlite3_prepare_v2(db, deadband_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", deadband_sql, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	int i;
+	for(i=0; i<d->numcols; i++) {
+		sqlite3_bind_text(stmt, 1, columns[i], -1, SQLITE_STATIC);
+		sqlite3_bind_double(stmt, 2, d->cols[i].absolute);
+		sqlite3_bind_double(stmt, 3, d->cols[i].relative);
+		sqlite3_bind_double(stmt, 4, d->heartbeat);
+
+		rc = sqlite3_step(stmt);
+		if(SQLITE_DONE != rc) {
+			fprintf(stderr, "sqlite3 deadband insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+			retvalue = -1;
+			break;
+		}
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	return retvalue;
+}
+
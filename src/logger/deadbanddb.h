@@ -0,0 +1,43 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Deadband settings database stuff
+ A log written with compression on has a row here for each obd column,
+ so readers know NULL means "hadn't moved" and how long a value can be
+ held for.
+ */
+
+#ifndef __DEADBANDDB_H
+#define __DEADBANDDB_H
+
+#include "sqlite3.h"
+#include "deadband.h"
+
+/// Create the deadband table in the database
+int createdeadbandtable(sqlite3 *db);
+
+/// Save the deadbands in use, replacing any already saved
+/** \param columns db_column name of each of d's columns
+ \return 0 on success, -1 on error */
+int savedeadbands(sqlite3 *db, const struct deadband *d, const char **columns);
+
+#endif //__DEADBANDDB_H
+
@@ -0,0 +1,325 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Collecting modes 06, 09 and 22
+ */
+
+#include "extmodes.h"
+#include "extmodesdb.h"
+#include "ecudb.h"
+#include "obdserial.h"
+#include "obddecode.h"
+#include "obdextmodes.h"
+#include "obdservicecommands.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "sqlite3.h"
+
+/// Most mode 06 tests we'll take from one response
+#define OBDEXT_MAXTESTS 32
+
+/// Most items we'll take from one mode 09 response
+#define OBDEXT_MAXITEMS 16
+
+/// Most frames we'll take from one response
+#define OBDEXT_MAXFRAMES 32
+
+/// One request the background task cycles through
+struct obdextrequest {
+	unsigned int mode; ///< 0x06 or 0x22
+	unsigned int pid; ///< MID for mode 06, PID for mode 22
+	const struct obddecode *dec; ///< How to decode a mode 22 value
+};
+
+struct obdextmodes {
+	sqlite3 *db; ///< Database we log to
+	sqlite3_stmt *ecuinfoinsert; ///< Insert into ecuinfo
+	sqlite3_stmt *obdtestinsert; ///< Insert into obdtest
+	sqlite3_stmt *obdextinsert; ///< Insert into obdext
+
+	sqlite3_int64 ecuid; ///< ecuid results are currently stored against
+
+	struct obdextrequest *requests; ///< Everything the background task asks for
+	int numrequests; ///< Number of requests
+	int nextrequest; ///< Next one to make
+
+	double interval; ///< Minimum time between background requests
+	double lastrequest; ///< When the last background request was made
+	double cost; ///< Moving average of how long a request takes, seconds
+};
+
+/// Current time, seconds
+static double obdextnow() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec/1000000.0;
+}
+
+/// Add a request to the background list
+static void obdextaddrequest(struct obdextmodes *x, unsigned int mode, unsigned int pid,
+	const struct obddecode *dec) {
+
+	struct obdextrequest *r = (struct obdextrequest *)realloc(x->requests,
+		(x->numrequests+1) * sizeof(struct obdextrequest));
+	if(NULL == r) return;
+	x->requests = r;
+	x->requests[x->numrequests].mode = mode;
+	x->requests[x->numrequests].pid = pid;
+	x->requests[x->numrequests].dec = dec;
+	x->numrequests++;
+}
+
+/// Ask the car which mode 06 MIDs it supports, and queue them
+static void obdextprobemodesix(struct obdextmodes *x, int fd) {
+	unsigned int base;
+	for(base=0x00; base<=0xE0; base+=0x20) {
+		unsigned int bytes[OBDFRAME_MAXBYTES];
+		int numbytes;
+		if(OBD_SUCCESS != getobdframes(fd, 0x06, base, bytes, sizeof(bytes)/sizeof(bytes[0]),
+			&numbytes, NULL, 0, NULL, 1) || numbytes < 4) {
+			break;
+		}
+
+		unsigned int mid;
+		for(mid=base+1; mid<base+0x20; mid++) {
+			if(obdPidInSupported(base, bytes, mid)) {
+				obdextaddrequest(x, 0x06, mid, NULL);
+			}
+		}
+
+		// The last bit says whether the next range is worth asking about
+		if(!obdPidInSupported(base, bytes, base+0x20)) break;
+	}
+}
+
+struct obdextmodes *obdextmodes_create(int fd, sqlite3 *db, double interval) {
+	if(0 != createextmodestables(db)) return NULL;
+
+	struct obdextmodes *x = (struct obdextmodes *)malloc(sizeof(struct obdextmodes));
+	if(NULL == x) return NULL;
+	memset(x, 0, sizeof(struct obdextmodes));
+
+	x->db = db;
+	x->ecuid = -1;
+	x->interval = interval;
+	x->cost = 0.1;
+
+	if(0 == createecuinfoinsertstmt(db, &x->ecuinfoinsert) ||
+		0 == createobdtestinsertstmt(db, &x->obdtestinsert) ||
+		0 == createobdextinsertstmt(db, &x->obdextinsert)) {
+		obdextmodes_free(x);
+		return NULL;
+	}
+
+	if(0 < interval && -1 < fd) {
+		obdextprobemodesix(x, fd);
+
+		const struct obddecode *d;
+		int i;
+		for(i=0; NULL != (d = obdDecodeLoadedForMode(0x22, i)); i++) {
+			obdextaddrequest(x, 0x22, d->cmdid, d);
+		}
+
+		if(0 < x->numrequests) {
+			printf("Polling %i mode 06 and 22 items in the background\n", x->numrequests);
+		}
+	}
+
+	return x;
+}
+
+void obdextmodes_free(struct obdextmodes *x) {
+	if(NULL == x) return;
+	if(NULL != x->ecuinfoinsert) sqlite3_finalize(x->ecuinfoinsert);
+	if(NULL != x->obdtestinsert) sqlite3_finalize(x->obdtestinsert);
+	if(NULL != x->obdextinsert) sqlite3_finalize(x->obdextinsert);
+	free(x->requests);
+	free(x);
+}
+
+/// Read one mode 09 pid into items
+static int obdextreadmodenine(int fd, unsigned int pid, char (*items)[OBDEXT_MAXSTRING]) {
+	unsigned int bytes[OBDFRAME_MAXBYTES];
+	int numbytes;
+	int framelen[OBDEXT_MAXFRAMES];
+	int numframes;
+
+	if(OBD_SUCCESS != getobdframes(fd, 0x09, pid, bytes, sizeof(bytes)/sizeof(bytes[0]),
+		&numbytes, framelen, OBDEXT_MAXFRAMES, &numframes, 1)) {
+		return 0;
+	}
+	return obdModeNineItems(pid, bytes, framelen, numframes, items, OBDEXT_MAXITEMS);
+}
+
+sqlite3_int64 obdextmodes_vehicleinfo(struct obdextmodes *x, int fd,
+	sqlite3_int64 trip, double time) {
+
+	char vin[OBDEXT_MAXITEMS][OBDEXT_MAXSTRING];
+	char ecuname[OBDEXT_MAXITEMS][OBDEXT_MAXSTRING];
+	int numvins = 0;
+	int numecunames = 0;
+
+	unsigned int supported[OBDFRAME_MAXBYTES];
+	int numsupported = 0;
+	if(OBD_SUCCESS != getobdframes(fd, 0x09, 0x00, supported, sizeof(supported)/sizeof(supported[0]),
+		&numsupported, NULL, 0, NULL, 1)) {
+		numsupported = 0;
+	}
+
+	if(4 <= numsupported) {
+		if(obdPidInSupported(0x00, supported, 0x02)) numvins = obdextreadmodenine(fd, 0x02, vin);
+		if(obdPidInSupported(0x00, supported, 0x0A)) numecunames = obdextreadmodenine(fd, 0x0A, ecuname);
+	}
+
+	x->ecuid = createecu(x->db, (0 < numvins)?vin[0]:NULL, 0, (0 < numecunames)?ecuname[0]:NULL);
+	if(0 < numvins) {
+		printf("Vehicle %s is ecu %i\n", vin[0], (int)x->ecuid);
+	}
+
+	if(4 > numsupported) return x->ecuid;
+
+	// Everything else we know how to read
+	int i;
+	for(i=0; i<sizeof(obdcmds_mode9)/sizeof(obdcmds_mode9[0]); i++) {
+		struct obdservicecmd *cmd = &obdcmds_mode9[i];
+		if(NULL == cmd->db_column || !obdPidInSupported(0x00, supported, cmd->cmdid)) continue;
+
+		char other[OBDEXT_MAXITEMS][OBDEXT_MAXSTRING];
+		char (*items)[OBDEXT_MAXSTRING] = other;
+		int numitems;
+		if(0x02 == cmd->cmdid) {
+			items = vin;
+			numitems = numvins;
+		} else if(0x0A == cmd->cmdid) {
+			items = ecuname;
+			numitems = numecunames;
+		} else {
+			numitems = obdextreadmodenine(fd, cmd->cmdid, other);
+		}
+
+		int j;
+		for(j=0; j<numitems; j++) {
+			sqlite3_bind_int64(x->ecuinfoinsert, 1, x->ecuid);
+			sqlite3_bind_int64(x->ecuinfoinsert, 2, trip);
+			sqlite3_bind_double(x->ecuinfoinsert, 3, time);
+			sqlite3_bind_int(x->ecuinfoinsert, 4, cmd->cmdid);
+			sqlite3_bind_text(x->ecuinfoinsert, 5, cmd->db_column, -1, SQLITE_STATIC);
+			sqlite3_bind_int(x->ecuinfoinsert, 6, j);
+			sqlite3_bind_text(x->ecuinfoinsert, 7, items[j], -1, SQLITE_TRANSIENT);
+
+			int rc = sqlite3_step(x->ecuinfoinsert);
+			if(SQLITE_DONE != rc) {
+				printf("sqlite3 ecuinfo insert failed(%i): %s\n", rc, sqlite3_errmsg(x->db));
+			}
+			sqlite3_reset(x->ecuinfoinsert);
+		}
+	}
+
+	return x->ecuid;
+}
+
+/// Make one mode 06 request and store the results
+static void obdextmodesix(struct obdextmodes *x, int fd, unsigned int mid,
+	sqlite3_int64 trip, double time) {
+
+	unsigned int bytes[OBDFRAME_MAXBYTES];
+	int numbytes;
+	if(OBD_SUCCESS != getobdframes(fd, 0x06, mid, bytes, sizeof(bytes)/sizeof(bytes[0]),
+		&numbytes, NULL, 0, NULL, 1)) {
+		return;
+	}
+
+	struct obdmodesixtest tests[OBDEXT_MAXTESTS];
+	int numtests = obdModeSixTests(mid, bytes, numbytes, tests, OBDEXT_MAXTESTS);
+
+	int i;
+	for(i=0; i<numtests; i++) {
+		sqlite3_bind_int64(x->obdtestinsert, 1, x->ecuid);
+		sqlite3_bind_int64(x->obdtestinsert, 2, trip);
+		sqlite3_bind_double(x->obdtestinsert, 3, time);
+		sqlite3_bind_int(x->obdtestinsert, 4, tests[i].mid);
+		sqlite3_bind_int(x->obdtestinsert, 5, tests[i].tid);
+		sqlite3_bind_int(x->obdtestinsert, 6, tests[i].uasid);
+		sqlite3_bind_int64(x->obdtestinsert, 7, tests[i].value);
+		sqlite3_bind_int64(x->obdtestinsert, 8, tests[i].min);
+		sqlite3_bind_int64(x->obdtestinsert, 9, tests[i].max);
+		sqlite3_bind_int(x->obdtestinsert, 10, tests[i].passed);
+
+		int rc = sqlite3_step(x->obdtestinsert);
+		if(SQLITE_DONE != rc) {
+			printf("sqlite3 obdtest insert failed(%i): %s\n", rc, sqlite3_errmsg(x->db));
+		}
+		sqlite3_reset(x->obdtestinsert);
+	}
+}
+
+/// Make one mode 22 request and store the value
+static void obdextmodetwentytwo(struct obdextmodes *x, int fd, const struct obdextrequest *r,
+	sqlite3_int64 trip, double time) {
+
+	unsigned int bytes[OBDFRAME_MAXBYTES];
+	int numbytes;
+	if(OBD_SUCCESS != getobdframes(fd, 0x22, r->pid, bytes, sizeof(bytes)/sizeof(bytes[0]),
+		&numbytes, NULL, 0, NULL, 1) || numbytes < r->dec->first + r->dec->nbytes) {
+		return;
+	}
+
+	sqlite3_bind_int64(x->obdextinsert, 1, x->ecuid);
+	sqlite3_bind_int64(x->obdextinsert, 2, trip);
+	sqlite3_bind_double(x->obdextinsert, 3, time);
+	sqlite3_bind_int(x->obdextinsert, 4, r->mode);
+	sqlite3_bind_int(x->obdextinsert, 5, r->pid);
+	sqlite3_bind_double(x->obdextinsert, 6, obdDecodeValue(r->dec, bytes));
+
+	int rc = sqlite3_step(x->obdextinsert);
+	if(SQLITE_DONE != rc) {
+		printf("sqlite3 obdext insert failed(%i): %s\n", rc, sqlite3_errmsg(x->db));
+	}
+	sqlite3_reset(x->obdextinsert);
+}
+
+int obdextmodes_background(struct obdextmodes *x, int fd,
+	sqlite3_int64 trip, double now, double deadline) {
+
+	if(NULL == x || 0 >= x->interval || 0 == x->numrequests || -1 >= fd) return 0;
+
+	if(now - x->lastrequest < x->interval) return 0;
+
+	// Only if a typical request would finish before the next sample is due
+	if(0 < deadline && deadline - now < x->cost) return 0;
+
+	const struct obdextrequest *r = &x->requests[x->nextrequest];
+	x->nextrequest = (x->nextrequest + 1) % x->numrequests;
+
+	if(0x06 == r->mode) {
+		obdextmodesix(x, fd, r->pid, trip, now);
+	} else {
+		obdextmodetwentytwo(x, fd, r, trip, now);
+	}
+
+	double end = obdextnow();
+	x->cost = 0.8 * x->cost + 0.2 * (end - now);
+	x->lastrequest = end;
+	return 1;
+}
+
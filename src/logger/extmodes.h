@@ -0,0 +1,67 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Collecting modes 06, 09 and 22
+ Mode 09 vehicle info is read once at the start of each trip. Mode 06
+  test results and mode 22 manufacturer PIDs are read one request at a
+  time in the slack between mode 01 samples, so they never push the
+  main loop past its deadline.
+ */
+
+#ifndef __EXTMODES_H
+#define __EXTMODES_H
+
+#include "sqlite3.h"
+
+/// Default seconds between background requests
+#define OBDEXT_DEFAULTINTERVAL 1.0
+
+/// Opaque state for the extra modes
+struct obdextmodes;
+
+/// Set up collection of the extra modes
+/** Creates the tables, and asks the car which mode 06 monitors it
+     has. Mode 22 PIDs are any loaded into the decode tables with
+     obdDecodeLoadFile
+ \param fd the serial port opened with openserial
+ \param db the database to log to
+ \param interval minimum seconds between background requests. <= 0 disables them
+ \return the state, or NULL on failure */
+struct obdextmodes *obdextmodes_create(int fd, sqlite3 *db, double interval);
+
+/// Free the state
+void obdextmodes_free(struct obdextmodes *x);
+
+/// Read mode 09 vehicle info at the start of a trip
+/** Finds or creates the ecu for this VIN, and stores everything else
+     the car reports in the ecuinfo table
+ \return the ecuid that further results are stored against */
+sqlite3_int64 obdextmodes_vehicleinfo(struct obdextmodes *x, int fd,
+	sqlite3_int64 trip, double time);
+
+/// Make at most one background request, if there's time
+/** \param now the current time
+ \param deadline when the next mode 01 sample is due. <= 0 means
+    there's no deadline, and the interval alone is used
+ \return 1 if a request was made, 0 otherwise */
+int obdextmodes_background(struct obdextmodes *x, int fd,
+	sqlite3_int64 trip, double now, double deadline);
+
+#endif //__EXTMODES_H
+
@@ -0,0 +1,96 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Database stuff for modes 06, 09 and 22
+ */
+
+#include "extmodesdb.h"
+
+#include <stdio.h>
+
+#include "sqlite3.h"
+
+int createextmodestables(sqlite3 *db) {
+	const char *create_sql[] = {
+		"CREATE TABLE IF NOT EXISTS ecuinfo (ecu INTEGER, trip INTEGER, time REAL, "
+			"pid INTEGER, name TEXT, item INTEGER, value TEXT)",
+		"CREATE TABLE IF NOT EXISTS obdtest (ecu INTEGER, trip INTEGER, time REAL, "
+			"mid INTEGER, tid INTEGER, uasid INTEGER, value INTEGER, min INTEGER, max INTEGER, passed INTEGER)",
+		"CREATE TABLE IF NOT EXISTS obdext (ecu INTEGER, trip INTEGER, time REAL, "
+			"mode INTEGER, pid INTEGER, value REAL)"
+	};
+	const char *create_idx_sql[] = {
+		"CREATE INDEX IF NOT EXISTS IDX_ECUINFOECU ON ecuinfo (ecu)",
+		"CREATE INDEX IF NOT EXISTS IDX_OBDTESTECU ON obdtest (ecu,mid)",
+		"CREATE INDEX IF NOT EXISTS IDX_OBDEXTTIME ON obdext (time)"
+	};
+
+	/// sqlite3 return status
+	int rc;
+	/// sqlite3 error message
+	char *errmsg;
+
+	int i;
+	for(i=0; i<sizeof(create_sql)/sizeof(create_sql[0]); i++) {
+		if(SQLITE_OK != (rc = sqlite3_exec(db, create_sql[i], NULL, NULL, &errmsg))) {
+			fprintf(stderr, "sqlite error on statement %s: %s\n", create_sql[i], errmsg);
+			sqlite3_free(errmsg);
+			return 1;
+		}
+	}
+
+	for(i=0; i<sizeof(create_idx_sql)/sizeof(create_idx_sql[0]); i++) {
+		if(SQLITE_OK != (rc = sqlite3_exec(db, create_idx_sql[i], NULL, NULL, &errmsg))) {
+			fprintf(stderr, "Not Fatal: sqlite error creating index %s: %s\n", create_idx_sql[i], errmsg);
+			sqlite3_free(errmsg);
+		}
+	}
+
+	return 0;
+}
+
+/// Prepare one of the inserts
+static int createextinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt, const char *insert_sql, int numcols) {
+	int rc;
+	const char *zTail;
+
+	rc = sqlite3_prepare_v2(db,insert_sql,-1,ret_stmt,&zTail);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", insert_sql, sqlite3_errmsg(db));
+		return 0;
+	}
+
+	return numcols;
+}
+
+int createecuinfoinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt) {
+	return createextinsertstmt(db, ret_stmt,
+		"INSERT INTO ecuinfo (ecu,trip,time,pid,name,item,value) VALUES (?,?,?,?,?,?,?)", 7);
+}
+
+int createobdtestinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt) {
+	return createextinsertstmt(db, ret_stmt,
+		"INSERT INTO obdtest (ecu,trip,time,mid,tid,uasid,value,min,max,passed) VALUES (?,?,?,?,?,?,?,?,?,?)", 10);
+}
+
+int createobdextinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt) {
+	return createextinsertstmt(db, ret_stmt,
+		"INSERT INTO obdext (ecu,trip,time,mode,pid,value) VALUES (?,?,?,?,?,?)", 6);
+}
+
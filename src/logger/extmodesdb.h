@@ -0,0 +1,51 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Database stuff for modes 06, 09 and 22
+ */
+
+#ifndef __EXTMODESDB_H
+#define __EXTMODESDB_H
+
+#include "sqlite3.h"
+
+/// Create the ecuinfo, obdtest and obdext tables in the database
+/** ecuinfo holds mode 09 vehicle info, obdtest holds mode 06 test
+     results, and obdext holds mode 22 values. All are keyed by the
+     ecuid from the ecu table
+ \return 0 on success, 1 on failure */
+int createextmodestables(sqlite3 *db);
+
+/// Prepare the insert statement for the ecuinfo table
+/** Columns are ecu, trip, time, pid, name, item, value
+ \return number of columns in the insert statement, or zero on fail */
+int createecuinfoinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt);
+
+/// Prepare the insert statement for the obdtest table
+/** Columns are ecu, trip, time, mid, tid, uasid, value, min, max, passed
+ \return number of columns in the insert statement, or zero on fail */
+int createobdtestinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt);
+
+/// Prepare the insert statement for the obdext table
+/** Columns are ecu, trip, time, mode, pid, value
+ \return number of columns in the insert statement, or zero on fail */
+int createobdextinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt);
+
+#endif //__EXTMODESDB_H
+
@@ -23,6 +23,14 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifdef HAVE_GPSD
 
+#include "gpscomm.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/select.h>
 #include <gps.h>
 
 struct gps_data_t *opengps(char *server, char *port) {
@@ -43,55 +51,102 @@ void closegps(struct gps_data_t *g) {
 	gps_close(g);
 }
 
-int getgpsposition(struct gps_data_t *g, double *lat, double *lon, double *alt, double *speed, double *course, double *gpstime) {
+/// Handle for gpssource_gpsd
+struct gpsdsource {
+	struct gps_data_t *g; ///< The connection
+	double lastfix; ///< gpstime of the last fix handed out
+};
+
+/// Open gpsd. Address is host:port
+static void *gpsd_open(const char *address) {
+	char server[256];
+	char *port = "2947";
+	strncpy(server, address, sizeof(server)-1);
+	server[sizeof(server)-1] = '\0';
+	char *colon = strrchr(server, ':');
+	if(NULL != colon) {
+		*colon = '\0';
+		port = colon+1;
+	}
+
+	struct gpsdsource *s = (struct gpsdsource *)malloc(sizeof(struct gpsdsource));
+	if(NULL == s) return NULL;
+	s->lastfix = 0;
+	s->g = opengps(server, port);
+	if(NULL == s->g) {
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+static int gpsd_read(void *h, struct gpsfix *fix, long timeout) {
+	struct gpsdsource *s = (struct gpsdsource *)h;
+	struct gps_data_t *g = s->g;
+
+#ifdef HAVE_GPSD_V3
 	fd_set fds;
 	FD_ZERO(&fds);
 	FD_SET(g->gps_fd, &fds);
-	struct timeval timeout;
-	timeout.tv_sec = 0;
-	timeout.tv_usec = 1;
-
-	int timesround = 0;
-	int count;
-	do {
-		timesround++;
-		count = select(g->gps_fd + 1, &fds, NULL, NULL, &timeout);
-		if(count > 0) {
-#ifdef HAVE_GPSD_V3
-			gps_poll(g);
-#else
-			gps_query(g, "o");
-#endif //HAVE_GPSD_V3
-		}
-	} while (count > 0);
-
-	// if(timesround > 1) {
-	//	printf("Times around gpsd loop: %i\n", timesround);
-	// }
+	struct timeval selecttime;
+	selecttime.tv_sec = timeout / 1000000l;
+	selecttime.tv_usec = timeout % 1000000l;
 
-	if(g->fix.mode < MODE_2D) {
+	int count = select(g->gps_fd + 1, &fds, NULL, NULL, &selecttime);
+	if(count < 0) {
+		return EINTR == errno?0:-1;
+	}
+	if(0 == count) {
+		return 0;
+	}
+	if(0 > gps_poll(g)) {
+		return -1;
+	}
+#else
+	// Old gpsd only answers when asked. Don't ask faster than it can fix
+	if(0 != gps_query(g, "o")) {
 		return -1;
 	}
-	if(g->fix.mode == MODE_2D) {
-		*lat = g->fix.latitude;
-		*lon = g->fix.longitude;
-		*course = g->fix.track;
-		*speed = g->fix.speed;
-		*gpstime = g->fix.time;
+	if(g->fix.mode < MODE_2D || g->fix.time == s->lastfix) {
+		struct timeval selecttime;
+		selecttime.tv_sec = timeout / 1000000l;
+		selecttime.tv_usec = timeout % 1000000l;
+		select(0, NULL, NULL, NULL, &selecttime);
+	}
+#endif //HAVE_GPSD_V3
+
+	if(g->fix.mode < MODE_2D || g->fix.time == s->lastfix) {
 		return 0;
 	}
+	s->lastfix = g->fix.time;
+
+	fix->lat = g->fix.latitude;
+	fix->lon = g->fix.longitude;
+	fix->course = g->fix.track;
+	fix->speed = g->fix.speed;
+	fix->gpstime = g->fix.time;
 	if(g->fix.mode == MODE_3D) {
-		*lat = g->fix.latitude;
-		*lon = g->fix.longitude;
-		*alt = g->fix.altitude;
-		*course = g->fix.track;
-		*speed = g->fix.speed;
-		*gpstime = g->fix.time;
-		return 1;
+		fix->alt = g->fix.altitude;
+		fix->status = 1;
+	} else {
+		fix->alt = 0;
+		fix->status = 0;
 	}
-	// Shouldn't be able to get to here...
-	return -1;
+	return 1;
 }
 
+static void gpsd_close(void *h) {
+	struct gpsdsource *s = (struct gpsdsource *)h;
+	closegps(s->g);
+	free(s);
+}
+
+const struct gpssource gpssource_gpsd = {
+	"gpsd",
+	gpsd_open,
+	gpsd_read,
+	gpsd_close
+};
+
 #endif //HAVE_GPSD
 
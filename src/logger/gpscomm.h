@@ -26,6 +26,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #define __GPSCOMM_H
 
 #include <gps.h>
+#include "gpsreader.h"
 
 /// Open the gps
 /** \param server server running gpsd
@@ -37,17 +38,9 @@ struct gps_data_t *opengps(char *server, char *port);
 /// Close the gps
 void closegps(struct gps_data_t *g);
 
-/// Get the current position
-/** \param g the gps_data_t returned from opengps
- \param lat pointer to where you want the latitude stored
- \param lon pointer to where you want the longitude stored
- \param alt pointer to where you want the altitude stored
- \param course pointer to where you want the course stored
- \param speed pointer to where you want the speed stored
- \param gpstime pointer to where you want the gpstime stored
- \return -1 for no workable co-ordinates, 0 for lat,lon, and 1 for lat,lon,alt
- */
-int getgpsposition(struct gps_data_t *g, double *lat, double *lon, double *alt, double *speed, double *course, double *gpstime);
+/// Fixes from gpsd
+/** Address is host:port */
+extern const struct gpssource gpssource_gpsd;
 
 
 #endif //__GPSCOMM_H
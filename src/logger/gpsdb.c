@@ -22,13 +22,15 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
  */
 
 #include "gpsdb.h"
+#include "database.h"
+#include "gpsreader.h"
 
 #include <stdio.h>
 
 #include "sqlite3.h"
 
 int creategpstable(sqlite3 *db) {
-	char create_sql[] = "CREATE TABLE IF NOT EXISTS gps (lat REAL, lon REAL, alt REAL, speed REAL, course REAL, gpstime REAL, time REAL, trip INTEGER)";
+	char create_sql[] = "CREATE TABLE IF NOT EXISTS gps (lat REAL, lon REAL, alt REAL, speed REAL, course REAL, gpstime REAL, time REAL, trip INTEGER, monotime REAL)";
 
 	/// sqlite3 return status
 	int rc;
@@ -41,6 +43,8 @@ int creategpstable(sqlite3 *db) {
 		return 1;
 	}
 
+	// Logs from before samples had a monotonic timestamp
+	addcolumnifmissing(db, "gps", "monotime", "REAL");
 
 	// Create the index
 	char create_idx_sql[] = "CREATE INDEX IF NOT EXISTS IDX_GPSTIME ON gps (time)";
@@ -62,7 +66,7 @@ int creategpstable(sqlite3 *db) {
 }
 
 int creategpsinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt) {
-	char insert_sql[] = "INSERT INTO gps (lat,lon,alt,speed,course,gpstime,time,trip) VALUES (?,?,?,?,?,?,?,?)";
+	char insert_sql[] = "INSERT INTO gps (lat,lon,alt,speed,course,gpstime,time,trip,monotime) VALUES (?,?,?,?,?,?,?,?,?)";
 
 	int rc;
 	const char *zTail;
@@ -77,4 +81,110 @@ int creategpsinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt) {
 
 }
 
+int insertgpsfix(sqlite3_stmt *gpsinsert, const struct gpsfix *fix, sqlite3_int64 trip) {
+	sqlite3_bind_double(gpsinsert, 1, fix->lat);
+	sqlite3_bind_double(gpsinsert, 2, fix->lon);
+	if(fix->status >= 1) {
+		sqlite3_bind_double(gpsinsert, 3, fix->alt);
+	} else {
+		sqlite3_bind_null(gpsinsert, 3);
+	}
+	sqlite3_bind_double(gpsinsert, 4, fix->speed);
+	sqlite3_bind_double(gpsinsert, 5, fix->course);
+	sqlite3_bind_double(gpsinsert, 6, fix->gpstime);
+
+	// When the fix arrived, not when the sample it was picked up in started
+	sqlite3_bind_double(gpsinsert, 7, fix->time);
+	sqlite3_bind_int64(gpsinsert, 8, trip);
+	sqlite3_bind_double(gpsinsert, 9, fix->mono);
+
+	int rc = sqlite3_step(gpsinsert);
+	if(SQLITE_DONE != rc) {
+		printf("sqlite3 gps insert failed(%i): %s\n", rc,
+			sqlite3_errmsg(sqlite3_db_handle(gpsinsert)));
+	}
+	sqlite3_reset(gpsinsert);
+	return (SQLITE_DONE == rc)?0:-1;
+}
+
+int initgpstagqueue(sqlite3 *db, struct gpstagqueue *q) {
+	char update_sql[] = "UPDATE obd SET lat=?, lon=?, alt=? WHERE rowid=?";
+
+	q->first = 0;
+	q->count = 0;
+
+	int rc = sqlite3_prepare_v2(db, update_sql, -1, &q->update, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", update_sql, sqlite3_errmsg(db));
+		q->update = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+void setgpstag(struct gpstagqueue *q, sqlite3_int64 rowid, const struct gpsfix *fix) {
+	if(NULL == q->update) return;
+
+	sqlite3_bind_double(q->update, 1, fix->lat);
+	sqlite3_bind_double(q->update, 2, fix->lon);
+	if(fix->status >= 1) {
+		sqlite3_bind_double(q->update, 3, fix->alt);
+	} else {
+		sqlite3_bind_null(q->update, 3);
+	}
+	sqlite3_bind_int64(q->update, 4, rowid);
+
+	int rc = sqlite3_step(q->update);
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "Not Fatal: sqlite3 obd position update failed(%i): %s\n",
+			rc, sqlite3_errmsg(sqlite3_db_handle(q->update)));
+	}
+	sqlite3_reset(q->update);
+}
+
+/// Tag the oldest row in the queue, if its position is known
+/** \return 1 if it was taken off the queue, 0 if it's still waiting */
+static int resolveoldestgpstag(struct gpstagqueue *q, int wait) {
+	struct gpsfix fix;
+	enum gpsreader_positionstatus status = gpsreader_position(q->mono[q->first], &fix, wait);
+	if(GPSREADER_NOTYET == status) return 0;
+
+	if(GPSREADER_POSITION == status) {
+		setgpstag(q, q->rowid[q->first], &fix);
+	}
+
+	q->first = (q->first + 1) % GPSTAGQUEUE_SIZE;
+	q->count--;
+	return 1;
+}
+
+void queuegpstag(struct gpstagqueue *q, sqlite3_int64 rowid, double mono) {
+	if(NULL == q->update) return;
+
+	if(GPSTAGQUEUE_SIZE == q->count) {
+		resolveoldestgpstag(q, 0);
+	}
+	int i = (q->first + q->count) % GPSTAGQUEUE_SIZE;
+	q->rowid[i] = rowid;
+	q->mono[i] = mono;
+	q->count++;
+}
+
+int resolvegpstags(struct gpstagqueue *q, int wait) {
+	int tagged = 0;
+	if(NULL == q->update) return 0;
+
+	while(0 < q->count && resolveoldestgpstag(q, wait)) {
+		tagged++;
+	}
+	return tagged;
+}
+
+void closegpstagqueue(struct gpstagqueue *q) {
+	if(NULL == q->update) return;
+
+	resolvegpstags(q, 0);
+	sqlite3_finalize(q->update);
+	q->update = NULL;
+}
 
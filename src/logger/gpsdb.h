@@ -25,6 +25,21 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #define __GPSD_H
 
 #include "sqlite3.h"
+#include "gpsreader.h"
+
+/// Most obd rows waiting for a position at once
+#define GPSTAGQUEUE_SIZE 256
+
+/// obd rows waiting for the gps to catch up with them
+/** A sample's position is interpolated between the fixes either side of
+     it, so it can't be filled in until the fix after it has arrived */
+struct gpstagqueue {
+	sqlite3_stmt *update; ///< Sets the position on an obd row
+	sqlite3_int64 rowid[GPSTAGQUEUE_SIZE]; ///< obd rows waiting
+	double mono[GPSTAGQUEUE_SIZE]; ///< When each was sampled
+	int first; ///< Oldest row waiting
+	int count; ///< Number of rows waiting
+};
 
 /// Create the gps table in the database
 int creategpstable(sqlite3 *db);
@@ -37,6 +52,30 @@ int creategpstable(sqlite3 *db);
  */
 int creategpsinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt);
 
+/// Insert a fix into the gps table
+/** \param gpsinsert statement from creategpsinsertstmt
+ \param trip trip the fix was on
+ \return 0 on success, -1 on error */
+int insertgpsfix(sqlite3_stmt *gpsinsert, const struct gpsfix *fix, sqlite3_int64 trip);
+
+/// Prepare a tag queue
+/** \return 0 on success, nonzero on failure */
+int initgpstagqueue(sqlite3 *db, struct gpstagqueue *q);
+
+/// Add an obd row to be tagged with the position at the time it was sampled
+/** If the queue is full, the oldest row gets whatever position there is */
+void queuegpstag(struct gpstagqueue *q, sqlite3_int64 rowid, double mono);
+
+/// Tag an obd row with a position now, without queueing it
+void setgpstag(struct gpstagqueue *q, sqlite3_int64 rowid, const struct gpsfix *fix);
+
+/// Tag every row whose position is known
+/** \param wait if zero, tag every row with whatever position there is
+ \return number of rows taken off the queue */
+int resolvegpstags(struct gpstagqueue *q, int wait);
+
+/// Tag everything left and finalize the statement
+void closegpstagqueue(struct gpstagqueue *q);
 
 #endif //__GPSD_H
 
@@ -0,0 +1,310 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/** \file
+ \brief GPS reader
+ */
+
+#include "gpsreader.h"
+#include "sampleclock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/select.h>
+
+#ifdef HAVE_GPSTHREAD
+#include <signal.h>
+#include <pthread.h>
+
+// Fixes are shared with the logger thread. Protected by gpsreader_lock
+static pthread_mutex_t gpsreader_lock = PTHREAD_MUTEX_INITIALIZER;
+#define GPSREADER_LOCK() pthread_mutex_lock(&gpsreader_lock)
+#define GPSREADER_UNLOCK() pthread_mutex_unlock(&gpsreader_lock)
+
+static pthread_t gpsreader_thread;
+static int gpsreader_threadrunning = 0;
+static int gpsreader_stopping = 0;
+#else
+#define GPSREADER_LOCK()
+#define GPSREADER_UNLOCK()
+#endif //HAVE_GPSTHREAD
+
+static struct gpsfix gpsreader_fixes[GPSREADER_HISTORY];
+static unsigned long gpsreader_head = 0; ///< Fixes ever pushed
+static unsigned long gpsreader_taken = 0; ///< Fixes handed out by gpsreader_newfixes
+
+// Only touched by whoever's reading the gps
+static const struct gpssource *gpsreader_src = NULL;
+static char *gpsreader_address = NULL;
+static void *gpsreader_handle = NULL;
+static double gpsreader_lastopen = 0;
+
+/// Wait a while
+static void gpsreader_sleep(long usec) {
+	struct timeval selecttime;
+	selecttime.tv_sec = usec / 1000000l;
+	selecttime.tv_usec = usec % 1000000l;
+	select(0, NULL, NULL, NULL, &selecttime);
+}
+
+/// Try to open the gps
+/** \return 0 on success, nonzero on failure */
+static int gpsreader_reopen() {
+	sampleclock_stamp(&gpsreader_lastopen, NULL);
+	gpsreader_handle = gpsreader_src->open(gpsreader_address);
+	return NULL == gpsreader_handle;
+}
+
+/// Read one fix from the gps, reopening it if it's time to
+/** \return as the source's read. -1 if the gps isn't open */
+static int gpsreader_readone(long timeout) {
+	if(NULL == gpsreader_handle) {
+		double now;
+		sampleclock_stamp(&now, NULL);
+		if(now - gpsreader_lastopen < GPSREADER_RETRYTIME || 0 != gpsreader_reopen()) {
+			return -1;
+		}
+		printf("Delayed connection to gps achieved\n");
+	}
+
+	struct gpsfix fix;
+	int rc = gpsreader_src->read(gpsreader_handle, &fix, timeout);
+	if(0 > rc) {
+		fprintf(stderr, "Lost connection to gps (%s)\n", gpsreader_src->name);
+		gpsreader_src->close(gpsreader_handle);
+		gpsreader_handle = NULL;
+		sampleclock_stamp(&gpsreader_lastopen, NULL);
+		return -1;
+	}
+	if(0 < rc) {
+		sampleclock_stamp(&fix.mono, &fix.time);
+		GPSREADER_LOCK();
+		gpsreader_fixes[gpsreader_head % GPSREADER_HISTORY] = fix;
+		gpsreader_head++;
+		GPSREADER_UNLOCK();
+	}
+	return rc;
+}
+
+#ifdef HAVE_GPSTHREAD
+/// The reader thread
+static void *gpsreader_run(void *arg) {
+	// Leave all the signals to the main thread
+	sigset_t allsigs;
+	sigfillset(&allsigs);
+	pthread_sigmask(SIG_BLOCK, &allsigs, NULL);
+
+	for(;;) {
+		GPSREADER_LOCK();
+		int stopping = gpsreader_stopping;
+		GPSREADER_UNLOCK();
+		if(stopping) break;
+
+		if(0 > gpsreader_readone(GPSREADER_READTIMEOUT)) {
+			gpsreader_sleep(GPSREADER_READTIMEOUT);
+		}
+	}
+	return NULL;
+}
+#endif //HAVE_GPSTHREAD
+
+int gpsreader_open(const struct gpssource *src, const char *address) {
+	gpsreader_src = src;
+	gpsreader_address = strdup(address);
+	if(NULL == gpsreader_address) {
+		perror("gpsreader_open");
+		gpsreader_src = NULL;
+		return -1;
+	}
+	gpsreader_head = gpsreader_taken = 0;
+
+	return gpsreader_reopen();
+}
+
+int gpsreader_start() {
+#ifdef HAVE_GPSTHREAD
+	if(NULL == gpsreader_src || gpsreader_threadrunning) return 0;
+
+	gpsreader_stopping = 0;
+	if(0 != pthread_create(&gpsreader_thread, NULL, gpsreader_run, NULL)) {
+		fprintf(stderr, "Couldn't create gps reader thread\n");
+		return -1;
+	}
+	gpsreader_threadrunning = 1;
+#endif //HAVE_GPSTHREAD
+	return 0;
+}
+
+void gpsreader_stop() {
+#ifdef HAVE_GPSTHREAD
+	if(gpsreader_threadrunning) {
+		GPSREADER_LOCK();
+		gpsreader_stopping = 1;
+		GPSREADER_UNLOCK();
+		pthread_join(gpsreader_thread, NULL);
+		gpsreader_threadrunning = 0;
+	}
+#endif //HAVE_GPSTHREAD
+
+	if(NULL == gpsreader_src) return;
+	if(NULL != gpsreader_handle) {
+		gpsreader_src->close(gpsreader_handle);
+		gpsreader_handle = NULL;
+	}
+	free(gpsreader_address);
+	gpsreader_address = NULL;
+	gpsreader_src = NULL;
+}
+
+void gpsreader_poll() {
+	if(NULL == gpsreader_src) return;
+#ifdef HAVE_GPSTHREAD
+	if(gpsreader_threadrunning) return;
+#endif //HAVE_GPSTHREAD
+	while(0 < gpsreader_readone(0)) {
+		// Keep going while there's more
+	}
+}
+
+int gpsreader_newfixes(struct gpsfix *fixes, int max) {
+	int n = 0;
+	GPSREADER_LOCK();
+	unsigned long first = gpsreader_taken;
+	if(gpsreader_head - first > GPSREADER_HISTORY) first = gpsreader_head - GPSREADER_HISTORY;
+	if(gpsreader_head - first > (unsigned long)max) first = gpsreader_head - max;
+	for(; first < gpsreader_head; first++) {
+		fixes[n++] = gpsreader_fixes[first % GPSREADER_HISTORY];
+	}
+	gpsreader_taken = gpsreader_head;
+	GPSREADER_UNLOCK();
+	return n;
+}
+
+int gpsreader_latest(struct gpsfix *fix) {
+	int found = 0;
+	GPSREADER_LOCK();
+	if(0 < gpsreader_head) {
+		*fix = gpsreader_fixes[(gpsreader_head-1) % GPSREADER_HISTORY];
+		found = 1;
+	}
+	GPSREADER_UNLOCK();
+
+	double now;
+	if(!found || 0 != sampleclock_stamp(&now, NULL)) return 0;
+	return now - fix->mono <= GPSREADER_MAXGAP;
+}
+
+/// Copy a fix, restamped to a different time
+static void gpsreader_restamp(struct gpsfix *fix, const struct gpsfix *from, double mono) {
+	*fix = *from;
+	fix->time = from->time + (mono - from->mono);
+	fix->mono = mono;
+}
+
+void gpsreader_interpolate(struct gpsfix *fix, const struct gpsfix *before,
+		const struct gpsfix *after, double mono) {
+	double frac = 0;
+	if(after->mono > before->mono) {
+		frac = (mono - before->mono) / (after->mono - before->mono);
+	}
+
+	// Go the short way round for longitude and course
+	double dlon = after->lon - before->lon;
+	if(dlon > 180) dlon -= 360;
+	if(dlon < -180) dlon += 360;
+	double dcourse = after->course - before->course;
+	if(dcourse > 180) dcourse -= 360;
+	if(dcourse < -180) dcourse += 360;
+
+	gpsreader_restamp(fix, before, mono);
+	fix->lat = before->lat + frac * (after->lat - before->lat);
+	fix->lon = before->lon + frac * dlon;
+	if(fix->lon > 180) fix->lon -= 360;
+	if(fix->lon < -180) fix->lon += 360;
+	fix->speed = before->speed + frac * (after->speed - before->speed);
+	fix->course = before->course + frac * dcourse;
+	if(fix->course < 0) fix->course += 360;
+	if(fix->course >= 360) fix->course -= 360;
+	fix->gpstime = 0;
+	if(before->gpstime > 0 && after->gpstime > 0) {
+		fix->gpstime = before->gpstime + frac * (after->gpstime - before->gpstime);
+	}
+	if(before->status >= 1 && after->status >= 1) {
+		fix->alt = before->alt + frac * (after->alt - before->alt);
+		fix->status = 1;
+	} else {
+		fix->status = 0;
+	}
+}
+
+enum gpsreader_positionstatus gpsreader_position(double mono, struct gpsfix *fix, int wait) {
+	struct gpsfix before, after;
+	int havebefore = 0, haveafter = 0;
+
+	GPSREADER_LOCK();
+	unsigned long i = gpsreader_head;
+	unsigned long oldest = gpsreader_head > GPSREADER_HISTORY?gpsreader_head - GPSREADER_HISTORY:0;
+	while(i > oldest) {
+		i--;
+		const struct gpsfix *f = &gpsreader_fixes[i % GPSREADER_HISTORY];
+		if(f->mono <= mono) {
+			before = *f;
+			havebefore = 1;
+			break;
+		}
+		after = *f;
+		haveafter = 1;
+	}
+	GPSREADER_UNLOCK();
+
+	if(havebefore && haveafter) {
+		if(after.mono - before.mono <= GPSREADER_MAXGAP) {
+			gpsreader_interpolate(fix, &before, &after, mono);
+		} else if(mono - before.mono <= after.mono - mono) {
+			if(mono - before.mono > GPSREADER_MAXGAP) return GPSREADER_NOPOSITION;
+			gpsreader_restamp(fix, &before, mono);
+		} else {
+			if(after.mono - mono > GPSREADER_MAXGAP) return GPSREADER_NOPOSITION;
+			gpsreader_restamp(fix, &after, mono);
+		}
+		return GPSREADER_POSITION;
+	}
+
+	if(haveafter) {
+		// Older than anything we still have
+		if(after.mono - mono > GPSREADER_MAXGAP) return GPSREADER_NOPOSITION;
+		gpsreader_restamp(fix, &after, mono);
+		return GPSREADER_POSITION;
+	}
+
+	// Newer than every fix so far. Another may be on its way
+	double now;
+	if(wait && 0 == sampleclock_stamp(&now, NULL) && now - mono < GPSREADER_MAXGAP) {
+		return GPSREADER_NOTYET;
+	}
+	if(!havebefore || mono - before.mono > GPSREADER_MAXGAP) return GPSREADER_NOPOSITION;
+	gpsreader_restamp(fix, &before, mono);
+	return GPSREADER_POSITION;
+}
+
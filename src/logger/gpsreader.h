@@ -0,0 +1,132 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief GPS reader
+ The gps is read continuously in its own thread, and the last few fixes
+  are kept stamped with when they arrived. The logger loop picks up new
+  fixes to write to the gps table, and asks for the position at the
+  time each obd sample was taken, interpolated between the fixes either
+  side of it. Without threads, gpsreader_poll reads whatever's waiting.
+ */
+
+#ifndef __GPSREADER_H
+#define __GPSREADER_H
+
+/// Number of fixes kept
+#define GPSREADER_HISTORY 64
+
+/// Seconds. Fixes further apart than this aren't interpolated between,
+///  and a position is never taken from a fix further away than this
+#define GPSREADER_MAXGAP 3.0
+
+/// Seconds between attempts to reopen a gps that isn't answering
+#define GPSREADER_RETRYTIME 10
+
+/// usec the reader thread waits for the gps before checking if it should stop
+#define GPSREADER_READTIMEOUT 250000
+
+/// One fix
+struct gpsfix {
+	double lat; ///< Latitude
+	double lon; ///< Longitude
+	double alt; ///< Altitude. Only meaningful if status is 1
+	double speed; ///< Speed
+	double course; ///< Course, degrees
+	double gpstime; ///< Time according to the gps. 0 if it doesn't know the date
+	int status; ///< 0 for lat,lon, and 1 for lat,lon,alt
+	double time; ///< Wall clock time the fix arrived
+	double mono; ///< Monotonic time the fix arrived, on the sample clock
+};
+
+/// Somewhere fixes come from
+struct gpssource {
+	const char *name; ///< Name of the source
+	/// Open the source
+	/** \param address where to find the gps. Format is up to the source
+	 \return a handle, or NULL on failure */
+	void *(*open)(const char *address);
+	/// Wait for the next fix
+	/** time and mono are filled in by the reader, not the source
+	 \param h handle returned from open
+	 \param fix where to store the fix
+	 \param timeout usec to wait for one
+	 \return 1 for a new fix, 0 for nothing new, -1 if the gps has gone away */
+	int (*read)(void *h, struct gpsfix *fix, long timeout);
+	/// Close the source
+	void (*close)(void *h);
+};
+
+/// Return values of gpsreader_position
+enum gpsreader_positionstatus {
+	GPSREADER_NOPOSITION = -1, ///< Nothing near enough that time
+	GPSREADER_NOTYET = 0, ///< A fix after that time may still arrive
+	GPSREADER_POSITION = 1 ///< Position found
+};
+
+/// Open a gps
+/** If it can't be opened now, it's retried every GPSREADER_RETRYTIME seconds
+ \param src the source to read
+ \param address passed to the source's open
+ \return 0 if the gps was opened, 1 if it wasn't but will be retried, -1 on error */
+int gpsreader_open(const struct gpssource *src, const char *address);
+
+/// Start the reader thread
+/** Separate from gpsreader_open so it can be called after daemonising
+ \return 0 on success, -1 if the thread couldn't be started */
+int gpsreader_start();
+
+/// Stop reading and close the gps
+void gpsreader_stop();
+
+/// Read any fixes waiting
+/** Only needed when there's no reader thread. Does nothing otherwise */
+void gpsreader_poll();
+
+/// Get fixes that arrived since the last call
+/** If more than max arrived, the oldest are dropped
+ \param fixes where to store them, oldest first
+ \param max size of fixes
+ \return number stored */
+int gpsreader_newfixes(struct gpsfix *fixes, int max);
+
+/// Get the latest fix
+/** \return 1 if there's one no older than GPSREADER_MAXGAP, 0 otherwise */
+int gpsreader_latest(struct gpsfix *fix);
+
+/// Get the position at a given time
+/** Interpolated between the fixes either side if they're close enough
+     together, otherwise taken from the nearest
+ \param mono monotonic time, on the sample clock
+ \param fix where to store the position. time and mono are set to the
+     time asked for
+ \param wait if nonzero, return GPSREADER_NOTYET rather than settle for
+     an earlier fix when a later one may still arrive
+ \return one of enum gpsreader_positionstatus */
+enum gpsreader_positionstatus gpsreader_position(double mono, struct gpsfix *fix, int wait);
+
+/// Interpolate between two fixes
+/** \param fix where to store the position. time and mono are set for mono
+ \param mono monotonic time, between before's and after's */
+void gpsreader_interpolate(struct gpsfix *fix, const struct gpsfix *before,
+		const struct gpsfix *after, double mono);
+
+#endif //__GPSREADER_H
+
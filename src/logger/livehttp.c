@@ -0,0 +1,594 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** \file
+ \brief Small embedded http server for live KML and JSON
+ */
+#ifdef HAVE_LIVEHTTP
+
+#include "livehttp.h"
+#include "obdservicecommands.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif //MSG_NOSIGNAL
+
+/// One position on the track
+struct livehttp_sample {
+	double time; ///< Time of the sample
+	double lat; ///< Latitude
+	double lon; ///< Longitude
+	float vss; ///< Vehicle speed, or -1 if unknown
+	float mpg; ///< Instantaneous mpg, or -1 if unknown
+};
+
+/// A fully rendered response, headers and all
+struct livehttp_response {
+	char *data; ///< The response
+	size_t len; ///< Length of data
+	int refs; ///< Number of clients still sending this, plus one if it's current
+};
+
+/// One connected viewer
+struct livehttp_client {
+	int fd; ///< Socket, or -1 if this slot is free
+	char req[1024]; ///< Request as read so far
+	size_t reqlen; ///< Length of req
+	struct livehttp_response *resp; ///< What we're sending them, or NULL if still reading
+	size_t sent; ///< How much of resp has been sent
+};
+
+/// Growable string for rendering into
+struct livehttp_buf {
+	char *data; ///< The string
+	size_t len; ///< Length of string
+	size_t size; ///< Space allocated
+};
+
+// Shared with the logger thread. Protected by livehttp_lock
+static pthread_mutex_t livehttp_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct livehttp_sample livehttp_ring[LIVEHTTP_RINGSIZE];
+static unsigned long livehttp_ringhead = 0;
+static struct obdlive_frame livehttp_latest;
+static unsigned long livehttp_generation = 0;
+
+// Only touched by the server thread
+static pthread_t livehttp_thread;
+static int livehttp_threadrunning = 0;
+static int livehttp_listenfd = -1;
+static int livehttp_stoppipe[2] = { -1, -1 };
+static int livehttp_port = 0;
+static struct livehttp_client livehttp_clients[LIVEHTTP_MAXCLIENTS];
+static struct livehttp_response *livehttp_kml = NULL;
+static struct livehttp_response *livehttp_json = NULL;
+static struct livehttp_response *livehttp_seed = NULL;
+static struct livehttp_response *livehttp_notfound = NULL;
+
+/// Append to a buffer, printf style
+static void livehttp_printf(struct livehttp_buf *b, const char *fmt, ...) {
+	for(;;) {
+		va_list ap;
+		size_t avail = b->size - b->len;
+		int n = -1;
+		if(NULL != b->data) {
+			va_start(ap, fmt);
+			n = vsnprintf(b->data + b->len, avail, fmt, ap);
+			va_end(ap);
+			if(0 > n) return;
+			if((size_t)n < avail) {
+				b->len += n;
+				return;
+			}
+		}
+		size_t newsize = b->size?b->size*2:8192;
+		while(0 <= n && newsize - b->len <= (size_t)n) newsize *= 2;
+		char *newdata = (char *)realloc(b->data, newsize);
+		if(NULL == newdata) return;
+		b->data = newdata;
+		b->size = newsize;
+	}
+}
+
+/// Wrap a body up with headers into a response
+static struct livehttp_response *livehttp_makeresponse(const char *status,
+		const char *contenttype, const char *extraheaders, struct livehttp_buf *body) {
+
+	struct livehttp_buf b = { NULL, 0, 0 };
+	livehttp_printf(&b, "HTTP/1.0 %s\r\n"
+		"Content-Type: %s\r\n"
+		"Content-Length: %lu\r\n"
+		"Cache-Control: no-cache\r\n"
+		"Connection: close\r\n"
+		"%s"
+		"\r\n", status, contenttype, (unsigned long)body->len, extraheaders);
+	livehttp_printf(&b, "%.*s", (int)body->len, NULL == body->data?"":body->data);
+	if(NULL == b.data) return NULL;
+
+	struct livehttp_response *r = (struct livehttp_response *)malloc(sizeof(struct livehttp_response));
+	if(NULL == r) {
+		free(b.data);
+		return NULL;
+	}
+	r->data = b.data;
+	r->len = b.len;
+	r->refs = 1;
+	return r;
+}
+
+/// Drop a reference to a response
+static void livehttp_unref(struct livehttp_response *r) {
+	if(NULL == r) return;
+	if(0 == --r->refs) {
+		free(r->data);
+		free(r);
+	}
+}
+
+void livehttp_push(const struct obdlive_frame *f) {
+	struct livehttp_sample s;
+	s.time = f->time;
+	s.lat = f->lat;
+	s.lon = f->lon;
+	s.vss = -1;
+	s.mpg = -1;
+
+	float maf = -1;
+	int i;
+	for(i=0; i<f->numvalues; i++) {
+		if(0x0D == f->pid[i]) s.vss = f->value[i];
+		else if(0x10 == f->pid[i]) maf = f->value[i];
+	}
+	if(0 <= s.vss && 0 < maf) {
+		// See doc/mpg-calculation
+		s.mpg = 7.107 * s.vss / maf;
+	}
+
+	pthread_mutex_lock(&livehttp_lock);
+	memcpy(&livehttp_latest, f, sizeof(livehttp_latest));
+	if(0 <= f->gpsstatus) {
+		livehttp_ring[livehttp_ringhead % LIVEHTTP_RINGSIZE] = s;
+		livehttp_ringhead++;
+	}
+	livehttp_generation++;
+	pthread_mutex_unlock(&livehttp_lock);
+}
+
+/// Render the KML body
+static void livehttp_renderkml(struct livehttp_buf *b, const struct obdlive_frame *latest,
+		const struct livehttp_sample *track, int tracklen) {
+
+	livehttp_printf(b, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+		"<Document>\n"
+		"<name>OBDGPSLogger live updates</name>\n"
+		"<Style id=\"LiveOBDKMLStyleGreen\"><LineStyle><color>ff00ff00</color></LineStyle>"
+			"<PolyStyle><color>ff00ff00</color></PolyStyle></Style>\n"
+		"<Style id=\"LiveOBDKMLStyleRed\"><LineStyle><color>ff0000ff</color></LineStyle>"
+			"<PolyStyle><color>ff0000ff</color></PolyStyle></Style>\n"
+		"<Folder>\n"
+		"<name>Height=&gt;speed, color=&gt;mpg</name>\n"
+		"<Style><ListStyle><listItemType>checkHideChildren</listItemType></ListStyle></Style>\n");
+
+	// One linestring for each run of the same color. Consecutive
+	//  linestrings share an end point so there's no gap
+	int i;
+	int start = 0;
+	while(start < tracklen) {
+		int green = track[start].mpg >= LIVEHTTP_TARGETMPG;
+		int end = start+1;
+		while(end < tracklen && (track[end].mpg >= LIVEHTTP_TARGETMPG) == green) end++;
+
+		livehttp_printf(b, "<Placemark>\n"
+			"<styleUrl>#LiveOBDKMLStyle%s</styleUrl>\n"
+			"<LineString>\n"
+			"<extrude>1</extrude>\n"
+			"<tessellate>1</tessellate>\n"
+			"<altitudeMode>relativeToGround</altitudeMode>\n"
+			"<coordinates>", green?"Green":"Red");
+		for(i=start; i<end+1 && i<tracklen; i++) {
+			livehttp_printf(b, "%f,%f,%f\n", track[i].lon, track[i].lat,
+				track[i].vss<0?0:track[i].vss);
+		}
+		livehttp_printf(b, "</coordinates>\n"
+			"</LineString>\n"
+			"</Placemark>\n");
+		start = end;
+	}
+	livehttp_printf(b, "</Folder>\n");
+
+	if(0 <= latest->gpsstatus) {
+		livehttp_printf(b, "<Placemark>\n"
+			"<name>Now</name>\n"
+			"<description><![CDATA[");
+		for(i=0; i<latest->numvalues; i++) {
+			struct obdservicecmd *cmd = obdGetCmdForPID(latest->pid[i]);
+			if(NULL == cmd) continue;
+			livehttp_printf(b, "%s: %f %s<br/>\n", cmd->human_name, latest->value[i],
+				NULL == cmd->units?"":cmd->units);
+		}
+		livehttp_printf(b, "]]></description>\n"
+			"<Point><coordinates>%f,%f,0</coordinates></Point>\n"
+			"</Placemark>\n", latest->lon, latest->lat);
+	}
+
+	livehttp_printf(b, "</Document>\n"
+		"</kml>\n");
+}
+
+/// Render the JSON body
+static void livehttp_renderjson(struct livehttp_buf *b, const struct obdlive_frame *latest,
+		const struct livehttp_sample *track, int tracklen) {
+
+	int i;
+	livehttp_printf(b, "{\"time\":%f,\"trip\":%lli,\"values\":{", latest->time, latest->trip);
+	int first = 1;
+	for(i=0; i<latest->numvalues; i++) {
+		struct obdservicecmd *cmd = obdGetCmdForPID(latest->pid[i]);
+		if(NULL == cmd || NULL == cmd->db_column) continue;
+		livehttp_printf(b, "%s\"%s\":%f", first?"":",", cmd->db_column, latest->value[i]);
+		first = 0;
+	}
+	livehttp_printf(b, "},\"gps\":");
+	if(0 <= latest->gpsstatus) {
+		livehttp_printf(b, "{\"lat\":%f,\"lon\":%f,", latest->lat, latest->lon);
+		if(1 <= latest->gpsstatus) {
+			livehttp_printf(b, "\"alt\":%f,", latest->alt);
+		}
+		livehttp_printf(b, "\"speed\":%f,\"course\":%f,\"gpstime\":%f}",
+			latest->speed, latest->course, latest->gpstime);
+	} else {
+		livehttp_printf(b, "null");
+	}
+	livehttp_printf(b, ",\"track\":[");
+	for(i=0; i<tracklen; i++) {
+		livehttp_printf(b, "%s[%f,%f,%f,%f,%f]", 0==i?"":",",
+			track[i].time, track[i].lat, track[i].lon, track[i].vss, track[i].mpg);
+	}
+	livehttp_printf(b, "]}\n");
+}
+
+/// Re-render the cached responses, if anything changed
+static void livehttp_render() {
+	static unsigned long lastgeneration = 0;
+	static struct livehttp_sample track[LIVEHTTP_RINGSIZE];
+	struct obdlive_frame latest;
+	int tracklen = 0;
+
+	pthread_mutex_lock(&livehttp_lock);
+	if(NULL != livehttp_kml && lastgeneration == livehttp_generation) {
+		pthread_mutex_unlock(&livehttp_lock);
+		return;
+	}
+	lastgeneration = livehttp_generation;
+	memcpy(&latest, &livehttp_latest, sizeof(latest));
+
+	unsigned long oldest = livehttp_ringhead>LIVEHTTP_RINGSIZE?livehttp_ringhead-LIVEHTTP_RINGSIZE:0;
+	unsigned long first = livehttp_ringhead;
+	while(first > oldest &&
+		livehttp_ring[(first-1) % LIVEHTTP_RINGSIZE].time >= latest.time - LIVEHTTP_TRACKSECONDS) {
+		first--;
+	}
+	unsigned long idx;
+	for(idx=first; idx<livehttp_ringhead; idx++) {
+		track[tracklen++] = livehttp_ring[idx % LIVEHTTP_RINGSIZE];
+	}
+	pthread_mutex_unlock(&livehttp_lock);
+
+	struct livehttp_buf body = { NULL, 0, 0 };
+	livehttp_renderkml(&body, &latest, track, tracklen);
+	struct livehttp_response *r = livehttp_makeresponse("200 OK",
+		"application/vnd.google-earth.kml+xml", "", &body);
+	if(NULL != r) {
+		livehttp_unref(livehttp_kml);
+		livehttp_kml = r;
+	}
+
+	body.len = 0;
+	livehttp_renderjson(&body, &latest, track, tracklen);
+	r = livehttp_makeresponse("200 OK", "application/json",
+		"Access-Control-Allow-Origin: *\r\n", &body);
+	if(NULL != r) {
+		livehttp_unref(livehttp_json);
+		livehttp_json = r;
+	}
+	free(body.data);
+}
+
+/// Responses that never change
+static void livehttp_renderstatic() {
+	struct livehttp_buf body = { NULL, 0, 0 };
+	livehttp_printf(&body, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<kml xmlns=\"http://www.opengis.net/kml/2.2\">\n"
+		"<NetworkLink>\n"
+		"<name>OBDGPSLogger network link</name>\n"
+		"<description>Showing live data from OBDGPSLogger</description>\n"
+		"<Link>\n"
+		"<href>http://127.0.0.1:%i/live.kml</href>\n"
+		"<refreshMode>onInterval</refreshMode>\n"
+		"<refreshInterval>%i</refreshInterval>\n"
+		"</Link>\n"
+		"</NetworkLink>\n"
+		"</kml>\n", livehttp_port, LIVEHTTP_REFRESH);
+	livehttp_seed = livehttp_makeresponse("200 OK",
+		"application/vnd.google-earth.kml+xml",
+		"Content-Disposition: attachment; filename=liveobdseed.kml\r\n", &body);
+
+	body.len = 0;
+	livehttp_printf(&body, "Not found. Try /live.kml, /live.json, or / for a Google Earth seed\n");
+	livehttp_notfound = livehttp_makeresponse("404 Not Found", "text/plain", "", &body);
+	free(body.data);
+}
+
+/// Close a client and free the slot
+static void livehttp_dropclient(struct livehttp_client *c) {
+	close(c->fd);
+	livehttp_unref(c->resp);
+	c->fd = -1;
+	c->resp = NULL;
+}
+
+/// Read from a client. Pick a response once we have the whole request
+static void livehttp_readclient(struct livehttp_client *c) {
+	ssize_t n = recv(c->fd, c->req + c->reqlen, sizeof(c->req) - 1 - c->reqlen, 0);
+	if(0 > n && (EAGAIN == errno || EINTR == errno)) return;
+	if(0 >= n) {
+		livehttp_dropclient(c);
+		return;
+	}
+	c->reqlen += n;
+	c->req[c->reqlen] = '\0';
+
+	if(NULL == strstr(c->req, "\r\n\r\n") && NULL == strstr(c->req, "\n\n")) {
+		if(c->reqlen >= sizeof(c->req) - 1) {
+			livehttp_dropclient(c);
+		}
+		return;
+	}
+
+	char path[256] = "";
+	sscanf(c->req, "GET %255s", path);
+	char *query = strchr(path, '?');
+	if(NULL != query) *query = '\0';
+
+	struct livehttp_response *r = livehttp_notfound;
+	if(0 == strcmp(path, "/live.kml")) {
+		r = livehttp_kml;
+	} else if(0 == strcmp(path, "/live.json")) {
+		r = livehttp_json;
+	} else if(0 == strcmp(path, "/") || 0 == strcmp(path, "/seed.kml")) {
+		r = livehttp_seed;
+	}
+
+	if(NULL == r) {
+		livehttp_dropclient(c);
+		return;
+	}
+	r->refs++;
+	c->resp = r;
+	c->sent = 0;
+}
+
+/// Send more of the response to a client
+static void livehttp_writeclient(struct livehttp_client *c) {
+	ssize_t n = send(c->fd, c->resp->data + c->sent, c->resp->len - c->sent, MSG_NOSIGNAL);
+	if(0 > n && (EAGAIN == errno || EINTR == errno)) return;
+	if(0 >= n) {
+		livehttp_dropclient(c);
+		return;
+	}
+	c->sent += n;
+	if(c->sent >= c->resp->len) {
+		livehttp_dropclient(c);
+	}
+}
+
+/// Accept everyone waiting to connect
+static void livehttp_accept() {
+	int fd;
+	while(-1 != (fd = accept(livehttp_listenfd, NULL, NULL))) {
+		int i;
+		for(i=0; i<LIVEHTTP_MAXCLIENTS; i++) {
+			if(-1 == livehttp_clients[i].fd) break;
+		}
+		if(LIVEHTTP_MAXCLIENTS == i) {
+			close(fd);
+			continue;
+		}
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+		int one = 1;
+		setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif //SO_NOSIGPIPE
+		livehttp_clients[i].fd = fd;
+		livehttp_clients[i].reqlen = 0;
+		livehttp_clients[i].resp = NULL;
+		livehttp_clients[i].sent = 0;
+	}
+}
+
+/// Get the time in seconds
+static double livehttp_now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec/1000000.0;
+}
+
+/// The server thread
+static void *livehttp_run(void *arg) {
+	// Leave all the signals to the main thread
+	sigset_t allsigs;
+	sigfillset(&allsigs);
+	pthread_sigmask(SIG_BLOCK, &allsigs, NULL);
+
+	double nexttick = 0;
+	struct pollfd fds[LIVEHTTP_MAXCLIENTS+2];
+
+	for(;;) {
+		double now = livehttp_now();
+		if(now >= nexttick || now < nexttick - LIVEHTTP_REFRESH) {
+			livehttp_render();
+			nexttick = now + LIVEHTTP_REFRESH;
+		}
+
+		int nfds = 0;
+		fds[nfds].fd = livehttp_stoppipe[0];
+		fds[nfds].events = POLLIN;
+		nfds++;
+		fds[nfds].fd = livehttp_listenfd;
+		fds[nfds].events = POLLIN;
+		nfds++;
+
+		int i;
+		for(i=0; i<LIVEHTTP_MAXCLIENTS; i++) {
+			if(-1 == livehttp_clients[i].fd) continue;
+			fds[nfds].fd = livehttp_clients[i].fd;
+			fds[nfds].events = NULL == livehttp_clients[i].resp?POLLIN:POLLOUT;
+			nfds++;
+		}
+
+		int timeout = (int)((nexttick - now) * 1000) + 1;
+		if(0 > poll(fds, nfds, timeout)) {
+			if(EINTR == errno) continue;
+			perror("Live http poll");
+			break;
+		}
+
+		if(fds[0].revents) break;
+		if(fds[1].revents & POLLIN) livehttp_accept();
+
+		int f;
+		for(f=2; f<nfds; f++) {
+			if(0 == fds[f].revents) continue;
+			for(i=0; i<LIVEHTTP_MAXCLIENTS; i++) {
+				struct livehttp_client *c = &livehttp_clients[i];
+				if(c->fd != fds[f].fd) continue;
+				if(NULL == c->resp) {
+					livehttp_readclient(c);
+				} else {
+					livehttp_writeclient(c);
+				}
+				break;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+int livehttp_start(int port) {
+	int i;
+	for(i=0; i<LIVEHTTP_MAXCLIENTS; i++) {
+		livehttp_clients[i].fd = -1;
+		livehttp_clients[i].resp = NULL;
+	}
+	livehttp_port = port;
+	livehttp_latest.gpsstatus = -1;
+
+	livehttp_listenfd = socket(AF_INET, SOCK_STREAM, 0);
+	if(-1 == livehttp_listenfd) {
+		perror("Live http socket");
+		return 1;
+	}
+
+	int one = 1;
+	setsockopt(livehttp_listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if(-1 == bind(livehttp_listenfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+			-1 == listen(livehttp_listenfd, 16)) {
+		perror("Live http bind");
+		close(livehttp_listenfd);
+		livehttp_listenfd = -1;
+		return 1;
+	}
+	fcntl(livehttp_listenfd, F_SETFL, fcntl(livehttp_listenfd, F_GETFL) | O_NONBLOCK);
+
+	if(-1 == pipe(livehttp_stoppipe)) {
+		perror("Live http pipe");
+		close(livehttp_listenfd);
+		livehttp_listenfd = -1;
+		return 1;
+	}
+
+	livehttp_renderstatic();
+
+	if(0 != pthread_create(&livehttp_thread, NULL, livehttp_run, NULL)) {
+		fprintf(stderr, "Couldn't create live http thread\n");
+		livehttp_stop();
+		return 1;
+	}
+	livehttp_threadrunning = 1;
+
+	return 0;
+}
+
+void livehttp_stop() {
+	if(-1 == livehttp_listenfd) return;
+
+	if(livehttp_threadrunning) {
+		char c = 0;
+		if(1 == write(livehttp_stoppipe[1], &c, 1)) {
+			pthread_join(livehttp_thread, NULL);
+		}
+		livehttp_threadrunning = 0;
+	}
+
+	int i;
+	for(i=0; i<LIVEHTTP_MAXCLIENTS; i++) {
+		if(-1 != livehttp_clients[i].fd) {
+			livehttp_dropclient(&livehttp_clients[i]);
+		}
+	}
+
+	close(livehttp_listenfd);
+	livehttp_listenfd = -1;
+	close(livehttp_stoppipe[0]);
+	close(livehttp_stoppipe[1]);
+	livehttp_stoppipe[0] = livehttp_stoppipe[1] = -1;
+
+	livehttp_unref(livehttp_kml);
+	livehttp_unref(livehttp_json);
+	livehttp_unref(livehttp_seed);
+	livehttp_unref(livehttp_notfound);
+	livehttp_kml = livehttp_json = livehttp_seed = livehttp_notfound = NULL;
+}
+
+#endif //HAVE_LIVEHTTP
+
@@ -0,0 +1,66 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** \file
+ \brief Small embedded http server for live KML and JSON
+ Recent samples are kept in a ring in memory. Once a tick, if anything
+  new has arrived, the KML and JSON responses are rendered once and
+  every viewer is handed the same cached buffer. Nothing here touches
+  the database.
+ */
+#ifdef HAVE_LIVEHTTP
+
+#ifndef __LIVEHTTP_H
+#define __LIVEHTTP_H
+
+#include "obdlivebus.h"
+
+/// Number of recent positions kept for the track
+#define LIVEHTTP_RINGSIZE 4096
+
+/// Seconds of track to include in each response
+#define LIVEHTTP_TRACKSECONDS 10
+
+/// Seconds between re-rendering responses. Also the KML refresh interval
+#define LIVEHTTP_REFRESH 1
+
+/// Most viewers connected at once
+#define LIVEHTTP_MAXCLIENTS 64
+
+/// Track is drawn green at or above this mpg, red below
+#define LIVEHTTP_TARGETMPG 20
+
+/// Start serving on localhost
+/** Runs in its own thread
+ \param port TCP port to listen on
+ \return 0 on success, nonzero on failure
+ */
+int livehttp_start(int port);
+
+/// Add a sample
+/** Cheap; just copies the frame in under a lock */
+void livehttp_push(const struct obdlive_frame *f);
+
+/// Stop serving and clean up
+void livehttp_stop();
+
+#endif //__LIVEHTTP_H
+
+#endif //HAVE_LIVEHTTP
+
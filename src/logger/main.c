@@ -32,27 +32,45 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include "obddb.h"
 #include "gpsdb.h"
 #include "ecudb.h"
+#include "responsedb.h"
+#include "clockdb.h"
+#include "deadband.h"
+#include "deadbanddb.h"
+#include "rollupdb.h"
+#include "tripsummary.h"
+#include "blackbox.h"
+#include "blackboxdb.h"
+#include "statsdb.h"
+#include "sampleclock.h"
+#include "stagetiming.h"
+#include "extmodes.h"
 #include "tripdb.h"
 #include "obdserial.h"
+#include "obdcapture.h"
+#include "pidtiming.h"
+#include "pidresponses.h"
 #include "gpscomm.h"
+#include "gpsreader.h"
+#include "nmeagps.h"
 #include "supportedcommands.h"
+#include "obdlivebus.h"
 
 #include "obdconfigfile.h"
 
-#ifdef HAVE_GPSD
-#include "gps.h"
-
-/// IP address of gpsd
-#define GPSD_ADDR "127.0.0.1"
+/// Prefix for a gps address that means gpsd
+#define GPSD_PREFIX "gpsd://"
 
-/// Port of gpsd
-#define GPSD_PORT "2947"
-#endif //HAVE_GPSD
+/// Where gpsd is, host:port
+#define GPSD_ADDRESS "127.0.0.1:2947"
 
 #ifdef HAVE_DBUS
 #include "obddbus.h"
 #endif //HAVE_DBUS
 
+#ifdef HAVE_LIVEHTTP
+#include "livehttp.h"
+#endif //HAVE_LIVEHTTP
+
 #include "sqlite3.h"
 
 #include <stdio.h>
@@ -72,19 +90,30 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 /// Commit transactions once every this many seconds
 #define TRANSACTIONTIME 8
 
+/// Save stage timings to the stagestats table once every this many seconds
+#define STAGESTATSTIME 60
+
 /// Set when we catch a signal we want to exit on
 static int receive_exitsignal = 0;
 
 /// If we catch a signal to start the trip, set this
 static int sig_starttrip = 0;
 
+/// If we catch a signal to dump stage timings, set this
+static int sig_dumpstats = 0;
+
+/// If we catch a signal to trigger the blackbox, set this
+static int sig_saveblackbox = 0;
+
 #ifdef OBDPLATFORM_POSIX
 /// Daemonise. Returns 0 for success, or nonzero on failure.
 static int obddaemonise();
 #endif //OBDPLATFORM_POSIX
 
 /// Set up signal handling
-static void install_signalhandlers();
+/** \param blackbox set to trigger the blackbox on SIGHUP. Otherwise
+     SIGHUP is left alone */
+static void install_signalhandlers(int blackbox);
 
 static void catch_quitsignal(int sig) {
 	receive_exitsignal = 1;
@@ -94,10 +123,21 @@ static void catch_tripstartsignal(int sig) {
 	sig_starttrip = 1;
 }
 
+static void catch_dumpstatssignal(int sig) {
+	sig_dumpstats = 1;
+}
+
+static void catch_blackboxsignal(int sig) {
+	sig_saveblackbox = 1;
+}
+
 int main(int argc, char** argv) {
 	/// Serial port full path to open
 	char *serialport = NULL;
 
+	/// GPS device to read directly, or gpsd://host:port
+	char *gpsaddress = NULL;
+
 	/// Database file to open
 	char *databasename = NULL;
 
@@ -122,15 +162,15 @@ int main(int argc, char** argv) {
 	/// Spam all readings to stdout
 	int spam_stdout = 0;
 
-	/// Enable elm optimisations
-	int enable_optimisations = 0;
-
 	/// Enable serial logging
 	int enable_seriallog = 0;
 
 	/// Serial log filename
 	char *seriallogname = NULL;
 
+	/// Binary serial capture filename
+	char *serialcapturename = NULL;
+
 #ifdef OBDPLATFORM_POSIX
 	/// Daemonise
 	int daemonise = 0;
@@ -139,14 +179,65 @@ int main(int argc, char** argv) {
 	/// Requested baudrate
 	long requested_baud = -1;
 
+#ifdef HAVE_LIVEHTTP
+	/// Port to serve live KML and JSON on. Zero for none
+	int httpport = 0;
+#endif //HAVE_LIVEHTTP
+
+#ifdef HAVE_DBUS
+	/// Frames per second to signal over dbus
+	double dbusrate = OBDDBUS_DEFAULTRATE;
+#endif //HAVE_DBUS
+
+	/// Seconds between background mode 06/22 requests
+	double background_interval = OBDEXT_DEFAULTINTERVAL;
+
+	/// Only log values that moved past their deadband
+	int compress = 0;
+
+	/// Seconds after which a value is logged even if it hasn't moved
+	double compress_heartbeat = 0;
+
+	/// Per-column deadbands, as in the config file
+	const char *deadbands = NULL;
+
+	/// Columns the trip table keeps the max and mean of
+	const char *trip_columns = OBD_DEFAULT_TRIPCOLUMNS;
+
+	/// Minutes of samples to keep in the blackbox. 0 to log everything as it comes
+	double blackboxtime = 0;
+
+	/// With the blackbox, log every this many samples until it's triggered
+	int blackbox_decimate = 10;
+
+	/// Seconds to log everything for after the blackbox is triggered
+	double blackbox_post = 30;
+
+	/// Thresholds that trigger the blackbox, as in the config file
+	const char *blackbox_triggers = NULL;
+
 	// Config File
 	struct OBDGPSConfig *obd_config = obd_loadConfig(0);
 
 	if(NULL != obd_config) {
+		if(NULL != obd_config->decode_file) {
+			int loaded = obdDecodeLoadFile(obd_config->decode_file);
+			if(0 <= loaded) {
+				fprintf(stderr, "Loaded %i PID decodes from %s\n", loaded, obd_config->decode_file);
+			}
+		}
 		samplespersecond = obd_config->samplerate;
-		enable_optimisations = obd_config->optimisations;
 		requested_baud = obd_config->baudrate;
 		baudrate_upgrade = obd_config->baudrate_upgrade;
+		background_interval = obd_config->background_interval;
+		compress = obd_config->compress;
+		compress_heartbeat = obd_config->compress_heartbeat;
+		deadbands = obd_config->deadbands;
+		trip_columns = obd_config->trip_columns;
+		blackboxtime = obd_config->blackbox;
+		blackbox_decimate = obd_config->blackbox_decimate;
+		blackbox_post = obd_config->blackbox_post;
+		blackbox_triggers = obd_config->blackbox_triggers;
 	}
 
 	// Do not attempt to buffer stdout at all
@@ -170,8 +261,15 @@ int main(int argc, char** argv) {
 				}
 				serialport = strdup(optarg);
 				break;
+			case 'g':
+				if(NULL != gpsaddress) {
+					free(gpsaddress);
+				}
+				gpsaddress = strdup(optarg);
+				break;
 			case 'o':
-				enable_optimisations = 1;
+				// Deprecated and ignored, not in printhelp. Response counts are
+				//   learned per vehicle now; see pidresponses.h
 				break;
 			case 't':
 				spam_stdout = 1;
@@ -227,9 +325,28 @@ int main(int argc, char** argv) {
 				}
 				seriallogname = strdup(optarg);
 				break;
+			case 'L':
+				if(NULL != serialcapturename) {
+					free(serialcapturename);
+				}
+				serialcapturename = strdup(optarg);
+				break;
 			case 'p':
 				showcapabilities = 1;
 				break;
+			case 'k':
+				blackboxtime = strtod(optarg, (char **)NULL);
+				break;
+#ifdef HAVE_LIVEHTTP
+			case 'H':
+				httpport = atoi(optarg);
+				break;
+#endif //HAVE_LIVEHTTP
+#ifdef HAVE_DBUS
+			case 'r':
+				dbusrate = strtod(optarg, (char **)NULL);
+				break;
+#endif //HAVE_DBUS
 			default:
 				mustexit = 1;
 				break;
@@ -251,6 +368,16 @@ int main(int argc, char** argv) {
 			serialport = strdup(OBD_DEFAULT_SERIALPORT);
 		}
 	}
+	if(NULL == gpsaddress) {
+#ifdef HAVE_GPSD
+		gpsaddress = strdup(GPSD_PREFIX GPSD_ADDRESS);
+#else
+		// No gpsd to ask, so read the configured device ourselves
+		if(NULL != obd_config && NULL != obd_config->gps_device) {
+			gpsaddress = strdup(obd_config->gps_device);
+		}
+#endif //HAVE_GPSD
+	}
 	if(NULL == databasename) {
 		if(NULL != obd_config && NULL != obd_config->log_file) {
 			databasename = strdup(obd_config->log_file);
@@ -271,6 +398,10 @@ int main(int argc, char** argv) {
 		startseriallog(seriallogname);
 	}
 
+	if(NULL != serialcapturename) {
+		startserialcapture(serialcapturename);
+	}
+
 
 	// Open the serial port.
 	int obd_serial_port = openserial(serialport, requested_baud, baudrate_upgrade);
@@ -306,32 +437,59 @@ int main(int argc, char** argv) {
 	}
 
 
-#ifdef HAVE_GPSD
-	// Open the gps device
-	struct gps_data_t *gpsdata;
-	gpsdata = opengps(GPSD_ADDR, GPSD_PORT);
+	// Set if there's a gps to read, even if it isn't answering yet
+	int have_gps = 0;
 
-	if(NULL == gpsdata) {
-		fprintf(stderr, "Couldn't open gps port on startup.\n");
-	} else {
-		fprintf(stderr, "Successfully connected to gpsd. Will log gps data\n");
-	}
-
-#endif //HAVE_GPSD
+	// Set if the gps answered on startup
+	int gpsopened = 0;
 
-	if(-1 == obd_serial_port
+	// Open the gps device. It's read in its own thread once we get going
+	if(NULL != gpsaddress && 0 < strlen(gpsaddress)) {
+		const struct gpssource *gpssrc = &gpssource_nmea;
+		const char *gpssrcaddress = gpsaddress;
+		if(0 == strncmp(gpsaddress, GPSD_PREFIX, strlen(GPSD_PREFIX))) {
+			gpssrcaddress = gpsaddress + strlen(GPSD_PREFIX);
 #ifdef HAVE_GPSD
-		&& NULL == gpsdata
+			gpssrc = &gpssource_gpsd;
+#else
+			gpssrc = NULL;
+			fprintf(stderr, "Not compiled with gpsd support; not logging gps\n");
 #endif //HAVE_GPSD
-	) {
+		}
+
+		if(NULL != gpssrc) {
+			int gpsrc = gpsreader_open(gpssrc, gpssrcaddress);
+			have_gps = (0 <= gpsrc);
+			if(0 == gpsrc) {
+				gpsopened = 1;
+				fprintf(stderr, "Successfully connected to %s. Will log gps data\n", gpssrc->name);
+			} else {
+				fprintf(stderr, "Couldn't open gps port on startup.\n");
+			}
+		}
+	}
+
+	if(-1 == obd_serial_port && 0 == gpsopened) {
 		fprintf(stderr, "Couldn't find either gps or obd to log. Exiting.\n");
 		exit(1);
 	}
 
 #ifdef HAVE_DBUS
 	obdinitialisedbus();
+	obddbussetrate(dbusrate);
 #endif //HAVE_DBUS
 
+#ifdef HAVE_LIVEBUS
+	struct obdlivebus *livebus = obdlivebus_create(OBD_LIVEBUS_NAME);
+	if(NULL == livebus) {
+		fprintf(stderr, "Not Fatal: Couldn't create live data bus " OBD_LIVEBUS_NAME "\n");
+	}
+#endif //HAVE_LIVEBUS
+
+	// Everything sampled each time through the loop, for live consumers
+	struct obdlive_frame liveframe;
+	memset(&liveframe, 0, sizeof(liveframe));
+
 	// sqlite database
 	sqlite3 *db;
 
@@ -381,20 +539,101 @@ int main(int argc, char** argv) {
 
 	createecutable(db);
 
+	createresponsetable(db);
+
+	createclocktables(db);
+
+	createstatstable(db);
+
+	// Modes 06, 09 and 22
+	struct obdextmodes *extmodes = obdextmodes_create(obd_serial_port, db, background_interval);
+
+	// The trip we last read mode 09 vehicle info for
+	sqlite3_int64 vehicleinfotrip = -1;
+
+	// The vehicle learned response counts are saved against
+	sqlite3_int64 responseecu = -1;
+
 	// All of these have obdnumcols-1 since the last column is time
 	int cmdlist[obdnumcols-1]; // Commands to send [index into obdcmds_mode1]
+	const struct obddecode *declist[obdnumcols-1]; // How to decode each command
 
 	int i,j;
 	for(i=0,j=0; i<sizeof(obdcmds_mode1)/sizeof(obdcmds_mode1[0]); i++) {
 		if(NULL != obdcmds_mode1[i].db_column) {
 			if(isobdcapabilitysupported(obdcaps,i)) {
 				cmdlist[j] = i;
+				declist[j] = obdDecodeForPID(0x01, obdcmds_mode1[i].cmdid);
 				j++;
 			}
 		}
 	}
 
 	freeobdcapabilities(obdcaps);
+
+	// Values that haven't moved are left out
+	struct deadband dband;
+	dband.numcols = 0;
+	dband.cols = NULL;
+	double rowvalues[obdnumcols-1];
+	unsigned char rowwrite[obdnumcols-1];
+	sqlite3_int64 deadbandtrip = -1;
+
+	// Summaries over intervals and trips, kept up to date as samples come in
+	struct rollup rollups;
+	struct tripsummary tripsum;
+	{
+		const char *columns[obdnumcols-1];
+		for(i=0; i<obdnumcols-1; i++) {
+			columns[i] = obdcmds_mode1[cmdlist[i]].db_column;
+		}
+		if(0 != initrollup(db, &rollups, columns, obdnumcols-1)) {
+			fprintf(stderr, "Not Fatal: Couldn't set up rollups\n");
+		}
+		if(0 != tripsummary_init(&tripsum, columns, obdnumcols-1, trip_columns)) {
+			fprintf(stderr, "Not Fatal: Couldn't set up trip summaries\n");
+		}
+		addtripsummarycolumns(db, &tripsum);
+	}
+
+	if(compress) {
+		if(0 != deadband_init(&dband, obdnumcols-1, compress_heartbeat)) {
+			fprintf(stderr, "Not Fatal: Couldn't set up deadbands. Logging every value\n");
+			compress = 0;
+		} else {
+			const char *columns[obdnumcols-1];
+			for(i=0; i<obdnumcols-1; i++) {
+				double absolute, relative;
+				columns[i] = obdcmds_mode1[cmdlist[i]].db_column;
+				obd_configDeadband(deadbands, columns[i], &absolute, &relative);
+				deadband_setcolumn(&dband, i, absolute, relative);
+			}
+			createdeadbandtable(db);
+			savedeadbands(db, &dband, columns);
+		}
+	}
+
+	// Samples between the ones logged are only kept in memory, until
+	//   something triggers the blackbox
+	struct blackbox bbox;
+	memset(&bbox, 0, sizeof(bbox));
+	if(0 < blackboxtime) {
+		if(0 != blackbox_init(&bbox, obdnumcols-1, blackboxtime*60, samplespersecond,
+				blackbox_decimate, blackbox_post)) {
+			fprintf(stderr, "Not Fatal: Couldn't allocate the blackbox. Logging every sample\n");
+			blackboxtime = 0;
+		} else {
+			const char *columns[obdnumcols-1];
+			for(i=0; i<obdnumcols-1; i++) {
+				columns[i] = obdcmds_mode1[cmdlist[i]].db_column;
+			}
+			blackbox_settriggers(&bbox, columns, obdnumcols-1, blackbox_triggers);
+			createblackboxtable(db);
+		}
+	}
+
+	// When trouble codes were last checked for the blackbox
+	double lastdtccheck = -1;
 	// We create the gps table even if gps is disabled, so that other
 	//  SQL commands expecting the table to at least exist will work.
 
@@ -422,14 +661,37 @@ int main(int argc, char** argv) {
 	}
 #endif //OBDPLATFORM_POSIX
 
-#ifdef HAVE_GPSD
 	// Ping a message to stdout the first time we get
 	//   enough of a satellite lock to begin logging
 	int have_gps_lock = 0;
-#endif //HAVE_GPSD
 
+	// obd rows waiting for a position
+	struct gpstagqueue gpstags;
+	gpstags.update = NULL;
 
-	install_signalhandlers();
+	// New fixes picked up from the gps reader
+	struct gpsfix gpsfixes[GPSREADER_HISTORY];
+
+	if(have_gps) {
+		initgpstagqueue(db, &gpstags);
+		if(0 != gpsreader_start()) {
+			fprintf(stderr, "Not Fatal: Falling back to reading the gps between samples\n");
+		}
+	}
+
+#ifdef HAVE_LIVEHTTP
+	// The server runs in its own thread, so it has to start after daemonising
+	if(0 < httpport) {
+		if(0 != livehttp_start(httpport)) {
+			fprintf(stderr, "Not Fatal: Couldn't start live http server on port %i\n", httpport);
+		} else {
+			fprintf(stderr, "Serving live data on http://127.0.0.1:%i/\n", httpport);
+		}
+	}
+#endif //HAVE_LIVEHTTP
+
+
+	install_signalhandlers(0 < blackboxtime);
 
 
 	// The current thing returned by starttrip
@@ -439,10 +701,7 @@ int main(int argc, char** argv) {
 	int ontrip = 0;
 
 	// The current time we're inserting
-	double time_insert;
-
-	// The last time we tried to check the gps daemon
-	double time_lastgpscheck = 0;
+	double time_insert = 0;
 
 	// Number of samples per transaction
 	const int basetransactioncount = TRANSACTIONTIME * (0==samplespersecond?10:samplespersecond);
@@ -450,18 +709,32 @@ int main(int argc, char** argv) {
 	// Store a few seconds worth of samples per transaction
 	int transactioncount = 0;
 
+	// When each sample is due
+	struct sampleclock sclock;
+	if(0 != sampleclock_init(&sclock, frametime)) {
+		closedb(db);
+		closeserial(obd_serial_port);
+		exit(1);
+	}
+
+	// The trip sclock's stats are being collected for
+	sqlite3_int64 clocktrip = -1;
+
+	// When stage timings were last saved, on sclock's monotonic time
+	double laststagestats = -1;
+
+	// Start of the span being timed
+	long long span;
+
 	obdbegintransaction(db);
 
 	while(samplecount == -1 || samplecount-- > 0) {
 
-		struct timeval starttime; // start time through loop
-		struct timeval endtime; // end time through loop
-		struct timeval selecttime; // =endtime-starttime [for select()]
-
-		if(0 != gettimeofday(&starttime,NULL)) {
-			perror("Couldn't gettimeofday");
+		if(0 != sampleclock_tick(&sclock)) {
 			break;
 		}
+		long long samplespan = stagetiming_start();
+		if(laststagestats < 0) laststagestats = sclock.mono;
 
 #ifdef HAVE_DBUS
 		enum obd_dbus_message msg_ret;
@@ -474,6 +747,11 @@ int main(int argc, char** argv) {
 						ontrip = 1;
 					}
 					break;
+				case OBD_DBUS_SAVEBLACKBOX:
+					if(0 < blackboxtime) {
+						blackbox_trigger(&bbox, sclock.mono, "dbus");
+					}
+					break;
 				case OBD_DBUS_NOMESSAGE:
 				default:
 					break;
@@ -481,7 +759,11 @@ int main(int argc, char** argv) {
 		}
 #endif //HAVE_DBUS
 
-		time_insert = (double)starttime.tv_sec+(double)starttime.tv_usec/1000000.0f;
+		time_insert = sclock.wall;
+
+		liveframe.time = time_insert;
+		liveframe.numvalues = 0;
+		liveframe.gpsstatus = -1;
 
 		if(sig_starttrip) {
 			if(ontrip) {
@@ -495,30 +777,62 @@ int main(int argc, char** argv) {
 			sig_starttrip = 0;
 		}
 
-		enum obd_serial_status obdstatus;
+		if(sig_saveblackbox) {
+			if(0 < blackboxtime) {
+				blackbox_trigger(&bbox, sclock.mono, "signal");
+			}
+			sig_saveblackbox = 0;
+		}
+
+		enum obd_serial_status obdstatus = OBD_NO_DATA;
 		if(-1 < obd_serial_port) {
+			int numanswered = 0; // PIDs that answered this sample
 
 			// Get all the OBD data
 			for(i=0; i<obdnumcols-1; i++) {
 				float val;
 				unsigned int cmdid = obdcmds_mode1[cmdlist[i]].cmdid;
-				int numbytes = enable_optimisations?obdcmds_mode1[cmdlist[i]].bytes_returned:0;
-				OBDConvFunc conv = obdcmds_mode1[cmdlist[i]].conv;
 
-				obdstatus = getobdvalue(obd_serial_port, cmdid, &val, numbytes, conv);
+				// PIDs that keep timing out are only asked once in a while
+				rowwrite[i] = 0;
+				if(pidtiming_shouldskip(0x01, cmdid)) {
+					sqlite3_bind_null(obdinsert, i+1);
+					continue;
+				}
+
+				obdstatus = getobdvalue(obd_serial_port, cmdid, &val, 0, declist[i]);
+				if(OBD_TIMEOUT == obdstatus) {
+					// One slow PID shouldn't cost the whole row
+					sqlite3_bind_null(obdinsert, i+1);
+					continue;
+				}
 				if(OBD_SUCCESS == obdstatus) {
-#ifdef HAVE_DBUS
-					obddbussignalpid(&obdcmds_mode1[cmdlist[i]], val);
-#endif //HAVE_DBUS
+					numanswered++;
+					if(liveframe.numvalues < OBDLIVEBUS_MAXVALUES) {
+						liveframe.pid[liveframe.numvalues] = cmdid;
+						liveframe.value[liveframe.numvalues] = val;
+						liveframe.numvalues++;
+					}
 					if(spam_stdout) {
 						printf("%s=%f\n", obdcmds_mode1[cmdlist[i]].db_column, val);
 					}
 					sqlite3_bind_double(obdinsert, i+1, (double)val);
+					rowvalues[i] = val;
+					rowwrite[i] = 1;
 					// printf("cmd: %02X, val: %f\n",obdcmds_mode1[cmdlist[i]].cmdid,val);
 				} else {
 					break;
 				}
 			}
+			if(i == obdnumcols-1) {
+				// Got through them all; timeouts and skipped PIDs are just NULL
+				obdstatus = (numanswered > 0)?OBD_SUCCESS:OBD_NO_DATA;
+			}
+
+			// The row's position is wherever we were halfway through reading it
+			double obddone = sclock.mono;
+			sampleclock_stamp(&obddone, NULL);
+			double obdmono = (sclock.mono + obddone) / 2;
 
 			if(obdstatus == OBD_SUCCESS) {
 				// If they're not on a trip but the engine is going, start a trip
@@ -529,16 +843,73 @@ int main(int argc, char** argv) {
 				}
 				sqlite3_bind_double(obdinsert, i+1, time_insert);
 				sqlite3_bind_int64(obdinsert, i+2, currenttrip);
+				sqlite3_bind_double(obdinsert, i+3, sclock.mono);
+
+				// Rollups see every value, moved or not
+				span = stagetiming_start();
+				rollup_add(&rollups, currenttrip, time_insert, rowvalues, rowwrite);
+				switchtripsummary(db, &tripsum, currenttrip);
+				tripsummary_addsample(&tripsum, obdmono, rowvalues, rowwrite);
+				stagetiming_end(OBDSTAGE_ROLLUP, span);
+
+				// With the blackbox, most rows only go in the ring
+				int numwrite = 1;
+				if(0 < blackboxtime) {
+					span = stagetiming_start();
+					numwrite = blackbox_addsample(&bbox, time_insert, sclock.mono,
+						currenttrip, rowvalues, rowwrite);
+					stagetiming_end(OBDSTAGE_BLACKBOX, span);
+				}
+
+				// Unmoved values go in as NULL. A row with none left isn't written
+				if(compress && 0 < numwrite) {
+					if(deadbandtrip != currenttrip) {
+						deadband_reset(&dband);
+						deadbandtrip = currenttrip;
+					}
+					numwrite = deadband_filter(&dband, rowvalues, rowwrite, sclock.mono);
+					for(j=0; j<obdnumcols-1; j++) {
+						if(!rowwrite[j]) sqlite3_bind_null(obdinsert, j+1);
+					}
+				}
 
 				// Do the OBD insert
-				rc = sqlite3_step(obdinsert);
-				if(SQLITE_DONE != rc) {
-					printf("sqlite3 obd insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+				if(0 < numwrite) {
+					span = stagetiming_start();
+					rc = sqlite3_step(obdinsert);
+					stagetiming_end(OBDSTAGE_OBDINSERT, span);
+					if(SQLITE_DONE != rc) {
+						printf("sqlite3 obd insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+					} else if(have_gps) {
+						queuegpstag(&gpstags, sqlite3_last_insert_rowid(db), obdmono);
+					}
+				}
+
+				// Once per trip, find out what we're talking to
+				if(NULL != extmodes && vehicleinfotrip != currenttrip) {
+					sqlite3_int64 ecuid = obdextmodes_vehicleinfo(extmodes, obd_serial_port,
+						currenttrip, time_insert);
+					vehicleinfotrip = currenttrip;
+
+					// Pick up response counts learned on earlier runs
+					if(0 < ecuid && ecuid != responseecu) {
+						if(0 < responseecu) {
+							saveresponsehints(db, responseecu);
+							pidresponses_reset();
+						}
+						int loaded = loadresponsehints(db, ecuid);
+						if(0 < loaded) {
+							printf("Loaded %i learned response counts\n", loaded);
+						}
+						responseecu = ecuid;
+					}
 				}
 			} else if(OBD_ERROR == obdstatus) {
+				liveframe.numvalues = 0;
 				fprintf(stderr, "Received OBD_ERROR from serial read. Exiting\n");
 				receive_exitsignal = 1;
 			} else {
+				liveframe.numvalues = 0;
 				// If they're on a trip, and the engine has desisted, stop the trip
 				if(ontrip) {
 					printf("Ending current trip\n");
@@ -547,73 +918,121 @@ int main(int argc, char** argv) {
 				}
 			}
 			sqlite3_reset(obdinsert);
+
+			// New trouble codes trigger the blackbox
+			if(0 < blackboxtime && ontrip && OBD_ERROR != obdstatus &&
+					(lastdtccheck < 0 || sclock.mono - lastdtccheck >= BLACKBOX_DTCINTERVAL)) {
+				unsigned int dtcs[BLACKBOX_MAXDTCS*2];
+				int numdtcbytes;
+				span = stagetiming_start();
+				if(OBD_SUCCESS == getobderrorcodes(obd_serial_port,
+						dtcs, sizeof(dtcs)/sizeof(dtcs[0]), &numdtcbytes)) {
+					blackbox_checkdtcs(&bbox, sclock.mono, dtcs, numdtcbytes);
+				}
+				stagetiming_end(OBDSTAGE_BACKGROUND, span);
+				lastdtccheck = sclock.mono;
+			}
 		}
 
 		// Constantly update the trip
+		span = stagetiming_start();
 		updatetrip(db, currenttrip, time_insert);
+		stagetiming_end(OBDSTAGE_UPDATETRIP, span);
 
-#ifdef HAVE_GPSD
-		// Get the GPS data
-		double lat,lon,alt,speed,course,gpstime;
+		if(have_gps) {
+			// Only new fixes go in the gps table
+			span = stagetiming_start();
+			gpsreader_poll();
+			int numfixes = gpsreader_newfixes(gpsfixes, GPSREADER_HISTORY);
+			stagetiming_end(OBDSTAGE_GPSPOLL, span);
 
-		int gpsstatus = -1;
-		if(NULL != gpsdata) {
-			gpsstatus = getgpsposition(gpsdata, &lat, &lon, &alt, &speed, &course, &gpstime);
-		} else {
-			if(time_insert - time_lastgpscheck > 10) { // Try again once in a while
-				gpsdata = opengps(GPSD_ADDR, GPSD_PORT);
-				if(NULL != gpsdata) {
-					printf("Delayed connection to gps achieved\n");
-				} else {
-					// fprintf(stderr, "Delayed connection to gps failed\n");
-				}
-				time_lastgpscheck = time_insert;
-			}
-		}
-		if(gpsstatus < 0 || NULL == gpsdata) {
-			// Nothing yet
-		} else if(gpsstatus >= 0) {
-			if(0 == have_gps_lock) {
+			if(0 < numfixes && 0 == have_gps_lock) {
 				fprintf(stderr,"GPS acquisition complete\n");
 				have_gps_lock = 1;
 			}
 
-			sqlite3_bind_double(gpsinsert, 1, lat);
-			sqlite3_bind_double(gpsinsert, 2, lon);
-			if(gpsstatus >= 1) {
-				sqlite3_bind_double(gpsinsert, 3, alt);
-			} else {
-				sqlite3_bind_null(gpsinsert, 3);
-			}
-			sqlite3_bind_double(gpsinsert, 4, speed);
-			sqlite3_bind_double(gpsinsert, 5, course);
-			sqlite3_bind_double(gpsinsert, 6, gpstime);
+			span = stagetiming_start();
+			int f;
+			for(f=0; f<numfixes; f++) {
+				struct gpsfix *fix = &gpsfixes[f];
 
-			if(spam_stdout) {
-				printf("gpspos=%f,%f,%f,%f,%f\n",
-					lat, lon, (gpsstatus>=1?alt:-1000.0), speed, course);
-			}
+				if(spam_stdout) {
+					printf("gpspos=%f,%f,%f,%f,%f\n",
+						fix->lat, fix->lon, (fix->status>=1?fix->alt:-1000.0), fix->speed, fix->course);
+				}
 
-			// Use time worked out before.
-			//  This makes table joins reliable, but the time itself may be wrong depending on gpsd lagginess
-			sqlite3_bind_double(gpsinsert, 7, time_insert);
+				if(ontrip) {
+					switchtripsummary(db, &tripsum, currenttrip);
+					tripsummary_addfix(&tripsum, fix->lat, fix->lon);
+				}
 
-			sqlite3_bind_int64(gpsinsert, 8, currenttrip);
+				// Do the GPS insert, unless it's only going in the blackbox
+				if(0 >= blackboxtime || blackbox_addfix(&bbox, fix, currenttrip)) {
+					insertgpsfix(gpsinsert, fix, currenttrip);
+				}
+			}
 
-			// Do the GPS insert
-			rc = sqlite3_step(gpsinsert);
-			if(SQLITE_DONE != rc) {
-				printf("sqlite3 gps insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+			// Fill in positions on obd rows the gps has caught up with
+			resolvegpstags(&gpstags, 1);
+			stagetiming_end(OBDSTAGE_GPSINSERT, span);
+
+			struct gpsfix latest;
+			if(gpsreader_latest(&latest)) {
+				liveframe.gpsstatus = latest.status;
+				liveframe.lat = latest.lat;
+				liveframe.lon = latest.lon;
+				liveframe.alt = latest.alt;
+				liveframe.speed = latest.speed;
+				liveframe.course = latest.course;
+				liveframe.gpstime = latest.gpstime;
 			}
-			sqlite3_reset(gpsinsert);
 		}
-#endif //HAVE_GPSD
 
-		if(0 != gettimeofday(&endtime,NULL)) {
-			perror("Couldn't gettimeofday");
-			break;
+		// Whatever triggered the blackbox, write out what it was holding
+		if(NULL != bbox.reason) {
+			span = stagetiming_start();
+			saveblackbox(db, &bbox, obdinsert, gpsinsert, &gpstags, time_insert);
+			stagetiming_end(OBDSTAGE_BLACKBOX, span);
 		}
 
+		liveframe.trip = ontrip?currenttrip:-1;
+		span = stagetiming_start();
+#ifdef HAVE_LIVEBUS
+		if(NULL != livebus) {
+			obdlivebus_publish(livebus, &liveframe);
+		}
+#endif //HAVE_LIVEBUS
+#ifdef HAVE_LIVEHTTP
+		if(0 < httpport) {
+			livehttp_push(&liveframe);
+		}
+#endif //HAVE_LIVEHTTP
+#ifdef HAVE_DBUS
+		obddbussignalframe(&liveframe);
+#endif //HAVE_DBUS
+		stagetiming_end(OBDSTAGE_PUBLISH, span);
+
+		// Mode 06 and 22, if there's time left before the next sample
+		if(NULL != extmodes && ontrip && -1 < obd_serial_port) {
+			struct timeval bgtime;
+			gettimeofday(&bgtime,NULL);
+			double now = (double)bgtime.tv_sec+(double)bgtime.tv_usec/1000000.0;
+			span = stagetiming_start();
+			obdextmodes_background(extmodes, obd_serial_port, currenttrip, now,
+				(0 < frametime)?now+sampleclock_remaining(&sclock):0);
+			stagetiming_end(OBDSTAGE_BACKGROUND, span);
+		}
+
+		// Sample clock stats are kept per trip
+		if(clocktrip != (ontrip?currenttrip:-1)) {
+			if(0 < clocktrip) {
+				saveclockstats(db, clocktrip, &sclock);
+			}
+			clocktrip = ontrip?currenttrip:-1;
+			sampleclock_resetstats(&sclock);
+		}
+		sampleclock_count(&sclock);
+
 		// Set via the signal handler
 		if(receive_exitsignal) {
 			break;
@@ -624,28 +1043,54 @@ int main(int argc, char** argv) {
 		transactioncount++;
 		transactioncount%=basetransactioncount;
 		if(0 == transactioncount) {
+			if(0 < responseecu) {
+				saveresponsehints(db, responseecu);
+			}
+			if(0 < clocktrip) {
+				saveclockstats(db, clocktrip, &sclock);
+			}
+			span = stagetiming_start();
+			rollup_save(&rollups);
+			savetripsummary(db, &tripsum);
+			stagetiming_end(OBDSTAGE_ROLLUP, span);
+
+			span = stagetiming_start();
 			obdcommittransaction(db);
 			obdbegintransaction(db);
+			stagetiming_end(OBDSTAGE_COMMIT, span);
+
+			// Now and then, let the device's timeout follow what we've learned
+			if(-1 < obd_serial_port) {
+				obdtuneelmtimeout(obd_serial_port);
+			}
 		}
 
-		
-		// usleep() not as portable as select()
 
-		if(0 < frametime) {
-			selecttime.tv_sec = endtime.tv_sec - starttime.tv_sec;
-			if (selecttime.tv_sec != 0) {
-					endtime.tv_usec += 1000000*selecttime.tv_sec;
-					selecttime.tv_sec = 0;
-			}
-			selecttime.tv_usec = (frametime) - 
-					(endtime.tv_usec - starttime.tv_usec);
-			if(selecttime.tv_usec < 0) {
-					selecttime.tv_usec = 1;
+		stagetiming_end(OBDSTAGE_SAMPLE, samplespan);
+
+		// Stage timings go in the database now and then, or when asked
+		if(sig_dumpstats || sclock.mono - laststagestats >= STAGESTATSTIME) {
+			if(sig_dumpstats) {
+				stagetiming_print(stderr);
+				sig_dumpstats = 0;
 			}
-			select(0,NULL,NULL,NULL,&selecttime);
+			savestagestats(db, time_insert);
+			stagetiming_reset();
+			laststagestats = sclock.mono;
 		}
+
+		// Sleep until the next sample is due
+		sampleclock_wait(&sclock, &receive_exitsignal);
 	}
 
+	// Stop reading the gps, then give the last few rows whatever it had
+	gpsreader_stop();
+	closegpstagqueue(&gpstags);
+
+	closerollup(&rollups);
+	savetripsummary(db, &tripsum);
+	tripsummary_close(&tripsum);
+
 	obdcommittransaction(db);
 
 	if(0 != ontrip) {
@@ -653,24 +1098,40 @@ int main(int argc, char** argv) {
 		ontrip = 0;
 	}
 
+	if(0 < responseecu) {
+		saveresponsehints(db, responseecu);
+	}
+	if(0 < clocktrip) {
+		saveclockstats(db, clocktrip, &sclock);
+	}
+	savestagestats(db, time_insert);
+
 	sqlite3_finalize(obdinsert);
 	sqlite3_finalize(gpsinsert);
+	deadband_close(&dband);
+	blackbox_close(&bbox);
+	obdextmodes_free(extmodes);
 
 	closeserial(obd_serial_port);
-#ifdef HAVE_GPSD
-	if(NULL != gpsdata) {
-		gps_close(gpsdata);
-	}
-#endif //HAVE_GPSD
+#ifdef HAVE_LIVEBUS
+	obdlivebus_close(livebus);
+#endif //HAVE_LIVEBUS
+#ifdef HAVE_LIVEHTTP
+	livehttp_stop();
+#endif //HAVE_LIVEHTTP
 	closedb(db);
 
 	if(enable_seriallog) {
 		closeseriallog();
 	}
 
+	closeserialcapture();
+
 	if(NULL != log_columns) free(log_columns);
 	if(NULL != databasename) free(databasename);
 	if(NULL != serialport) free(serialport);
+	if(NULL != gpsaddress) free(gpsaddress);
+	if(NULL != serialcapturename) free(serialcapturename);
 
 	obd_freeConfig(obd_config);
 	return 0;
@@ -714,20 +1175,28 @@ static int obddaemonise() {
 
 void printhelp(const char *argv0) {
 	printf("Usage: %s [params]\n"
-				"   [-s|--serial <" OBD_DEFAULT_SERIALPORT ">]\n"
+				"   [-s|--serial <" OBD_DEFAULT_SERIALPORT "|tcp://host:port|replay://capture>]\n"
+				"   [-g|--gps <device[?baud=N&rate=N&ubx=1]|gpsd://host:port>]\n"
 				"   [-c|--count <infinite>]\n"
 				"   [-i|--log-columns <" OBD_DEFAULT_COLUMNS ">]\n"
 				"   [-t|--spam-stdout]\n"
 				"   [-p|--capabilities]\n"
-				"   [-o|--enable-optimisations]\n"
 				"   [-u|--output-log <filename>]\n"
 #ifdef OBDPLATFORM_POSIX
 				"   [-m|--daemonise]\n"
 #endif //OBDPLATFORM_POSIX
+#ifdef HAVE_LIVEHTTP
+				"   [-H|--http-port <port>]\n"
+#endif //HAVE_LIVEHTTP
+#ifdef HAVE_DBUS
+				"   [-r|--dbus-rate <frames per second [1]>]\n"
+#endif //HAVE_DBUS
 				"   [-b|--baud <number>]\n"
 				"   [-B|--modifybaud <number>]\n"
 				"   [-l|--serial-log <filename>]\n"
+				"   [-L|--serial-capture <filename>]\n"
 				"   [-a|--samplerate [1]]\n"
+				"   [-k|--blackbox <minutes>]\n"
 				"   [-d|--db <" OBD_DEFAULT_DATABASE ">]\n"
 				"   [-v|--version] [-h|--help]\n", argv0);
 }
@@ -737,7 +1206,7 @@ void printversion() {
 }
 
 
-void install_signalhandlers() {
+void install_signalhandlers(int blackbox) {
 	// Set up signal handling
 
 #ifdef HAVE_SIGACTION
@@ -761,6 +1230,24 @@ void install_signalhandlers() {
 	sigaction(SIGUSR1, &sa_new, NULL);
 #endif //SIGUSR1
 
+#ifdef SIGUSR2
+	// Dump stage timings on USR2
+	sa_new.sa_handler = catch_dumpstatssignal;
+	sigemptyset(&sa_new.sa_mask);
+	sigaddset(&sa_new.sa_mask, SIGUSR2);
+	sigaction(SIGUSR2, &sa_new, NULL);
+#endif //SIGUSR2
+
+#ifdef SIGHUP
+	// Trigger the blackbox on HUP
+	if(blackbox) {
+		sa_new.sa_handler = catch_blackboxsignal;
+		sigemptyset(&sa_new.sa_mask);
+		sigaddset(&sa_new.sa_mask, SIGHUP);
+		sigaction(SIGHUP, &sa_new, NULL);
+	}
+#endif //SIGHUP
+
 #else // HAVE_SIGACTION
 
 // If your unix implementation doesn't have sigaction, we can fall
@@ -776,6 +1263,18 @@ void install_signalhandlers() {
 	signal(SIGUSR1, catch_tripstartsignal);
 #endif //SIGUSR1
 
+#ifdef SIGUSR2
+	// Dump stage timings on USR2
+	signal(SIGUSR2, catch_dumpstatssignal);
+#endif //SIGUSR2
+
+#ifdef SIGHUP
+	// Trigger the blackbox on HUP
+	if(blackbox) {
+		signal(SIGHUP, catch_blackboxsignal);
+	}
+#endif //SIGHUP
+
 #endif // HAVE_SIGNAL_FUNC
 
 
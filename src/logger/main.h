@@ -31,28 +31,43 @@ static const struct option longopts[] = {
 	{ "help", no_argument, NULL, 'h' }, ///< Print the help text
 	{ "version", no_argument, NULL, 'v' }, ///< Print the version text
 	{ "serial", required_argument, NULL, 's' }, ///< Serial Port
+	{ "gps", required_argument, NULL, 'g' }, ///< GPS device, or gpsd://host:port
 	{ "db", required_argument, NULL, 'd' }, ///< Database file
 	{ "samplerate", required_argument, NULL, 'a' }, ///< Number of samples per second
 	{ "count", required_argument, NULL, 'c' }, ///< Number of values to grab
 	{ "capabilities", no_argument, NULL, 'p' }, ///< Show the capabilities the OBD device claims it can report
 	{ "spam-stdout", no_argument, NULL, 't' }, ///< Spam readings to stdout
 	{ "serial-log", required_argument, NULL, 'l' }, ///< Log serial port data transfer
+	{ "serial-capture", required_argument, NULL, 'L' }, ///< Binary capture of serial port data transfer
 	{ "output-log", required_argument, NULL, 'u' }, ///< Log serial port data transfer
 	{ "baud", required_argument, NULL, 'b' }, ///< Baud rate to connect at
 	{ "modifybaud", required_argument, NULL, 'B' }, ///< Upgrade to this baudrate
 	{ "log-columns", required_argument, NULL, 'i' }, ///< Log these columns
-	{ "enable-optimisations", no_argument, NULL, 'o' }, ///< Enable elm optimisations
+	{ "enable-optimisations", no_argument, NULL, 'o' }, ///< Ignored; response counts are learned
+	{ "blackbox", required_argument, NULL, 'k' }, ///< Minutes of samples to keep in memory
 #ifdef OBDPLATFORM_POSIX
 	{ "daemon", no_argument, NULL, 'm' }, ///< Daemonise
 #endif //OBDPLATFORM_POSIX
+#ifdef HAVE_LIVEHTTP
+	{ "http-port", required_argument, NULL, 'H' }, ///< Serve live KML and JSON on this port
+#endif //HAVE_LIVEHTTP
+#ifdef HAVE_DBUS
+	{ "dbus-rate", required_argument, NULL, 'r' }, ///< Frames per second to send over dbus
+#endif //HAVE_DBUS
 	{ NULL, 0, NULL, 0 } ///< End
 };
 
 /// getopt() short options
-static const char shortopts[] = "htd:i:b:vs:l:c:a:opu:B:"
+static const char shortopts[] = "htd:i:b:vs:g:l:L:c:a:opu:B:k:"
 #ifdef OBDPLATFORM_POSIX
 	"m"
 #endif //OBDPLATFORM_POSIX
+#ifdef HAVE_LIVEHTTP
+	"H:"
+#endif //HAVE_LIVEHTTP
+#ifdef HAVE_DBUS
+	"r:"
+#endif //HAVE_DBUS
 ;
 
 /// Print Help for --help
@@ -0,0 +1,514 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/** \file
+ \brief Read NMEA and u-blox UBX straight from a serial gps
+ */
+
+#include "nmeagps.h"
+#include "obdserial.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/select.h>
+
+/// Most fields in an NMEA sentence we care about
+#define NMEA_MAXFIELDS 24
+
+/// Knots to metres a second
+#define NMEA_KNOTS 0.514444
+
+/// One field of a sentence. Points into the read buffer
+struct nmeafield {
+	const char *p; ///< Start of the field
+	int len; ///< Length of the field
+};
+
+/// The fix being put together from one epoch's sentences
+struct nmeaepoch {
+	double tod; ///< UTC seconds since midnight. -1 if nothing yet
+	int havermc; ///< Set once we've seen the RMC
+	int havegga; ///< Set once we've seen the GGA
+	int havealt; ///< Set if the GGA had an altitude
+	int emitted; ///< Set once this epoch has been handed out
+	int valid; ///< Cleared if any sentence says there's no fix
+	struct gpsfix fix; ///< What we know so far
+};
+
+/// Handle for gpssource_nmea
+struct nmeagps {
+	int fd; ///< The serial port
+	unsigned char buf[NMEAGPS_BUFSIZE]; ///< Bytes read so far
+	int len; ///< Bytes in buf
+	int pos; ///< Where parsing is up to
+	long days; ///< Days since 1970 from the last RMC. -1 if none yet
+	double daystod; ///< Time of day of the RMC days came from
+	int sawubx; ///< Set once the receiver has sent NAV-PVT
+	struct nmeaepoch epoch; ///< Fix being assembled from NMEA
+};
+
+/// Days from 1970-01-01 to a date
+static long nmea_daysfromcivil(int y, int m, int d) {
+	y -= m <= 2;
+	long era = (y >= 0 ? y : y-399) / 400;
+	long yoe = y - era * 400;
+	long doy = (153*(m + (m > 2 ? -3 : 9)) + 2)/5 + d-1;
+	long doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+/// Parse a decimal number in place
+/** \return 0 on success, -1 if it's empty or not a number */
+static int nmea_number(const struct nmeafield *f, double *val) {
+	const char *p = f->p;
+	const char *end = f->p + f->len;
+	int neg = 0;
+	double v = 0;
+	double scale = 1;
+	int digits = 0;
+
+	if(p < end && ('-' == *p || '+' == *p)) {
+		neg = ('-' == *p);
+		p++;
+	}
+	for(; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+		v = v * 10 + (*p - '0');
+	}
+	if(p < end && '.' == *p) {
+		for(p++; p < end && *p >= '0' && *p <= '9'; p++, digits++) {
+			scale /= 10;
+			v += (*p - '0') * scale;
+		}
+	}
+	if(0 == digits || p != end) return -1;
+	*val = neg?-v:v;
+	return 0;
+}
+
+/// Parse ddmm.mmmm or dddmm.mmmm plus a hemisphere into degrees
+static int nmea_latlon(const struct nmeafield *f, const struct nmeafield *hemi, double *val) {
+	double raw;
+	if(0 != nmea_number(f, &raw) || 1 != hemi->len) return -1;
+	int degrees = (int)(raw / 100);
+	*val = degrees + (raw - degrees * 100) / 60;
+	if('S' == *hemi->p || 'W' == *hemi->p) *val = -*val;
+	return 0;
+}
+
+/// Parse hhmmss.sss into seconds since midnight
+static int nmea_tod(const struct nmeafield *f, double *val) {
+	double raw;
+	if(6 > f->len || 0 != nmea_number(f, &raw)) return -1;
+	int hms = (int)raw;
+	*val = (hms / 10000) * 3600 + ((hms / 100) % 100) * 60 + (raw - (hms / 100) * 100);
+	return 0;
+}
+
+/// Two digits at p
+static int nmea_twodigits(const char *p) {
+	return (p[0] - '0') * 10 + (p[1] - '0');
+}
+
+/// Split a sentence into fields
+/** \param s first character after the $
+ \param end the *
+ \return number of fields */
+static int nmea_split(const char *s, const char *end, struct nmeafield *fields) {
+	int n = 0;
+	const char *start = s;
+	for(; s <= end && n < NMEA_MAXFIELDS; s++) {
+		if(s == end || ',' == *s) {
+			fields[n].p = start;
+			fields[n].len = s - start;
+			n++;
+			start = s+1;
+		}
+	}
+	return n;
+}
+
+/// Hex digit value, or -1
+static int nmea_hex(char c) {
+	if(c >= '0' && c <= '9') return c - '0';
+	if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+/// Hand out the epoch if it has a position
+/** \return 1 if fix was filled in */
+static int nmea_emit(struct nmeagps *g, struct gpsfix *fix) {
+	struct nmeaepoch *e = &g->epoch;
+	if(e->emitted || !e->valid || !(e->havermc || e->havegga)) return 0;
+	e->emitted = 1;
+	*fix = e->fix;
+	fix->status = e->havealt?1:0;
+	// Without a date, or once midnight has passed since the last one,
+	//   the time of day alone isn't a time. 0 says we don't know
+	fix->gpstime = 0;
+	if(0 <= g->days && e->tod >= g->daystod) {
+		fix->gpstime = g->days * 86400.0 + e->tod;
+	}
+	return 1;
+}
+
+/// Start a new epoch
+static void nmea_newepoch(struct nmeaepoch *e, double tod) {
+	memset(e, 0, sizeof(*e));
+	e->tod = tod;
+	e->valid = 1;
+}
+
+/// Handle one sentence
+/** \param s first character after the $
+ \param end the *
+ \return 1 if fix was filled in */
+static int nmea_sentence(struct nmeagps *g, const char *s, const char *end, struct gpsfix *fix) {
+	struct nmeafield f[NMEA_MAXFIELDS];
+	int n = nmea_split(s, end, f);
+	if(1 > n || 5 > f[0].len) return 0;
+
+	// Any talker; GP, GN, GL and so on all look alike
+	const char *type = f[0].p + f[0].len - 3;
+	int isrmc = (0 == memcmp(type, "RMC", 3));
+	int isgga = (0 == memcmp(type, "GGA", 3));
+	if(!isrmc && !isgga) return 0;
+	if(g->sawubx) return 0;
+
+	double tod;
+	if(2 > n || 0 != nmea_tod(&f[1], &tod)) return 0;
+
+	// A new epoch. If the last one never got both sentences, it goes now
+	int ready = 0;
+	struct nmeaepoch *e = &g->epoch;
+	if(tod != e->tod) {
+		ready = nmea_emit(g, fix);
+		nmea_newepoch(e, tod);
+	}
+	if(e->emitted) return ready;
+
+	if(isrmc) {
+		// $xxRMC,time,status,lat,N,lon,E,knots,course,ddmmyy,...
+		if(10 > n) return ready;
+		e->havermc = 1;
+		if(1 != f[2].len || 'A' != *f[2].p ||
+				0 != nmea_latlon(&f[3], &f[4], &e->fix.lat) ||
+				0 != nmea_latlon(&f[5], &f[6], &e->fix.lon)) {
+			e->valid = 0;
+			return ready;
+		}
+		double v;
+		if(0 == nmea_number(&f[7], &v)) e->fix.speed = v * NMEA_KNOTS;
+		if(0 == nmea_number(&f[8], &v)) e->fix.course = v;
+		if(6 == f[9].len) {
+			int day = nmea_twodigits(f[9].p);
+			int month = nmea_twodigits(f[9].p+2);
+			int year = 2000 + nmea_twodigits(f[9].p+4);
+			if(day >= 1 && day <= 31 && month >= 1 && month <= 12) {
+				g->days = nmea_daysfromcivil(year, month, day);
+				g->daystod = tod;
+			}
+		}
+	} else {
+		// $xxGGA,time,lat,N,lon,E,quality,numsats,hdop,alt,M,...
+		if(10 > n) return ready;
+		double quality;
+		e->havegga = 1;
+		if(0 != nmea_number(&f[6], &quality) || 0 >= quality ||
+				0 != nmea_latlon(&f[2], &f[3], &e->fix.lat) ||
+				0 != nmea_latlon(&f[4], &f[5], &e->fix.lon)) {
+			e->valid = 0;
+			return ready;
+		}
+		// Position but no altitude is 2D
+		e->havealt = (0 == nmea_number(&f[9], &e->fix.alt));
+	}
+
+	if(e->havermc && e->havegga) {
+		ready |= nmea_emit(g, fix);
+	}
+	return ready;
+}
+
+/// Little-endian integers out of a UBX payload
+static unsigned long ubx_u4(const unsigned char *p) {
+	return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+		((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static long ubx_i4(const unsigned char *p) {
+	unsigned long u = ubx_u4(p);
+	return (u & 0x80000000ul)?-(long)(0xFFFFFFFFul - u) - 1:(long)u;
+}
+
+/// Handle one UBX message
+/** \return 1 if fix was filled in */
+static int ubx_message(struct nmeagps *g, int cls, int id, const unsigned char *p, int len, struct gpsfix *fix) {
+	// NAV-PVT
+	if(0x01 != cls || 0x07 != id || 92 > len) return 0;
+
+	g->sawubx = 1;
+
+	int fixtype = p[20];
+	int gnssfixok = p[21] & 0x01;
+	if(!gnssfixok || fixtype < 2 || fixtype > 4) return 0;
+
+	fix->lon = ubx_i4(p+24) / 10000000.0;
+	fix->lat = ubx_i4(p+28) / 10000000.0;
+	fix->alt = ubx_i4(p+36) / 1000.0;
+	fix->speed = ubx_i4(p+60) / 1000.0;
+	fix->course = ubx_i4(p+64) / 100000.0;
+	fix->status = (2 == fixtype)?0:1;
+
+	int year = p[4] | (p[5] << 8);
+	fix->gpstime = 0;
+	if(0x03 == (p[11] & 0x03)) {
+		fix->gpstime = nmea_daysfromcivil(year, p[6], p[7]) * 86400.0 +
+			p[8] * 3600 + p[9] * 60 + p[10] + ubx_i4(p+16) / 1000000000.0;
+	}
+	return 1;
+}
+
+/// Work through whatever's in the buffer
+/** \return 1 if fix was filled in. Parsing stops there */
+static int nmea_parse(struct nmeagps *g, struct gpsfix *fix) {
+	int ready = 0;
+
+	while(!ready && g->pos < g->len) {
+		unsigned char *p = g->buf + g->pos;
+		int avail = g->len - g->pos;
+
+		if('$' == *p) {
+			unsigned char *nl = memchr(p, '\n', avail);
+			if(NULL == nl) {
+				if(avail > NMEAGPS_MAXSENTENCE) {
+					g->pos++;
+					continue;
+				}
+				break;
+			}
+			int slen = nl - p;
+			g->pos += slen + 1;
+
+			// $...*HH
+			unsigned char *star = memchr(p, '*', slen);
+			if(NULL == star || star + 2 >= nl) continue;
+			int h1 = nmea_hex(star[1]), h2 = nmea_hex(star[2]);
+			if(0 > h1 || 0 > h2) continue;
+			unsigned char sum = 0;
+			unsigned char *c;
+			for(c = p+1; c < star; c++) sum ^= *c;
+			if(sum != (h1 << 4 | h2)) continue;
+
+			ready = nmea_sentence(g, (const char *)p+1, (const char *)star, fix);
+		} else if(0xB5 == *p) {
+			if(avail < 6) break;
+			if(0x62 != p[1]) {
+				g->pos++;
+				continue;
+			}
+			int plen = p[4] | (p[5] << 8);
+			if(plen > NMEAGPS_MAXUBX) {
+				g->pos++;
+				continue;
+			}
+			if(avail < plen + 8) break;
+
+			// Fletcher checksum over class, id, length and payload
+			unsigned char cka = 0, ckb = 0;
+			int i;
+			for(i=2; i<plen+6; i++) {
+				cka += p[i];
+				ckb += cka;
+			}
+			if(cka != p[plen+6] || ckb != p[plen+7]) {
+				g->pos++;
+				continue;
+			}
+			g->pos += plen + 8;
+			ready = ubx_message(g, p[2], p[3], p+6, plen, fix);
+		} else {
+			g->pos++;
+		}
+	}
+
+	// Keep the unparsed tail at the front
+	if(g->pos > 0) {
+		memmove(g->buf, g->buf + g->pos, g->len - g->pos);
+		g->len -= g->pos;
+		g->pos = 0;
+	}
+	return ready;
+}
+
+/// Send a UBX message
+static void ubx_send(int fd, int cls, int id, const unsigned char *payload, int len) {
+	unsigned char msg[64];
+	if(len + 8 > (int)sizeof(msg)) return;
+	msg[0] = 0xB5;
+	msg[1] = 0x62;
+	msg[2] = cls;
+	msg[3] = id;
+	msg[4] = len & 0xFF;
+	msg[5] = (len >> 8) & 0xFF;
+	memcpy(msg+6, payload, len);
+	unsigned char cka = 0, ckb = 0;
+	int i;
+	for(i=2; i<len+6; i++) {
+		cka += msg[i];
+		ckb += cka;
+	}
+	msg[len+6] = cka;
+	msg[len+7] = ckb;
+	if(len + 8 != write(fd, msg, len + 8)) {
+		perror("Not Fatal: Couldn't configure gps");
+	}
+}
+
+/// Open the serial gps. Address is device[?baud=N&rate=N&ubx=1]
+static void *nmea_open(const char *address) {
+	char device[1024];
+	long baud = -1;
+	int rate = 0;
+	int ubx = 0;
+
+	strncpy(device, address, sizeof(device)-1);
+	device[sizeof(device)-1] = '\0';
+	char *opts = strchr(device, '?');
+	if(NULL != opts) {
+		*opts++ = '\0';
+		char *opt;
+		for(opt = strtok(opts, "&"); NULL != opt; opt = strtok(NULL, "&")) {
+			if(0 == strncmp(opt, "baud=", 5)) {
+				baud = strtol(opt+5, NULL, 10);
+			} else if(0 == strncmp(opt, "rate=", 5)) {
+				rate = atoi(opt+5);
+			} else if(0 == strncmp(opt, "ubx=", 4)) {
+				ubx = atoi(opt+4);
+			} else {
+				fprintf(stderr, "Not Fatal: Unknown gps option %s\n", opt);
+			}
+		}
+	}
+
+	int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(-1 == fd) {
+		return NULL;
+	}
+
+	// Raw, if it's a tty
+	struct termios options;
+	if(0 == tcgetattr(fd, &options)) {
+		cfmakeraw(&options);
+		options.c_cflag |= (CLOCAL | CREAD);
+		tcsetattr(fd, TCSANOW, &options);
+		if(0 < baud && 0 != modifybaud(fd, baud)) {
+			fprintf(stderr, "Not Fatal: Couldn't set gps to %li baud\n", baud);
+		}
+		// Whatever's queued up arrived before now; it'd be stamped wrong
+		tcflush(fd, TCIFLUSH);
+	}
+
+	if(0 < rate) {
+		// CFG-RATE: measurement period in ms, one nav solution each, GPS time
+		int period = 1000 / rate;
+		unsigned char cfgrate[6] = { period & 0xFF, (period >> 8) & 0xFF, 1, 0, 1, 0 };
+		ubx_send(fd, 0x06, 0x08, cfgrate, sizeof(cfgrate));
+	}
+	if(ubx) {
+		// CFG-MSG: NAV-PVT once per solution on this port
+		unsigned char cfgmsg[3] = { 0x01, 0x07, 1 };
+		ubx_send(fd, 0x06, 0x01, cfgmsg, sizeof(cfgmsg));
+	}
+
+	struct nmeagps *g = (struct nmeagps *)malloc(sizeof(struct nmeagps));
+	if(NULL == g) {
+		close(fd);
+		return NULL;
+	}
+	g->fd = fd;
+	g->len = 0;
+	g->pos = 0;
+	g->days = -1;
+	g->daystod = 0;
+	g->sawubx = 0;
+	nmea_newepoch(&g->epoch, -1);
+	return g;
+}
+
+static int nmea_read(void *h, struct gpsfix *fix, long timeout) {
+	struct nmeagps *g = (struct nmeagps *)h;
+
+	// Anything left over from last time
+	if(nmea_parse(g, fix)) return 1;
+
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(g->fd, &fds);
+	struct timeval selecttime;
+	selecttime.tv_sec = timeout / 1000000l;
+	selecttime.tv_usec = timeout % 1000000l;
+
+	int count = select(g->fd + 1, &fds, NULL, NULL, &selecttime);
+	if(count < 0) {
+		return EINTR == errno?0:-1;
+	}
+	if(0 == count) {
+		return 0;
+	}
+
+	if(g->len == NMEAGPS_BUFSIZE) {
+		// Nothing in here parses. Start again
+		g->len = 0;
+	}
+	ssize_t n = read(g->fd, g->buf + g->len, NMEAGPS_BUFSIZE - g->len);
+	if(0 > n) {
+		return (EAGAIN == errno || EINTR == errno)?0:-1;
+	}
+	if(0 == n) {
+		// Unplugged
+		return -1;
+	}
+	g->len += n;
+
+	return nmea_parse(g, fix);
+}
+
+static void nmea_close(void *h) {
+	struct nmeagps *g = (struct nmeagps *)h;
+	close(g->fd);
+	free(g);
+}
+
+const struct gpssource gpssource_nmea = {
+	"nmea",
+	nmea_open,
+	nmea_read,
+	nmea_close
+};
+
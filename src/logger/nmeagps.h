@@ -0,0 +1,54 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+
+/** \file
+ \brief Read NMEA and u-blox UBX straight from a serial gps
+ For when there's no gpsd. Sentences are parsed where they sit in the
+  read buffer and checksummed before anything's believed. NMEA fixes are
+  put together from the RMC and GGA sentences for each epoch. Once the
+  receiver has sent a UBX NAV-PVT, its NMEA is ignored; NAV-PVT has
+  everything in one message, so it's how to get 5-10Hz out of a u-blox.
+
+ Address is device[?option&option...]
+  baud=N  set the serial port to N baud. Default is to leave it alone
+  rate=N  ask a u-blox receiver for N fixes a second
+  ubx=1   ask a u-blox receiver to send NAV-PVT
+ */
+
+#ifndef __NMEAGPS_H
+#define __NMEAGPS_H
+
+#include "gpsreader.h"
+
+/// Longest NMEA sentence we'll look at. The standard says 82
+#define NMEAGPS_MAXSENTENCE 128
+
+/// Longest UBX payload we'll look at
+#define NMEAGPS_MAXUBX 512
+
+/// Size of the read buffer
+#define NMEAGPS_BUFSIZE 2048
+
+/// Fixes read straight from a serial gps
+extern const struct gpssource gpssource_nmea;
+
+#endif //__NMEAGPS_H
+
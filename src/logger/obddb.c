@@ -22,6 +22,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
  */
 
 #include "obddb.h"
+#include "database.h"
 #include "obdservicecommands.h"
 #include "supportedcommands.h"
 
@@ -66,7 +67,8 @@ int createobdtable(sqlite3 *db, void *obdcaps) {
 				strcat(create_stmt," REAL,");
 			}
 		}
-		strcat(create_stmt,"time REAL, trip INTEGER, ecu INTEGER DEFAULT 0)");
+		strcat(create_stmt,"time REAL, trip INTEGER, ecu INTEGER DEFAULT 0, monotime REAL, "
+			"lat REAL, lon REAL, alt REAL)");
 
 		// printf("Create_stmt:\n  %s\n", create_stmt);
 
@@ -77,18 +79,18 @@ int createobdtable(sqlite3 *db, void *obdcaps) {
 		}
 
 	} else { // If the table already existed
+		// One pass over the existing columns, marking the ones we know about
+		char found_row[256];
+		memset(found_row, 0, sizeof(found_row));
+		sqlite3_reset(pragma_stmt);
+		while(SQLITE_ROW == sqlite3_step(pragma_stmt)) {
+			struct obdservicecmd *cmd = obdGetCmdForColumn((const char *)sqlite3_column_text(pragma_stmt, 1));
+			if(NULL != cmd) found_row[cmd->cmdid] = 1;
+		}
+
 		for(i=0; i<sizeof(obdcmds_mode1)/sizeof(obdcmds_mode1[0]); i++) {
 			if(NULL != obdcmds_mode1[i].db_column && isobdcapabilitysupported(obdcaps,i)) {
-				sqlite3_reset(pragma_stmt);
-				int found_row = 0;
-
-				while(SQLITE_ROW == sqlite3_step(pragma_stmt)) {
-					if(0 == strcmp(obdcmds_mode1[i].db_column ,sqlite3_column_text(pragma_stmt, 1))) {
-						found_row = 1;
-					}
-				}
-
-				if(found_row) {
+				if(found_row[obdcmds_mode1[i].cmdid]) {
 					// printf("Found row %s already in database\n", obdcmds_mode1[i].db_column);
 				} else {
 					char sql[512];
@@ -106,6 +108,14 @@ int createobdtable(sqlite3 *db, void *obdcaps) {
 
 	sqlite3_finalize(pragma_stmt);
 
+	// Logs from before samples had a monotonic timestamp
+	addcolumnifmissing(db, "obd", "monotime", "REAL");
+
+	// Logs from before samples were tagged with a position
+	addcolumnifmissing(db, "obd", "lat", "REAL");
+	addcolumnifmissing(db, "obd", "lon", "REAL");
+	addcolumnifmissing(db, "obd", "alt", "REAL");
+
 	// Create the table index
 	char create_idx_sql[] = "CREATE INDEX IF NOT EXISTS IDX_OBDTIME ON obd (time)";
 
@@ -138,11 +148,11 @@ int createobdinsertstmt(sqlite3 *db,sqlite3_stmt **ret_stmt, void *obdcaps) {
 			columncount++;
 		}
 	}
-	strcat(insert_sql,"time,trip) VALUES (");
+	strcat(insert_sql,"time,trip,monotime) VALUES (");
 	for(i=0; i<columncount; i++) {
 		strcat(insert_sql,"?,");
 	}
-	strcat(insert_sql,"?,?)");
+	strcat(insert_sql,"?,?,?)");
 
 	columncount++; // for time
 	// printf("insert_sql:\n  %s\n", insert_sql);
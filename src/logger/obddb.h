@@ -36,7 +36,8 @@ int createobdtable(sqlite3 *db, void *obdcaps);
  \param db the database handle this is for
  \param ret_stmt the prepared statement is placed in this value
  \param obdcaps the obdcapabilities returned from getobdcapabilities
- \return number of columns in the insert statement, or zero on fail
+ \return number of columns in the insert statement up to and including
+    time, or zero on fail. trip and monotime follow time
  */
 int createobdinsertstmt(sqlite3 *db, sqlite3_stmt **ret_stmt, void *obdcaps);
 
@@ -29,6 +29,12 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 // Not for you
 static DBusConnection* obddbusconn = NULL;
 
+/// Minimum time between frames we signal. Negative means never
+static double obddbusinterval = 1.0/OBDDBUS_DEFAULTRATE;
+
+/// Time of the last frame we signalled
+static double obddbuslastframe = 0;
+
 int obdinitialisedbus() {
 	DBusError err;
 
@@ -91,6 +97,8 @@ enum obd_dbus_message obdhandledbusmessages() {
 	if(NULL != (msg = dbus_connection_pop_message(obddbusconn))) {
 		if(dbus_message_is_method_call(msg, OBDDBUS_INTERFACENAME, "startTrip")) {
 			retvalue = OBD_DBUS_STARTTRIP;
+		} else if(dbus_message_is_method_call(msg, OBDDBUS_INTERFACENAME, "saveBlackBox")) {
+			retvalue = OBD_DBUS_SAVEBLACKBOX;
 		} else if(dbus_message_is_method_call(msg, DBUS_INTERFACE_INTROSPECTABLE, "Introspect")) {
 			obddbusintropsect(msg);
 		}
@@ -101,18 +109,24 @@ enum obd_dbus_message obdhandledbusmessages() {
 	return retvalue;
 }
 
-void obddbussignalpid(struct obdservicecmd *cmd, float value) {
+void obddbussetrate(double hz) {
+	if(hz <= 0) {
+		obddbusinterval = -1;
+	} else {
+		obddbusinterval = 1.0/hz;
+	}
+}
+
+/// Queue a signal for one value
+static void obddbusqueuepid(struct obdservicecmd *cmd, float value) {
 	DBusMessage *msg;
 	dbus_uint32_t serial;
-	
-	if(NULL == obddbusconn) return;
 
 	msg = dbus_message_new_signal("/obd", OBDDBUS_INTERFACENAME, "value");
 	if(NULL == msg) return;
 
 	double val = value; // DBus lacks a single float type
 
-	// printf("Sending msg %u %f\n", cmd->cmdid, value);
 	dbus_message_append_args (msg,
 					DBUS_TYPE_UINT32, &(cmd->cmdid), // PID
 					DBUS_TYPE_DOUBLE, &val, // Actual value
@@ -124,7 +138,24 @@ void obddbussignalpid(struct obdservicecmd *cmd, float value) {
 	dbus_message_set_no_reply(msg, TRUE);
 	dbus_connection_send(obddbusconn, msg, &serial);
 	dbus_message_unref(msg);
+}
+
+void obddbussignalframe(const struct obdlive_frame *f) {
+	if(NULL == obddbusconn) return;
+	if(obddbusinterval < 0) return;
+	if(f->time - obddbuslastframe < obddbusinterval &&
+		f->time >= obddbuslastframe) return;
+
+	obddbuslastframe = f->time;
+
+	int i;
+	for(i=0; i<f->numvalues; i++) {
+		struct obdservicecmd *cmd = obdGetCmdForPID(f->pid[i]);
+		if(NULL == cmd) continue;
+		obddbusqueuepid(cmd, f->value[i]);
+	}
 
+	dbus_connection_flush(obddbusconn);
 }
 
 
@@ -26,6 +26,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef HAVE_DBUS
 
 #include <dbus/dbus.h>
+#include "obdlivebus.h"
 
 /// Interface name for obdgpslogger dbus calls
 #define OBDDBUS_INTERFACENAME "org.icculus.obdgpslogger"
@@ -33,7 +34,8 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 /// We've been sent a message from another app
 enum obd_dbus_message {
 	OBD_DBUS_NOMESSAGE, ///< No Message waiting at this time
-	OBD_DBUS_STARTTRIP ///< Start a trip
+	OBD_DBUS_STARTTRIP, ///< Start a trip
+	OBD_DBUS_SAVEBLACKBOX ///< Trigger the blackbox
 };
 
 /// Handle any dbus messages we've been sent
@@ -42,8 +44,20 @@ enum obd_dbus_message obdhandledbusmessages();
 /// Initialise dbus
 int obdinitialisedbus();
 
-/// Signal that we have found a value for this cmd
-void obddbussignalpid(struct obdservicecmd *cmd, float value);
+/// Default number of frames per second to signal over dbus
+#define OBDDBUS_DEFAULTRATE 1.0
+
+/// Set how many frames per second are signalled over dbus
+/** The live bus carries every sample; dbus is only for slower consumers.
+ \param hz frames per second. Zero or less disables dbus signals
+ */
+void obddbussetrate(double hz);
+
+/// Signal all the values in this frame
+/** Frames arriving faster than the rate set by obddbussetrate are
+     dropped. All the signals for one frame go out in a single flush
+ */
+void obddbussignalframe(const struct obdlive_frame *f);
 
 
 #endif //HAVE_DBUS
@@ -0,0 +1,138 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Learned response counts database stuff
+ */
+
+#include "responsedb.h"
+#include "pidresponses.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sqlite3.h"
+
+int createresponsetable(sqlite3 *db) {
+	char create_sql[] = "CREATE TABLE IF NOT EXISTS pidresponses (ecu INTEGER, mode INTEGER, "
+		"pid INTEGER, responses INTEGER, PRIMARY KEY (ecu,mode,pid))";
+
+	/// sqlite3 return status
+	int rc;
+	/// sqlite3 error message
+	char *errmsg;
+
+	if(SQLITE_OK != (rc = sqlite3_exec(db, create_sql, NULL, NULL, &errmsg))) {
+		fprintf(stderr, "sqlite error on statement %s: %s\n", create_sql, errmsg);
+		sqlite3_free(errmsg);
+		return 1;
+	}
+
+	return 0;
+}
+
+int loadresponsehints(sqlite3 *db, sqlite3_int64 ecuid) {
+	char select_sql[] = "SELECT mode,pid,responses FROM pidresponses WHERE ecu=?";
+	int rc;
+	sqlite3_stmt *stmt;
+
+	rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL);
+
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", select_sql, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	sqlite3_bind_int64(stmt, 1, ecuid);
+
+	int count = 0;
+	while(SQLITE_ROW == (rc = sqlite3_step(stmt))) {
+		pidresponses_set(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1),
+			sqlite3_column_int(stmt, 2));
+		count++;
+	}
+
+	if(SQLITE_DONE != rc && SQLITE_OK != rc) {
+		fprintf(stderr, "Error stepping select statement(%i): %s\n", rc, sqlite3_errmsg(db));
+		count = -1;
+	}
+
+	sqlite3_finalize(stmt);
+
+	return count;
+}
+
+/// Everything saveresponse needs
+struct saveresponse_args {
+	sqlite3_int64 ecuid; ///< Vehicle being saved
+	sqlite3_stmt *insert; ///< Prepared insert
+	sqlite3_stmt *forget; ///< Prepared delete
+	int failed; ///< Set if anything went wrong
+};
+
+/// Save one pid; a pidresponses_cb
+static void saveresponse(unsigned int mode, unsigned int pid, int responses, void *arg) {
+	struct saveresponse_args *a = (struct saveresponse_args *)arg;
+	sqlite3_stmt *stmt = (PIDRESPONSES_UNKNOWN == responses)?a->forget:a->insert;
+
+	sqlite3_bind_int64(stmt, 1, a->ecuid);
+	sqlite3_bind_int(stmt, 2, mode);
+	sqlite3_bind_int(stmt, 3, pid);
+	if(PIDRESPONSES_UNKNOWN != responses) {
+		sqlite3_bind_int(stmt, 4, responses);
+	}
+
+	int rc = sqlite3_step(stmt);
+	if(SQLITE_OK != rc && SQLITE_DONE != rc) {
+		a->failed = 1;
+	}
+	sqlite3_reset(stmt);
+}
+
+int saveresponsehints(sqlite3 *db, sqlite3_int64 ecuid) {
+	char insert_sql[] = "INSERT OR REPLACE INTO pidresponses (ecu,mode,pid,responses) VALUES (?,?,?,?)";
+	char delete_sql[] = "DELETE FROM pidresponses WHERE ecu=? AND mode=? AND pid=?";
+
+	struct saveresponse_args a;
+	memset(&a, 0, sizeof(a));
+	a.ecuid = ecuid;
+
+	if(SQLITE_OK != sqlite3_prepare_v2(db, insert_sql, -1, &a.insert, NULL)) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", insert_sql, sqlite3_errmsg(db));
+		return -1;
+	}
+	if(SQLITE_OK != sqlite3_prepare_v2(db, delete_sql, -1, &a.forget, NULL)) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", delete_sql, sqlite3_errmsg(db));
+		sqlite3_finalize(a.insert);
+		return -1;
+	}
+
+	pidresponses_foreach(1, saveresponse, &a);
+
+	if(a.failed) {
+		fprintf(stderr, "Error saving response counts: %s\n", sqlite3_errmsg(db));
+	}
+
+	sqlite3_finalize(a.insert);
+	sqlite3_finalize(a.forget);
+
+	return a.failed?-1:0;
+}
+
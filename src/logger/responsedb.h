@@ -0,0 +1,47 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Learned response counts database stuff
+ Response counts are kept per vehicle, against the ecu table's ecuid,
+  so they don't have to be relearned every run.
+ */
+
+#ifndef __RESPONSEDB_H
+#define __RESPONSEDB_H
+
+#include "sqlite3.h"
+
+/// Create the pidresponses table in the database
+int createresponsetable(sqlite3 *db);
+
+/// Load the counts learned for this vehicle
+/** Anything learned this run that isn't in the database is kept
+ \param ecuid from the ecu table
+ \return number of pids loaded, or -1 on error */
+int loadresponsehints(sqlite3 *db, sqlite3_int64 ecuid);
+
+/// Save counts that have changed since the last save
+/** \param ecuid from the ecu table
+ \return 0 on success, -1 on error */
+int saveresponsehints(sqlite3 *db, sqlite3_int64 ecuid);
+
+#endif //__RESPONSEDB_H
+
@@ -0,0 +1,214 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Rollup tables: obd values summarised over fixed intervals
+ */
+
+#include "rollupdb.h"
+#include "database.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sqlite3.h"
+
+/// Suffixes for each column's summary columns, in the order they're bound
+static const char *rollup_suffixes[] = { "_min", "_max", "_mean", "_count" };
+
+/// Number of rollup_suffixes
+#define ROLLUP_NUMSUFFIXES (sizeof(rollup_suffixes)/sizeof(rollup_suffixes[0]))
+
+int initrollup(sqlite3 *db, struct rollup *r, const char **columns, int numcols) {
+	const int resolutions[ROLLUP_NUMLEVELS] = ROLLUP_RESOLUTIONS;
+	int i, j;
+	int rc;
+	char *errmsg;
+
+	memset(r, 0, sizeof(struct rollup));
+
+	// Room for each column name four times over, with suffixes and placeholders
+	size_t len = 512;
+	for(i=0;i<numcols;i++) {
+		len += ROLLUP_NUMSUFFIXES * (strlen(columns[i]) + 16);
+	}
+	char *create_sql = (char *)malloc(len);
+	char *insert_sql = (char *)malloc(len);
+	if(NULL == create_sql || NULL == insert_sql) {
+		free(create_sql);
+		free(insert_sql);
+		return 1;
+	}
+
+	snprintf(create_sql, len, "CREATE TABLE IF NOT EXISTS " ROLLUP_TABLE " (resolution INTEGER, "
+		"trip INTEGER, start REAL, samples INTEGER");
+	snprintf(insert_sql, len, "INSERT OR REPLACE INTO " ROLLUP_TABLE " (resolution,trip,start,samples");
+	for(i=0;i<numcols;i++) {
+		for(j=0;j<ROLLUP_NUMSUFFIXES;j++) {
+			const char *type = (ROLLUP_NUMSUFFIXES-1 == j)?"INTEGER":"REAL";
+			snprintf(create_sql + strlen(create_sql), len - strlen(create_sql), ", %s%s %s",
+				columns[i], rollup_suffixes[j], type);
+			snprintf(insert_sql + strlen(insert_sql), len - strlen(insert_sql), ",%s%s",
+				columns[i], rollup_suffixes[j]);
+		}
+	}
+	strncat(create_sql, ", PRIMARY KEY (resolution,trip,start))", len - strlen(create_sql) - 1);
+	strncat(insert_sql, ") VALUES (?,?,?,?", len - strlen(insert_sql) - 1);
+	for(i=0;i<numcols*ROLLUP_NUMSUFFIXES;i++) {
+		strncat(insert_sql, ",?", len - strlen(insert_sql) - 1);
+	}
+	strncat(insert_sql, ")", len - strlen(insert_sql) - 1);
+
+	if(SQLITE_OK != (rc = sqlite3_exec(db, create_sql, NULL, NULL, &errmsg))) {
+		fprintf(stderr, "sqlite error on statement %s: %s\n", create_sql, errmsg);
+		sqlite3_free(errmsg);
+		free(create_sql);
+		free(insert_sql);
+		return 1;
+	}
+	free(create_sql);
+
+	// Earlier runs may have logged different columns
+	for(i=0;i<numcols;i++) {
+		for(j=0;j<ROLLUP_NUMSUFFIXES;j++) {
+			char column[128];
+			snprintf(column, sizeof(column), "%s%s", columns[i], rollup_suffixes[j]);
+			addcolumnifmissing(db, ROLLUP_TABLE, column, (ROLLUP_NUMSUFFIXES-1 == j)?"INTEGER":"REAL");
+		}
+	}
+
+	rc = sqlite3_prepare_v2(db, insert_sql, -1, &r->insert, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", insert_sql, sqlite3_errmsg(db));
+		free(insert_sql);
+		r->insert = NULL;
+		return 1;
+	}
+	free(insert_sql);
+
+	r->numcols = numcols;
+	for(i=0;i<ROLLUP_NUMLEVELS;i++) {
+		r->levels[i].resolution = resolutions[i];
+		r->levels[i].cols = (struct rollupcolumn *)calloc(numcols>0?numcols:1, sizeof(struct rollupcolumn));
+		if(NULL == r->levels[i].cols) {
+			closerollup(r);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/// Write one level's interval as it stands
+static int rollup_write(struct rollup *r, struct rolluplevel *l) {
+	int i;
+	int param = 1;
+
+	sqlite3_bind_int(r->insert, param++, l->resolution);
+	sqlite3_bind_int64(r->insert, param++, l->trip);
+	sqlite3_bind_double(r->insert, param++, l->start);
+	sqlite3_bind_int64(r->insert, param++, l->samples);
+	for(i=0;i<r->numcols;i++) {
+		const struct rollupcolumn *c = &l->cols[i];
+		if(0 < c->count) {
+			sqlite3_bind_double(r->insert, param++, c->min);
+			sqlite3_bind_double(r->insert, param++, c->max);
+			sqlite3_bind_double(r->insert, param++, c->sum / c->count);
+		} else {
+			sqlite3_bind_null(r->insert, param++);
+			sqlite3_bind_null(r->insert, param++);
+			sqlite3_bind_null(r->insert, param++);
+		}
+		sqlite3_bind_int64(r->insert, param++, c->count);
+	}
+
+	int rc = sqlite3_step(r->insert);
+	sqlite3_reset(r->insert);
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "Not Fatal: sqlite3 rollup insert failed(%i): %s\n",
+			rc, sqlite3_errmsg(sqlite3_db_handle(r->insert)));
+		return -1;
+	}
+	return 0;
+}
+
+void rollup_add(struct rollup *r, sqlite3_int64 trip, double time,
+		const double *values, const unsigned char *present) {
+	int i, j;
+
+	if(NULL == r->insert) return;
+
+	for(i=0;i<ROLLUP_NUMLEVELS;i++) {
+		struct rolluplevel *l = &r->levels[i];
+		double start = (double)((long long)(time / l->resolution)) * l->resolution;
+
+		if(l->open && (start != l->start || trip != l->trip)) {
+			rollup_write(r, l);
+			l->open = 0;
+		}
+		if(!l->open) {
+			l->open = 1;
+			l->trip = trip;
+			l->start = start;
+			l->samples = 0;
+			memset(l->cols, 0, r->numcols * sizeof(struct rollupcolumn));
+		}
+
+		l->samples++;
+		for(j=0;j<r->numcols;j++) {
+			struct rollupcolumn *c = &l->cols[j];
+			if(!present[j]) continue;
+			if(0 == c->count || values[j] < c->min) c->min = values[j];
+			if(0 == c->count || values[j] > c->max) c->max = values[j];
+			c->sum += values[j];
+			c->count++;
+		}
+	}
+}
+
+int rollup_save(struct rollup *r) {
+	int i;
+	int retvalue = 0;
+
+	if(NULL == r->insert) return 0;
+
+	for(i=0;i<ROLLUP_NUMLEVELS;i++) {
+		if(r->levels[i].open && 0 != rollup_write(r, &r->levels[i])) {
+			retvalue = -1;
+		}
+	}
+	return retvalue;
+}
+
+void closerollup(struct rollup *r) {
+	int i;
+
+	rollup_save(r);
+	if(NULL != r->insert) {
+		sqlite3_finalize(r->insert);
+		r->insert = NULL;
+	}
+	for(i=0;i<ROLLUP_NUMLEVELS;i++) {
+		free(r->levels[i].cols);
+		r->levels[i].cols = NULL;
+		r->levels[i].open = 0;
+	}
+}
+
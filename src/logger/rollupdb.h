@@ -0,0 +1,93 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Rollup tables: obd values summarised over fixed intervals
+ The obdrollup table has a row per resolution, trip and interval, with
+ the min, max, mean and count of each obd column over that interval.
+ Columns are named <column>_min, <column>_max, <column>_mean and
+ <column>_count. Tools covering long spans can read a coarse level
+ instead of every sample.
+ */
+
+#ifndef __ROLLUPDB_H
+#define __ROLLUPDB_H
+
+#include "sqlite3.h"
+
+/// Name of the rollup table
+#define ROLLUP_TABLE "obdrollup"
+
+/// Number of resolutions kept
+#define ROLLUP_NUMLEVELS 3
+
+/// Seconds covered by each level's intervals
+#define ROLLUP_RESOLUTIONS { 1, 60, 3600 }
+
+/// One column's summary over the interval so far
+struct rollupcolumn {
+	long count; ///< Values seen
+	double min; ///< Smallest value
+	double max; ///< Largest value
+	double sum; ///< Total, for the mean
+};
+
+/// The interval being summarised at one resolution
+struct rolluplevel {
+	int resolution; ///< Seconds per interval
+	int open; ///< Set if the fields below hold an interval
+	sqlite3_int64 trip; ///< Trip the interval is in
+	double start; ///< Start of the interval, in seconds since the epoch
+	long samples; ///< Samples in the interval
+	struct rollupcolumn *cols; ///< Per-column summaries
+};
+
+/// Rollups being maintained as samples come in
+struct rollup {
+	sqlite3_stmt *insert; ///< Replaces one interval's row
+	int numcols; ///< obd columns summarised
+	struct rolluplevel levels[ROLLUP_NUMLEVELS]; ///< One per resolution
+};
+
+/// Create the rollup table and prepare to maintain it
+/** \param columns db_column name of each column summarised
+ \return 0 on success, nonzero on failure */
+int initrollup(sqlite3 *db, struct rollup *r, const char **columns, int numcols);
+
+/// Add a sample to every level
+/** An interval is written out once a sample arrives for a later one,
+     or for another trip
+ \param time wall clock time of the sample
+ \param values one per column
+ \param present one per column. Set where values holds something */
+void rollup_add(struct rollup *r, sqlite3_int64 trip, double time,
+	const double *values, const unsigned char *present);
+
+/// Write every interval still open as it stands
+/** Call before committing, so the rollups keep up with the obd table.
+     They're written again once they're complete
+ \return 0 on success, -1 on error */
+int rollup_save(struct rollup *r);
+
+/// Write out what's open and finalize the statement
+void closerollup(struct rollup *r);
+
+#endif //__ROLLUPDB_H
+
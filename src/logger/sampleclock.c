@@ -0,0 +1,180 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Sample clock for the logger main loop
+ */
+
+#include "sampleclock.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/select.h>
+
+/// Get the time on the clock samples are scheduled on
+static int sampleclock_now(struct timespec *ts) {
+#ifdef HAVE_CLOCK_MONOTONIC
+	return clock_gettime(CLOCK_MONOTONIC, ts);
+#else
+	// No monotonic clock; at least keep the arithmetic right
+	struct timeval tv;
+	if(0 != gettimeofday(&tv, NULL)) return -1;
+	ts->tv_sec = tv.tv_sec;
+	ts->tv_nsec = tv.tv_usec * 1000l;
+	return 0;
+#endif //HAVE_CLOCK_MONOTONIC
+}
+
+/// a-b in usec
+static long sampleclock_diff(const struct timespec *a, const struct timespec *b) {
+	return (long)(a->tv_sec - b->tv_sec) * 1000000l + (a->tv_nsec - b->tv_nsec) / 1000l;
+}
+
+/// Move a time forward by some usec
+static void sampleclock_add(struct timespec *ts, long usec) {
+	ts->tv_sec += usec / 1000000l;
+	ts->tv_nsec += (usec % 1000000l) * 1000l;
+	if(ts->tv_nsec >= 1000000000l) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000l;
+	}
+}
+
+int sampleclock_stamp(double *mono, double *wall) {
+	struct timespec now;
+	struct timeval wallnow;
+
+	if(0 != sampleclock_now(&now) || 0 != gettimeofday(&wallnow, NULL)) {
+		return -1;
+	}
+	if(NULL != mono) *mono = (double)now.tv_sec + (double)now.tv_nsec/1000000000.0;
+	if(NULL != wall) *wall = (double)wallnow.tv_sec + (double)wallnow.tv_usec/1000000.0;
+	return 0;
+}
+
+int sampleclock_init(struct sampleclock *c, long period) {
+	memset(c, 0, sizeof(*c));
+	c->period = period;
+	if(0 != sampleclock_now(&c->next)) {
+		perror("Couldn't read the sample clock");
+		return -1;
+	}
+	return 0;
+}
+
+int sampleclock_tick(struct sampleclock *c) {
+	struct timespec now;
+	struct timeval wallnow;
+
+	if(0 != sampleclock_now(&now) || 0 != gettimeofday(&wallnow, NULL)) {
+		perror("Couldn't read the sample clock");
+		return -1;
+	}
+
+	c->mono = (double)now.tv_sec + (double)now.tv_nsec/1000000000.0;
+	c->wall = (double)wallnow.tv_sec + (double)wallnow.tv_usec/1000000.0;
+
+	if(0 < c->period) {
+		c->late = sampleclock_diff(&now, &c->next);
+		if(c->late < 0) c->late = 0; // Woken early by a signal
+		sampleclock_add(&c->next, c->period);
+	} else {
+		c->late = 0;
+		c->next = now;
+	}
+
+	return 0;
+}
+
+void sampleclock_count(struct sampleclock *c) {
+	int bucket;
+	long edge = 1000;
+	for(bucket=0; bucket<SAMPLECLOCK_LATEBUCKETS-1 && c->late >= edge; bucket++) {
+		edge *= 2;
+	}
+	c->lateness[bucket]++;
+	if(c->late > c->maxlate) c->maxlate = c->late;
+	c->samples++;
+}
+
+long sampleclock_wait(struct sampleclock *c, const int *stop) {
+	struct timespec now;
+	long skipped = 0;
+
+	if(0 >= c->period) return 0;
+
+	if(0 != sampleclock_now(&now)) {
+		perror("Couldn't read the sample clock");
+		return 0;
+	}
+
+	// A little late, start straight away. Much later than that, drop the
+	//   ticks we've missed and wait for the next one, rather than sampling
+	//   back-to-back or off the grid to catch up
+	long overdue = sampleclock_diff(&now, &c->next);
+	if(overdue >= 0 && overdue < c->period/2) return 0;
+	if(overdue >= 0) {
+		skipped = overdue / c->period + 1;
+		sampleclock_add(&c->next, skipped * c->period);
+		c->skipped += skipped;
+	}
+
+#if defined(HAVE_CLOCK_NANOSLEEP) && defined(HAVE_CLOCK_MONOTONIC)
+	int rc;
+	while(EINTR == (rc = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &c->next, NULL))) {
+		if(NULL != stop && *stop) break;
+	}
+	if(0 != rc && EINTR != rc) {
+		fprintf(stderr, "clock_nanosleep: %s\n", strerror(rc));
+	}
+#else
+	long remaining;
+	while(0 == sampleclock_now(&now) && 0 < (remaining = sampleclock_diff(&c->next, &now))) {
+		struct timeval selecttime;
+		selecttime.tv_sec = remaining / 1000000l;
+		selecttime.tv_usec = remaining % 1000000l;
+		if(-1 == select(0, NULL, NULL, NULL, &selecttime) && NULL != stop && *stop) break;
+	}
+#endif //HAVE_CLOCK_NANOSLEEP && HAVE_CLOCK_MONOTONIC
+
+	return skipped;
+}
+
+double sampleclock_remaining(const struct sampleclock *c) {
+	struct timespec now;
+	if(0 >= c->period || 0 != sampleclock_now(&now)) return 0;
+	return (double)sampleclock_diff(&c->next, &now) / 1000000.0;
+}
+
+long sampleclock_bucketedge(int bucket) {
+	if(0 >= bucket) return 0;
+	return 1000l << (bucket-1);
+}
+
+void sampleclock_resetstats(struct sampleclock *c) {
+	c->samples = 0;
+	c->skipped = 0;
+	c->maxlate = 0;
+	memset(c->lateness, 0, sizeof(c->lateness));
+}
+
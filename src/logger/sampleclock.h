@@ -0,0 +1,91 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Sample clock for the logger main loop
+ Samples are due at fixed points on a monotonic clock, so a slow sample
+  doesn't push every later one back and the wall clock being stepped
+  [by ntp or gpsd] doesn't stretch or squash the sample period. When a
+  sample overruns by half a period or more, the ticks it ran into are
+  skipped and counted, and the next sample waits for its own tick.
+ */
+
+#ifndef __SAMPLECLOCK_H
+#define __SAMPLECLOCK_H
+
+#include <time.h>
+
+/// Number of lateness histogram buckets
+/** Bucket 0 is under 1ms late, bucket n is under 2^n ms, the last is everything else */
+#define SAMPLECLOCK_LATEBUCKETS 16
+
+/// Everything about the sample clock
+struct sampleclock {
+	long period; ///< usec between samples. 0 for as fast as possible
+	struct timespec next; ///< When the next sample is due, on the monotonic clock
+
+	double mono; ///< Monotonic time this sample started, seconds
+	double wall; ///< Wall clock time this sample started, seconds since the epoch
+	long late; ///< How late this sample started, usec
+
+	long samples; ///< Samples taken since the stats were reset
+	long skipped; ///< Ticks skipped since the stats were reset
+	long maxlate; ///< Latest start since the stats were reset, usec
+	unsigned long lateness[SAMPLECLOCK_LATEBUCKETS]; ///< Histogram of late
+};
+
+/// Start the clock. The first sample is due immediately
+/** \param period usec between samples, or 0 for as fast as possible
+ \return 0 on success, -1 on error */
+int sampleclock_init(struct sampleclock *c, long period);
+
+/// Read the clocks samples are stamped with
+/** \param mono if non-NULL, the monotonic time in seconds is stored here
+ \param wall if non-NULL, the wall clock time in seconds since the epoch is stored here
+ \return 0 on success, -1 on error */
+int sampleclock_stamp(double *mono, double *wall);
+
+/// Start a sample
+/** Fills in mono, wall and late
+ \return 0 on success, -1 on error */
+int sampleclock_tick(struct sampleclock *c);
+
+/// Add the current sample to the stats
+/** Separate from sampleclock_tick so a sample can count towards a trip
+    that started while it was being taken */
+void sampleclock_count(struct sampleclock *c);
+
+/// Wait until the next sample is due
+/** \param stop if non-NULL, give up early when a signal arrives and this is set
+ \return number of ticks skipped because we were too late for them */
+long sampleclock_wait(struct sampleclock *c, const int *stop);
+
+/// Seconds until the next sample is due. Negative if it's overdue
+/** Always 0 if running as fast as possible */
+double sampleclock_remaining(const struct sampleclock *c);
+
+/// Lower edge of a lateness bucket, usec
+long sampleclock_bucketedge(int bucket);
+
+/// Reset samples, skipped, maxlate and lateness
+void sampleclock_resetstats(struct sampleclock *c);
+
+#endif //__SAMPLECLOCK_H
+
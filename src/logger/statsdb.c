@@ -0,0 +1,91 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Stage timing database stuff
+ */
+
+#include "statsdb.h"
+#include "stagetiming.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sqlite3.h"
+
+int createstatstable(sqlite3 *db) {
+	char create_sql[] = "CREATE TABLE IF NOT EXISTS stagestats (time REAL, stage TEXT, "
+		"count INTEGER, total REAL, mean REAL, p50 REAL, p90 REAL, p99 REAL, max REAL)";
+
+	/// sqlite3 return status
+	int rc;
+	/// sqlite3 error message
+	char *errmsg;
+
+	if(SQLITE_OK != (rc = sqlite3_exec(db, create_sql, NULL, NULL, &errmsg))) {
+		fprintf(stderr, "sqlite error on statement %s: %s\n", create_sql, errmsg);
+		sqlite3_free(errmsg);
+		return 1;
+	}
+	return 0;
+}
+
+int savestagestats(sqlite3 *db, double time) {
+	char insert_sql[] = "INSERT INTO stagestats (time,stage,count,total,mean,p50,p90,p99,max) "
+		"VALUES (?,?,?,?,?,?,?,?,?)";
+	sqlite3_stmt *stmt;
+	int rc;
+	int retvalue = 0;
+
+	rc = sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", insert_sql, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	int i;
+	for(i=0; i<OBDSTAGE_COUNT; i++) {
+		struct stagetiming_summary s;
+		if(0 == stagetiming_summarise(i, &s)) continue;
+
+		const char *name = stagetiming_name(i);
+		sqlite3_bind_double(stmt, 1, time);
+		sqlite3_bind_text(stmt, 2, name, strlen(name), NULL);
+		sqlite3_bind_int64(stmt, 3, s.count);
+		sqlite3_bind_double(stmt, 4, s.total);
+		sqlite3_bind_double(stmt, 5, s.mean);
+		sqlite3_bind_double(stmt, 6, s.p50);
+		sqlite3_bind_double(stmt, 7, s.p90);
+		sqlite3_bind_double(stmt, 8, s.p99);
+		sqlite3_bind_double(stmt, 9, s.max);
+
+		rc = sqlite3_step(stmt);
+		if(SQLITE_DONE != rc) {
+			fprintf(stderr, "sqlite3 stagestats insert failed(%i): %s\n", rc, sqlite3_errmsg(db));
+			retvalue = -1;
+			break;
+		}
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+
+	return retvalue;
+}
+
@@ -0,0 +1,40 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Stage timing database stuff
+ */
+
+#ifndef __STATSDB_H
+#define __STATSDB_H
+
+#include "sqlite3.h"
+
+/// Create the stagestats table in the database
+int createstatstable(sqlite3 *db);
+
+/// Save a summary of every stage timed since the last reset
+/** One row per stage, all with the same time
+ \param time when this summary was taken
+ \return 0 on success, -1 on error */
+int savestagestats(sqlite3 *db, double time);
+
+#endif //__STATSDB_H
+
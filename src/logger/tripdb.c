@@ -22,8 +22,11 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
  */
 
 #include "tripdb.h"
+#include "database.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "sqlite3.h"
 
@@ -101,3 +104,100 @@ void updatetrip(sqlite3 *db, sqlite3_int64 obdtripid, double endtime) {
 
 }
 
+int addtripsummarycolumns(sqlite3 *db, const struct tripsummary *s) {
+	const char *columns[] = { "duration", "idle", "distance", "air", "fuel" };
+	int i;
+	int retvalue = 0;
+
+	for(i=0;i<sizeof(columns)/sizeof(columns[0]);i++) {
+		if(0 != addcolumnifmissing(db, "trip", columns[i], "REAL")) retvalue = -1;
+	}
+	for(i=0;i<s->numcols;i++) {
+		char column[128];
+		snprintf(column, sizeof(column), "%s_max", s->cols[i].name);
+		if(0 != addcolumnifmissing(db, "trip", column, "REAL")) retvalue = -1;
+		snprintf(column, sizeof(column), "%s_mean", s->cols[i].name);
+		if(0 != addcolumnifmissing(db, "trip", column, "REAL")) retvalue = -1;
+	}
+	return retvalue;
+}
+
+int savetripsummary(sqlite3 *db, const struct tripsummary *s) {
+	sqlite3_stmt *stmt;
+	int rc;
+	int i;
+
+	if(0 > s->trip || 0 == s->samples) return 0;
+
+	size_t len = 256;
+	for(i=0;i<s->numcols;i++) {
+		len += 2 * (strlen(s->cols[i].name) + 16);
+	}
+	char *update_sql = (char *)malloc(len);
+	if(NULL == update_sql) return -1;
+
+	snprintf(update_sql, len, "UPDATE trip SET duration=?,idle=?,distance=?,air=?,fuel=?");
+	for(i=0;i<s->numcols;i++) {
+		snprintf(update_sql + strlen(update_sql), len - strlen(update_sql),
+			",%s_max=?,%s_mean=?", s->cols[i].name, s->cols[i].name);
+	}
+	strncat(update_sql, " WHERE tripid=?", len - strlen(update_sql) - 1);
+
+	rc = sqlite3_prepare_v2(db, update_sql, -1, &stmt, NULL);
+	if(SQLITE_OK != rc) {
+		fprintf(stderr, "Can't prepare statement %s: %s\n", update_sql, sqlite3_errmsg(db));
+		free(update_sql);
+		return -1;
+	}
+	free(update_sql);
+
+	// Whatever wasn't logged stays NULL, rather than looking like zero
+	int param = 1;
+	sqlite3_bind_double(stmt, param++, s->lastmono - s->firstmono);
+	if(0 <= s->rpmcol && 0 <= s->vsscol) {
+		sqlite3_bind_double(stmt, param++, s->idle);
+	} else {
+		sqlite3_bind_null(stmt, param++);
+	}
+	if(s->havefix) {
+		sqlite3_bind_double(stmt, param++, s->distance);
+	} else {
+		sqlite3_bind_null(stmt, param++);
+	}
+	if(0 <= s->mafcol) {
+		sqlite3_bind_double(stmt, param++, s->air);
+		sqlite3_bind_double(stmt, param++, s->air / TRIPSUMMARY_AFR);
+	} else {
+		sqlite3_bind_null(stmt, param++);
+		sqlite3_bind_null(stmt, param++);
+	}
+	for(i=0;i<s->numcols;i++) {
+		const struct tripsummarycolumn *c = &s->cols[i];
+		if(0 < c->count) {
+			sqlite3_bind_double(stmt, param++, c->max);
+			sqlite3_bind_double(stmt, param++, c->sum / c->count);
+		} else {
+			sqlite3_bind_null(stmt, param++);
+			sqlite3_bind_null(stmt, param++);
+		}
+	}
+	sqlite3_bind_int64(stmt, param++, s->trip);
+
+	int retvalue = 0;
+	rc = sqlite3_step(stmt);
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "sqlite3 trip summary update failed(%i): %s\n", rc, sqlite3_errmsg(db));
+		retvalue = -1;
+	}
+	sqlite3_finalize(stmt);
+
+	return retvalue;
+}
+
+void switchtripsummary(sqlite3 *db, struct tripsummary *s, sqlite3_int64 trip) {
+	if(trip == s->trip) return;
+
+	savetripsummary(db, s);
+	tripsummary_start(s, trip);
+}
+
@@ -25,6 +25,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #define __TRIPDB_H
 
 #include "sqlite3.h"
+#include "tripsummary.h"
 
 /// Create the trip table in the database
 int createtriptable(sqlite3 *db);
@@ -43,6 +44,20 @@ sqlite3_int64 starttrip(sqlite3 *db, double starttime);
  */
 void updatetrip(sqlite3 *db, sqlite3_int64 obdtripid, double endtime);
 
+/// Add the trip table columns a summary is saved in, if they're missing
+/** duration, idle, distance, air and fuel, plus <column>_max and
+     <column>_mean for each column the summary keeps them for
+ \return 0 on success, -1 on error */
+int addtripsummarycolumns(sqlite3 *db, const struct tripsummary *s);
+
+/// Save a trip's summary as it stands into the trip table
+/** \return 0 on success, -1 on error */
+int savetripsummary(sqlite3 *db, const struct tripsummary *s);
+
+/// Move a summary on to another trip, saving the last one first
+/** Does nothing if it's already summarising that trip */
+void switchtripsummary(sqlite3 *db, struct tripsummary *s, sqlite3_int64 trip);
+
 
 #endif //__GPSDB_H
 
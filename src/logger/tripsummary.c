@@ -0,0 +1,145 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Trip summaries, accumulated as samples and fixes arrive
+ */
+
+#include "tripsummary.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/// Mean earth radius in kilometers
+#define TRIPSUMMARY_EARTHRADIUS 6371.0
+
+/// Great circle distance in kilometers, same as examinetrips' haversine_dist
+static double tripsummary_haversine(double latA, double lonA, double latB, double lonB) {
+	double sinlat = sin(((latB-latA)/2) * (M_PI/180));
+	double sinlon = sin(((lonB-lonA)/2) * (M_PI/180));
+
+	double a = sinlat*sinlat + sinlon*sinlon * cos(latA * (M_PI/180)) * cos(latB * (M_PI/180));
+	return TRIPSUMMARY_EARTHRADIUS * 2 * atan2(sqrt(a), sqrt(1-a));
+}
+
+/// Index of a column, or -1
+static int tripsummary_find(const char **columns, int numcolumns, const char *name) {
+	int i;
+	for(i=0;i<numcolumns;i++) {
+		if(0 == strcmp(columns[i], name)) return i;
+	}
+	return -1;
+}
+
+int tripsummary_init(struct tripsummary *s, const char **columns, int numcolumns, const char *selected) {
+	memset(s, 0, sizeof(struct tripsummary));
+	s->trip = -1;
+	s->rpmcol = tripsummary_find(columns, numcolumns, "rpm");
+	s->vsscol = tripsummary_find(columns, numcolumns, "vss");
+	s->mafcol = tripsummary_find(columns, numcolumns, "maf");
+
+	s->cols = (struct tripsummarycolumn *)calloc(numcolumns>0?numcolumns:1, sizeof(struct tripsummarycolumn));
+	if(NULL == s->cols) return -1;
+	if(NULL == selected) return 0;
+
+	char *list = strdup(selected);
+	if(NULL == list) return -1;
+
+	char *col = strtok(list, ",: ");
+	while(NULL != col && s->numcols < numcolumns) {
+		int i, index = tripsummary_find(columns, numcolumns, col);
+		int dup = 0;
+		for(i=0;i<s->numcols;i++) {
+			if(s->cols[i].index == index) dup = 1;
+		}
+		if(0 <= index && !dup) {
+			s->cols[s->numcols].name = columns[index];
+			s->cols[s->numcols].index = index;
+			s->numcols++;
+		}
+		col = strtok(NULL, ",: ");
+	}
+	free(list);
+	return 0;
+}
+
+void tripsummary_start(struct tripsummary *s, sqlite3_int64 trip) {
+	int i;
+
+	s->trip = trip;
+	s->samples = 0;
+	s->idle = 0;
+	s->air = 0;
+	s->havefix = 0;
+	s->distance = 0;
+	for(i=0;i<s->numcols;i++) {
+		s->cols[i].count = 0;
+		s->cols[i].sum = 0;
+	}
+}
+
+void tripsummary_addsample(struct tripsummary *s, double mono,
+		const double *values, const unsigned char *present) {
+	int i;
+
+	if(0 == s->samples) {
+		s->firstmono = mono;
+	} else {
+		// Each value holds for the time since the sample before it
+		double dt = mono - s->lastmono;
+		if(dt > 0 && dt <= TRIPSUMMARY_MAXGAP) {
+			if(0 <= s->mafcol && present[s->mafcol]) {
+				s->air += values[s->mafcol] * dt;
+			}
+			if(0 <= s->rpmcol && present[s->rpmcol] && values[s->rpmcol] > 0 &&
+					0 <= s->vsscol && present[s->vsscol] && 0 == values[s->vsscol]) {
+				s->idle += dt;
+			}
+		}
+	}
+	s->lastmono = mono;
+	s->samples++;
+
+	for(i=0;i<s->numcols;i++) {
+		struct tripsummarycolumn *c = &s->cols[i];
+		if(!present[c->index]) continue;
+		if(0 == c->count || values[c->index] > c->max) c->max = values[c->index];
+		c->sum += values[c->index];
+		c->count++;
+	}
+}
+
+void tripsummary_addfix(struct tripsummary *s, double lat, double lon) {
+	if(s->havefix) {
+		s->distance += tripsummary_haversine(s->lastlat, s->lastlon, lat, lon);
+	}
+	s->havefix = 1;
+	s->lastlat = lat;
+	s->lastlon = lon;
+}
+
+void tripsummary_close(struct tripsummary *s) {
+	free(s->cols);
+	s->cols = NULL;
+	s->numcols = 0;
+	s->trip = -1;
+}
+
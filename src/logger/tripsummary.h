@@ -0,0 +1,91 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Trip summaries, accumulated as samples and fixes arrive
+ Distance, fuel, duration, idle time and the max and mean of a few
+ columns are kept up to date for the current trip, so they can be saved
+ in the trip table instead of worked out later from every row.
+ */
+
+#ifndef __TRIPSUMMARY_H
+#define __TRIPSUMMARY_H
+
+#include "sqlite3.h"
+
+/// Samples further apart than this many seconds aren't integrated across
+#define TRIPSUMMARY_MAXGAP 5.0
+
+/// Grams of air per gram of petrol, at stoichiometric
+#define TRIPSUMMARY_AFR 14.7
+
+/// One summarised column
+struct tripsummarycolumn {
+	const char *name; ///< db_column
+	int index; ///< Index into a sample's values
+	long count; ///< Values seen
+	double max; ///< Largest value
+	double sum; ///< Total, for the mean
+};
+
+/// The current trip's summary
+struct tripsummary {
+	sqlite3_int64 trip; ///< Trip being summarised, or -1 for none
+	int samples; ///< Samples seen
+	double firstmono; ///< First sample, monotonic seconds
+	double lastmono; ///< Last sample, monotonic seconds
+	double idle; ///< Seconds with the engine running and the car still
+	double air; ///< Grams of air through the maf
+	int havefix; ///< Set once lastlat and lastlon hold a fix
+	double lastlat; ///< Last fix's latitude
+	double lastlon; ///< Last fix's longitude
+	double distance; ///< Kilometers between fixes
+	int rpmcol; ///< Index of rpm in a sample's values, or -1
+	int vsscol; ///< Index of vss in a sample's values, or -1
+	int mafcol; ///< Index of maf in a sample's values, or -1
+	int numcols; ///< Columns in cols
+	struct tripsummarycolumn *cols; ///< Columns with a max and mean
+};
+
+/// Set up a summary
+/** \param columns db_column of each value in a sample
+ \param selected comma-separated list of columns to keep the max and mean of.
+     Those not in columns are skipped
+ \return 0 on success, -1 on error */
+int tripsummary_init(struct tripsummary *s, const char **columns, int numcolumns, const char *selected);
+
+/// Start summarising a trip, forgetting the last one
+void tripsummary_start(struct tripsummary *s, sqlite3_int64 trip);
+
+/// Add a sample
+/** \param mono when it was sampled, monotonic seconds
+ \param values one per column passed to tripsummary_init
+ \param present one per column. Set where values holds something */
+void tripsummary_addsample(struct tripsummary *s, double mono,
+	const double *values, const unsigned char *present);
+
+/// Add a gps fix
+void tripsummary_addfix(struct tripsummary *s, double lat, double lon);
+
+/// Free anything tripsummary_init allocated
+void tripsummary_close(struct tripsummary *s);
+
+#endif //__TRIPSUMMARY_H
+
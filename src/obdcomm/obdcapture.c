@@ -0,0 +1,136 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Binary capture of raw serial traffic, for replaying later
+ */
+
+#include "obdcapture.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+/// Handle to the capture file
+static FILE *serialcapture = NULL;
+
+/// obdcapture_now() when the capture started
+static unsigned long long capturestart = 0;
+
+unsigned long long obdcapture_now() {
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	if(0 == clock_gettime(CLOCK_MONOTONIC, &ts)) {
+		return (unsigned long long)ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+	}
+#endif //CLOCK_MONOTONIC
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (unsigned long long)tv.tv_sec * 1000000ull + tv.tv_usec;
+}
+
+int startserialcapture(const char *filename) {
+	if(NULL == (serialcapture = fopen(filename, "wb"))) {
+		perror("Couldn't open serial capture");
+		return 1;
+	}
+	if(1 != fwrite(OBDCAPTURE_MAGIC, strlen(OBDCAPTURE_MAGIC), 1, serialcapture)) {
+		perror("Couldn't write serial capture header");
+		fclose(serialcapture);
+		serialcapture = NULL;
+		return 1;
+	}
+	capturestart = obdcapture_now();
+	return 0;
+}
+
+void closeserialcapture() {
+	if(NULL == serialcapture) return;
+	fclose(serialcapture);
+	serialcapture = NULL;
+}
+
+void appendserialcapture(const char *data, int len, int direction) {
+	if(NULL == serialcapture || 0 >= len) return;
+
+	unsigned char header[11];
+	unsigned long long usec = obdcapture_now() - capturestart;
+	int i;
+
+	// Split anything too long to describe in one record
+	while(len > 0) {
+		int chunk = len>OBDCAPTURE_MAXLEN?OBDCAPTURE_MAXLEN:len;
+
+		for(i=0; i<8; i++) {
+			header[i] = (usec >> (8*i)) & 0xFF;
+		}
+		header[8] = direction;
+		header[9] = chunk & 0xFF;
+		header[10] = (chunk >> 8) & 0xFF;
+
+		fwrite(header, sizeof(header), 1, serialcapture);
+		fwrite(data, chunk, 1, serialcapture);
+
+		data += chunk;
+		len -= chunk;
+	}
+}
+
+FILE *obdcapture_openread(const char *filename) {
+	char magic[sizeof(OBDCAPTURE_MAGIC)];
+
+	FILE *f = fopen(filename, "rb");
+	if(NULL == f) {
+		perror(filename);
+		return NULL;
+	}
+
+	if(1 != fread(magic, strlen(OBDCAPTURE_MAGIC), 1, f) ||
+		0 != memcmp(magic, OBDCAPTURE_MAGIC, strlen(OBDCAPTURE_MAGIC))) {
+		fprintf(stderr, "%s is not a serial capture file\n", filename);
+		fclose(f);
+		return NULL;
+	}
+	return f;
+}
+
+int obdcapture_readrecord(FILE *f, struct obdcapture_record *r) {
+	unsigned char header[11];
+	int i;
+
+	size_t nread = fread(header, 1, sizeof(header), f);
+	if(0 == nread && feof(f)) return 1;
+	if(sizeof(header) != nread) return -1;
+
+	r->usec = 0;
+	for(i=7; i>=0; i--) {
+		r->usec = (r->usec << 8) | header[i];
+	}
+	r->direction = header[8];
+	r->len = header[9] | (header[10] << 8);
+
+	if(OBDCAPTURE_IN != r->direction && OBDCAPTURE_OUT != r->direction) return -1;
+
+	if(0 < r->len && 1 != fread(r->data, r->len, 1, f)) return -1;
+
+	return 0;
+}
+
@@ -0,0 +1,79 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Binary capture of raw serial traffic, for replaying later
+ A capture file is an eight byte header, OBDCAPTURE_MAGIC, followed by
+  one record per chunk read from or written to the device:
+   - 8 bytes: usec since the capture started, monotonic, little-endian
+   - 1 byte: OBDCAPTURE_IN or OBDCAPTURE_OUT
+   - 2 bytes: length of data, little-endian
+   - length bytes: the data exactly as it went over the wire
+  Baudrate negotiation is not captured.
+ */
+
+#ifndef __OBDCAPTURE_H
+#define __OBDCAPTURE_H
+
+#include <stdio.h>
+
+/// First eight bytes of every capture file
+#define OBDCAPTURE_MAGIC "OBDCAP01"
+
+/// Data came from the device
+#define OBDCAPTURE_IN 0
+
+/// Data was sent to the device
+#define OBDCAPTURE_OUT 1
+
+/// Largest chunk a single record can hold
+#define OBDCAPTURE_MAXLEN 65535
+
+/// One chunk of captured traffic
+struct obdcapture_record {
+	unsigned long long usec; ///< usec since the start of the capture
+	int direction; ///< OBDCAPTURE_IN or OBDCAPTURE_OUT
+	int len; ///< Number of bytes in data
+	unsigned char data[OBDCAPTURE_MAXLEN]; ///< The raw bytes
+};
+
+/// Start capturing all serial traffic to this file
+/** \return 0 on success, 1 on failure */
+int startserialcapture(const char *filename);
+
+/// Stop capturing and close the file
+void closeserialcapture();
+
+/// Append a chunk to the capture, if one is running
+void appendserialcapture(const char *data, int len, int direction);
+
+/// Monotonic time in usec. Only useful for differences
+unsigned long long obdcapture_now();
+
+/// Open a capture file for reading
+/** \return the opened file positioned at the first record, or NULL on error */
+FILE *obdcapture_openread(const char *filename);
+
+/// Read the next record from a capture file
+/** \return 0 on success, 1 at end of file, -1 on a damaged file */
+int obdcapture_readrecord(FILE *f, struct obdcapture_record *r);
+
+#endif // __OBDCAPTURE_H
+
@@ -25,14 +25,21 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 // http://easysw.com/~mike/serial/serial.html
 
 #include "obdserial.h"
+#include "obdtransport.h"
+#include "obdcapture.h"
+#include "pidtiming.h"
+#include "pidresponses.h"
+#include "stagetiming.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/select.h>
 #include <termios.h>
 
 /// What to use as the obd newline char in commands
@@ -42,6 +49,21 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #define SERIAL_IN 0
 #define SERIAL_OUT 1
 
+/// Returned by readserialdata_timeout when the deadline passes
+#define OBDSERIAL_TIMEDOUT -2
+
+/// Units of the ELM327's ATST timeout, usec
+#define ELM_ATST_UNIT 4000l
+
+/// Lowest ATST we'll ask for. 0x19 is 100ms
+#define ELM_ATST_MIN 0x19
+
+/// ATST the ELM327 uses until told otherwise. 0x32 is 200ms
+#define ELM_ATST_DEFAULT 0x32
+
+/// Last ATST sent, so we only send it when it changes
+static int current_atst = -1;
+
 /// Handle to the serial log
 static FILE *seriallog = NULL;
 
@@ -80,9 +102,11 @@ static void appendseriallog(const char *line, int out) {
 /** Reads up to the next '>'
    \param buf buffer to fill
    \param n size of buf
-   \return number of bytes put in buf, or -1 on error
+   \param timeout give up after this many usec
+   \return number of bytes put in buf, OBDSERIAL_TIMEDOUT if the timeout
+     passed, or -1 on error
 */
-int readserialdata(int fd, char *buf, int n) {
+static int readserialdata_timeout(int fd, char *buf, int n, long timeout) {
 	char *bufptr = buf; // current position in buf
 
 	struct timeval start,curr; // For timing out
@@ -94,34 +118,94 @@ int readserialdata(int fd, char *buf, int n) {
 	int retval = 0; // Value to return
 	int nbytes; // Number of bytes read
 	do {
+		if(0 != gettimeofday(&curr, NULL)) {
+			perror("Couldn't gettimeofday");
+			return -1;
+		}
+		long remaining = timeout - (1000000l*(curr.tv_sec - start.tv_sec) +
+			(curr.tv_usec - start.tv_usec));
+		if(0 >= remaining) {
+			return OBDSERIAL_TIMEDOUT;
+		}
+		if(buf+n-bufptr-1 <= 0) {
+			fprintf(stderr, "Filled buffer without finding a prompt\n");
+			return -1;
+		}
+
+		fd_set rfds;
+		FD_ZERO(&rfds);
+		FD_SET(fd, &rfds);
+		struct timeval selecttime;
+		selecttime.tv_sec = remaining / 1000000l;
+		selecttime.tv_usec = remaining % 1000000l;
+
+		int ready = select(fd+1, &rfds, NULL, NULL, &selecttime);
+		if(-1 == ready && EINTR != errno) {
+			perror("Error in readserialdata select");
+			return -1;
+		}
+		if(0 >= ready) continue;
+
 		nbytes = read(fd, bufptr, buf+n-bufptr-1);
-		if(-1 == nbytes && EAGAIN != errno) {
+		if(0 == nbytes) {
+			fprintf(stderr, "OBD device closed the connection\n");
+			return -1;
+		}
+		if(-1 == nbytes && EAGAIN != errno && EINTR != errno) {
 			perror("Error in readserialdata");
+			return -1;
 		}
 		if(-1 != nbytes) {
 			// printf("Read bytes '%s'\n", bufptr);
+			appendserialcapture(bufptr, nbytes, OBDCAPTURE_IN);
 			retval += nbytes; // Increment bytecount
 			bufptr += nbytes; // Move pointer forward
 		}
-		if(0 != gettimeofday(&curr, NULL)) {
-			perror("Couldn't gettimeofday");
-			return -1;
-		}
-		if(OBDCOMM_TIMEOUT < 1000000l*(curr.tv_sec - start.tv_sec) +
-			(curr.tv_usec - start.tv_usec)) {
-			printf("Timeout!\n");
-			return -1;
-		}
 	} while (retval == 0 || bufptr[-1] != '>');
 
 	appendseriallog(buf, SERIAL_IN);
 	return retval;
 }
 
+/// Collect data up to the next prompt, using the transport's timeout
+int readserialdata(int fd, char *buf, int n) {
+	int nbytes = readserialdata_timeout(fd, buf, n, obdtransport_get(fd)->response_timeout);
+	if(OBDSERIAL_TIMEDOUT == nbytes) {
+		printf("Timeout!\n");
+		return -1;
+	}
+	return nbytes;
+}
+
 /// Throw away all data until the next prompt
 void readtonextprompt(int fd) {
 	char retbuf[4096]; // Buffer to store returned stuff
-	readserialdata(fd, retbuf, sizeof(retbuf));
+	if(OBDSERIAL_TIMEDOUT == readserialdata_timeout(fd, retbuf, sizeof(retbuf),
+			obdtransport_get(fd)->init_timeout)) {
+		printf("Timeout!\n");
+	}
+}
+
+/// Get back to a prompt after giving up on a response
+/** Any character sent while the ELM327 is busy makes it stop and give a
+   prompt, so send one and wait for that, then throw away anything that
+   shows up shortly after
+ \return 0 if we're back at a prompt, -1 if not */
+static int resyncserial(int fd) {
+	char retbuf[4096]; // Buffer to store returned stuff
+	const struct obdtransport *t = obdtransport_get(fd);
+
+	appendseriallog(OBDCMD_NEWLINE, SERIAL_OUT);
+	appendserialcapture(OBDCMD_NEWLINE, strlen(OBDCMD_NEWLINE), OBDCAPTURE_OUT);
+	if(write(fd, OBDCMD_NEWLINE, strlen(OBDCMD_NEWLINE)) < (ssize_t)strlen(OBDCMD_NEWLINE)) {
+		return -1;
+	}
+	if(0 >= readserialdata_timeout(fd, retbuf, sizeof(retbuf), t->init_timeout)) {
+		return -1;
+	}
+	// A late response and the interrupt can both end in a prompt
+	readserialdata_timeout(fd, retbuf, sizeof(retbuf), t->settle_time);
+	return 0;
 }
 
 // Blindly send a command and throw away all data to next prompt
@@ -134,50 +218,46 @@ void blindcmd(int fd, const char *cmd, int no_response) {
 	char outstr[1024];
 	snprintf(outstr, sizeof(outstr), "%s%s\0", cmd, OBDCMD_NEWLINE);
 	appendseriallog(outstr, SERIAL_OUT);
+	appendserialcapture(outstr, strlen(outstr), OBDCAPTURE_OUT);
 	write(fd,outstr, strlen(outstr));
 	if(0 != no_response) {
-		sleep(1);
+		usleep(obdtransport_get(fd)->settle_time);
 		readtonextprompt(fd);
 	}
 }
 
 int openserial(const char *portfilename, long baudrate, long baudrate_target) {
-	struct termios options;
 	int fd;
 
-	fprintf(stderr,"Opening serial port %s, this can take a while\n", portfilename);
-	fd = open(portfilename, O_RDWR | O_NOCTTY | O_NDELAY);
-	// fd = open(portfilename, O_RDWR | O_NOCTTY);
-
-	if(fd == -1) {
-		perror(portfilename);
-	} else {
-		fcntl(fd, F_SETFL, 0);
+	const char *address;
+	const struct obdtransport *t = obdtransport_find(portfilename, &address);
 
-		// Get the current options for the port
-		tcgetattr(fd, &options);
+	fprintf(stderr,"Opening %s port %s, this can take a while\n", t->name, address);
+	fd = t->open(address);
 
-		options.c_cflag |= (CLOCAL | CREAD);
-		options.c_lflag &= !(ICANON | ECHO | ECHOE | ISIG);
-		options.c_oflag &= !(OPOST);
-		options.c_cc[VMIN] = 0;
-		options.c_cc[VTIME] = 100;
+	if(fd != -1) {
+		obdtransport_attach(fd, t);
 
-		tcsetattr(fd, TCSANOW, &options);
+		// All reads go through select() with the transport's timeouts
+		if(-1 == fcntl(fd, F_SETFL, O_NONBLOCK)) {
+			perror("fcntl");
+		}
 
 		long current_baud = 9600;
-		if(0 != modifybaud(fd, baudrate)) {
-			fprintf(stderr, "Error modifying baudrate. Continuing, but may suffer issues\n");
-		} else {
-			if(baudrate != 0)
-				current_baud = baudrate;
+		if(t->has_baudrate) {
+			if(0 != modifybaud(fd, baudrate)) {
+				fprintf(stderr, "Error modifying baudrate. Continuing, but may suffer issues\n");
+			} else {
+				if(baudrate != 0)
+					current_baud = baudrate;
+			}
 		}
 
 		// Reset the device. Some software changes settings and then leaves it
 		blindcmd(fd,"ATZ",1);
 
 		// printf("Baudrate upgrader disabled\n");
-		if(0 > upgradebaudrate(fd, baudrate_target, current_baud)) {
+		if(t->has_baudrate && 0 > upgradebaudrate(fd, baudrate_target, current_baud)) {
 			fprintf(stderr, "Error upgrading baudrate. Continuing, but may suffer issues\n");
 		}
 
@@ -193,14 +273,36 @@ int openserial(const char *portfilename, long baudrate, long baudrate_target) {
 		blindcmd(fd,"ATS0",1);
 		// Then do it again to make sure the command really worked
 		blindcmd(fd,"0100",1);
+		// Let the device shorten its own timeout when the ecu answers quickly
+		blindcmd(fd,"ATAT1",1);
+		current_atst = -1;
 
 	}
 	return fd;
 }
 
 void closeserial(int fd) {
+	if(-1 == fd) return;
+	const struct obdtransport *t = obdtransport_get(fd);
 	blindcmd(fd,"ATZ",0);
-	close(fd);
+	t->close(fd);
+	obdtransport_detach(fd);
+}
+
+int obdtuneelmtimeout(int fd) {
+	long worst = pidtiming_worstpercentile(PIDTIMING_PERCENTILE);
+	if(worst < 0) return current_atst;
+
+	int atst = (int)(worst * PIDTIMING_HEADROOM / ELM_ATST_UNIT) + 1;
+	if(atst < ELM_ATST_MIN) atst = ELM_ATST_MIN;
+	if(atst > 0xFF) atst = 0xFF;
+	if(atst == current_atst) return current_atst;
+
+	char atst_cmd[16];
+	snprintf(atst_cmd, sizeof(atst_cmd), "ATST%02X", atst);
+	blindcmd(fd, atst_cmd, 1);
+	current_atst = atst;
+	return current_atst;
 }
 
 static long attempt_upgradebaudrate(int fd, long rate, long previousrate) {
@@ -361,7 +463,7 @@ long guessbaudrate(int fd) {
 
 		sleep(1); // CHEESY
 		nbytes = read(fd, retbuf, sizeof(retbuf));
-		if(-1 == nbytes) {
+		if(-1 == nbytes && EAGAIN != errno) {
 			perror("Error reading from serial port guessing baudrate");
 			return -1;
 		}
@@ -674,18 +776,23 @@ static enum obd_serial_status parseobdline(const char *line, unsigned int mode,
 }
 
 
-enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd, int numbytes_expected,
-	unsigned int *retvals, unsigned int retvals_size, int *numbytes_returned, int quiet) {
+/// Send a request and read the response, checking for the usual complaints
+/** \return OBD_SUCCESS if retbuf holds something worth parsing */
+static enum obd_serial_status sendobdrequest(int fd, unsigned int mode, unsigned int cmd, int numbytes_expected,
+	char *retbuf, int retbuf_size, int quiet) {
 
 	char sendbuf[20]; // Command to send
 	int sendbuflen; // Number of bytes in the send buffer
 
-	char retbuf[4096]; // Buffer to store returned stuff
-
 	int nbytes; // Number of bytes read
 
+	struct timeval sent, received; // For learning response times
+
 	if(mode == 0x03 || mode == 0x04) {
 		sendbuflen = snprintf(sendbuf,sizeof(sendbuf),"%02X" OBDCMD_NEWLINE, mode);
+	} else if(mode == 0x22) {
+		// Manufacturer PIDs are sixteen bits
+		sendbuflen = snprintf(sendbuf,sizeof(sendbuf),"%02X%04X" OBDCMD_NEWLINE, mode, cmd);
 	} else {
 		if(0 == numbytes_expected) {
 			sendbuflen = snprintf(sendbuf,sizeof(sendbuf),"%02X%02X" OBDCMD_NEWLINE, mode, cmd);
@@ -695,11 +802,34 @@ enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd,
 	}
 
 	appendseriallog(sendbuf, SERIAL_OUT);
+	appendserialcapture(sendbuf, sendbuflen, OBDCAPTURE_OUT);
+	long long span = stagetiming_start();
+	gettimeofday(&sent, NULL);
 	if(write(fd,sendbuf,sendbuflen) < sendbuflen) {
 		return OBD_ERROR;
 	}
-
-	nbytes = readserialdata(fd, retbuf, sizeof(retbuf));
+	stagetiming_end(OBDSTAGE_SERIALWRITE, span);
+
+	// The device's own timeout, tuned from every pid's learned times, is what
+	//   ends a slow answer. Only give up on the device a little after that
+	long deadline = (current_atst<0?ELM_ATST_DEFAULT:current_atst) * ELM_ATST_UNIT +
+		PIDTIMING_MINDEADLINE;
+	long fallback = obdtransport_get(fd)->response_timeout;
+	if(deadline > fallback) deadline = fallback;
+	span = stagetiming_start();
+	nbytes = readserialdata_timeout(fd, retbuf, retbuf_size, deadline);
+	stagetiming_end(OBDSTAGE_ELMWAIT, span);
+	if(OBDSERIAL_TIMEDOUT == nbytes) {
+		pidtiming_timeout(mode, cmd);
+		if(!quiet)
+			fprintf(stderr, "Timeout after %lims waiting for %02X %02X\n",
+				deadline/1000, mode, cmd);
+		if(0 != resyncserial(fd)) {
+			fprintf(stderr, "Couldn't get back to a prompt after a timeout\n");
+			return OBD_ERROR;
+		}
+		return OBD_TIMEOUT;
+	}
 	if(0 == nbytes) {
 		if(!quiet)
 			fprintf(stderr, "No data at all returned from serial port\n");
@@ -730,6 +860,35 @@ enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd,
 		return OBD_UNABLE_TO_CONNECT;
 	}
 
+	// Only real answers are timed; NO DATA takes as long as the device's timeout
+	gettimeofday(&received, NULL);
+	pidtiming_record(mode, cmd, 1000000l*(received.tv_sec - sent.tv_sec) +
+		(received.tv_usec - sent.tv_usec));
+
+	return OBD_SUCCESS;
+}
+
+enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd, int numbytes_expected,
+	unsigned int *retvals, unsigned int retvals_size, int *numbytes_returned, int quiet) {
+
+	char retbuf[4096]; // Buffer to store returned stuff
+
+	// Tell the device how many responses to wait for, if we know
+	int hint = 0;
+	if(0x01 == mode && 0 == numbytes_expected) {
+		numbytes_expected = hint = pidresponses_hint(mode, cmd);
+	}
+
+	enum obd_serial_status sendret = sendobdrequest(fd, mode, cmd, numbytes_expected,
+		retbuf, sizeof(retbuf), quiet);
+	if(0 != hint && OBD_NO_DATA == sendret && NULL != strstr(retbuf, "?")) {
+		// Device doesn't understand a response count
+		pidresponses_mismatch(mode, cmd);
+		hint = 0;
+		sendret = sendobdrequest(fd, mode, cmd, 0, retbuf, sizeof(retbuf), quiet);
+	}
+	if(OBD_SUCCESS != sendret) return sendret;
+
 	/* 
 		Good grief, this is ugly.
 		1) We look go through the output line by line [strtokking]
@@ -738,9 +897,11 @@ enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd,
 		4) So go into crazy C string handling mode.
 	*/
 
+	long long span = stagetiming_start();
 	char *line = strtok(retbuf, "\r\n>");
 
 	int values_returned = 0;
+	int responses = 0; // Lines that parsed; one per ecu that answered
 	enum obd_serial_status ret = OBD_ERROR;
 	while(NULL != line) {
 		char *colon;
@@ -758,22 +919,31 @@ enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd,
 		}
 		// We gracefully handle these lines without
 		//   needing to actually parse them
-		if(3 >= strlen(parseline)) continue;
+		if(3 >= strlen(parseline)) {
+			if(0 == joined_lines) line = strtok(NULL, "\r\n>");
+			continue;
+		}
 
 		// printf("parseline: %s\n", parseline);
 
 		unsigned int local_rets[20];
 		unsigned int vals_read;
 
-		ret = parseobdline(parseline, mode, cmd,
-			local_rets, sizeof(local_rets)/sizeof(local_rets[0]), &vals_read, quiet);
-
-		if(OBD_SUCCESS == ret) {
-			int i;
-			for(i=0; i<vals_read; i++, values_returned++) {
-				retvals[values_returned] = local_rets[i];
+		// The first response is used; the rest are only counted
+		enum obd_serial_status lineret = parseobdline(parseline, mode, cmd,
+			local_rets, sizeof(local_rets)/sizeof(local_rets[0]), &vals_read,
+			quiet || 0 < responses);
+
+		if(OBD_SUCCESS == lineret) {
+			if(0 == responses) {
+				int i;
+				for(i=0; i<vals_read && values_returned<retvals_size; i++, values_returned++) {
+					retvals[values_returned] = local_rets[i];
+				}
 			}
-			break;
+			responses++;
+		} else if(0 == responses) {
+			ret = lineret;
 		}
 
 		if(0 == joined_lines) {
@@ -781,21 +951,177 @@ enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd,
 			line = strtok(NULL, "\r\n>");
 		}
 	}
+	stagetiming_end(OBDSTAGE_PARSE, span);
 	*numbytes_returned = values_returned;
+	if(0x01 == mode && 0 < responses) {
+		pidresponses_observe(mode, cmd, hint, responses);
+	}
 	if(0 == values_returned) return ret;
 	return OBD_SUCCESS;
 }
 
-enum obd_serial_status getobdvalue(int fd, unsigned int cmd, float *ret, int numbytes, OBDConvFunc conv) {
+/// Parse one frame of a response into bytes, checking the mode and pid echo
+static enum obd_serial_status parseobdframe(const char *line, unsigned int mode, unsigned int cmd,
+	unsigned int *retvals, unsigned int retvals_size, unsigned int *vals_read, int quiet) {
+
+	unsigned int bytes[OBDFRAME_MAXBYTES];
+	int count = 0;
+	int used;
+	const char *p = line;
+	while(count < sizeof(bytes)/sizeof(bytes[0]) && 1 == sscanf(p, "%2x%n", &bytes[count], &used)) {
+		p += used;
+		count++;
+	}
+
+	// Mode 03 and 04 don't echo the pid, mode 22 echoes two bytes of it
+	int cmdlen = 1;
+	if(0x03 == mode || 0x04 == mode) cmdlen = 0;
+	else if(0x22 == mode) cmdlen = 2;
+
+	if(count < 1 + cmdlen) {
+		return OBD_UNPARSABLE;
+	}
+
+	if(0x7F == bytes[0]) {
+		// Negative response. The ECU understood us, but has nothing to say
+		if(!quiet)
+			fprintf(stderr, "Negative response for %02X %02X: %s\n", mode, cmd, line);
+		return OBD_NO_DATA;
+	}
+
+	if(bytes[0] != 0x40 + mode) {
+		if(!quiet)
+			fprintf(stderr, "Unsuccessful mode response for %02X %02X: %s\n", mode, cmd, line);
+		return OBD_INVALID_RESPONSE;
+	}
+
+	unsigned int cmdret = 0;
+	int i;
+	for(i=1; i<=cmdlen; i++) {
+		cmdret = (cmdret << 8) | bytes[i];
+	}
+	if(cmdlen > 0 && cmdret != cmd) {
+		if(!quiet)
+			fprintf(stderr, "Unsuccessful cmd response for %02X %02X: %s\n", mode, cmd, line);
+		return OBD_INVALID_MODE;
+	}
+
+	*vals_read = 0;
+	for(i=1+cmdlen; i<count && *vals_read<retvals_size; i++) {
+		retvals[(*vals_read)++] = bytes[i];
+	}
+	return OBD_SUCCESS;
+}
+
+enum obd_serial_status getobdframes(int fd, unsigned int mode, unsigned int cmd,
+	unsigned int *retvals, unsigned int retvals_size, int *numbytes_returned,
+	int *framelen, int framelen_size, int *numframes, int quiet) {
+
+	char retbuf[4096]; // Buffer to store returned stuff
+
+	*numbytes_returned = 0;
+	if(NULL != numframes) *numframes = 0;
+
+	enum obd_serial_status ret = sendobdrequest(fd, mode, cmd, 0,
+		retbuf, sizeof(retbuf), quiet);
+	if(OBD_SUCCESS != ret) return ret;
+
+	/* A multi-frame ISO 15765 response without headers looks like:
+		014
+		0: 49 02 01 31 44 34
+		1: 47 50 30 30 52 35 35
+		2: 42 31 32 33 34 35 36
+	  The first line is the total length in hex, and the rest need
+	  joining back together. Every other line is a frame on its own */
+
+	char joined[OBDFRAME_MAXBYTES*3+1] = "\0"; // Multi-frame message being put back together
+	int joined_length = -1; // Length from the line before the "0:", if any
+	int frames = 0;
+	enum obd_serial_status lastret = OBD_UNPARSABLE;
+
+	char *line = strtok(retbuf, "\r\n>");
+	for(;;) {
+		char *colon = (NULL == line)?NULL:strchr(line, ':');
+		int is_segment = (NULL != colon && colon - line <= 2);
+
+		// Anything other than the next segment finishes a joined message
+		if('\0' != joined[0] && (NULL == line || !is_segment)) {
+
+			unsigned int local_rets[OBDFRAME_MAXBYTES];
+			unsigned int vals_read = 0;
+			lastret = parseobdframe(joined, mode, cmd, local_rets,
+				sizeof(local_rets)/sizeof(local_rets[0]), &vals_read, quiet);
+			if(OBD_SUCCESS == lastret) {
+				// Drop trailing padding; the length counts the mode and pid echo
+				if(0 <= joined_length) {
+					int echolen = (0x22 == mode)?3:2;
+					if(joined_length - echolen < (int)vals_read) {
+						vals_read = (joined_length > echolen)?joined_length - echolen:0;
+					}
+				}
+				int i;
+				for(i=0; i<vals_read && *numbytes_returned<retvals_size; i++) {
+					retvals[(*numbytes_returned)++] = local_rets[i];
+				}
+				if(NULL != framelen && frames < framelen_size) framelen[frames] = i;
+				frames++;
+			}
+			joined[0] = '\0';
+			joined_length = -1;
+		}
+
+		if(NULL == line) break;
+
+		if(is_segment) {
+			strncat(joined, colon+1, sizeof(joined)-strlen(joined)-1);
+		} else if(3 >= strlen(line)) {
+			// Probably the length of a multi-frame message that's about to start
+			char *end;
+			long l = strtol(line, &end, 16);
+			joined_length = (end != line && '\0' == *end)?(int)l:-1;
+		} else {
+			unsigned int local_rets[OBDFRAME_MAXBYTES];
+			unsigned int vals_read = 0;
+			// Lines like SEARCHING... won't parse; that's fine
+			lastret = parseobdframe(line, mode, cmd, local_rets,
+				sizeof(local_rets)/sizeof(local_rets[0]), &vals_read, 1);
+			if(OBD_SUCCESS == lastret) {
+				int i;
+				for(i=0; i<vals_read && *numbytes_returned<retvals_size; i++) {
+					retvals[(*numbytes_returned)++] = local_rets[i];
+				}
+				if(NULL != framelen && frames < framelen_size) framelen[frames] = i;
+				frames++;
+			} else if(OBD_NO_DATA == lastret) {
+				break;
+			}
+		}
+
+		line = strtok(NULL, "\r\n>");
+	}
+
+	if(NULL != numframes) {
+		*numframes = (NULL != framelen && frames > framelen_size)?framelen_size:frames;
+	}
+	if(0 == frames) {
+		if(!quiet)
+			fprintf(stderr, "Couldn't find a frame for %02X %02X\n", mode, cmd);
+		return lastret;
+	}
+	return OBD_SUCCESS;
+}
+
+enum obd_serial_status getobdvalue(int fd, unsigned int cmd, float *ret, int numbytes, const struct obddecode *dec) {
 	int numbytes_returned;
-	unsigned int obdbytes[4];
+	unsigned int obdbytes[OBDDECODE_MAXLENGTH];
 
 	enum obd_serial_status ret_status = getobdbytes(fd, 0x01, cmd, numbytes,
 		obdbytes, sizeof(obdbytes)/sizeof(obdbytes[0]), &numbytes_returned, 0);
 
 	if(OBD_SUCCESS != ret_status) return ret_status;
 
-	if(NULL == conv) {
+	long long span = stagetiming_start();
+	if(NULL == dec || numbytes_returned < dec->first + dec->nbytes) {
 		int i;
 		*ret = 0;
 		for(i=0;i<numbytes_returned;i++) {
@@ -803,8 +1129,9 @@ enum obd_serial_status getobdvalue(int fd, unsigned int cmd, float *ret, int num
 			*ret = *ret + obdbytes[i];
 		}
 	} else {
-		*ret = conv(obdbytes[0], obdbytes[1], obdbytes[2], obdbytes[3]);
+		*ret = obdDecodeValue(dec, obdbytes);
 	}
+	stagetiming_end(OBDSTAGE_DECODE, span);
 	return OBD_SUCCESS;
 }
 
@@ -24,7 +24,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef __OBDSERIAL_H
 #define __OBDSERIAL_H
 
-#include "obdconvertfunctions.h"
+#include "obddecode.h"
 
 /// This is returned from getobdvalue
 enum obd_serial_status {
@@ -34,15 +34,19 @@ enum obd_serial_status {
 	OBD_INVALID_RESPONSE, ///< Invalid response
 	OBD_INVALID_MODE, ///< Invalid mode
 	OBD_UNABLE_TO_CONNECT, ///< Device reported UNABLE TO CONNECT
+	OBD_TIMEOUT, ///< No response before this pid's deadline
 	OBD_ERROR ///< Some other error
 };
 
-/// The timeout for serial reads in general, measured in usec
+/// The timeout for serial port reads, measured in usec
+/** Other transports pick their own; see obdtransport.h. Once a pid's
+   response times are known it gets a shorter deadline; see pidtiming.h */
 #define OBDCOMM_TIMEOUT 10000000l
 
 /// Open the serial port and set appropriate options
 /**
- \param portfilename path and filename of the serial port
+ \param portfilename path and filename of the serial port, tcp://host:port
+    for a network adapter, or rfcomm://bdaddr[/channel] for bluetooth
  \param baudrate -1 for "don't touch", 0 for "guess", >0 for the passed number
  \param baudrate_target -1 for "don't touch", 0 for "guess", >0 for the passed number
  \return fd on success or -1 on error
@@ -52,6 +56,11 @@ int openserial(const char *portfilename, long baudrate, long baudrate_target);
 /// Close the serialport
 void closeserial(int fd);
 
+/// Set the ELM327's own timeout from the learned response times
+/** Sends ATST only when the value changes. Cheap to call often
+ \return the ATST value in use, or -1 if it's not been set */
+int obdtuneelmtimeout(int fd);
+
 /// Modify the baudrate of the passed serial port
 /**
  \param baurdate attempt to set to this value. -1 makes no changes
@@ -76,18 +85,18 @@ enum obd_serial_status getobderrorcodes(int fd,
  \param fd the serial port opened with openserial
  \param cmd the obd service command
  \param ret the return value
- \param numbytes the number of bytes we expect in the response [optimisation]. Set to zero for safe-nothing-can-go-wrong
- \param conv the convert function to get from A,B,C,D to a float
+ \param numbytes the number of responses to wait for [optimisation]. Set to zero to use a learned count if there is one; see pidresponses.h
+ \param dec how to decode the bytes returned. If NULL, they're treated as one big number
  \return something from the obd_serial_status enum 
  */
-enum obd_serial_status getobdvalue(int fd, unsigned int cmd, float *ret, int numbytes, OBDConvFunc conv);
+enum obd_serial_status getobdvalue(int fd, unsigned int cmd, float *ret, int numbytes, const struct obddecode *dec);
 
 /// Get the raw bits returned from an OBD command
 /** This returns some unsigned integers. Each contains eight bits
 	in its low byte and zeros in the rest
  \param fd the serial port opened with openserial
  \param cmd the obd service command
- \param numbytes_expected the number of bytes we expect in the response [optimisation]. Set to zero for safe-nothing-can-go-wrong
+ \param numbytes_expected the number of responses to wait for [optimisation]. Set to zero to use a learned count if there is one; see pidresponses.h
  \param retvals_size number of retvals allocated in the retvals array
  \param retvals array of retvals_size items to stuff with retvalues
  \param numbytes_returned tells you how many of retvals were filled.
@@ -96,6 +105,30 @@ enum obd_serial_status getobdvalue(int fd, unsigned int cmd, float *ret, int num
 enum obd_serial_status getobdbytes(int fd, unsigned int mode, unsigned int cmd, int numbytes_expected,
         unsigned int *retvals, unsigned int retvals_size, int *numbytes_returned, int quiet);
 
+/// Most bytes in a single frame, after multi-frame messages are joined
+#define OBDFRAME_MAXBYTES 256
+
+/// Get every frame of a possibly multi-frame response
+/** getobdbytes stops at the first line it can parse. This collects them
+	all: ISO 15765 multi-frame messages are joined back together, and each
+	other line [eg, each message of a legacy protocol, or each ECU that
+	replied] is a frame of its own.
+ \param fd the serial port opened with openserial
+ \param mode the obd service mode
+ \param cmd the pid. For mode 22 this is sixteen bits
+ \param retvals filled with each frame's payload in turn, mode and pid echo removed
+ \param retvals_size number of items in retvals
+ \param numbytes_returned number of retvals filled
+ \param framelen if not NULL, filled with the number of bytes from each frame
+ \param framelen_size number of items in framelen
+ \param numframes if not NULL, set to the number of frames found
+ \param quiet if set, don't complain on stderr
+ \return something from the obd_serial_status enum
+*/
+enum obd_serial_status getobdframes(int fd, unsigned int mode, unsigned int cmd,
+	unsigned int *retvals, unsigned int retvals_size, int *numbytes_returned,
+	int *framelen, int framelen_size, int *numframes, int quiet);
+
 /// Get the number of errors codes the car claims to currently have
 int getnumobderrors(int fd);
 
@@ -0,0 +1,113 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Transports used to reach an OBD adapter
+ */
+
+#include "obdtransport.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Adding a transport involves two edits here.
+// First, add an extern like the others
+// Second, add it to available_transports, before the serial transport
+
+extern struct obdtransport obdtransport_tcp;
+extern struct obdtransport obdtransport_replay;
+#ifdef HAVE_BLUETOOTH
+extern struct obdtransport obdtransport_rfcomm;
+#endif //HAVE_BLUETOOTH
+extern struct obdtransport obdtransport_serial;
+
+/// All transports in this build. Serial matches anything, so goes last
+static struct obdtransport *available_transports[] = {
+	&obdtransport_tcp,
+	&obdtransport_replay,
+#ifdef HAVE_BLUETOOTH
+	&obdtransport_rfcomm,
+#endif //HAVE_BLUETOOTH
+	&obdtransport_serial
+};
+
+/// Most fds we'll remember transports for at one time
+#define OBDTRANSPORT_MAXOPEN 16
+
+/// An fd and the transport that opened it
+struct obdtransport_fd {
+	int fd; ///< The fd
+	const struct obdtransport *transport; ///< NULL if this slot is free
+};
+
+/// Every fd currently attached to a transport
+static struct obdtransport_fd open_transports[OBDTRANSPORT_MAXOPEN];
+
+const struct obdtransport *obdtransport_find(const char *device, const char **address) {
+	int i;
+	int numtransports = sizeof(available_transports)/sizeof(available_transports[0]);
+	for(i=0; i<numtransports; i++) {
+		const struct obdtransport *t = available_transports[i];
+		if(NULL == t->prefix) {
+			*address = device;
+			return t;
+		}
+		if(0 == strncmp(device, t->prefix, strlen(t->prefix))) {
+			*address = device + strlen(t->prefix);
+			return t;
+		}
+	}
+
+	*address = device;
+	return &obdtransport_serial;
+}
+
+void obdtransport_attach(int fd, const struct obdtransport *t) {
+	int i;
+	obdtransport_detach(fd);
+	for(i=0; i<OBDTRANSPORT_MAXOPEN; i++) {
+		if(NULL == open_transports[i].transport) {
+			open_transports[i].fd = fd;
+			open_transports[i].transport = t;
+			return;
+		}
+	}
+	fprintf(stderr, "Too many open transports, treating fd %i as serial\n", fd);
+}
+
+void obdtransport_detach(int fd) {
+	int i;
+	for(i=0; i<OBDTRANSPORT_MAXOPEN; i++) {
+		if(NULL != open_transports[i].transport && fd == open_transports[i].fd) {
+			open_transports[i].transport = NULL;
+		}
+	}
+}
+
+const struct obdtransport *obdtransport_get(int fd) {
+	int i;
+	for(i=0; i<OBDTRANSPORT_MAXOPEN; i++) {
+		if(NULL != open_transports[i].transport && fd == open_transports[i].fd) {
+			return open_transports[i].transport;
+		}
+	}
+	return &obdtransport_serial;
+}
+
@@ -0,0 +1,79 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Transports used to reach an OBD adapter
+ Everything ends up as a non-blocking file descriptor. A transport just
+  describes how to get one, and how patient to be with it.
+ */
+
+#ifndef __OBDTRANSPORT_H
+#define __OBDTRANSPORT_H
+
+/// Declare a transport by building one of these structs
+struct obdtransport {
+	/// Human-friendly name
+	const char *name;
+
+	/// Device strings starting with this are handed to this transport
+	/** NULL matches anything. Only the last transport should do that */
+	const char *prefix;
+
+	/// Open the device
+	/** \param address the device string with the prefix stripped
+	 \return fd on success or -1 on error
+	 */
+	int (*open)(const char *address);
+
+	/// Close an fd returned by open
+	void (*close)(int fd);
+
+	/// Set if it makes sense to fiddle with the baudrate
+	int has_baudrate;
+
+	/// Give up waiting for a prompt after this many usec in normal operation
+	long response_timeout;
+
+	/// Give up waiting for a prompt after this many usec while initialising
+	long init_timeout;
+
+	/// Wait this many usec after blind commands before reading the response
+	long settle_time;
+};
+
+/// Find the transport for this device string
+/** \param device the device passed by the user [eg, /dev/ttyUSB0 or tcp://host:port]
+ \param address when returned, points into device just past the transport prefix
+ \return the transport to use. Never NULL
+ */
+const struct obdtransport *obdtransport_find(const char *device, const char **address);
+
+/// Remember which transport was used to open this fd
+void obdtransport_attach(int fd, const struct obdtransport *t);
+
+/// Forget about this fd
+void obdtransport_detach(int fd);
+
+/// Get the transport that opened this fd
+/** \return the transport attached to fd, or the serial transport if none was */
+const struct obdtransport *obdtransport_get(int fd);
+
+#endif // __OBDTRANSPORT_H
+
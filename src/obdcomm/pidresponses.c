@@ -0,0 +1,145 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Learn how many responses each pid gets
+ */
+
+#include "pidresponses.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/// Everything known about one pid
+struct pidresponses_entry {
+	unsigned int key; ///< mode<<16 | pid
+	int hint; ///< Count in use, or 0
+	int never; ///< Set if it's been wrong too often
+	int lastcount; ///< Responses last time it was asked without a count
+	int samecount; ///< Times running lastcount has been seen
+	int mismatches; ///< Times the count has been wrong
+	int changed; ///< Set if hint or never changed since the last save
+};
+
+/// Every pid we know about
+static struct pidresponses_entry pidresponses[PIDRESPONSES_MAXPIDS];
+
+/// Number of entries used in pidresponses
+static int numpidresponses = 0;
+
+/// Find a pid's entry
+/** \param create add it if it's not there
+ \return the entry, or NULL */
+static struct pidresponses_entry *pidresponses_find(unsigned int mode, unsigned int pid, int create) {
+	unsigned int key = (mode << 16) | pid;
+	int i;
+	for(i=0; i<numpidresponses; i++) {
+		if(key == pidresponses[i].key) return &pidresponses[i];
+	}
+	if(!create || numpidresponses >= PIDRESPONSES_MAXPIDS) return NULL;
+
+	struct pidresponses_entry *e = &pidresponses[numpidresponses++];
+	memset(e, 0, sizeof(*e));
+	e->key = key;
+	return e;
+}
+
+int pidresponses_hint(unsigned int mode, unsigned int pid) {
+	struct pidresponses_entry *e = pidresponses_find(mode, pid, 0);
+	return (NULL == e || e->never)?0:e->hint;
+}
+
+void pidresponses_observe(unsigned int mode, unsigned int pid, int hint, int responses) {
+	struct pidresponses_entry *e = pidresponses_find(mode, pid, 1);
+	if(NULL == e || e->never) return;
+
+	if(0 != hint) {
+		// The device gave up waiting before it got them all
+		if(responses < hint) pidresponses_mismatch(mode, pid);
+		return;
+	}
+
+	if(responses == e->lastcount) {
+		e->samecount++;
+	} else {
+		e->lastcount = responses;
+		e->samecount = 1;
+	}
+
+	// Each time it's been wrong, it has to prove itself for longer
+	if(0 == e->hint && 0 < responses && PIDRESPONSES_MAXCOUNT >= responses &&
+			e->samecount >= PIDRESPONSES_LEARNAFTER * (1 + e->mismatches)) {
+		e->hint = responses;
+		e->changed = 1;
+	}
+}
+
+void pidresponses_mismatch(unsigned int mode, unsigned int pid) {
+	struct pidresponses_entry *e = pidresponses_find(mode, pid, 1);
+	if(NULL == e || e->never) return;
+
+	e->mismatches++;
+	e->hint = 0;
+	e->samecount = 0;
+	e->changed = 1;
+	if(e->mismatches >= PIDRESPONSES_MAXMISMATCHES) {
+		fprintf(stderr, "Not Fatal: Response count for %02X %02X was wrong %i times. "
+			"Not using one any more\n", mode, pid, e->mismatches);
+		e->never = 1;
+	}
+}
+
+void pidresponses_set(unsigned int mode, unsigned int pid, int responses) {
+	struct pidresponses_entry *e = pidresponses_find(mode, pid, 1);
+	if(NULL == e) return;
+
+	if(PIDRESPONSES_NEVER == responses) {
+		e->never = 1;
+		e->hint = 0;
+	} else if(0 < responses && PIDRESPONSES_MAXCOUNT >= responses) {
+		e->never = 0;
+		e->hint = responses;
+	}
+	e->changed = 0;
+}
+
+int pidresponses_foreach(int onlychanged, pidresponses_cb cb, void *arg) {
+	int i;
+	int count = 0;
+	for(i=0; i<numpidresponses; i++) {
+		struct pidresponses_entry *e = &pidresponses[i];
+		if(onlychanged && !e->changed) continue;
+		int responses = e->never?PIDRESPONSES_NEVER:e->hint;
+		if(0 == e->hint && !e->never) {
+			// A count that was taken away is forgotten, then relearned
+			if(!onlychanged) continue;
+			responses = PIDRESPONSES_UNKNOWN;
+		}
+		cb(e->key >> 16, e->key & 0xFFFF, responses, arg);
+		if(onlychanged) e->changed = 0;
+		count++;
+	}
+	return count;
+}
+
+void pidresponses_reset() {
+	numpidresponses = 0;
+}
+
@@ -0,0 +1,81 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Learn how many responses each pid gets
+ An ELM327 told how many responses to expect ["010C1"] can return as soon
+  as it has them, instead of waiting in case another ecu answers. This
+  counts the responses each pid really gets, and only uses that count once
+  it's been the same for a while. A pid that gets a count wrong has it
+  taken away.
+ */
+
+#ifndef __PIDRESPONSES_H
+#define __PIDRESPONSES_H
+
+/// Same count this many times running before it's used
+#define PIDRESPONSES_LEARNAFTER 10
+
+/// After this many wrong counts, a pid is never given one again
+#define PIDRESPONSES_MAXMISMATCHES 3
+
+/// Most responses that can be asked for. ELM327 takes one hex digit
+#define PIDRESPONSES_MAXCOUNT 0xF
+
+/// Most pids tracked at once
+#define PIDRESPONSES_MAXPIDS 256
+
+/// Stored for pids that should never be given a count
+#define PIDRESPONSES_NEVER 0
+
+/// Passed to pidresponses_cb for a pid whose count was taken away
+#define PIDRESPONSES_UNKNOWN -1
+
+/// Get the number of responses to ask for
+/** \return the count, or 0 to not ask for one */
+int pidresponses_hint(unsigned int mode, unsigned int pid);
+
+/// Record how many responses a request got
+/** \param hint the count that was asked for, or 0
+ \param responses the number of responses that parsed
+ */
+void pidresponses_observe(unsigned int mode, unsigned int pid, int hint, int responses);
+
+/// Record that a count was wrong for a pid
+void pidresponses_mismatch(unsigned int mode, unsigned int pid);
+
+/// Set what's known about a pid, eg from a previous run
+/** \param responses count to use, or PIDRESPONSES_NEVER */
+void pidresponses_set(unsigned int mode, unsigned int pid, int responses);
+
+/// Called once per pid by pidresponses_foreach
+/** \param responses count being used, PIDRESPONSES_NEVER or PIDRESPONSES_UNKNOWN */
+typedef void (*pidresponses_cb)(unsigned int mode, unsigned int pid, int responses, void *arg);
+
+/// Walk every pid with a count or marked never
+/** \param onlychanged only those changed since the last call with this set
+ \return number of pids passed to cb */
+int pidresponses_foreach(int onlychanged, pidresponses_cb cb, void *arg);
+
+/// Forget everything learned
+void pidresponses_reset();
+
+#endif // __PIDRESPONSES_H
+
@@ -0,0 +1,174 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Learn how long each pid takes to answer
+ */
+
+#include "pidtiming.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/// Everything known about one pid
+struct pidtiming_entry {
+	unsigned int key; ///< mode<<16 | pid
+	long samples; ///< Responses ever recorded
+	double average; ///< Moving average response time, usec
+	unsigned int buckets[PIDTIMING_NUMBUCKETS]; ///< Histogram of response times
+	unsigned int total; ///< Sum of buckets
+	int consecutive_timeouts; ///< Timeouts since the last response
+	int demoted; ///< Set once it's timed out too often
+	int skipped; ///< Samples skipped since it was last tried
+};
+
+/// Every pid we know about
+static struct pidtiming_entry pidtimings[PIDTIMING_MAXPIDS];
+
+/// Number of entries used in pidtimings
+static int numpidtimings = 0;
+
+/// Upper edge of each bucket, usec. Filled in on first use
+static long bucketedges[PIDTIMING_NUMBUCKETS];
+
+/// Find a pid's entry
+/** \param create add it if it's not there
+ \return the entry, or NULL */
+static struct pidtiming_entry *pidtiming_find(unsigned int mode, unsigned int pid, int create) {
+	unsigned int key = (mode << 16) | pid;
+	int i;
+	for(i=0; i<numpidtimings; i++) {
+		if(key == pidtimings[i].key) return &pidtimings[i];
+	}
+	if(!create || numpidtimings >= PIDTIMING_MAXPIDS) return NULL;
+
+	if(0 == bucketedges[0]) {
+		double edge = PIDTIMING_BUCKETBASE;
+		for(i=0; i<PIDTIMING_NUMBUCKETS; i++) {
+			bucketedges[i] = (long)edge;
+			edge *= 1.25;
+		}
+	}
+
+	struct pidtiming_entry *e = &pidtimings[numpidtimings++];
+	memset(e, 0, sizeof(*e));
+	e->key = key;
+	e->average = -1;
+	return e;
+}
+
+/// Percentile of one entry, or -1
+static long pidtiming_entrypercentile(const struct pidtiming_entry *e, double p) {
+	if(NULL == e || e->samples < PIDTIMING_MINSAMPLES || 0 == e->total) return -1;
+
+	unsigned int want = (unsigned int)(p * e->total);
+	unsigned int seen = 0;
+	int i;
+	for(i=0; i<PIDTIMING_NUMBUCKETS; i++) {
+		seen += e->buckets[i];
+		if(seen > want) return bucketedges[i];
+	}
+	return bucketedges[PIDTIMING_NUMBUCKETS-1];
+}
+
+void pidtiming_record(unsigned int mode, unsigned int pid, long usec) {
+	struct pidtiming_entry *e = pidtiming_find(mode, pid, 1);
+	int i;
+	if(NULL == e) return;
+
+	for(i=0; i<PIDTIMING_NUMBUCKETS-1 && usec > bucketedges[i]; i++);
+	e->buckets[i]++;
+	e->total++;
+
+	if(e->total >= PIDTIMING_DECAYCOUNT) {
+		e->total = 0;
+		for(i=0; i<PIDTIMING_NUMBUCKETS; i++) {
+			e->buckets[i] /= 2;
+			e->total += e->buckets[i];
+		}
+	}
+
+	if(e->average < 0) {
+		e->average = usec;
+	} else {
+		e->average += PIDTIMING_EWMAWEIGHT * (usec - e->average);
+	}
+	e->samples++;
+
+	if(e->demoted) {
+		printf("pid %02X %02X is answering again\n", mode, pid);
+	}
+	e->consecutive_timeouts = 0;
+	e->demoted = 0;
+}
+
+void pidtiming_timeout(unsigned int mode, unsigned int pid) {
+	struct pidtiming_entry *e = pidtiming_find(mode, pid, 1);
+	if(NULL == e) return;
+
+	e->consecutive_timeouts++;
+	if(!e->demoted && e->consecutive_timeouts >= PIDTIMING_DEMOTEAFTER) {
+		fprintf(stderr, "Not Fatal: pid %02X %02X timed out %i times running. "
+			"Only asking every %i samples\n", mode, pid,
+			e->consecutive_timeouts, PIDTIMING_RETRYINTERVAL);
+		e->demoted = 1;
+		e->skipped = 0;
+	}
+}
+
+int pidtiming_shouldskip(unsigned int mode, unsigned int pid) {
+	struct pidtiming_entry *e = pidtiming_find(mode, pid, 0);
+	if(NULL == e || !e->demoted) return 0;
+
+	if(++e->skipped >= PIDTIMING_RETRYINTERVAL) {
+		e->skipped = 0;
+		return 0;
+	}
+	return 1;
+}
+
+int pidtiming_isdemoted(unsigned int mode, unsigned int pid) {
+	struct pidtiming_entry *e = pidtiming_find(mode, pid, 0);
+	return (NULL != e && e->demoted);
+}
+
+double pidtiming_average(unsigned int mode, unsigned int pid) {
+	struct pidtiming_entry *e = pidtiming_find(mode, pid, 0);
+	return (NULL == e)?-1:e->average;
+}
+
+long pidtiming_percentile(unsigned int mode, unsigned int pid, double p) {
+	return pidtiming_entrypercentile(pidtiming_find(mode, pid, 0), p);
+}
+
+long pidtiming_worstpercentile(double p) {
+	long worst = -1;
+	int i;
+	for(i=0; i<numpidtimings; i++) {
+		long thisp = pidtiming_entrypercentile(&pidtimings[i], p);
+		if(thisp > worst) worst = thisp;
+	}
+	return worst;
+}
+
+void pidtiming_reset() {
+	numpidtimings = 0;
+}
+
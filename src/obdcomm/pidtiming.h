@@ -0,0 +1,98 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Learn how long each pid takes to answer
+ Response times are kept per mode and pid as a moving average and a
+  histogram. The slowest pid's sets the ELM327's own timeout, and pids
+  that keep timing out are only asked for now and then.
+ */
+
+#ifndef __PIDTIMING_H
+#define __PIDTIMING_H
+
+/// Upper edge of the first histogram bucket, usec
+#define PIDTIMING_BUCKETBASE 1000l
+
+/// Number of histogram buckets. Each is 25% wider than the last
+#define PIDTIMING_NUMBUCKETS 48
+
+/// Halve the histogram once it holds this many samples, so it keeps learning
+#define PIDTIMING_DECAYCOUNT 1024
+
+/// Weight given to each new sample in the moving average
+#define PIDTIMING_EWMAWEIGHT 0.1
+
+/// Samples needed before a pid's learned times are used
+#define PIDTIMING_MINSAMPLES 20
+
+/// Percentile timeouts are based on
+#define PIDTIMING_PERCENTILE 0.99
+
+/// Timeouts are this many times the learned percentile
+#define PIDTIMING_HEADROOM 1.5
+
+/// How much longer than the device's own timeout we wait for it, usec
+#define PIDTIMING_MINDEADLINE 100000l
+
+/// Consecutive timeouts before a pid is demoted
+#define PIDTIMING_DEMOTEAFTER 3
+
+/// Demoted pids are still tried once every this many samples
+#define PIDTIMING_RETRYINTERVAL 30
+
+/// Most pids tracked at once
+#define PIDTIMING_MAXPIDS 256
+
+/// Record how long a pid took to answer
+/** Only real answers are recorded. NO DATA, errors and timeouts aren't,
+     since they take as long as the device's timeout rather than the pid
+ \param mode the obd service mode
+ \param pid the pid
+ \param usec time from sending the request to the prompt
+ */
+void pidtiming_record(unsigned int mode, unsigned int pid, long usec);
+
+/// Record that a pid didn't answer before its deadline
+void pidtiming_timeout(unsigned int mode, unsigned int pid);
+
+/// Find out if this pid should be skipped this sample
+/** Demoted pids are skipped, except for an occasional retry
+ \return 1 to skip it, 0 to ask for it
+ */
+int pidtiming_shouldskip(unsigned int mode, unsigned int pid);
+
+/// Find out if a pid is currently demoted
+int pidtiming_isdemoted(unsigned int mode, unsigned int pid);
+
+/// Moving average response time for a pid, usec. -1 if unknown
+double pidtiming_average(unsigned int mode, unsigned int pid);
+
+/// Response time percentile for a pid, usec. -1 if too little is known
+long pidtiming_percentile(unsigned int mode, unsigned int pid, double p);
+
+/// Highest learned percentile across every pid, usec. -1 if too little is known
+long pidtiming_worstpercentile(double p);
+
+/// Forget everything learned
+void pidtiming_reset();
+
+#endif // __PIDTIMING_H
+
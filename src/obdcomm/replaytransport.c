@@ -0,0 +1,198 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Replay a serial capture as if it were a live adapter
+ Device strings look like replay://capturefile or
+  replay://capturefile?speed=N. Speed is a multiplier on the recorded
+  timing; zero means as fast as possible.
+ Every recorded command is matched up to the next live one, and the
+  recorded responses to it are sent at their recorded delay after it.
+ */
+
+#include "obdtransport.h"
+#include "obdcapture.h"
+#include "obdserial.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/// Process feeding the replay. We only support one at a time
+static pid_t replay_pid = -1;
+
+/// A live command read from the logger
+struct replay_cmd {
+	char buf[1024]; ///< Command, up to and including the '\r'
+	int len; ///< Bytes in buf that are part of the command
+	char extra[1024]; ///< Bytes read past the end of the command
+	int extralen; ///< Bytes in extra
+};
+
+/// Read the next complete command the logger sends
+/** \return 0 on success, -1 if the logger went away */
+static int replay_readcmd(int s, struct replay_cmd *c) {
+	c->len = 0;
+	for(;;) {
+		int i;
+		for(i=0; i<c->extralen; i++) {
+			if(c->len < (int)sizeof(c->buf)) {
+				c->buf[c->len++] = c->extra[i];
+			}
+			if('\r' == c->extra[i]) {
+				memmove(c->extra, c->extra+i+1, c->extralen-i-1);
+				c->extralen -= i+1;
+				return 0;
+			}
+		}
+		c->extralen = read(s, c->extra, sizeof(c->extra));
+		if(0 >= c->extralen) return -1;
+	}
+}
+
+/// Body of the replay process
+static void replay_run(int s, FILE *f, double speed) {
+	struct obdcapture_record *r = (struct obdcapture_record *)malloc(sizeof(struct obdcapture_record));
+	struct replay_cmd *c = (struct replay_cmd *)malloc(sizeof(struct replay_cmd));
+	if(NULL == r || NULL == c) return;
+	c->extralen = 0;
+
+	unsigned long long last_out_rec = 0; // Recorded time of the last command
+	unsigned long long last_out_live = obdcapture_now(); // When we got it live
+
+	int diverged = 0;
+	int rc;
+	while(0 == (rc = obdcapture_readrecord(f, r))) {
+		if(OBDCAPTURE_OUT == r->direction) {
+			if(0 != replay_readcmd(s, c)) break;
+			if(!diverged && (c->len != r->len || 0 != memcmp(c->buf, r->data, r->len))) {
+				fprintf(stderr, "Replay diverged from capture at %.3fs: "
+					"recorded \"%.*s\", got \"%.*s\"\n", r->usec/1000000.0,
+					r->len-1, r->data, c->len-1, c->buf);
+				diverged = 1;
+			}
+			last_out_rec = r->usec;
+			last_out_live = obdcapture_now();
+		} else {
+			if(0 < speed && r->usec > last_out_rec) {
+				unsigned long long target = last_out_live +
+					(unsigned long long)((r->usec - last_out_rec) / speed);
+				unsigned long long now = obdcapture_now();
+				if(target > now) usleep(target - now);
+			}
+			if(r->len != write(s, r->data, r->len)) break;
+		}
+	}
+	if(-1 == rc) {
+		fprintf(stderr, "Serial capture is damaged, ending replay early\n");
+	}
+
+	// Let the other end see EOF, but keep eating what it sends until it closes
+	shutdown(s, SHUT_WR);
+	while(0 < read(s, c->extra, sizeof(c->extra)));
+
+	free(c);
+	free(r);
+}
+
+static int replay_open(const char *address) {
+	char *filename = strdup(address);
+	if(NULL == filename) return -1;
+
+	double speed = 1;
+	char *params = strrchr(filename, '?');
+	if(NULL != params) {
+		*params = '\0';
+		params++;
+		if(1 != sscanf(params, "speed=%lf", &speed) || speed < 0) {
+			fprintf(stderr, "Couldn't understand replay option \"%s\"\n", params);
+			free(filename);
+			return -1;
+		}
+	}
+
+	FILE *f = obdcapture_openread(filename);
+	free(filename);
+	if(NULL == f) return -1;
+
+	if(-1 != replay_pid) {
+		fprintf(stderr, "Only one replay can run at a time\n");
+		fclose(f);
+		return -1;
+	}
+
+	int sv[2];
+	if(-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+		perror("socketpair");
+		fclose(f);
+		return -1;
+	}
+
+	pid_t pid = fork();
+	switch(pid) {
+		case -1:
+			perror("Couldn't fork replay");
+			close(sv[0]);
+			close(sv[1]);
+			fclose(f);
+			return -1;
+		case 0: // child
+			close(sv[0]);
+			signal(SIGPIPE, SIG_IGN);
+			replay_run(sv[1], f, speed);
+			fclose(f);
+			close(sv[1]);
+			_exit(0);
+		default: // parent
+			break;
+	}
+
+	replay_pid = pid;
+	fclose(f);
+	close(sv[1]);
+	return sv[0];
+}
+
+static void replay_close(int fd) {
+	close(fd);
+	if(-1 != replay_pid) {
+		waitpid(replay_pid, NULL, 0);
+		replay_pid = -1;
+	}
+}
+
+/// Declare the replay transport. Pulled in as an extern in obdtransport.c
+/** The replay process does all the waiting, so never settle */
+struct obdtransport obdtransport_replay = {
+	"replay",
+	"replay://",
+	replay_open,
+	replay_close,
+	0,
+	OBDCOMM_TIMEOUT,
+	OBDCOMM_TIMEOUT,
+	0
+};
+
@@ -0,0 +1,96 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Bluetooth RFCOMM transport, without needing an rfcomm bind first
+ Device strings look like rfcomm://00:11:22:33:44:55 or
+  rfcomm://00:11:22:33:44:55/channel [channel defaults to 1]
+ */
+
+#ifdef HAVE_BLUETOOTH
+
+#include "obdtransport.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/rfcomm.h>
+
+static int rfcomm_open(const char *address) {
+	unsigned int b[6];
+	unsigned int channel = 1;
+
+	int count = sscanf(address, "%2x:%2x:%2x:%2x:%2x:%2x/%u",
+		b, b+1, b+2, b+3, b+4, b+5, &channel);
+	if(count < 6 || channel < 1 || channel > 30) {
+		fprintf(stderr, "Must pass rfcomm://XX:XX:XX:XX:XX:XX[/channel], not rfcomm://%s\n", address);
+		return -1;
+	}
+
+	struct sockaddr_rc addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.rc_family = AF_BLUETOOTH;
+	addr.rc_channel = (uint8_t)channel;
+
+	// bdaddr_t is stored backwards relative to how humans write it
+	int i;
+	for(i=0; i<6; i++) {
+		addr.rc_bdaddr.b[5-i] = (uint8_t)b[i];
+	}
+
+	int s = socket(AF_BLUETOOTH, SOCK_STREAM, BTPROTO_RFCOMM);
+	if(-1 == s) {
+		perror("Couldn't open bluetooth socket");
+		return -1;
+	}
+
+	// Blocking connect; baseband paging has its own timeout
+	if(-1 == connect(s, (struct sockaddr *)&addr, sizeof(addr))) {
+		perror(address);
+		close(s);
+		return -1;
+	}
+
+	return s;
+}
+
+static void rfcomm_close(int fd) {
+	close(fd);
+}
+
+/// Declare the rfcomm transport. Pulled in as an extern in obdtransport.c
+/** Bluetooth adds tens of ms of jitter to every exchange, and sniff
+  mode can add a lot more after we've been quiet for a while */
+struct obdtransport obdtransport_rfcomm = {
+	"rfcomm",
+	"rfcomm://",
+	rfcomm_open,
+	rfcomm_close,
+	0,
+	5000000l,
+	10000000l,
+	500000l
+};
+
+#endif //HAVE_BLUETOOTH
+
@@ -0,0 +1,75 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Serial port transport [and anything else that looks like a tty]
+ */
+
+#include "obdtransport.h"
+#include "obdserial.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+
+static int serial_open(const char *portfilename) {
+	struct termios options;
+	int fd;
+
+	fd = open(portfilename, O_RDWR | O_NOCTTY | O_NDELAY);
+
+	if(fd == -1) {
+		perror(portfilename);
+		return -1;
+	}
+
+	fcntl(fd, F_SETFL, 0);
+
+	// Get the current options for the port
+	tcgetattr(fd, &options);
+
+	options.c_cflag |= (CLOCAL | CREAD);
+	options.c_lflag &= !(ICANON | ECHO | ECHOE | ISIG);
+	options.c_oflag &= !(OPOST);
+	options.c_cc[VMIN] = 0;
+	options.c_cc[VTIME] = 100;
+
+	tcsetattr(fd, TCSANOW, &options);
+
+	return fd;
+}
+
+static void serial_close(int fd) {
+	close(fd);
+}
+
+/// Declare the serial transport. Pulled in as an extern in obdtransport.c
+struct obdtransport obdtransport_serial = {
+	"serial",
+	NULL,
+	serial_open,
+	serial_close,
+	1,
+	OBDCOMM_TIMEOUT,
+	OBDCOMM_TIMEOUT,
+	1000000l
+};
+
@@ -0,0 +1,156 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Where each sample's time goes
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "stagetiming.h"
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif //HAVE_SYS_SDT_H
+
+/// Names of each stage, in enum order
+static const char *stagetiming_names[OBDSTAGE_COUNT] = {
+	"serialwrite", "elmwait", "parse", "decode", "obdinsert", "rollup", "gpspoll",
+	"gpsinsert", "blackbox", "updatetrip", "publish", "background", "commit", "sample"
+};
+
+/// Everything known about one stage
+struct stagetiming_stage {
+	unsigned long buckets[STAGETIMING_NUMBUCKETS]; ///< Histogram of span lengths
+	long count; ///< Spans timed
+	long long total; ///< Total nsec
+	long long max; ///< Longest span, nsec
+};
+
+/// Every stage
+static struct stagetiming_stage stagetimings[OBDSTAGE_COUNT];
+
+/// Upper edge of each bucket, nsec. Filled in on first use
+static long long bucketedges[STAGETIMING_NUMBUCKETS];
+
+long long stagetiming_start() {
+#ifdef HAVE_CLOCK_MONOTONIC
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000000000ll + tv.tv_usec * 1000ll;
+#endif //HAVE_CLOCK_MONOTONIC
+}
+
+void stagetiming_end(enum obdstage stage, long long start) {
+	long long span = stagetiming_start() - start;
+	if(stage < 0 || stage >= OBDSTAGE_COUNT) return;
+	if(span < 0) span = 0;
+
+	if(0 == bucketedges[0]) {
+		int i;
+		double edge = 1000.0;
+		for(i=0; i<STAGETIMING_NUMBUCKETS; i++) {
+			bucketedges[i] = (long long)edge;
+			edge *= 1.25;
+		}
+	}
+
+	// Binary search for the first bucket this fits under
+	int lo = 0, hi = STAGETIMING_NUMBUCKETS-1;
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		if(span <= bucketedges[mid]) hi = mid;
+		else lo = mid + 1;
+	}
+
+	struct stagetiming_stage *s = &stagetimings[stage];
+	s->buckets[lo]++;
+	s->count++;
+	s->total += span;
+	if(span > s->max) s->max = span;
+
+#ifdef HAVE_SYS_SDT_H
+	DTRACE_PROBE2(obdgpslogger, stage, stagetiming_names[stage], (long)(span/1000));
+#endif //HAVE_SYS_SDT_H
+}
+
+const char *stagetiming_name(enum obdstage stage) {
+	if(stage < 0 || stage >= OBDSTAGE_COUNT) return "unknown";
+	return stagetiming_names[stage];
+}
+
+/// Top edge of the bucket holding the pth of a stage's spans, seconds
+static double stagetiming_percentile(const struct stagetiming_stage *s, double p) {
+	unsigned long want = (unsigned long)(p * s->count);
+	unsigned long seen = 0;
+	int i;
+	for(i=0; i<STAGETIMING_NUMBUCKETS; i++) {
+		seen += s->buckets[i];
+		if(seen > want) break;
+	}
+	if(i >= STAGETIMING_NUMBUCKETS) i = STAGETIMING_NUMBUCKETS-1;
+
+	// The last bucket has no top edge, and nothing is longer than max
+	long long edge = bucketedges[i];
+	if(i == STAGETIMING_NUMBUCKETS-1 || edge > s->max) edge = s->max;
+	return (double)edge / 1000000000.0;
+}
+
+long stagetiming_summarise(enum obdstage stage, struct stagetiming_summary *summary) {
+	memset(summary, 0, sizeof(*summary));
+	if(stage < 0 || stage >= OBDSTAGE_COUNT) return 0;
+
+	const struct stagetiming_stage *s = &stagetimings[stage];
+	if(0 == s->count) return 0;
+
+	summary->count = s->count;
+	summary->total = (double)s->total / 1000000000.0;
+	summary->mean = summary->total / s->count;
+	summary->p50 = stagetiming_percentile(s, 0.5);
+	summary->p90 = stagetiming_percentile(s, 0.9);
+	summary->p99 = stagetiming_percentile(s, 0.99);
+	summary->max = (double)s->max / 1000000000.0;
+	return s->count;
+}
+
+void stagetiming_print(FILE *f) {
+	int i;
+	fprintf(f, "%-12s %8s %10s %10s %10s %10s %10s %10s\n", "stage", "count",
+		"total(s)", "mean(ms)", "p50(ms)", "p90(ms)", "p99(ms)", "max(ms)");
+	for(i=0; i<OBDSTAGE_COUNT; i++) {
+		struct stagetiming_summary s;
+		if(0 == stagetiming_summarise(i, &s)) continue;
+		fprintf(f, "%-12s %8li %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n",
+			stagetiming_names[i], s.count, s.total, s.mean*1000.0,
+			s.p50*1000.0, s.p90*1000.0, s.p99*1000.0, s.max*1000.0);
+	}
+}
+
+void stagetiming_reset() {
+	memset(stagetimings, 0, sizeof(stagetimings));
+}
+
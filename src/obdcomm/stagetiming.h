@@ -0,0 +1,91 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Where each sample's time goes
+ Each stage of taking a sample is timed into its own histogram. It's cheap
+  enough to leave on all the time: two reads of the monotonic clock and a
+  few compares per span. Built with sys/sdt.h, each span also fires the
+  obdgpslogger:stage USDT probe, with the stage name and usec taken, for
+  perf or bpftrace to attach to.
+ */
+
+#ifndef __STAGETIMING_H
+#define __STAGETIMING_H
+
+#include <stdio.h>
+
+/// Stages of a sample
+enum obdstage {
+	OBDSTAGE_SERIALWRITE, ///< Writing a request to the device
+	OBDSTAGE_ELMWAIT, ///< Waiting for the device to answer
+	OBDSTAGE_PARSE, ///< Parsing the answer into bytes
+	OBDSTAGE_DECODE, ///< Converting bytes to a value
+	OBDSTAGE_OBDINSERT, ///< sqlite3_step for the obd table
+	OBDSTAGE_ROLLUP, ///< Writing rollup intervals
+	OBDSTAGE_GPSPOLL, ///< Picking up new fixes from the gps reader
+	OBDSTAGE_GPSINSERT, ///< sqlite3_step for the gps table
+	OBDSTAGE_BLACKBOX, ///< Keeping samples in the blackbox, and writing them out
+	OBDSTAGE_UPDATETRIP, ///< Updating the trip's end time
+	OBDSTAGE_PUBLISH, ///< Live bus, live http and dbus
+	OBDSTAGE_BACKGROUND, ///< Mode 06 and 22 requests between samples
+	OBDSTAGE_COMMIT, ///< Committing the transaction
+	OBDSTAGE_SAMPLE, ///< The whole sample, not counting the wait for the next one
+	OBDSTAGE_COUNT ///< Number of stages. Not a stage
+};
+
+/// Number of histogram buckets. Each is 25% wider than the last, from 1usec
+#define STAGETIMING_NUMBUCKETS 80
+
+/// Summary of one stage
+struct stagetiming_summary {
+	long count; ///< Spans timed
+	double total; ///< Seconds spent in the stage
+	double mean; ///< Mean seconds per span
+	double p50; ///< Median, seconds
+	double p90; ///< 90th percentile, seconds
+	double p99; ///< 99th percentile, seconds
+	double max; ///< Longest span, seconds
+};
+
+/// Start timing a span
+/** \return an opaque start time for stagetiming_end */
+long long stagetiming_start();
+
+/// Finish timing a span
+/** \param start returned by stagetiming_start */
+void stagetiming_end(enum obdstage stage, long long start);
+
+/// Short name of a stage, as used in the stagestats table
+const char *stagetiming_name(enum obdstage stage);
+
+/// Summarise a stage since the last reset
+/** Percentiles are the top edge of the bucket they fall in
+ \return number of spans timed */
+long stagetiming_summarise(enum obdstage stage, struct stagetiming_summary *s);
+
+/// Write a summary of every stage that's been timed
+void stagetiming_print(FILE *f);
+
+/// Forget every span timed so far
+void stagetiming_reset();
+
+#endif //__STAGETIMING_H
+
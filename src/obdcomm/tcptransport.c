@@ -0,0 +1,160 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief TCP transport, for wifi ELM327 clones
+ Device strings look like tcp://host:port
+ */
+
+#include "obdtransport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+
+/// Give up connecting after this many seconds
+#define TCPTRANSPORT_CONNECT_TIMEOUT 5
+
+/// Non-blocking connect with a timeout
+/** \return 0 on success, -1 on failure */
+static int tcp_connect(int s, const struct sockaddr *addr, socklen_t addrlen) {
+	if(-1 == fcntl(s, F_SETFL, O_NONBLOCK)) {
+		perror("fcntl");
+		return -1;
+	}
+
+	if(0 == connect(s, addr, addrlen)) {
+		return 0;
+	}
+	if(EINPROGRESS != errno) {
+		return -1;
+	}
+
+	fd_set wfds;
+	FD_ZERO(&wfds);
+	FD_SET(s, &wfds);
+
+	struct timeval timeout;
+	timeout.tv_sec = TCPTRANSPORT_CONNECT_TIMEOUT;
+	timeout.tv_usec = 0;
+
+	if(0 >= select(s+1, NULL, &wfds, NULL, &timeout)) {
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	int err = 0;
+	socklen_t errlen = sizeof(err);
+	if(-1 == getsockopt(s, SOL_SOCKET, SO_ERROR, &err, &errlen) || 0 != err) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+static int tcp_open(const char *address) {
+	char *node = strdup(address); // Because we need to split it
+	if(NULL == node) return -1;
+
+	char *service = strrchr(node, ':');
+	if(NULL == service) {
+		fprintf(stderr, "Must pass tcp://ip-or-hostname:port, not tcp://%s\n", address);
+		free(node);
+		return -1;
+	}
+	*service = '\0';
+	service++;
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	struct addrinfo *res; // From getaddrinfo
+	int gai_ret = getaddrinfo(node, service, &hints, &res);
+	free(node);
+	if(0 != gai_ret) {
+		fprintf(stderr, "getaddrinfo error for %s: %s\n", address, gai_strerror(gai_ret));
+		return -1;
+	}
+
+	int s = -1;
+	struct addrinfo *curr;
+	for(curr = res; NULL != curr; curr = curr->ai_next) {
+		s = socket(curr->ai_family, curr->ai_socktype, curr->ai_protocol);
+		if(-1 == s) continue;
+
+		if(0 == tcp_connect(s, curr->ai_addr, curr->ai_addrlen)) break;
+
+		close(s);
+		s = -1;
+	}
+
+	freeaddrinfo(res);
+
+	if(-1 == s) {
+		perror(address);
+		return -1;
+	}
+
+	// Each request is a handful of bytes and we wait for the answer
+	//   before sending another, so Nagle only ever adds latency
+	int one = 1;
+	if(-1 == setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one))) {
+		perror("Not Fatal: couldn't set TCP_NODELAY");
+	}
+
+	// Notice if the adapter drops off the network while we're idle
+	if(-1 == setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one))) {
+		perror("Not Fatal: couldn't set SO_KEEPALIVE");
+	}
+
+	return s;
+}
+
+static void tcp_close(int fd) {
+	close(fd);
+}
+
+/// Declare the tcp transport. Pulled in as an extern in obdtransport.c
+/** Wifi adapters answer quickly or not at all, but still need the full
+  time to search protocols on first connect */
+struct obdtransport obdtransport_tcp = {
+	"tcp",
+	"tcp://",
+	tcp_open,
+	tcp_close,
+	0,
+	2000000l,
+	10000000l,
+	100000l
+};
+
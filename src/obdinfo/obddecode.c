@@ -0,0 +1,317 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** \file
+ \brief Table-driven conversion between OBD bytes and values
+ */
+
+#include "obddecode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Built-in mode 01 PIDs
+/** Bit-encoded PIDs are here too, as the raw number, so a multi-PID
+     response can be walked past them. Derived from the original
+     obdConvert_* functions, and checked against them */
+static const struct obddecode obddecode_mode1[] = {
+	// mode  pid len first n  mask shift signed  bias    mul       div     offset
+	{ 0x01, 0x00, 4, 0, 4, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x01, 4, 0, 4, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x02, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x03, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x04, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x05, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,   -40.0f },
+	{ 0x01, 0x06, 1, 0, 1, 0, 0, 0, -128.0f,  100.0f,   128.0f,     0.0f },
+	{ 0x01, 0x07, 1, 0, 1, 0, 0, 0, -128.0f,  100.0f,   128.0f,     0.0f },
+	{ 0x01, 0x08, 1, 0, 1, 0, 0, 0, -128.0f,  100.0f,   128.0f,     0.0f },
+	{ 0x01, 0x09, 1, 0, 1, 0, 0, 0, -128.0f,  100.0f,   128.0f,     0.0f },
+	{ 0x01, 0x0A, 1, 0, 1, 0, 0, 0,    0.0f,    3.0f,     1.0f,     0.0f },
+	{ 0x01, 0x0B, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x0C, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     4.0f,     0.0f },
+	{ 0x01, 0x0D, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x0E, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     2.0f,   -64.0f },
+	{ 0x01, 0x0F, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,   -40.0f },
+	{ 0x01, 0x10, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,   100.0f,     0.0f },
+	{ 0x01, 0x11, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x12, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x13, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x14, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x15, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x16, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x17, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x18, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x19, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x1A, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x1B, 2, 0, 1, 0, 0, 0,    0.0f,  0.005f,     1.0f,     0.0f },
+	{ 0x01, 0x1C, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x1D, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x1E, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x1F, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x20, 4, 0, 4, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x21, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x22, 2, 0, 2, 0, 0, 0,    0.0f,  0.079f,     1.0f,     0.0f },
+	{ 0x01, 0x23, 2, 0, 2, 0, 0, 0,    0.0f,   10.0f,     1.0f,     0.0f },
+	{ 0x01, 0x24, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x25, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x26, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x27, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x28, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x29, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x2A, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x2B, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x2C, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x2D, 1, 0, 1, 0, 0, 0,    0.0f, 0.78125f,    1.0f,  -100.0f },
+	{ 0x01, 0x2E, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x2F, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x30, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x31, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x32, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     4.0f, -8192.0f },
+	{ 0x01, 0x33, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x34, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x35, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x36, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x37, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x38, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x39, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x3A, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x3B, 4, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x3C, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,    10.0f,   -40.0f },
+	{ 0x01, 0x3D, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,    10.0f,   -40.0f },
+	{ 0x01, 0x3E, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,    10.0f,   -40.0f },
+	{ 0x01, 0x3F, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,    10.0f,   -40.0f },
+	{ 0x01, 0x40, 4, 0, 4, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x41, 4, 0, 4, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x42, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,  1000.0f,     0.0f },
+	{ 0x01, 0x43, 2, 0, 2, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x44, 2, 0, 2, 0, 0, 0,    0.0f, 0.0000305f,  1.0f,     0.0f },
+	{ 0x01, 0x45, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x46, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,   -40.0f },
+	{ 0x01, 0x47, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x48, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x49, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x4A, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x4B, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x4C, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+	{ 0x01, 0x4D, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x4E, 2, 0, 2, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x4F, 4, 0, 4, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x50, 4, 0, 4, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x51, 1, 0, 1, 0, 0, 0,    0.0f,    1.0f,     1.0f,     0.0f },
+	{ 0x01, 0x52, 1, 0, 1, 0, 0, 0,    0.0f,  100.0f,   255.0f,     0.0f },
+};
+
+/// Entries loaded from files
+static struct obddecode *obddecode_loaded = NULL;
+
+/// Number of entries in obddecode_loaded
+static int obddecode_numloaded = 0;
+
+/// Direct index of mode 01 PIDs
+static const struct obddecode *obddecode_index1[256];
+
+/// Set once obddecode_index1 has been filled in
+static int obddecode_indexed = 0;
+
+/// Fill in obddecode_index1
+static void obddecode_buildindex() {
+	int i;
+	memset(obddecode_index1, 0, sizeof(obddecode_index1));
+	for(i=0; i<sizeof(obddecode_mode1)/sizeof(obddecode_mode1[0]); i++) {
+		obddecode_index1[obddecode_mode1[i].cmdid & 0xFF] = &obddecode_mode1[i];
+	}
+	for(i=0; i<obddecode_numloaded; i++) {
+		if(0x01 == obddecode_loaded[i].mode && obddecode_loaded[i].cmdid < 256) {
+			obddecode_index1[obddecode_loaded[i].cmdid] = &obddecode_loaded[i];
+		}
+	}
+	obddecode_indexed = 1;
+}
+
+const struct obddecode *obdDecodeForPID(unsigned int mode, unsigned int cmdid) {
+	if(0x01 == mode) {
+		if(!obddecode_indexed) obddecode_buildindex();
+		if(cmdid >= 256) return NULL;
+		return obddecode_index1[cmdid];
+	}
+
+	int i;
+	for(i=0; i<obddecode_numloaded; i++) {
+		if(mode == obddecode_loaded[i].mode && cmdid == obddecode_loaded[i].cmdid) {
+			return &obddecode_loaded[i];
+		}
+	}
+	return NULL;
+}
+
+const struct obddecode *obdDecodeLoadedForMode(unsigned int mode, int n) {
+	int i;
+	for(i=0; i<obddecode_numloaded; i++) {
+		if(mode == obddecode_loaded[i].mode) {
+			if(0 == n) return &obddecode_loaded[i];
+			n--;
+		}
+	}
+	return NULL;
+}
+
+/// Number of bits in the field
+static int obddecode_fieldbits(const struct obddecode *d) {
+	if(0 == d->mask) return d->nbytes * 8;
+
+	unsigned long m = d->mask >> d->shift;
+	int bits = 0;
+	while(m) {
+		bits++;
+		m >>= 1;
+	}
+	return bits;
+}
+
+float obdDecodeValue(const struct obddecode *d, const unsigned int *bytes) {
+	unsigned long long raw = 0;
+	int i;
+	for(i=0; i<d->nbytes; i++) {
+		raw = (raw << 8) | (bytes[d->first + i] & 0xFF);
+	}
+	if(0 != d->mask) raw &= d->mask;
+	raw >>= d->shift;
+
+	float field;
+	int bits = obddecode_fieldbits(d);
+	if(d->is_signed && bits > 0 && (raw & (1ULL << (bits-1)))) {
+		field = -(float)((1ULL << bits) - raw);
+	} else {
+		field = (float)raw;
+	}
+
+	return (field + d->bias) * d->mul / d->div + d->offset;
+}
+
+int obdEncodeValue(const struct obddecode *d, float val, unsigned int *bytes) {
+	int i;
+	for(i=0; i<d->length; i++) {
+		bytes[i] = 0;
+	}
+
+	// Round to nearest
+	double field = ((double)val - d->offset) * d->div / d->mul - d->bias;
+	if(field < 0) {
+		field = -(double)(long long)(0.5 - field);
+	} else {
+		field = (double)(long long)(field + 0.5);
+	}
+
+	int bits = obddecode_fieldbits(d);
+	double minfield, maxfield;
+	if(d->is_signed) {
+		minfield = -(double)(1ULL << (bits-1));
+		maxfield = (double)(1ULL << (bits-1)) - 1;
+	} else {
+		minfield = 0;
+		maxfield = (double)((1ULL << bits) - 1);
+	}
+	if(field < minfield) field = minfield;
+	if(field > maxfield) field = maxfield;
+
+	unsigned long long raw;
+	if(field < 0) {
+		raw = (1ULL << bits) - (unsigned long long)(-field);
+	} else {
+		raw = (unsigned long long)field;
+	}
+	raw <<= d->shift;
+	if(0 != d->mask) raw &= d->mask;
+
+	for(i=d->nbytes-1; i>=0; i--) {
+		bytes[d->first + i] |= raw & 0xFF;
+		raw >>= 8;
+	}
+
+	return d->length;
+}
+
+int obdEncodeValueABCD(const struct obddecode *d, float val,
+	unsigned int *A, unsigned int *B, unsigned int *C, unsigned int *D) {
+
+	unsigned int bytes[OBDDECODE_MAXLENGTH];
+	int n = obdEncodeValue(d, val, bytes);
+	*A = bytes[0];
+	if(n > 1) *B = bytes[1];
+	if(n > 2) *C = bytes[2];
+	if(n > 3) *D = bytes[3];
+	return n>4?4:n;
+}
+
+int obdDecodeLoadFile(const char *filename) {
+	FILE *f = fopen(filename, "r");
+	if(NULL == f) {
+		perror(filename);
+		return -1;
+	}
+
+	int loaded = 0;
+	int lineno = 0;
+	char line[1024];
+	while(NULL != fgets(line, sizeof(line), f)) {
+		lineno++;
+
+		char *firstnonspace = line;
+		while(' ' == *firstnonspace || '\t' == *firstnonspace) firstnonspace++;
+		if('#' == *firstnonspace || '\n' == *firstnonspace ||
+			'\r' == *firstnonspace || '\0' == *firstnonspace) continue;
+
+		struct obddecode d;
+		memset(&d, 0, sizeof(d));
+		if(12 != sscanf(firstnonspace, "%x %x %i %i %i %lx %i %i %f %f %f %f",
+				&d.mode, &d.cmdid, &d.length, &d.first, &d.nbytes, &d.mask,
+				&d.shift, &d.is_signed, &d.bias, &d.mul, &d.div, &d.offset)) {
+			fprintf(stderr, "%s:%i: Couldn't parse decode line\n", filename, lineno);
+			continue;
+		}
+		if(d.length < 1 || d.length > OBDDECODE_MAXLENGTH || d.nbytes < 1 ||
+				d.nbytes > 4 || d.first < 0 ||
+				d.first + d.nbytes > d.length || d.shift < 0 || d.shift >= 8*d.nbytes ||
+				0 == d.mul || 0 == d.div) {
+			fprintf(stderr, "%s:%i: Decode line doesn't make sense\n", filename, lineno);
+			continue;
+		}
+
+		// Replace an existing entry for the same PID
+		int i;
+		for(i=0; i<obddecode_numloaded; i++) {
+			if(obddecode_loaded[i].mode == d.mode && obddecode_loaded[i].cmdid == d.cmdid) break;
+		}
+		if(i == obddecode_numloaded) {
+			struct obddecode *newloaded = (struct obddecode *)realloc(obddecode_loaded,
+				(obddecode_numloaded+1) * sizeof(struct obddecode));
+			if(NULL == newloaded) break;
+			obddecode_loaded = newloaded;
+			obddecode_numloaded++;
+		}
+		obddecode_loaded[i] = d;
+		loaded++;
+	}
+	fclose(f);
+
+	obddecode_buildindex();
+	return loaded;
+}
+
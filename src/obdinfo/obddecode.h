@@ -0,0 +1,99 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+/** \file
+ \brief Table-driven conversion between OBD bytes and values
+ Each PID is described by where its bits are in the response and a
+  linear scale, instead of a function per PID. The same description
+  converts both ways:
+  value = ((field + bias) * mul / div) + offset
+ */
+#ifndef __OBDDECODE_H
+#define __OBDDECODE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif //  __cplusplus
+
+/// How to decode one PID
+struct obddecode {
+	unsigned int mode; ///< OBD service mode [eg 0x01]
+	unsigned int cmdid; ///< PID
+	int length; ///< Number of data bytes the ECU returns for this PID
+	int first; ///< Index of the first byte the field is in [0 == A]
+	int nbytes; ///< Number of bytes the field spans, most significant first. At most four
+	unsigned long mask; ///< Bits of those bytes that are the field, before shifting [0 == all]
+	int shift; ///< Shift right this many bits after masking
+	int is_signed; ///< Set if the field is two's complement
+	float bias; ///< Added to the field before scaling
+	float mul; ///< Scale numerator
+	float div; ///< Scale denominator
+	float offset; ///< Added after scaling
+};
+
+/// Most data bytes any one PID can return
+#define OBDDECODE_MAXLENGTH 8
+
+/// Find how to decode this PID
+/** Entries loaded with obdDecodeLoadFile take precedence over built-in ones
+ \return the entry, or NULL if we don't know it
+ */
+const struct obddecode *obdDecodeForPID(unsigned int mode, unsigned int cmdid);
+
+/// Convert bytes to a value
+/** \param bytes the data bytes returned for this PID, bytes[0] being A */
+float obdDecodeValue(const struct obddecode *d, const unsigned int *bytes);
+
+/// Convert a value to bytes
+/** Rounds to the nearest representable value, and clamps to the field's range
+ \param bytes at least d->length bytes to fill
+ \return number of bytes filled
+ */
+int obdEncodeValue(const struct obddecode *d, float val, unsigned int *bytes);
+
+/// Convert a value to bytes, the same way an OBDConvRevFunc does
+/** Only the first four bytes can be returned this way
+ \return number of bytes filled, at most four
+ */
+int obdEncodeValueABCD(const struct obddecode *d, float val,
+	unsigned int *A, unsigned int *B, unsigned int *C, unsigned int *D);
+
+/// Load extra PIDs from a file
+/** One PID per line, whitespace separated:
+   mode pid length first nbytes mask shift signed bias mul div offset
+  mode, pid and mask are hex. Lines starting with # are ignored
+ \return number of entries loaded, or -1 if the file couldn't be opened
+ */
+int obdDecodeLoadFile(const char *filename);
+
+/// Walk the entries loaded for one mode
+/** Built-in mode 01 entries aren't included; this is for finding
+     out which manufacturer [mode 22] PIDs the user asked for
+ \param mode the mode to look for
+ \param n which one of them to return, starting at zero
+ \return the nth entry for that mode, or NULL if there aren't that many
+ */
+const struct obddecode *obdDecodeLoadedForMode(unsigned int mode, int n);
+
+#ifdef __cplusplus
+}
+#endif //  __cplusplus
+
+#endif // __OBDDECODE_H
+
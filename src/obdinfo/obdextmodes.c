@@ -0,0 +1,112 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Decoding for the less frequently used modes: 06 and 09
+ */
+
+#include "obdextmodes.h"
+#include "obdservicecommands.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int obdModeNineItems(unsigned int pid, const unsigned int *bytes, const int *framelen, int numframes,
+	char (*items)[OBDEXT_MAXSTRING], int maxitems) {
+
+	struct obdservicecmd *cmd = obdGetCmdForModePID(0x09, pid);
+	if(NULL == cmd || NULL == cmd->db_column || 0 >= cmd->bytes_returned) return 0;
+	int itemlen = cmd->bytes_returned;
+
+	// Put the data back together without the counts
+	unsigned int data[1024];
+	int n = 0;
+	int f, i;
+	const unsigned int *p = bytes;
+	for(f=0; f<numframes; f++) {
+		for(i=1; i<framelen[f] && n<sizeof(data)/sizeof(data[0]); i++) {
+			data[n++] = p[i];
+		}
+		p += framelen[f];
+	}
+
+	// Legacy protocols send four bytes at a time, so a VIN arrives
+	//   with three bytes of padding in front
+	int skip = n % itemlen;
+
+	int count = 0;
+	for(i=skip; i+itemlen<=n && count<maxitems; i+=itemlen, count++) {
+		char *s = items[count];
+		int len = 0;
+		int j;
+		s[0] = '\0';
+		if(0 == strcmp(cmd->units, "ASCII")) {
+			for(j=0; j<itemlen && len<OBDEXT_MAXSTRING-1; j++) {
+				if(data[i+j] >= 0x20 && data[i+j] < 0x7F) {
+					s[len++] = (char)data[i+j];
+				}
+			}
+			s[len] = '\0';
+		} else if(0 == strcmp(cmd->units, "Hex")) {
+			for(j=0; j<itemlen && len<OBDEXT_MAXSTRING-3; j++) {
+				len += snprintf(s+len, OBDEXT_MAXSTRING-len, "%02X", data[i+j]);
+			}
+		} else {
+			unsigned long v = 0;
+			for(j=0; j<itemlen; j++) {
+				v = (v << 8) | data[i+j];
+			}
+			snprintf(s, OBDEXT_MAXSTRING, "%lu", v);
+		}
+	}
+	return count;
+}
+
+/// Two bytes, signed or not depending on the unit and scaling id
+static long obdmodesixword(unsigned int hi, unsigned int lo, unsigned int uasid) {
+	long v = (long)((hi << 8) | lo);
+	if(uasid >= 0x80 && v >= 0x8000) v -= 0x10000;
+	return v;
+}
+
+int obdModeSixTests(unsigned int mid, const unsigned int *bytes, int numbytes,
+	struct obdmodesixtest *tests, int maxtests) {
+
+	int count = 0;
+	int i = -1; // The first MID was the echo
+	while(i+9 <= numbytes && count < maxtests) {
+		struct obdmodesixtest *t = &tests[count];
+		t->mid = (i < 0)?mid:bytes[i];
+		t->tid = bytes[i+1];
+		t->uasid = bytes[i+2];
+		t->value = obdmodesixword(bytes[i+3], bytes[i+4], t->uasid);
+		t->min = obdmodesixword(bytes[i+5], bytes[i+6], t->uasid);
+		t->max = obdmodesixword(bytes[i+7], bytes[i+8], t->uasid);
+		t->passed = (t->min <= t->value && t->value <= t->max);
+		count++;
+		i += 9;
+	}
+	return count;
+}
+
+int obdPidInSupported(unsigned int base, const unsigned int *bytes, unsigned int pid) {
+	if(pid <= base || pid > base + 0x20) return 0;
+	unsigned int bit = pid - base - 1;
+	return 0 != (bytes[bit/8] & (0x80 >> (bit%8)));
+}
+
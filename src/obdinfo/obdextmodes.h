@@ -0,0 +1,89 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/** \file
+ \brief Decoding for the less frequently used modes: 06 and 09
+ These take the payload collected by getobdframes and pull out the
+  individual items. Anything that needs to talk to the car lives elsewhere
+ */
+#ifndef __OBDEXTMODES_H
+#define __OBDEXTMODES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif //  __cplusplus
+
+/// Longest item we'll pull from a mode 09 response, including the NUL
+#define OBDEXT_MAXSTRING 64
+
+/// One mode 06 test result
+/** Values are unscaled; the scaling depends on uasid, and comparing
+    against the limits doesn't need it */
+struct obdmodesixtest {
+	unsigned int mid; ///< On-board monitor ID
+	unsigned int tid; ///< Test ID
+	unsigned int uasid; ///< Unit and scaling ID. 0x80 and up are signed
+	long value; ///< Test value
+	long min; ///< Minimum test limit
+	long max; ///< Maximum test limit
+	int passed; ///< Set if min <= value <= max
+};
+
+/// Pull the items out of a mode 09 response
+/** Each frame starts with a message count or sequence number, which is
+    dropped. The rest is split into items of the length given in
+    obdcmds_mode9. ASCII items are copied with the padding removed,
+    calibration verification numbers are rendered in hex, and counters
+    in decimal
+ \param pid the mode 09 pid the response is for
+ \param bytes the payload from getobdframes
+ \param framelen number of bytes in each frame, from getobdframes
+ \param numframes number of frames
+ \param items filled with one string per item
+ \param maxitems number of items available
+ \return number of items filled
+ */
+int obdModeNineItems(unsigned int pid, const unsigned int *bytes, const int *framelen, int numframes,
+	char (*items)[OBDEXT_MAXSTRING], int maxitems);
+
+/// Pull the test results out of a mode 06 response
+/** ISO 15765 only; each test is MID TID UASID value min max, with the
+    first MID being the echo that getobdframes already removed
+ \param mid the mid the response is for
+ \param bytes the payload from getobdframes
+ \param numbytes number of bytes in the payload
+ \param tests filled with the test results
+ \param maxtests number of tests available
+ \return number of tests filled
+ */
+int obdModeSixTests(unsigned int mid, const unsigned int *bytes, int numbytes,
+	struct obdmodesixtest *tests, int maxtests);
+
+/// Check a "PIDs supported" response
+/** \param base the pid that was asked for [0x00, 0x20, ...]
+ \param bytes the four bytes returned
+ \param pid the pid to check
+ \return nonzero if pid is supported */
+int obdPidInSupported(unsigned int base, const unsigned int *bytes, unsigned int pid);
+
+#ifdef __cplusplus
+}
+#endif //  __cplusplus
+
+#endif //__OBDEXTMODES_H
+
@@ -0,0 +1,227 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Fill in values left out of deadband-compressed logs
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "obdreconstruct.h"
+
+/// Per-column state
+struct obdreconstruct_column {
+	int have; ///< Set once a value has been seen
+	double value; ///< Last value seen
+	double time; ///< When it was seen
+	long long waitfrom; ///< First held-back row waiting on this column, or -1
+};
+
+struct obdreconstruct {
+	int numcols; ///< Columns per row
+	enum obdreconstruct_mode mode; ///< How to fill gaps
+	double maxhold; ///< Longest gap filled, seconds. <= 0 for no limit
+	int window; ///< Rows held back at most
+	struct obdreconstruct_row *rows; ///< Ring of held-back rows
+	double *values; ///< Storage for rows' values
+	unsigned char *present; ///< Storage for rows' present flags
+	long long head; ///< Sequence number of the oldest held-back row
+	long long tail; ///< Sequence number the next row will get
+	struct obdreconstruct_column *cols; ///< Per-column state
+	obdreconstruct_emit emit; ///< Output callback
+	void *arg; ///< Passed to emit
+};
+
+struct obdreconstruct *obdreconstruct_create(int numcols, enum obdreconstruct_mode mode,
+		double maxhold, int window, obdreconstruct_emit emit, void *arg) {
+	int i;
+	struct obdreconstruct *r;
+
+	if(numcols < 0) return NULL;
+
+	r = (struct obdreconstruct *)calloc(1, sizeof(struct obdreconstruct));
+	if(NULL == r) return NULL;
+
+	// Step and none never hold anything back
+	if(OBDRECONSTRUCT_LINEAR != mode) window = 1;
+	else if(window <= 0) window = OBDRECONSTRUCT_DEFAULTWINDOW;
+
+	r->numcols = numcols;
+	r->mode = mode;
+	r->maxhold = maxhold;
+	r->window = window;
+	r->emit = emit;
+	r->arg = arg;
+	r->rows = (struct obdreconstruct_row *)calloc(window, sizeof(struct obdreconstruct_row));
+	r->values = (double *)calloc((size_t)window * (numcols>0?numcols:1), sizeof(double));
+	r->present = (unsigned char *)calloc((size_t)window * (numcols>0?numcols:1), 1);
+	r->cols = (struct obdreconstruct_column *)calloc(numcols>0?numcols:1,
+		sizeof(struct obdreconstruct_column));
+	if(NULL == r->rows || NULL == r->values || NULL == r->present || NULL == r->cols) {
+		obdreconstruct_free(r);
+		return NULL;
+	}
+
+	for(i=0;i<window;i++) {
+		r->rows[i].values = r->values + (size_t)i * numcols;
+		r->rows[i].present = r->present + (size_t)i * numcols;
+	}
+	for(i=0;i<numcols;i++) {
+		r->cols[i].waitfrom = -1;
+	}
+	return r;
+}
+
+/// Held-back row with this sequence number
+static struct obdreconstruct_row *recon_row(struct obdreconstruct *r, long long seq) {
+	return &r->rows[seq % r->window];
+}
+
+/// Whether a gap starting at the column's last value still reaches t
+static int recon_inhold(const struct obdreconstruct *r,
+		const struct obdreconstruct_column *c, double t) {
+	return c->have && (r->maxhold <= 0 || t - c->time <= r->maxhold);
+}
+
+/// Fill a column's waiting rows by holding its last value
+static void recon_stepwaiting(struct obdreconstruct *r, int col) {
+	struct obdreconstruct_column *c = &r->cols[col];
+	long long seq;
+
+	if(c->waitfrom < 0) return;
+	for(seq=c->waitfrom;seq<r->tail;seq++) {
+		struct obdreconstruct_row *row = recon_row(r, seq);
+		if(row->present[col] || !recon_inhold(r, c, row->time)) continue;
+		row->values[col] = c->value;
+		row->present[col] = 1;
+	}
+	c->waitfrom = -1;
+}
+
+/// Fill a column's waiting rows on the line up to a new value
+static void recon_linearwaiting(struct obdreconstruct *r, int col,
+		double t, double v) {
+	struct obdreconstruct_column *c = &r->cols[col];
+	long long seq;
+
+	if(c->waitfrom < 0) return;
+	if(!recon_inhold(r, c, t) || t <= c->time) {
+		// The new value is too far off to draw a line to
+		recon_stepwaiting(r, col);
+		return;
+	}
+	for(seq=c->waitfrom;seq<r->tail;seq++) {
+		struct obdreconstruct_row *row = recon_row(r, seq);
+		if(row->present[col]) continue;
+		row->values[col] = c->value + (v - c->value) * (row->time - c->time) / (t - c->time);
+		row->present[col] = 1;
+	}
+	c->waitfrom = -1;
+}
+
+/// Emit held-back rows that nothing is waiting on any more
+static void recon_drain(struct obdreconstruct *r) {
+	long long oldestwait = r->tail;
+	int i;
+
+	for(i=0;i<r->numcols;i++) {
+		if(r->cols[i].waitfrom >= 0 && r->cols[i].waitfrom < oldestwait) {
+			oldestwait = r->cols[i].waitfrom;
+		}
+	}
+	while(r->head < oldestwait) {
+		r->emit(recon_row(r, r->head), r->arg);
+		r->head++;
+	}
+}
+
+void obdreconstruct_add(struct obdreconstruct *r, const struct obdreconstruct_row *in) {
+	int i;
+
+	if(OBDRECONSTRUCT_NONE == r->mode) {
+		r->emit(in, r->arg);
+		return;
+	}
+
+	if(r->tail - r->head >= r->window) {
+		// Full. Whatever is still waiting gets held instead
+		for(i=0;i<r->numcols;i++) {
+			recon_stepwaiting(r, i);
+		}
+		recon_drain(r);
+	}
+
+	long long seq = r->tail++;
+	struct obdreconstruct_row *row = recon_row(r, seq);
+	row->time = in->time;
+	row->id = in->id;
+	memcpy(row->values, in->values, r->numcols * sizeof(double));
+	memcpy(row->present, in->present, r->numcols);
+
+	for(i=0;i<r->numcols;i++) {
+		struct obdreconstruct_column *c = &r->cols[i];
+		if(row->present[i]) {
+			if(OBDRECONSTRUCT_LINEAR == r->mode) {
+				recon_linearwaiting(r, i, row->time, row->values[i]);
+			}
+			c->have = 1;
+			c->value = row->values[i];
+			c->time = row->time;
+		} else if(!recon_inhold(r, c, row->time)) {
+			// Nothing to fill from. Stop earlier rows waiting too
+			recon_stepwaiting(r, i);
+		} else if(OBDRECONSTRUCT_STEP == r->mode) {
+			row->values[i] = c->value;
+			row->present[i] = 1;
+		} else if(c->waitfrom < 0) {
+			c->waitfrom = seq;
+		}
+	}
+
+	recon_drain(r);
+}
+
+void obdreconstruct_flush(struct obdreconstruct *r) {
+	int i;
+
+	for(i=0;i<r->numcols;i++) {
+		recon_stepwaiting(r, i);
+		r->cols[i].have = 0;
+	}
+	recon_drain(r);
+}
+
+void obdreconstruct_free(struct obdreconstruct *r) {
+	if(NULL == r) return;
+	free(r->rows);
+	free(r->values);
+	free(r->present);
+	free(r->cols);
+	free(r);
+}
+
+int obdreconstruct_parsemode(const char *name) {
+	if(NULL == name) return -1;
+	if(0 == strcmp(name, "none")) return OBDRECONSTRUCT_NONE;
+	if(0 == strcmp(name, "step")) return OBDRECONSTRUCT_STEP;
+	if(0 == strcmp(name, "linear")) return OBDRECONSTRUCT_LINEAR;
+	return -1;
+}
+
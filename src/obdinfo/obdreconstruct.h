@@ -0,0 +1,94 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Fill in values left out of deadband-compressed logs
+ When the logger compresses, a value only goes in the obd table when it
+ has moved past its deadband or hasn't been written for a while, and
+ NULL goes in otherwise. Feed rows through here in time order to get
+ them back with the gaps filled, either by holding the last value
+ written or by interpolating between the values either side.
+ */
+#ifndef __OBDRECONSTRUCT_H
+#define __OBDRECONSTRUCT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/// Default number of rows held back waiting for the next value, in linear mode
+#define OBDRECONSTRUCT_DEFAULTWINDOW 4096
+
+/// How to fill gaps
+enum obdreconstruct_mode {
+	OBDRECONSTRUCT_NONE, ///< Leave them empty
+	OBDRECONSTRUCT_STEP, ///< Hold the last value written
+	OBDRECONSTRUCT_LINEAR ///< Interpolate between the values either side
+};
+
+/// One row
+struct obdreconstruct_row {
+	double time; ///< Time of the row. Rows must arrive in order
+	long long id; ///< Carried through untouched for the caller
+	double *values; ///< One per column
+	unsigned char *present; ///< Nonzero where values holds something
+};
+
+/// Called for each row once its gaps are filled, in order
+/** Columns that couldn't be filled still have present cleared */
+typedef void (*obdreconstruct_emit)(const struct obdreconstruct_row *r, void *arg);
+
+/// Opaque reconstructor
+struct obdreconstruct;
+
+/// Create a reconstructor
+/** \param numcols number of value columns in each row
+ \param mode how to fill gaps
+ \param maxhold seconds. A gap longer than this is left empty; the
+     column probably wasn't answering. <= 0 for no limit
+ \param window rows held back at most in linear mode. <= 0 for the default
+ \param emit called for each row
+ \param arg passed to emit
+ \return the reconstructor, or NULL on error
+ */
+struct obdreconstruct *obdreconstruct_create(int numcols, enum obdreconstruct_mode mode,
+	double maxhold, int window, obdreconstruct_emit emit, void *arg);
+
+/// Add a row. It's copied
+void obdreconstruct_add(struct obdreconstruct *r, const struct obdreconstruct_row *row);
+
+/// Emit everything still held back
+/** Gaps with nothing after them are filled by holding the last value.
+    The last values are forgotten, so the next row starts afresh */
+void obdreconstruct_flush(struct obdreconstruct *r);
+
+/// Free a reconstructor. Doesn't flush
+void obdreconstruct_free(struct obdreconstruct *r);
+
+/// Parse a mode name
+/** \return the mode, or -1 if it isn't one */
+int obdreconstruct_parsemode(const char *name);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //__OBDRECONSTRUCT_H
+
@@ -26,66 +26,142 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdlib.h>
 
-struct obdservicecmd *obdGetCmdForColumn(const char *db_column) {
-	int i;
-	int numrows = sizeof(obdcmds_mode1)/sizeof(obdcmds_mode1[0]);
-	for(i=0;i<numrows;i++) {
-		struct obdservicecmd *o = &obdcmds_mode1[i];
-		if(NULL == o->db_column) {
-			continue;
-		}
+/// Lookup tables for one mode's commands
+struct obdserviceindex {
+	struct obdservicecmd *bypid[256]; ///< Direct index by PID
+	struct obdservicecmd **bycolumn; ///< Perfect hash of db_column
+	unsigned int columnmask; ///< Number of slots in bycolumn, minus one
+	unsigned int seed; ///< Hash seed that gives no collisions
+};
+
+/// One mode's list of commands
+struct obdservicemode {
+	unsigned int mode; ///< OBD service mode
+	struct obdservicecmd *cmds; ///< Its commands
+	int numcmds; ///< Number of entries in cmds
+	struct obdserviceindex *index; ///< Built the first time it's needed
+};
+
+/// All the modes we have tables for
+static struct obdservicemode obdservicemodes[] = {
+	{ 0x01, obdcmds_mode1, sizeof(obdcmds_mode1)/sizeof(obdcmds_mode1[0]), NULL },
+	{ 0x06, obdcmds_mode6, sizeof(obdcmds_mode6)/sizeof(obdcmds_mode6[0]), NULL },
+	{ 0x09, obdcmds_mode9, sizeof(obdcmds_mode9)/sizeof(obdcmds_mode9[0]), NULL },
+};
+
+/// Hash a column name [FNV-1a]
+static unsigned int obdcolumnhash(const char *s, unsigned int seed) {
+	unsigned int h = 2166136261U ^ seed;
+	while(*s) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619U;
+	}
+	return h;
+}
 
-		if(0 == strcmp(db_column,o->db_column)) {
-			return o;
+/// Try to place every column with this seed. Returns 0 if none collide
+static int obdfillcolumnhash(struct obdservicemode *m, struct obdserviceindex *idx) {
+	memset(idx->bycolumn, 0, (idx->columnmask+1) * sizeof(struct obdservicecmd *));
+	int i;
+	for(i=0; i<m->numcmds; i++) {
+		struct obdservicecmd *o = &m->cmds[i];
+		if(NULL == o->db_column) continue;
+
+		unsigned int slot = obdcolumnhash(o->db_column, idx->seed) & idx->columnmask;
+		if(NULL != idx->bycolumn[slot]) {
+			// Same name twice; first one wins, like the old linear search
+			if(0 == strcmp(idx->bycolumn[slot]->db_column, o->db_column)) continue;
+			return 1;
 		}
+		idx->bycolumn[slot] = o;
 	}
-	return NULL;
+	return 0;
 }
 
-/// O(log(n)) PID finder
-/** Profiling, it usually ends up slower than the linear one, which is
-because we're normally in the lower end of the PID scale and the linear
-one is much simpler */
-static struct obdservicecmd *obdGetCmdForPID_recursive(const unsigned int pid,
-	const int first_idx, const int last_idx) {
+/// Build the lookup tables for a mode
+static struct obdserviceindex *obdbuildindex(struct obdservicemode *m) {
+	struct obdserviceindex *idx = (struct obdserviceindex *)malloc(sizeof(struct obdserviceindex));
+	if(NULL == idx) return NULL;
 
-	// printf("%i %i\n", first_idx, last_idx);
-
-	// const unsigned int first_pid = obdcmds_mode1[first_idx].cmdid;
-	const unsigned int last_pid = obdcmds_mode1[last_idx].cmdid;
-
-	// if(pid == first_pid) return &obdcmds_mode1[first_idx];
-	if(pid == last_pid) return &obdcmds_mode1[last_idx];
-
-	if(first_idx >= last_idx) {
-		return NULL;
+	memset(idx->bypid, 0, sizeof(idx->bypid));
+	int i;
+	for(i=m->numcmds-1; i>=0; i--) {
+		// Going backwards, so the first of any duplicates wins
+		if(NULL == m->cmds[i].human_name) continue; // Sentinel
+		if(m->cmds[i].cmdid < 256) {
+			idx->bypid[m->cmds[i].cmdid] = &m->cmds[i];
+		}
 	}
 
-	int middle_idx = (last_idx + first_idx)/2;
-	const unsigned int middle_pid = obdcmds_mode1[middle_idx].cmdid;
-
-	if(pid == middle_pid) return &obdcmds_mode1[middle_idx];
+	// Start with four slots per column and grow until a seed works
+	unsigned int slots = 4;
+	while(slots < 4 * (unsigned int)m->numcmds) slots *= 2;
+
+	idx->bycolumn = NULL;
+	for(;;) {
+		struct obdservicecmd **newcols = (struct obdservicecmd **)realloc(idx->bycolumn,
+			slots * sizeof(struct obdservicecmd *));
+		if(NULL == newcols) {
+			free(idx->bycolumn);
+			free(idx);
+			return NULL;
+		}
+		idx->bycolumn = newcols;
+		idx->columnmask = slots-1;
 
-	if(middle_pid < pid) {
-		return obdGetCmdForPID_recursive(pid, middle_idx+1, last_idx-1);
-	} else {
-		return obdGetCmdForPID_recursive(pid, first_idx, middle_idx-1);
+		for(idx->seed=0; idx->seed<1000; idx->seed++) {
+			if(0 == obdfillcolumnhash(m, idx)) return idx;
+		}
+		slots *= 2;
 	}
 }
 
-struct obdservicecmd *obdGetCmdForPID(const unsigned int pid) {
+/// Get the lookup tables for a mode, building them if needed
+static struct obdserviceindex *obdgetindex(const unsigned int mode) {
 	int i;
-	int numrows = sizeof(obdcmds_mode1)/sizeof(obdcmds_mode1[0]);
-	for(i=0;i<numrows;i++) {
-		struct obdservicecmd *o = &obdcmds_mode1[i];
-
-		if(pid == o->cmdid) {
-			return o;
+	for(i=0; i<sizeof(obdservicemodes)/sizeof(obdservicemodes[0]); i++) {
+		struct obdservicemode *m = &obdservicemodes[i];
+		if(mode != m->mode) continue;
+
+		if(NULL != m->index) return m->index;
+
+		struct obdserviceindex *idx = obdbuildindex(m);
+		if(NULL == idx) return NULL;
+#ifdef __GNUC__
+		// Another thread might have got there first
+		if(!__sync_bool_compare_and_swap(&m->index, NULL, idx)) {
+			free(idx->bycolumn);
+			free(idx);
 		}
+#else
+		m->index = idx;
+#endif //__GNUC__
+		return m->index;
 	}
 	return NULL;
+}
+
+struct obdservicecmd *obdGetCmdForModeColumn(const unsigned int mode, const char *db_column) {
+	struct obdserviceindex *idx = obdgetindex(mode);
+	if(NULL == idx || NULL == db_column) return NULL;
+
+	struct obdservicecmd *o = idx->bycolumn[obdcolumnhash(db_column, idx->seed) & idx->columnmask];
+	if(NULL == o || 0 != strcmp(db_column, o->db_column)) return NULL;
+	return o;
+}
 
-	// return obdGetCmdForPID_recursive(pid, 0, sizeof(obdcmds_mode1)/sizeof(obdcmds_mode1[0]));
+struct obdservicecmd *obdGetCmdForModePID(const unsigned int mode, const unsigned int pid) {
+	struct obdserviceindex *idx = obdgetindex(mode);
+	if(NULL == idx || pid >= 256) return NULL;
+	return idx->bypid[pid];
+}
+
+struct obdservicecmd *obdGetCmdForColumn(const char *db_column) {
+	return obdGetCmdForModeColumn(0x01, db_column);
+}
+
+struct obdservicecmd *obdGetCmdForPID(const unsigned int pid) {
+	return obdGetCmdForModePID(0x01, pid);
 }
 
 int obderrconvert_r(char *buf, int n, unsigned int A, unsigned int B) {
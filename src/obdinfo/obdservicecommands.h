@@ -43,16 +43,22 @@ struct obdservicecmd {
 	OBDConvRevFunc convrev; ///< Function to convert a useful number back to OBD values
 };
 
-/// Return the obdservicecmd struct for the requested db_column name
-/** This function is O(n) including a strcmp. You probably don't
-want to call it very often. */
+/// Return the mode 01 obdservicecmd struct for the requested db_column name
+/** O(1); a hash and a single strcmp */
 struct obdservicecmd *obdGetCmdForColumn(const char *db_column);
 
-/// Return the obdservicecmd struct for the requested db_column name
-/** This function is O(n). You probably don't
-want to call it very often. */
+/// Return the mode 01 obdservicecmd struct for the requested PID
+/** O(1) */
 struct obdservicecmd *obdGetCmdForPID(const unsigned int pid);
 
+/// Return the obdservicecmd struct for the requested mode and db_column name
+/** \return the command, or NULL if there's no such column or mode */
+struct obdservicecmd *obdGetCmdForModeColumn(const unsigned int mode, const char *db_column);
+
+/// Return the obdservicecmd struct for the requested mode and PID
+/** \return the command, or NULL if there's no such PID or mode */
+struct obdservicecmd *obdGetCmdForModePID(const unsigned int mode, const unsigned int pid);
+
 
 // Fix "variable obdcmds defined but not used" warnings
 #ifdef __GNUC__
@@ -176,6 +182,122 @@ static struct obdservicecmd VARIABLE_IS_NOT_USED obdcmds_mode1[] = {
 	{ 0x00, 0, NULL,            NULL, 0, 0, NULL, NULL, NULL }
 };
 
+/// Mode 06 on-board monitor IDs
+/** Each MID reports one or more tests; see obdextmodes.h. Only the
+	ISO 15765 [CAN] flavour of mode 06 is understood */
+static struct obdservicecmd VARIABLE_IS_NOT_USED obdcmds_mode6[] = {
+	{ 0x00, 0, NULL,            "MIDs supported 01-20", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0x01, 0, "o2_b1s1",       "Oxygen Sensor Monitor Bank 1 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x02, 0, "o2_b1s2",       "Oxygen Sensor Monitor Bank 1 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x03, 0, "o2_b1s3",       "Oxygen Sensor Monitor Bank 1 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x04, 0, "o2_b1s4",       "Oxygen Sensor Monitor Bank 1 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x05, 0, "o2_b2s1",       "Oxygen Sensor Monitor Bank 2 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x06, 0, "o2_b2s2",       "Oxygen Sensor Monitor Bank 2 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x07, 0, "o2_b2s3",       "Oxygen Sensor Monitor Bank 2 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x08, 0, "o2_b2s4",       "Oxygen Sensor Monitor Bank 2 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x09, 0, "o2_b3s1",       "Oxygen Sensor Monitor Bank 3 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x0A, 0, "o2_b3s2",       "Oxygen Sensor Monitor Bank 3 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x0B, 0, "o2_b3s3",       "Oxygen Sensor Monitor Bank 3 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x0C, 0, "o2_b3s4",       "Oxygen Sensor Monitor Bank 3 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x0D, 0, "o2_b4s1",       "Oxygen Sensor Monitor Bank 4 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x0E, 0, "o2_b4s2",       "Oxygen Sensor Monitor Bank 4 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x0F, 0, "o2_b4s3",       "Oxygen Sensor Monitor Bank 4 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x10, 0, "o2_b4s4",       "Oxygen Sensor Monitor Bank 4 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x20, 0, NULL,            "MIDs supported 21-40", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0x21, 0, "cat_b1",        "Catalyst Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x22, 0, "cat_b2",        "Catalyst Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x23, 0, "cat_b3",        "Catalyst Monitor Bank 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x24, 0, "cat_b4",        "Catalyst Monitor Bank 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x31, 0, "egr_b1",        "EGR Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x32, 0, "egr_b2",        "EGR Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x33, 0, "egr_b3",        "EGR Monitor Bank 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x34, 0, "egr_b4",        "EGR Monitor Bank 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x35, 0, "vvt_b1",        "VVT Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x36, 0, "vvt_b2",        "VVT Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x37, 0, "vvt_b3",        "VVT Monitor Bank 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x38, 0, "vvt_b4",        "VVT Monitor Bank 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x39, 0, "evap_0150",     "EVAP Monitor (Cap Off / 0.150\")", 0, 0, "Test Results", NULL, NULL },
+	{ 0x3A, 0, "evap_0090",     "EVAP Monitor (0.090\")", 0, 0, "Test Results", NULL, NULL },
+	{ 0x3B, 0, "evap_0040",     "EVAP Monitor (0.040\")", 0, 0, "Test Results", NULL, NULL },
+	{ 0x3C, 0, "evap_0020",     "EVAP Monitor (0.020\")", 0, 0, "Test Results", NULL, NULL },
+	{ 0x3D, 0, "purgeflow",     "Purge Flow Monitor", 0, 0, "Test Results", NULL, NULL },
+	{ 0x40, 0, NULL,            "MIDs supported 41-60", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0x41, 0, "o2htr_b1s1",    "Oxygen Sensor Heater Monitor Bank 1 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x42, 0, "o2htr_b1s2",    "Oxygen Sensor Heater Monitor Bank 1 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x43, 0, "o2htr_b1s3",    "Oxygen Sensor Heater Monitor Bank 1 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x44, 0, "o2htr_b1s4",    "Oxygen Sensor Heater Monitor Bank 1 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x45, 0, "o2htr_b2s1",    "Oxygen Sensor Heater Monitor Bank 2 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x46, 0, "o2htr_b2s2",    "Oxygen Sensor Heater Monitor Bank 2 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x47, 0, "o2htr_b2s3",    "Oxygen Sensor Heater Monitor Bank 2 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x48, 0, "o2htr_b2s4",    "Oxygen Sensor Heater Monitor Bank 2 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x49, 0, "o2htr_b3s1",    "Oxygen Sensor Heater Monitor Bank 3 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x4A, 0, "o2htr_b3s2",    "Oxygen Sensor Heater Monitor Bank 3 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x4B, 0, "o2htr_b3s3",    "Oxygen Sensor Heater Monitor Bank 3 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x4C, 0, "o2htr_b3s4",    "Oxygen Sensor Heater Monitor Bank 3 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x4D, 0, "o2htr_b4s1",    "Oxygen Sensor Heater Monitor Bank 4 Sensor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x4E, 0, "o2htr_b4s2",    "Oxygen Sensor Heater Monitor Bank 4 Sensor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x4F, 0, "o2htr_b4s3",    "Oxygen Sensor Heater Monitor Bank 4 Sensor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x50, 0, "o2htr_b4s4",    "Oxygen Sensor Heater Monitor Bank 4 Sensor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x60, 0, NULL,            "MIDs supported 61-80", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0x61, 0, "hcat_b1",       "Heated Catalyst Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x62, 0, "hcat_b2",       "Heated Catalyst Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x63, 0, "hcat_b3",       "Heated Catalyst Monitor Bank 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x64, 0, "hcat_b4",       "Heated Catalyst Monitor Bank 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x71, 0, "air_1",         "Secondary Air Monitor 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x72, 0, "air_2",         "Secondary Air Monitor 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x73, 0, "air_3",         "Secondary Air Monitor 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x74, 0, "air_4",         "Secondary Air Monitor 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x80, 0, NULL,            "MIDs supported 81-A0", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0x81, 0, "fuel_b1",       "Fuel System Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x82, 0, "fuel_b2",       "Fuel System Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x83, 0, "fuel_b3",       "Fuel System Monitor Bank 3", 0, 0, "Test Results", NULL, NULL },
+	{ 0x84, 0, "fuel_b4",       "Fuel System Monitor Bank 4", 0, 0, "Test Results", NULL, NULL },
+	{ 0x85, 0, "boost_b1",      "Boost Pressure Control Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x86, 0, "boost_b2",      "Boost Pressure Control Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x90, 0, "noxabs_b1",     "NOx Adsorber Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x91, 0, "noxabs_b2",     "NOx Adsorber Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0x98, 0, "noxcat_b1",     "NOx Catalyst Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0x99, 0, "noxcat_b2",     "NOx Catalyst Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA0, 0, NULL,            "MIDs supported A1-C0", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0xA1, 0, "misfire",       "Misfire Monitor General Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA2, 0, "misfire_cyl1",  "Misfire Cylinder 1 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA3, 0, "misfire_cyl2",  "Misfire Cylinder 2 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA4, 0, "misfire_cyl3",  "Misfire Cylinder 3 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA5, 0, "misfire_cyl4",  "Misfire Cylinder 4 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA6, 0, "misfire_cyl5",  "Misfire Cylinder 5 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA7, 0, "misfire_cyl6",  "Misfire Cylinder 6 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA8, 0, "misfire_cyl7",  "Misfire Cylinder 7 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xA9, 0, "misfire_cyl8",  "Misfire Cylinder 8 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xAA, 0, "misfire_cyl9",  "Misfire Cylinder 9 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xAB, 0, "misfire_cyl10", "Misfire Cylinder 10 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xAC, 0, "misfire_cyl11", "Misfire Cylinder 11 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xAD, 0, "misfire_cyl12", "Misfire Cylinder 12 Data", 0, 0, "Test Results", NULL, NULL },
+	{ 0xB0, 0, "pmf_b1",        "PM Filter Monitor Bank 1", 0, 0, "Test Results", NULL, NULL },
+	{ 0xB1, 0, "pmf_b2",        "PM Filter Monitor Bank 2", 0, 0, "Test Results", NULL, NULL },
+	{ 0xC0, 0, NULL,            "MIDs supported C1-E0", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0xE0, 0, NULL,            "MIDs supported E1-FF", 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0x00, 0, NULL,            NULL, 0, 0, NULL, NULL, NULL }
+};
+
+/// Mode 09 vehicle information
+/** bytes_returned is the length of each item in the response; a
+	single response can carry several [eg, one calibration ID per module] */
+static struct obdservicecmd VARIABLE_IS_NOT_USED obdcmds_mode9[] = {
+	{ 0x00, 4, NULL,            "PIDs supported 01-20" , 0, 0, "Bit Encoded", NULL, NULL },
+	{ 0x01, 1, NULL,            "VIN message count" , 0, 0, "Count", NULL, NULL },
+	{ 0x02, 17, "vin",          "Vehicle Identification Number" , 0, 0, "ASCII", NULL, NULL },
+	{ 0x03, 1, NULL,            "Calibration ID message count" , 0, 0, "Count", NULL, NULL },
+	{ 0x04, 16, "calid",        "Calibration ID" , 0, 0, "ASCII", NULL, NULL },
+	{ 0x05, 1, NULL,            "CVN message count" , 0, 0, "Count", NULL, NULL },
+	{ 0x06, 4, "cvn",           "Calibration Verification Number" , 0, 0, "Hex", NULL, NULL },
+	{ 0x07, 1, NULL,            "In-use performance tracking message count" , 0, 0, "Count", NULL, NULL },
+	{ 0x08, 2, "iptrack",       "In-use performance tracking, spark ignition" , 0, 0, "Count", NULL, NULL },
+	{ 0x09, 1, NULL,            "ECU name message count" , 0, 0, "Count", NULL, NULL },
+	{ 0x0A, 20, "ecuname",      "ECU name" , 0, 0, "ASCII", NULL, NULL },
+	{ 0x0B, 2, "iptrack_ci",    "In-use performance tracking, compression ignition" , 0, 0, "Count", NULL, NULL },
+	{ 0x00, 0, NULL,            NULL, 0, 0, NULL, NULL, NULL }
+};
+
 // Convert these two bytes to an OBDII error DTC, re-entrant flavor
 /* \param buf pointer to buffer to fill
  \param number of bytes allocated in buf
@@ -0,0 +1,205 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Streaming track simplification
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "tracksimplify.h"
+
+/// Mean earth radius in meters
+#define TRACK_EARTHRADIUS 6371000.0
+
+struct tracksimplify {
+	double tolerance; ///< Most error allowed, meters
+	int window; ///< Size of pts
+	struct trackpoint *pts; ///< Points waiting to be simplified
+	int n; ///< Points in pts
+	char *keep; ///< Scratch: which points in pts survive
+	int *stack; ///< Scratch: spans still to be examined
+	tracksimplify_emit emit; ///< Output callback
+	void *arg; ///< Passed to emit
+	long in; ///< Points added
+	long out; ///< Points emitted
+};
+
+struct tracksimplify *tracksimplify_create(double tolerance, int window,
+		tracksimplify_emit emit, void *arg) {
+	struct tracksimplify *s = (struct tracksimplify *)calloc(1, sizeof(struct tracksimplify));
+	if(NULL == s) return NULL;
+
+	if(window <= 2) window = TRACKSIMPLIFY_DEFAULTWINDOW;
+
+	s->tolerance = tolerance;
+	s->window = window;
+	s->emit = emit;
+	s->arg = arg;
+	s->pts = (struct trackpoint *)malloc(window * sizeof(struct trackpoint));
+	s->keep = (char *)malloc(window);
+	s->stack = (int *)malloc(2 * window * sizeof(int));
+	if(NULL == s->pts || NULL == s->keep || NULL == s->stack) {
+		tracksimplify_free(s);
+		return NULL;
+	}
+	return s;
+}
+
+/// Project a point to meters on a plane tangent at lat0
+static void track_project(const struct trackpoint *p, double lon0, double lat0,
+		double coslat0, double *xyz) {
+	xyz[0] = (p->lon - lon0) * (M_PI/180.0) * TRACK_EARTHRADIUS * coslat0;
+	xyz[1] = (p->lat - lat0) * (M_PI/180.0) * TRACK_EARTHRADIUS;
+	xyz[2] = p->z;
+}
+
+/// Square of the distance from p to the segment a-b
+static double track_segdist2(const double *p, const double *a, const double *b) {
+	double ab[3], ap[3];
+	int i;
+	double len2 = 0, dot = 0;
+	for(i=0;i<3;i++) {
+		ab[i] = b[i] - a[i];
+		ap[i] = p[i] - a[i];
+		len2 += ab[i]*ab[i];
+		dot += ab[i]*ap[i];
+	}
+
+	double t = 0;
+	if(len2 > 0) {
+		t = dot / len2;
+		if(t < 0) t = 0;
+		if(t > 1) t = 1;
+	}
+
+	double d2 = 0;
+	for(i=0;i<3;i++) {
+		double d = ap[i] - t*ab[i];
+		d2 += d*d;
+	}
+	return d2;
+}
+
+/// Douglas-Peucker over everything buffered. Marks survivors in keep[]
+static void track_simplifywindow(struct tracksimplify *s) {
+	const struct trackpoint *pts = s->pts;
+	double lon0 = pts[0].lon;
+	double lat0 = pts[0].lat;
+	double coslat0 = cos(lat0 * M_PI/180.0);
+	double tol2 = s->tolerance * s->tolerance;
+	int sp = 0;
+
+	memset(s->keep, 0, s->n);
+	s->keep[0] = 1;
+	s->keep[s->n-1] = 1;
+
+	// Explicit stack; a pathological track would recurse window-deep
+	s->stack[sp++] = 0;
+	s->stack[sp++] = s->n-1;
+	while(sp > 0) {
+		int last = s->stack[--sp];
+		int first = s->stack[--sp];
+		if(last - first < 2) continue;
+
+		double a[3], b[3], p[3];
+		track_project(&pts[first], lon0, lat0, coslat0, a);
+		track_project(&pts[last], lon0, lat0, coslat0, b);
+
+		int i;
+		int worst = -1;
+		double worstd2 = tol2;
+		for(i=first+1;i<last;i++) {
+			track_project(&pts[i], lon0, lat0, coslat0, p);
+			double d2 = track_segdist2(p, a, b);
+			if(d2 > worstd2) {
+				worstd2 = d2;
+				worst = i;
+			}
+		}
+
+		if(worst >= 0) {
+			s->keep[worst] = 1;
+			s->stack[sp++] = first;
+			s->stack[sp++] = worst;
+			s->stack[sp++] = worst;
+			s->stack[sp++] = last;
+		}
+	}
+}
+
+/// Emit kept points. The last point is held back as the next window's first
+static void track_drain(struct tracksimplify *s, int final) {
+	int i;
+
+	if(0 == s->n) return;
+
+	track_simplifywindow(s);
+
+	for(i=0;i<s->n-1;i++) {
+		if(s->keep[i]) {
+			s->emit(&s->pts[i], s->arg);
+			s->out++;
+		}
+	}
+
+	if(final) {
+		s->emit(&s->pts[s->n-1], s->arg);
+		s->out++;
+		s->n = 0;
+	} else {
+		s->pts[0] = s->pts[s->n-1];
+		s->n = 1;
+	}
+}
+
+void tracksimplify_add(struct tracksimplify *s, const struct trackpoint *p) {
+	s->in++;
+
+	if(s->tolerance <= 0) {
+		s->emit(p, s->arg);
+		s->out++;
+		return;
+	}
+
+	s->pts[s->n++] = *p;
+	if(s->n == s->window) {
+		track_drain(s, 0);
+	}
+}
+
+void tracksimplify_flush(struct tracksimplify *s) {
+	track_drain(s, 1);
+}
+
+void tracksimplify_stats(const struct tracksimplify *s, long *in, long *out) {
+	if(NULL != in) *in = s->in;
+	if(NULL != out) *out = s->out;
+}
+
+void tracksimplify_free(struct tracksimplify *s) {
+	if(NULL == s) return;
+	free(s->pts);
+	free(s->keep);
+	free(s->stack);
+	free(s);
+}
+
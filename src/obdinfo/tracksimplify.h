@@ -0,0 +1,81 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Streaming track simplification
+ Ramer-Douglas-Peucker over a bounded window of points. Every input
+ point ends up within the tolerance of the output polyline, and memory
+ is bounded by the window no matter how long the track is.
+ */
+#ifndef __TRACKSIMPLIFY_H
+#define __TRACKSIMPLIFY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif //__cplusplus
+
+/// Default number of points simplified at once
+#define TRACKSIMPLIFY_DEFAULTWINDOW 4096
+
+/// One point on a track
+struct trackpoint {
+	double lon; ///< Longitude, degrees
+	double lat; ///< Latitude, degrees
+	double z; ///< Height in meters. Counts towards the error like lat/lon do
+	double val; ///< Carried through untouched for the caller
+	double time; ///< Carried through untouched for the caller
+	int flags; ///< Carried through untouched for the caller
+};
+
+/// Called for each point that survives simplification, in order
+typedef void (*tracksimplify_emit)(const struct trackpoint *p, void *arg);
+
+/// Opaque simplifier
+struct tracksimplify;
+
+/// Create a simplifier
+/** \param tolerance most error allowed, in meters. <= 0 passes every point straight through
+ \param window points simplified at once. <= 2 for the default
+ \param emit called for every point kept
+ \param arg passed to emit
+ \return the simplifier, or NULL on error
+ */
+struct tracksimplify *tracksimplify_create(double tolerance, int window,
+	tracksimplify_emit emit, void *arg);
+
+/// Add a point
+void tracksimplify_add(struct tracksimplify *s, const struct trackpoint *p);
+
+/// End the current track, emitting everything still buffered
+/** The simplifier can be reused for another track afterwards */
+void tracksimplify_flush(struct tracksimplify *s);
+
+/// Get counts of points in and out since creation
+void tracksimplify_stats(const struct tracksimplify *s, long *in, long *out);
+
+/// Free a simplifier. Doesn't flush
+void tracksimplify_free(struct tracksimplify *s);
+
+#ifdef __cplusplus
+}
+#endif //__cplusplus
+
+#endif //__TRACKSIMPLIFY_H
+
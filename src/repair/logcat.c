@@ -0,0 +1,527 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Catenate and split logfiles
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "sqlite3.h"
+
+#include "logcat.h"
+
+/// Most columns we'll handle in one table
+#define LOGCAT_MAXCOLS 256
+
+/// Tables a logger database can have, in the order they're copied
+static const char *logcat_tables[] = {
+	"trip", "ecu", "deadband", "obd", "gps", "ecuinfo", "obdtest", "obdext"
+};
+
+/// Index of the first table in logcat_tables with a trip column
+#define LOGCAT_FIRSTTRIPTABLE 3
+
+/// Tables whose ecu column holds an ecu.ecuid
+static const char *logcat_ecutables[] = {
+	"obd", "ecuinfo", "obdtest", "obdext"
+};
+
+/// How trip, ecu and deadband get created; they have keys the others don't
+static const char *logcat_create_sql[] = {
+	"CREATE TABLE IF NOT EXISTS main.trip (tripid INTEGER PRIMARY KEY, start REAL, end REAL DEFAULT -1)",
+	"CREATE TABLE IF NOT EXISTS main.ecu (ecuid INTEGER PRIMARY KEY, vin TEXT, ecu INTEGER, ecudesc TEXT)",
+	"CREATE TABLE IF NOT EXISTS main.deadband (column TEXT PRIMARY KEY, absolute REAL, relative REAL, heartbeat REAL)"
+};
+
+/// Columns of one table
+struct logcat_cols {
+	int n; ///< Number of columns
+	char name[LOGCAT_MAXCOLS][64]; ///< Column names
+	char type[LOGCAT_MAXCOLS][32]; ///< Declared types
+	char dflt[LOGCAT_MAXCOLS][32]; ///< Default values, or ""
+};
+
+static int logcat_exec(sqlite3 *db, const char *sql) {
+	char *errmsg = NULL;
+	if(SQLITE_OK != sqlite3_exec(db, sql, NULL, NULL, &errmsg)) {
+		fprintf(stderr, "sqlite error on statement %s: %s\n", sql, errmsg);
+		sqlite3_free(errmsg);
+		return 1;
+	}
+	return 0;
+}
+
+/// Read a table's columns
+/** \return number of columns. 0 if the table doesn't exist */
+static int logcat_getcols(sqlite3 *db, const char *schema, const char *table, struct logcat_cols *cols) {
+	sqlite3_stmt *stmt;
+	char pragma_sql[128];
+
+	cols->n = 0;
+	snprintf(pragma_sql, sizeof(pragma_sql), "PRAGMA %s.table_info(%s)", schema, table);
+	if(SQLITE_OK != sqlite3_prepare_v2(db, pragma_sql, -1, &stmt, NULL)) {
+		return 0;
+	}
+	while(SQLITE_ROW == sqlite3_step(stmt) && cols->n < LOGCAT_MAXCOLS) {
+		const char *name = (const char *)sqlite3_column_text(stmt, 1);
+		const char *type = (const char *)sqlite3_column_text(stmt, 2);
+		const char *dflt = (const char *)sqlite3_column_text(stmt, 4);
+		snprintf(cols->name[cols->n], sizeof(cols->name[0]), "%s", name?name:"");
+		snprintf(cols->type[cols->n], sizeof(cols->type[0]), "%s", type?type:"");
+		snprintf(cols->dflt[cols->n], sizeof(cols->dflt[0]), "%s", dflt?dflt:"");
+		cols->n++;
+	}
+	sqlite3_finalize(stmt);
+	return cols->n;
+}
+
+static int logcat_hascol(const struct logcat_cols *cols, const char *name) {
+	int i;
+	for(i=0;i<cols->n;i++) {
+		if(0 == strcmp(cols->name[i], name)) return 1;
+	}
+	return 0;
+}
+
+/// Make main.table able to hold everything in the source's table
+/** \return 0 if the source has nothing to copy, 1 if it does, -1 for error */
+static int logcat_reconcile(sqlite3 *db, const char *table, struct logcat_cols *srccols) {
+	struct logcat_cols dstcols;
+	char sql[8192];
+	int i;
+
+	if(0 == logcat_getcols(db, LOGCAT_SRC, table, srccols)) return 0;
+
+	if(0 == strcmp(table, "trip")) {
+		if(0 != logcat_exec(db, logcat_create_sql[0])) return -1;
+	} else if(0 == strcmp(table, "ecu")) {
+		if(0 != logcat_exec(db, logcat_create_sql[1])) return -1;
+		logcat_exec(db, "CREATE UNIQUE INDEX IF NOT EXISTS main.IDX_VINECU ON ecu (vin,ecu)");
+	} else if(0 == strcmp(table, "deadband")) {
+		if(0 != logcat_exec(db, logcat_create_sql[2])) return -1;
+	}
+
+	if(0 == logcat_getcols(db, "main", table, &dstcols)) {
+		snprintf(sql, sizeof(sql), "CREATE TABLE main.%s (", table);
+		for(i=0;i<srccols->n;i++) {
+			strncat(sql, srccols->name[i], sizeof(sql) - strlen(sql) - 1);
+			strncat(sql, " ", sizeof(sql) - strlen(sql) - 1);
+			strncat(sql, srccols->type[i], sizeof(sql) - strlen(sql) - 1);
+			if('\0' != srccols->dflt[i][0]) {
+				strncat(sql, " DEFAULT ", sizeof(sql) - strlen(sql) - 1);
+				strncat(sql, srccols->dflt[i], sizeof(sql) - strlen(sql) - 1);
+			}
+			strncat(sql, (i == srccols->n-1)?")":",", sizeof(sql) - strlen(sql) - 1);
+		}
+		return (0 == logcat_exec(db, sql))?1:-1;
+	}
+
+	// Different logs have different sets of obd columns
+	for(i=0;i<srccols->n;i++) {
+		if(!logcat_hascol(&dstcols, srccols->name[i])) {
+			snprintf(sql, sizeof(sql), "ALTER TABLE main.%s ADD %s %s%s%s", table,
+				srccols->name[i], srccols->type[i],
+				('\0' != srccols->dflt[i][0])?" DEFAULT ":"", srccols->dflt[i]);
+			if(0 != logcat_exec(db, sql)) return -1;
+			printf("Added column %s to %s\n", srccols->name[i], table);
+		}
+	}
+	return 1;
+}
+
+/// Copy rows from the source's table into main's
+/** \param tripoffset added to trip ids
+ \param mapecus set to translate ecu columns through temp.logcatecumap
+ \param where appended to the select, or NULL
+ \return 0 for success
+ */
+static int logcat_copy(sqlite3 *db, const char *table, const struct logcat_cols *cols,
+		sqlite3_int64 tripoffset, int mapecus, const char *where) {
+	char names[8192] = "";
+	char exprs[8192] = "";
+	int i;
+
+	for(i=0;i<cols->n;i++) {
+		const char *name = cols->name[i];
+		char expr[256];
+
+		if(tripoffset && (0 == strcmp(name, "trip") ||
+				(0 == strcmp(table, "trip") && 0 == strcmp(name, "tripid")))) {
+			snprintf(expr, sizeof(expr), "s.%s+%lli", name, (long long)tripoffset);
+		} else if(mapecus && 0 == strcmp(name, "ecu")) {
+			snprintf(expr, sizeof(expr), "COALESCE((SELECT new FROM temp.logcatecumap WHERE old=s.ecu),s.ecu)");
+		} else {
+			snprintf(expr, sizeof(expr), "s.%s", name);
+		}
+
+		// A column cut short would make broken SQL
+		if(strlen(names) + strlen(name) + 2 > sizeof(names) ||
+				strlen(exprs) + strlen(expr) + 2 > sizeof(exprs)) {
+			fprintf(stderr, "Too many columns to copy %s\n", table);
+			return 1;
+		}
+		strcat(names, name);
+		strcat(exprs, expr);
+		if(i < cols->n-1) {
+			strcat(names, ",");
+			strcat(exprs, ",");
+		}
+	}
+
+	// Copied in time order, so blackbox rows end up in rowid order too
+	const char *order = logcat_hascol(cols, "time")?" ORDER BY s.time":"";
+
+	size_t len = strlen(names) + strlen(exprs) + 2*strlen(table) +
+		(where?strlen(where):0) + strlen(order) + 64;
+	char *sql = (char *)malloc(len);
+	if(NULL == sql) {
+		fprintf(stderr, "Couldn't allocate memory to copy %s\n", table);
+		return 1;
+	}
+	snprintf(sql, len, "INSERT INTO main.%s (%s) SELECT %s FROM " LOGCAT_SRC ".%s s%s%s%s",
+		table, names, exprs, table, where?" WHERE ":"", where?where:"", order);
+	int rc = logcat_exec(db, sql);
+	free(sql);
+	return rc;
+}
+
+/// Return the single integer a query yields
+static sqlite3_int64 logcat_queryint(sqlite3 *db, const char *sql, sqlite3_int64 def) {
+	sqlite3_stmt *stmt;
+	sqlite3_int64 retvalue = def;
+	if(SQLITE_OK != sqlite3_prepare_v2(db, sql, -1, &stmt, NULL)) {
+		fprintf(stderr, "Error preparing SQL: %s\nSQL: \"%s\"\n", sqlite3_errmsg(db), sql);
+		return def;
+	}
+	if(SQLITE_ROW == sqlite3_step(stmt) && SQLITE_NULL != sqlite3_column_type(stmt, 0)) {
+		retvalue = sqlite3_column_int64(stmt, 0);
+	}
+	sqlite3_finalize(stmt);
+	return retvalue;
+}
+
+static int logcat_attach(sqlite3 *db, const char *filename) {
+	sqlite3_stmt *stmt;
+	int rc;
+	if(SQLITE_OK != sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS " LOGCAT_SRC, -1, &stmt, NULL)) {
+		fprintf(stderr, "Couldn't prepare attach: %s\n", sqlite3_errmsg(db));
+		return 1;
+	}
+	sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_STATIC);
+	rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "Couldn't attach %s: %s\n", filename, sqlite3_errmsg(db));
+		return 1;
+	}
+	return 0;
+}
+
+static void logcat_detach(sqlite3 *db) {
+	sqlite3_exec(db, "DETACH DATABASE " LOGCAT_SRC, NULL, NULL, NULL);
+}
+
+void logcat_createindices(sqlite3 *db) {
+	const char *create_idx_sql[] = {
+		"CREATE INDEX IF NOT EXISTS IDX_OBDTIME ON obd (time)",
+		"CREATE INDEX IF NOT EXISTS IDX_OBDTRIP ON obd (trip)",
+		"CREATE INDEX IF NOT EXISTS IDX_GPSTIME ON gps (time)",
+		"CREATE INDEX IF NOT EXISTS IDX_GPSTRIP ON gps (trip)",
+		"CREATE INDEX IF NOT EXISTS IDX_ECUINFOECU ON ecuinfo (ecu)",
+		"CREATE INDEX IF NOT EXISTS IDX_OBDTESTECU ON obdtest (ecu,mid)",
+		"CREATE INDEX IF NOT EXISTS IDX_OBDEXTTIME ON obdext (time)"
+	};
+	int i;
+	struct logcat_cols cols;
+
+	for(i=0; i<sizeof(create_idx_sql)/sizeof(create_idx_sql[0]); i++) {
+		// Only for tables this log actually has
+		const char *table = strstr(create_idx_sql[i], " ON ") + 4;
+		char tablename[32];
+		sscanf(table, "%31s", tablename);
+		if(0 == logcat_getcols(db, "main", tablename, &cols)) continue;
+
+		char *errmsg = NULL;
+		if(SQLITE_OK != sqlite3_exec(db, create_idx_sql[i], NULL, NULL, &errmsg)) {
+			fprintf(stderr, "Not Fatal: sqlite error creating index %s: %s\n", create_idx_sql[i], errmsg);
+			sqlite3_free(errmsg);
+		}
+	}
+}
+
+int logcat_append(sqlite3 *db, const char *srcfilename) {
+	struct logcat_cols cols;
+	int i, j;
+	int rc;
+	int mapecus = 0;
+
+	if(0 != logcat_attach(db, srcfilename)) return 1;
+
+	if(0 != logcat_exec(db, "BEGIN")) {
+		logcat_detach(db);
+		return 1;
+	}
+
+	// Move the source's trips clear of the ones already here
+	sqlite3_int64 tripoffset = 0;
+	if(0 < logcat_getcols(db, "main", "trip", &cols) && 0 < logcat_getcols(db, LOGCAT_SRC, "trip", &cols)) {
+		sqlite3_int64 maxdst = logcat_queryint(db, "SELECT max(tripid) FROM main.trip", 0);
+		sqlite3_int64 minsrc = logcat_queryint(db, "SELECT min(tripid) FROM " LOGCAT_SRC ".trip", 1);
+		if(maxdst >= minsrc) tripoffset = maxdst - minsrc + 1;
+	}
+
+	for(i=0; i<sizeof(logcat_tables)/sizeof(logcat_tables[0]); i++) {
+		const char *table = logcat_tables[i];
+
+		if(0 > (rc = logcat_reconcile(db, table, &cols))) goto fail;
+		if(0 == rc) continue;
+
+		if(0 == strcmp(table, "ecu")) {
+			// ecus are the same ecu if they have the same vin and number
+			if(0 != logcat_exec(db, "INSERT OR IGNORE INTO main.ecu (vin,ecu,ecudesc) "
+					"SELECT vin,ecu,ecudesc FROM " LOGCAT_SRC ".ecu") ||
+				0 != logcat_exec(db, "DROP TABLE IF EXISTS temp.logcatecumap") ||
+				0 != logcat_exec(db, "CREATE TEMP TABLE logcatecumap (old INTEGER PRIMARY KEY, new INTEGER)") ||
+				0 != logcat_exec(db, "INSERT OR REPLACE INTO temp.logcatecumap (old,new) "
+					"SELECT s.ecuid,m.ecuid FROM " LOGCAT_SRC ".ecu s, main.ecu m "
+					"WHERE m.vin IS s.vin AND m.ecu IS s.ecu")) {
+				goto fail;
+			}
+			mapecus = 1;
+			continue;
+		}
+
+		if(0 == strcmp(table, "deadband")) {
+			// Without this a compressed log reads as uncompressed. Where logs
+			//   disagree, keep the loosest, so a value is held long enough
+			if(0 != logcat_exec(db, "INSERT OR REPLACE INTO main.deadband (column,absolute,relative,heartbeat) "
+					"SELECT s.column, max(s.absolute,COALESCE(m.absolute,s.absolute)), "
+					"max(s.relative,COALESCE(m.relative,s.relative)), "
+					"max(s.heartbeat,COALESCE(m.heartbeat,s.heartbeat)) "
+					"FROM " LOGCAT_SRC ".deadband s LEFT JOIN main.deadband m ON m.column=s.column")) {
+				goto fail;
+			}
+			printf("Merged %i rows into deadband\n", sqlite3_changes(db));
+			continue;
+		}
+
+		int isecutable = 0;
+		for(j=0; j<sizeof(logcat_ecutables)/sizeof(logcat_ecutables[0]); j++) {
+			if(0 == strcmp(table, logcat_ecutables[j])) isecutable = 1;
+		}
+
+		if(0 != logcat_copy(db, table, &cols, tripoffset, mapecus && isecutable, NULL)) goto fail;
+		printf("Copied %i rows into %s\n", sqlite3_changes(db), table);
+	}
+
+	if(0 != logcat_exec(db, "COMMIT")) goto fail;
+
+	if(mapecus) logcat_exec(db, "DROP TABLE IF EXISTS temp.logcatecumap");
+	logcat_detach(db);
+	if(tripoffset) {
+		printf("Renumbered trips from %s by %lli\n", srcfilename, (long long)tripoffset);
+	}
+	return 0;
+
+fail:
+	logcat_exec(db, "ROLLBACK");
+	logcat_exec(db, "DROP TABLE IF EXISTS temp.logcatecumap");
+	logcat_detach(db);
+	return 1;
+}
+
+/// Open the next file a split is writing to
+/** \return 0 for success */
+static int logcat_splitopen(sqlite3 **db, const char *outbase, int filenum,
+		const char *srcfilename, struct logcat_cols *tablecols, int *hastable) {
+	char filename[1024];
+	struct stat st;
+	int i;
+
+	snprintf(filename, sizeof(filename), "%s-%i.db", outbase, filenum);
+	if(0 == stat(filename, &st)) {
+		fprintf(stderr, "%s already exists, not overwriting it\n", filename);
+		return 1;
+	}
+
+	if(SQLITE_OK != sqlite3_open(filename, db)) {
+		fprintf(stderr, "Can't open database %s: %s\n", filename, sqlite3_errmsg(*db));
+		sqlite3_close(*db);
+		*db = NULL;
+		return 1;
+	}
+
+	if(0 != logcat_attach(*db, srcfilename) || 0 != logcat_exec(*db, "BEGIN")) {
+		return 1;
+	}
+
+	for(i=0; i<sizeof(logcat_tables)/sizeof(logcat_tables[0]); i++) {
+		int rc = logcat_reconcile(*db, logcat_tables[i], &tablecols[i]);
+		if(rc < 0) return 1;
+		hastable[i] = rc;
+	}
+
+	// ecu ids are kept as they are, so every file gets the whole table
+	if(hastable[1] && 0 != logcat_copy(*db, "ecu", &tablecols[1], 0, 0, NULL)) return 1;
+
+	// Every file was written with the same deadbands
+	if(hastable[2] && 0 != logcat_copy(*db, "deadband", &tablecols[2], 0, 0, NULL)) return 1;
+
+	// Index up front so the file's size while filling it is the real size
+	logcat_createindices(*db);
+
+	printf("Writing %s\n", filename);
+	return 0;
+}
+
+/// Finish a file a split was writing to
+static int logcat_splitclose(sqlite3 *db) {
+	int rc = 0;
+	if(0 != logcat_exec(db, "COMMIT")) rc = 1;
+	logcat_detach(db);
+	sqlite3_close(db);
+	return rc;
+}
+
+int logcat_split(const char *srcfilename, const char *outbase, long long maxbytes,
+		const struct logcat_filter *filter) {
+	sqlite3 *src;
+	sqlite3 *db = NULL;
+	sqlite3_stmt *trip_stmt;
+	struct logcat_cols tablecols[sizeof(logcat_tables)/sizeof(logcat_tables[0])];
+	int hastable[sizeof(logcat_tables)/sizeof(logcat_tables[0])];
+	struct stat st;
+	int filenum = 0;
+	int tripsinfile = 0;
+	long long filebytes = 0; ///< Size of the file being written
+	int i;
+
+	if(SQLITE_OK != sqlite3_open_v2(srcfilename, &src, SQLITE_OPEN_READONLY, NULL)) {
+		fprintf(stderr, "Can't open database %s: %s\n", srcfilename, sqlite3_errmsg(src));
+		sqlite3_close(src);
+		return -1;
+	}
+
+	// Size each trip up by its share of rows
+	double bytesperrow = 0;
+	sqlite3_int64 totalrows = 0;
+	for(i=LOGCAT_FIRSTTRIPTABLE; i<sizeof(logcat_tables)/sizeof(logcat_tables[0]); i++) {
+		char count_sql[128];
+		struct logcat_cols cols;
+		if(0 == logcat_getcols(src, "main", logcat_tables[i], &cols)) continue;
+		if(!logcat_hascol(&cols, "trip")) {
+			fprintf(stderr, "trip column missing from %s table:\n  "
+				"Please run obdlogrepair on this database\n", logcat_tables[i]);
+			sqlite3_close(src);
+			return -1;
+		}
+		snprintf(count_sql, sizeof(count_sql), "SELECT count(*) FROM %s", logcat_tables[i]);
+		totalrows += logcat_queryint(src, count_sql, 0);
+	}
+	if(0 == stat(srcfilename, &st) && totalrows > 0) {
+		bytesperrow = (double)st.st_size / totalrows;
+	}
+
+	const char trip_sql[] = "SELECT tripid FROM trip "
+		"WHERE (?1<0 OR tripid=?1) AND (?2<0 OR end<0 OR end>?2) AND (?3<0 OR start<?3) "
+		"ORDER BY tripid";
+	if(SQLITE_OK != sqlite3_prepare_v2(src, trip_sql, -1, &trip_stmt, NULL)) {
+		fprintf(stderr, "Error preparing SQL: %s\nSQL: \"%s\"\n", sqlite3_errmsg(src), trip_sql);
+		sqlite3_close(src);
+		return -1;
+	}
+	sqlite3_bind_int(trip_stmt, 1, filter->trip);
+	sqlite3_bind_double(trip_stmt, 2, filter->start);
+	sqlite3_bind_double(trip_stmt, 3, filter->end);
+
+	int failed = 0;
+	while(!failed && SQLITE_ROW == sqlite3_step(trip_stmt)) {
+		int tripid = sqlite3_column_int(trip_stmt, 0);
+		char where[256];
+		char timewhere[128] = "";
+
+		if(filter->start >= 0) {
+			snprintf(timewhere + strlen(timewhere), sizeof(timewhere) - strlen(timewhere),
+				" AND s.time>%f", filter->start);
+		}
+		if(filter->end >= 0) {
+			snprintf(timewhere + strlen(timewhere), sizeof(timewhere) - strlen(timewhere),
+				" AND s.time<%f", filter->end);
+		}
+
+		// Work out how big this trip is before deciding where it goes
+		sqlite3_int64 triprows = 0;
+		for(i=LOGCAT_FIRSTTRIPTABLE; i<sizeof(logcat_tables)/sizeof(logcat_tables[0]); i++) {
+			char count_sql[512];
+			struct logcat_cols cols;
+			if(0 == logcat_getcols(src, "main", logcat_tables[i], &cols)) continue;
+			snprintf(count_sql, sizeof(count_sql), "SELECT count(*) FROM %s s WHERE s.trip=%i%s",
+				logcat_tables[i], tripid, timewhere);
+			triprows += logcat_queryint(src, count_sql, 0);
+		}
+		long long tripbytes = (long long)(triprows * bytesperrow);
+
+		if(NULL != db && tripsinfile > 0 && filebytes + tripbytes > maxbytes) {
+			if(0 != logcat_splitclose(db)) failed = 1;
+			db = NULL;
+		}
+		if(NULL == db) {
+			filenum++;
+			if(0 != logcat_splitopen(&db, outbase, filenum, srcfilename, tablecols, hastable)) {
+				failed = 1;
+				break;
+			}
+			tripsinfile = 0;
+			filebytes = 0;
+		}
+
+		for(i=0; i<sizeof(logcat_tables)/sizeof(logcat_tables[0]) && !failed; i++) {
+			if(!hastable[i] || 0 == strcmp(logcat_tables[i], "ecu") ||
+				0 == strcmp(logcat_tables[i], "deadband")) continue;
+			if(0 == strcmp(logcat_tables[i], "trip")) {
+				snprintf(where, sizeof(where), "s.tripid=%i", tripid);
+			} else {
+				snprintf(where, sizeof(where), "s.trip=%i%s", tripid, timewhere);
+			}
+			if(0 != logcat_copy(db, logcat_tables[i], &tablecols[i], 0, 0, where)) failed = 1;
+		}
+
+		tripsinfile++;
+		filebytes = logcat_queryint(db, "PRAGMA main.page_count", 0) *
+			logcat_queryint(db, "PRAGMA main.page_size", 0);
+	}
+	sqlite3_finalize(trip_stmt);
+	sqlite3_close(src);
+
+	if(NULL != db) {
+		if(failed) {
+			logcat_exec(db, "ROLLBACK");
+			sqlite3_close(db);
+		} else if(0 != logcat_splitclose(db)) {
+			failed = 1;
+		}
+	}
+
+	return failed?-1:filenum;
+}
+
@@ -0,0 +1,64 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Catenate and split logfiles
+ */
+#ifndef __LOGCAT_H
+#define __LOGCAT_H
+
+#include "sqlite3.h"
+
+/// Name the source database is attached under
+#define LOGCAT_SRC "logcatsrc"
+
+/// What to take from a log when splitting it
+struct logcat_filter {
+	int trip; ///< Only this trip. -1 for all
+	double start; ///< Only rows after this time. <0 for no limit
+	double end; ///< Only rows before this time. <0 for no limit
+};
+
+/// Append a whole log to db, renumbering its trips and ecus
+/** Trips are moved above the highest trip already in db. ecus are
+  matched on vin and ecu number, and added if they're new. Columns
+  the source has and db doesn't are added to db.
+ \param db the database to add to. Tables are created if needed
+ \param srcfilename the log to read
+ \return 0 for success
+ */
+int logcat_append(sqlite3 *db, const char *srcfilename);
+
+/// Split a log into files of bounded size, never splitting a trip
+/** \param srcfilename the log to split
+ \param outbase files are written to outbase-1.db, outbase-2.db, ...
+ \param maxbytes start a new file rather than grow past this. A
+    single trip bigger than this still gets a file to itself
+ \param filter which parts of the log to take
+ \return number of files written, or -1 for error
+ */
+int logcat_split(const char *srcfilename, const char *outbase, long long maxbytes,
+	const struct logcat_filter *filter);
+
+/// Create the standard indices on a merged or split log
+void logcat_createindices(sqlite3 *db);
+
+#endif // __LOGCAT_H
+
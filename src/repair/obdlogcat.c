@@ -0,0 +1,157 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Catenate and split obdgpslogger logfiles
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "obdconfig.h"
+#include "obdlogcat.h"
+#include "logcat.h"
+
+#include "sqlite3.h"
+
+int main(int argc, char **argv) {
+	/// Output file, or base name when splitting
+	char *outfilename = NULL;
+
+	/// Set to split rather than catenate
+	int split = 0;
+
+	/// Most megabytes per file when splitting
+	double maxmegabytes = DEFAULT_MAXMEGABYTES;
+
+	/// What to take when splitting
+	struct logcat_filter filter = { -1, -1, -1 };
+
+	/// getopt's current option
+	int optc;
+
+	/// might get set during option parsing. Exit when done parsing
+	int mustexit = 0;
+
+	int i;
+
+	while ((optc = getopt_long (argc, argv, logcatshortopts, logcatlongopts, NULL)) != -1) {
+		switch (optc) {
+			case 'h':
+				logcatprinthelp(argv[0]);
+				mustexit = 1;
+				break;
+			case 'v':
+				logcatprintversion();
+				mustexit = 1;
+				break;
+			case 'o':
+				if(NULL != outfilename) {
+					free(outfilename);
+				}
+				outfilename = strdup(optarg);
+				break;
+			case 'S':
+				split = 1;
+				break;
+			case 'm':
+				maxmegabytes = atof(optarg);
+				break;
+			case 't':
+				filter.trip = atoi(optarg);
+				break;
+			case 's':
+				filter.start = atof(optarg);
+				break;
+			case 'e':
+				filter.end = atof(optarg);
+				break;
+			default:
+				logcatprinthelp(argv[0]);
+				mustexit = 1;
+				break;
+		}
+	}
+	if(mustexit) exit(0);
+
+	if(optind >= argc) {
+		logcatprinthelp(argv[0]);
+		exit(1);
+	}
+
+	if(NULL == outfilename) {
+		outfilename = DEFAULT_OUTFILENAME;
+	}
+
+	if(split) {
+		if(optind != argc - 1) {
+			fprintf(stderr, "Can only split one file at a time\n");
+			exit(1);
+		}
+
+		// Files are outbase-1.db, outbase-2.db, ...
+		char outbase[1024];
+		snprintf(outbase, sizeof(outbase), "%s", outfilename);
+		size_t len = strlen(outbase);
+		if(len > 3 && 0 == strcmp(outbase + len - 3, ".db")) {
+			outbase[len - 3] = '\0';
+		}
+
+		int files = logcat_split(argv[optind], outbase,
+			(long long)(maxmegabytes * 1024 * 1024), &filter);
+		if(files < 0) exit(1);
+		printf("Wrote %i files\n", files);
+		return 0;
+	}
+
+	sqlite3 *db;
+	if(SQLITE_OK != sqlite3_open(outfilename, &db)) {
+		fprintf(stderr, "Can't open database %s: %s\n", outfilename, sqlite3_errmsg(db));
+		sqlite3_close(db);
+		exit(1);
+	}
+
+	int failed = 0;
+	for(i=optind; i<argc; i++) {
+		printf("Adding %s\n", argv[i]);
+		if(0 != logcat_append(db, argv[i])) {
+			fprintf(stderr, "Couldn't add %s; nothing from it was written\n", argv[i]);
+			failed = 1;
+		}
+	}
+
+	logcat_createindices(db);
+	sqlite3_close(db);
+
+	return failed;
+}
+
+void logcatprinthelp(const char *argv0) {
+	printf("Usage: %s [params] <logfile> [logfile...]\n"
+		"   [-o|--out=<" DEFAULT_OUTFILENAME ">]\n"
+		"   [-S|--split [-m|--maxsize=<%i>] [-t|--trip=<tripid>]\n"
+		"      [-s|--start=<time>] [-e|--end=<time>]]\n"
+		"   [-v|--version] [-h|--help]\n", argv0, DEFAULT_MAXMEGABYTES);
+}
+
+void logcatprintversion() {
+	printf("Version: %i.%i\n", OBDGPSLOGGER_MAJOR_VERSION, OBDGPSLOGGER_MINOR_VERSION);
+}
+
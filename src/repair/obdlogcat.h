@@ -0,0 +1,60 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief obdlogcat main headers
+ */
+#ifndef __OBDLOGCAT_H
+#define __OBDLOGCAT_H
+
+#include <getopt.h>
+
+/// Default out filename
+#define DEFAULT_OUTFILENAME "./obdlogger-cat.db"
+
+/// Default most megabytes in each file when splitting
+#define DEFAULT_MAXMEGABYTES 64
+
+/// getopt_long long options
+static const struct option logcatlongopts[] = {
+	{ "help", no_argument, NULL, 'h' }, ///< Print the help text
+	{ "version", no_argument, NULL, 'v' }, ///< Print the version text
+	{ "out", required_argument, NULL, 'o' }, ///< Output file, or base name when splitting
+	{ "split", no_argument, NULL, 'S' }, ///< Split instead of catenating
+	{ "maxsize", required_argument, NULL, 'm' }, ///< Most megabytes per file when splitting
+	{ "trip", required_argument, NULL, 't' }, ///< Only this trip when splitting
+	{ "start", required_argument, NULL, 's' }, ///< Only after this time when splitting
+	{ "end", required_argument, NULL, 'e' }, ///< Only before this time when splitting
+	{ NULL, 0, NULL, 0 } ///< End
+};
+
+/// getopt() short options
+static const char logcatshortopts[] = "hvo:Sm:t:s:e:";
+
+/// Print Help for --help
+/** \param argv0 your program's argv[0]
+ */
+void logcatprinthelp(const char *argv0);
+
+/// Print the version string
+void logcatprintversion();
+
+#endif //__OBDLOGCAT_H
+
@@ -23,6 +23,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include "sqlite3.h"
 
 #include "obdrepair.h"
+#include "repairtrips.h"
 
 /// Internal function for checkindices
 /** \return 0 if we changed nothing. -1 for error. >0 if we changed stuff. */
@@ -187,9 +188,12 @@ int checktripends(sqlite3 *db) {
 	int retvalue = 0;
 	char *errmsg = NULL;
 
+	// Each unfinished trip ends just before the next one starts. The
+	//   last trip has no next one, and stays open
 	const char update_sql[] = "UPDATE trip SET end="
-			"(SELECT (t2.start-0.01) AS newstart from trip t2 WHERE trip.tripid=t2.tripid+1) "
-		"WHERE trip.end = -1";
+			"(SELECT (t2.start-0.01) AS newstart from trip t2 WHERE t2.tripid=trip.tripid+1) "
+		"WHERE (trip.end = -1 OR trip.end IS NULL OR trip.end < trip.start) "
+			"AND EXISTS (SELECT 1 FROM trip t2 WHERE t2.tripid=trip.tripid+1)";
 
 	if(SQLITE_OK != sqlite3_exec(db, update_sql, NULL, NULL, &errmsg)) {
 		fprintf(stderr, "UPDATE db. SQL reported: %s\nSQL: \"%s\"\n", errmsg, update_sql);
@@ -202,13 +206,107 @@ int checktripends(sqlite3 *db) {
 	return retvalue;
 }
 
-int checktripids(sqlite3 *db, const char *table_name) {
-	int retvalue = 0;
+/// Argument for the tripids step
+struct tripids_arg {
+	const char *table_name; ///< Table to fill the trip column in
+};
+
+/// Result of the tripids analysis
+struct tripids_result {
+	sqlite3_int64 minrowid; ///< First row in the trip
+	sqlite3_int64 maxrowid; ///< Last row in the trip
+	double end; ///< End of the trip's time range
+};
+
+/// repairtrips_analyse for checktripids; find the rowids the trip covers
+static int tripids_analyse(sqlite3 *db, const struct repairtrip *trip, void *result, void *arg) {
+	struct tripids_arg *a = (struct tripids_arg *)arg;
+	struct tripids_result *r = (struct tripids_result *)result;
+	sqlite3_stmt *stmt;
+	int rc;
+	int retvalue = 1;
+
+	// A trip that never ended runs up to the start of the next one
+	r->end = trip->end;
+	if(trip->end < trip->start) {
+		const char end_sql[] = "SELECT min(start) FROM trip WHERE start>?";
+		r->end = 1e300;
+		if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, end_sql, -1, &stmt, NULL))) {
+			fprintf(stderr,"Error preparing SQL: (%i) %s\nSQL: \"%s\"\n", rc, sqlite3_errmsg(db), end_sql);
+			return -1;
+		}
+		sqlite3_bind_double(stmt, 1, trip->start);
+		if(SQLITE_ROW == sqlite3_step(stmt) && SQLITE_NULL != sqlite3_column_type(stmt, 0)) {
+			r->end = sqlite3_column_double(stmt, 0);
+		}
+		sqlite3_finalize(stmt);
+	}
+
+	char select_sql[256];
+	snprintf(select_sql, sizeof(select_sql), "SELECT min(rowid),max(rowid) FROM %s WHERE time>? AND time<?", a->table_name);
+
+	if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL))) {
+		fprintf(stderr,"Error preparing SQL: (%i) %s\nSQL: \"%s\"\n", rc, sqlite3_errmsg(db), select_sql);
+		return -1;
+	}
+	sqlite3_bind_double(stmt, 1, trip->start);
+	sqlite3_bind_double(stmt, 2, r->end);
+
+	rc = sqlite3_step(stmt);
+	if(SQLITE_ROW == rc) {
+		if(SQLITE_NULL != sqlite3_column_type(stmt, 0)) {
+			r->minrowid = sqlite3_column_int64(stmt, 0);
+			r->maxrowid = sqlite3_column_int64(stmt, 1);
+			retvalue = 0;
+		}
+	} else {
+		fprintf(stderr, "Trip %i range select: %s\n", trip->tripid, sqlite3_errmsg(db));
+		retvalue = -1;
+	}
+	sqlite3_finalize(stmt);
+	return retvalue;
+}
+
+/// repairtrips_apply for checktripids
+static int tripids_apply(sqlite3 *db, const struct repairtrip *trip, const void *result, void *arg) {
+	struct tripids_arg *a = (struct tripids_arg *)arg;
+	const struct tripids_result *r = (const struct tripids_result *)result;
+	sqlite3_stmt *stmt;
+	int rc;
+
+	// The rowid bounds mean this doesn't walk the whole table, even without IDX_*TIME
+	char update_sql[256];
+	snprintf(update_sql, sizeof(update_sql), "UPDATE %s SET trip=? "
+		"WHERE rowid>=? AND rowid<=? AND time>? AND time<?", a->table_name);
+
+	if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, update_sql, -1, &stmt, NULL))) {
+		fprintf(stderr, "UPDATE db. SQL reported: %s\nSQL: \"%s\"\n", sqlite3_errmsg(db), update_sql);
+		return -1;
+	}
+	sqlite3_bind_int(stmt, 1, trip->tripid);
+	sqlite3_bind_int64(stmt, 2, r->minrowid);
+	sqlite3_bind_int64(stmt, 3, r->maxrowid);
+	sqlite3_bind_double(stmt, 4, trip->start);
+	sqlite3_bind_double(stmt, 5, r->end);
+
+	rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "Updating trip %i: %s\n", trip->tripid, sqlite3_errmsg(db));
+		return -1;
+	}
+	return sqlite3_changes(db);
+}
+
+int checktripids(sqlite3 *db, const char *dbfilename, const char *table_name, int jobs) {
 	int rc = 0;
 	char *errmsg = NULL;
 
 	sqlite3_stmt *stmt;
 
+	char stepname[64];
+	snprintf(stepname, sizeof(stepname), "tripids:%s", table_name);
+
 	char pragma_sql[256];
 	snprintf(pragma_sql, sizeof(pragma_sql), "PRAGMA table_info(%s)", table_name);
 
@@ -226,61 +324,282 @@ int checktripids(sqlite3 *db, const char *table_name) {
 
 	sqlite3_finalize(stmt);
 
+	if(0 != repairprogress_init(db)) return -1;
+
 	if(0 == found_trip_col) {
 		char addcol_sql[256];
 		snprintf(addcol_sql, sizeof(addcol_sql), "ALTER TABLE %s ADD trip INTEGER", table_name);
 
+		// Add the column and mark the step started together, so an
+		//   interrupted run knows to come back and finish filling it
+		sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
 		if(SQLITE_OK != sqlite3_exec(db, addcol_sql, NULL, NULL, &errmsg)) {
 			fprintf(stderr, "ALTER db. SQL reported: %s\nSQL: \"%s\"\n", errmsg, addcol_sql);
 			sqlite3_free(errmsg);
+			sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
 			return -1;
-		} else {
-			printf("Ran ALTER sql: \"%s\"\n", addcol_sql);
 		}
+		if(0 != repairprogress_mark(db, stepname, -1) ||
+				SQLITE_OK != sqlite3_exec(db, "COMMIT", NULL, NULL, NULL)) {
+			sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+			return -1;
+		}
+		printf("Ran ALTER sql: \"%s\"\n", addcol_sql);
+	} else if(repairprogress_started(db, stepname)) {
+		printf("%s: resuming from last run\n", stepname);
+	} else {
+		return 0;
+	}
 
-		sqlite3_stmt *trip_stmt;
-		sqlite3_stmt *update_stmt;
-		
-		const char trip_sql[] = "SELECT tripid, start, end FROM trip";
-		char update_sql[1024];
-		snprintf(update_sql, sizeof(update_sql), "UPDATE %s SET trip=? WHERE time>? AND time<?", table_name);
+	struct tripids_arg arg = { table_name };
+	struct repairstep step = { stepname, sizeof(struct tripids_result),
+		tripids_analyse, tripids_apply, &arg };
 
-		if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, update_sql, -1, &update_stmt, NULL))) {
-			fprintf(stderr, "UPDATE db. SQL reported: %s\nSQL: \"%s\"\n", sqlite3_errmsg(db), update_sql);
-			return -1;
+	return repairtrips(db, dbfilename, jobs, &step);
+}
+
+/// Result of the gps clock analysis
+struct gpsclock_result {
+	double delta; ///< Seconds to add to the trip's times
+};
+
+/// repairtrips_analyse for checktimesagainstgps
+static int gpsclock_analyse(sqlite3 *db, const struct repairtrip *trip, void *result, void *arg) {
+	struct gpsclock_result *r = (struct gpsclock_result *)result;
+	sqlite3_stmt *stmt;
+	int rc;
+	int retvalue = 1;
+
+	// Median, so a few bad fixes can't drag the whole trip with them
+	const char getdelta_sql[] = "SELECT ROUND(gpstime-time) AS delta FROM gps "
+		"WHERE trip=?1 AND gpstime>=?2 ORDER BY delta LIMIT 1 OFFSET "
+		"(SELECT (COUNT(*)-1)/2 FROM gps WHERE trip=?1 AND gpstime>=?2)";
+
+	if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, getdelta_sql, -1, &stmt, NULL))) {
+		fprintf(stderr,"Error preparing SQL: (%i) %s\nSQL: \"%s\"\n", rc, sqlite3_errmsg(db), getdelta_sql);
+		return -1;
+	}
+	sqlite3_bind_int(stmt, 1, trip->tripid);
+	sqlite3_bind_double(stmt, 2, REPAIR_MINGPSTIME);
+
+	rc = sqlite3_step(stmt);
+	if(SQLITE_ROW == rc) {
+		if(SQLITE_NULL != sqlite3_column_type(stmt, 0)) {
+			r->delta = sqlite3_column_double(stmt, 0);
+			if(r->delta >= REPAIR_MINCLOCKSKEW || r->delta <= -REPAIR_MINCLOCKSKEW) {
+				retvalue = 0;
+			}
 		}
+	} else if(SQLITE_DONE != rc) {
+		fprintf(stderr, "Trip %i gps time select: %s\n", trip->tripid, sqlite3_errmsg(db));
+		retvalue = -1;
+	}
+	sqlite3_finalize(stmt);
+	return retvalue;
+}
 
-		if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, trip_sql, -1, &trip_stmt, NULL))) {
-			fprintf(stderr, "Trip select: %s\nSQL: \"%s\"\n", sqlite3_errmsg(db), trip_sql);
+/// repairtrips_apply for checktimesagainstgps
+static int gpsclock_apply(sqlite3 *db, const struct repairtrip *trip, const void *result, void *arg) {
+	const struct gpsclock_result *r = (const struct gpsclock_result *)result;
+	const char *applydelta_sql[] = {
+		"UPDATE gps SET time=time+?1 WHERE trip=?2",
+		"UPDATE obd SET time=time+?1 WHERE trip=?2",
+		"UPDATE trip SET start=start+?1,end=CASE WHEN end<0 THEN end ELSE end+?1 END WHERE tripid=?2",
+	};
+	int changed = 0;
+	int i;
+
+	printf("Trip %i: system clock was %.0f seconds off gps\n", trip->tripid, -r->delta);
+
+	for(i=0;i<sizeof(applydelta_sql)/sizeof(applydelta_sql[0]);i++) {
+		sqlite3_stmt *stmt;
+		int rc;
+		if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, applydelta_sql[i], -1, &stmt, NULL))) {
+			fprintf(stderr, "UPDATE db. SQL reported: %s\nSQL: \"%s\"\n", sqlite3_errmsg(db), applydelta_sql[i]);
 			return -1;
 		}
-
-		while(SQLITE_ROW == sqlite3_step(trip_stmt)) {
-			printf("Updating trip; trip %i: %f<time<%f\n",
-				sqlite3_column_int(trip_stmt, 0),
-				sqlite3_column_double(trip_stmt, 1),
-				sqlite3_column_double(trip_stmt, 2));
-
-			sqlite3_reset(update_stmt);
-			sqlite3_bind_int(update_stmt, 1, sqlite3_column_int(trip_stmt, 0));
-			sqlite3_bind_double(update_stmt, 2, sqlite3_column_double(trip_stmt, 1));
-			sqlite3_bind_double(update_stmt, 3, sqlite3_column_double(trip_stmt, 2));
-			sqlite3_step(update_stmt);
-		
-			retvalue++;
+		sqlite3_bind_double(stmt, 1, r->delta);
+		sqlite3_bind_int(stmt, 2, trip->tripid);
+		rc = sqlite3_step(stmt);
+		sqlite3_finalize(stmt);
+		if(SQLITE_DONE != rc) {
+			fprintf(stderr, "Shifting trip %i: %s\n", trip->tripid, sqlite3_errmsg(db));
+			return -1;
 		}
-
-		sqlite3_finalize(update_stmt);
-		sqlite3_finalize(trip_stmt);
+		changed += sqlite3_changes(db);
 	}
-	
-	return retvalue;
+	return changed;
 }
 
-int checktimesagainstgps(sqlite3 *db) {
-	char getdelta_sql[] = "SELECT trip,ROUND(AVG(gpstime-time)) FROM gps WHERE gpstime IS NOT NULL AND trip IS NOT NULL GROUP BY trip";
-	char applydelta_gps_sql[] = "UPDATE gps SET time=time+? WHERE trip=?";
-	char applydelta_obd_sql[] = "UPDATE obd SET time=time+? WHERE trip=?";
-	char applydelta_trip_sql[] = "UPDATE trip SET start=start+?,end=end+? WHERE trip=?";
+int checktimesagainstgps(sqlite3 *db, const char *dbfilename, int jobs) {
+	if(repairprogress_started(db, "gpsclock")) {
+		printf("gpsclock: resuming from last run\n");
+	}
+
+	struct repairstep step = { "gpsclock", sizeof(struct gpsclock_result),
+		gpsclock_analyse, gpsclock_apply, NULL };
+
+	return repairtrips(db, dbfilename, jobs, &step);
 }
 
+
+/// Columns in the obd table that aren't PID values
+static const char *rollup_bookkeeping[] = {
+	"time", "trip", "ecu", "monotime", "lat", "lon", "alt"
+};
+
+/// Summary columns for each obd column, as the logger creates them
+static const char *rollup_suffixes[] = { "_min", "_max", "_mean", "_count" };
+
+/// Summary for each suffix, in the same order
+static const char *rollup_aggregates[] = { "MIN", "MAX", "AVG", "COUNT" };
+
+/// Seconds per interval at each level, as the logger keeps them
+static const int rollup_resolutions[] = { 1, 60, 3600 };
+
+int checkrollups(sqlite3 *db, int rebuild) {
+	sqlite3_stmt *stmt;
+	int rc;
+	int i, j;
+	char *errmsg = NULL;
+
+	char obdcols[128][64];
+	int numobdcols = 0;
+
+	char pragma_sql[] = "PRAGMA table_info(obd)";
+	if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, pragma_sql, -1, &stmt, NULL))) {
+		fprintf(stderr,"Error preparing SQL: (%i) %s\nSQL: \"%s\"\n", rc, sqlite3_errmsg(db), pragma_sql);
+		return -1;
+	}
+	while(SQLITE_ROW == sqlite3_step(stmt) && numobdcols < sizeof(obdcols)/sizeof(obdcols[0])) {
+		const char *name = (const char *)sqlite3_column_text(stmt, 1);
+		int isbookkeeping = 0;
+		if(NULL == name) continue;
+		for(i=0;i<sizeof(rollup_bookkeeping)/sizeof(rollup_bookkeeping[0]);i++) {
+			if(0 == strcmp(name, rollup_bookkeeping[i])) isbookkeeping = 1;
+		}
+		if(isbookkeeping) continue;
+		snprintf(obdcols[numobdcols++], sizeof(obdcols[0]), "%s", name);
+	}
+	sqlite3_finalize(stmt);
+
+	if(0 == numobdcols) return 0;
+
+	if(SQLITE_OK != sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS obdrollup (resolution INTEGER, "
+			"trip INTEGER, start REAL, samples INTEGER, PRIMARY KEY (resolution,trip,start))",
+			NULL, NULL, &errmsg)) {
+		fprintf(stderr, "Couldn't create obdrollup. SQL reported: %s\n", errmsg);
+		sqlite3_free(errmsg);
+		return -1;
+	}
+
+	// The logger only adds summaries for the columns it logged
+	char rollupcols[4*128][80];
+	int numrollupcols = 0;
+	if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, "PRAGMA table_info(obdrollup)", -1, &stmt, NULL))) {
+		fprintf(stderr,"Error preparing SQL: (%i) %s\n", rc, sqlite3_errmsg(db));
+		return -1;
+	}
+	while(SQLITE_ROW == sqlite3_step(stmt) && numrollupcols < sizeof(rollupcols)/sizeof(rollupcols[0])) {
+		const char *name = (const char *)sqlite3_column_text(stmt, 1);
+		snprintf(rollupcols[numrollupcols++], sizeof(rollupcols[0]), "%s", name?name:"");
+	}
+	sqlite3_finalize(stmt);
+
+	for(i=0;i<numobdcols;i++) {
+		for(j=0;j<sizeof(rollup_suffixes)/sizeof(rollup_suffixes[0]);j++) {
+			char column[sizeof(obdcols[0]) + sizeof("_count")];
+			int k, found = 0;
+			if(snprintf(column, sizeof(column), "%s%s", obdcols[i], rollup_suffixes[j]) >= sizeof(column)) {
+				fprintf(stderr, "Column name too long: %s%s\n", obdcols[i], rollup_suffixes[j]);
+				return -1;
+			}
+			for(k=0;k<numrollupcols;k++) {
+				if(0 == strcmp(column, rollupcols[k])) found = 1;
+			}
+			if(found) continue;
+
+			char addcol_sql[256];
+			snprintf(addcol_sql, sizeof(addcol_sql), "ALTER TABLE obdrollup ADD %s %s",
+				column, (0 == strcmp(rollup_suffixes[j], "_count"))?"INTEGER":"REAL");
+			if(SQLITE_OK != sqlite3_exec(db, addcol_sql, NULL, NULL, &errmsg)) {
+				fprintf(stderr, "ALTER db. SQL reported: %s\nSQL: \"%s\"\n", errmsg, addcol_sql);
+				sqlite3_free(errmsg);
+				return -1;
+			}
+		}
+	}
+
+	if(SQLITE_OK != sqlite3_exec(db, "BEGIN", NULL, NULL, &errmsg)) {
+		fprintf(stderr, "Couldn't begin transaction. SQL reported: %s\n", errmsg);
+		sqlite3_free(errmsg);
+		return -1;
+	}
+
+	int before = sqlite3_total_changes(db);
+	if(rebuild && SQLITE_OK != sqlite3_exec(db, "DELETE FROM obdrollup", NULL, NULL, &errmsg)) {
+		fprintf(stderr, "Couldn't clear obdrollup. SQL reported: %s\n", errmsg);
+		sqlite3_free(errmsg);
+		sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+		return -1;
+	}
+	int cleared = sqlite3_total_changes(db) - before;
+
+	size_t len = 1024 + numobdcols * 4 * 2 * 80;
+	char *names = (char *)malloc(len);
+	char *exprs = (char *)malloc(len);
+	char *insert_sql = (char *)malloc(3*len);
+	if(NULL == names || NULL == exprs || NULL == insert_sql) {
+		free(names);
+		free(exprs);
+		free(insert_sql);
+		sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+		return -1;
+	}
+	names[0] = exprs[0] = '\0';
+	for(i=0;i<numobdcols;i++) {
+		for(j=0;j<sizeof(rollup_suffixes)/sizeof(rollup_suffixes[0]);j++) {
+			snprintf(names + strlen(names), len - strlen(names), ",%s%s",
+				obdcols[i], rollup_suffixes[j]);
+			snprintf(exprs + strlen(exprs), len - strlen(exprs), ",%s(%s)",
+				rollup_aggregates[j], obdcols[i]);
+		}
+	}
+
+	int retvalue = 0;
+	before = sqlite3_total_changes(db);
+	for(i=0;i<sizeof(rollup_resolutions)/sizeof(rollup_resolutions[0]);i++) {
+		int res = rollup_resolutions[i];
+		snprintf(insert_sql, 3*len, "INSERT OR REPLACE INTO obdrollup (resolution,trip,start,samples%s) "
+			"SELECT %i,trip,CAST(time/%i AS INTEGER)*%i AS rollupstart,COUNT(*)%s FROM obd "
+			"WHERE trip NOT IN (SELECT DISTINCT trip FROM obdrollup WHERE resolution=%i AND trip IS NOT NULL) "
+			"GROUP BY trip,rollupstart",
+			names, res, res, res, exprs, res);
+
+		if(SQLITE_OK != sqlite3_exec(db, insert_sql, NULL, NULL, &errmsg)) {
+			fprintf(stderr, "Couldn't fill obdrollup. SQL reported: %s\nSQL: \"%s\"\n", errmsg, insert_sql);
+			sqlite3_free(errmsg);
+			retvalue = -1;
+			break;
+		}
+	}
+	free(names);
+	free(exprs);
+	free(insert_sql);
+
+	if(-1 == retvalue) {
+		sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+		return -1;
+	}
+	if(SQLITE_OK != sqlite3_exec(db, "COMMIT", NULL, NULL, &errmsg)) {
+		fprintf(stderr, "Couldn't commit. SQL reported: %s\n", errmsg);
+		sqlite3_free(errmsg);
+		return -1;
+	}
+
+	int added = sqlite3_total_changes(db) - before;
+	if(0 < added) {
+		printf("Worked out %i rollup intervals%s\n", added, cleared?", replacing the old ones":"");
+	}
+	return added + cleared;
+}
@@ -34,8 +34,34 @@ int checkobdecu(sqlite3 *db);
 int checktripends(sqlite3 *db);
 
 /// Fix trip ids
-/** \return 0 if we changed nothing. -1 for error. >0 if we changed stuff. */
-int checktripids(sqlite3 *db, const char *table_name);
+/** Works one trip at a time, and resumes if interrupted
+ \param dbfilename file db is open on, for the analysis threads
+ \param jobs number of analysis threads
+ \return 0 if we changed nothing. -1 for error. >0 if we changed stuff. */
+int checktripids(sqlite3 *db, const char *dbfilename, const char *table_name, int jobs);
+
+/// Smallest clock error, in seconds, checktimesagainstgps will fix
+#define REPAIR_MINCLOCKSKEW 5
+
+/// gps times before this, 2000-01-01, are a receiver that didn't know the date
+#define REPAIR_MINGPSTIME 946684800.0
+
+/// Shift each trip's times by how far the system clock was off gps time
+/** Uses the median difference over fixes with a plausible gpstime.
+    Works one trip at a time, and resumes if interrupted
+ \param dbfilename file db is open on, for the analysis threads
+ \param jobs number of analysis threads
+ \return 0 if we changed nothing. -1 for error. >0 if we changed stuff. */
+int checktimesagainstgps(sqlite3 *db, const char *dbfilename, int jobs);
+
+/// Fill in the obdrollup table for trips that don't have rollups
+/** Logs from before rollups, or put together with obdlogcat, get theirs
+     from the obd table. Rollups from logs written with compression only
+     see the values that were written
+ \param rebuild set to throw away all rollups and work them all out again,
+     eg after trips or times have changed
+ \return 0 if we changed nothing. -1 for error. >0 if we changed stuff. */
+int checkrollups(sqlite3 *db, int rebuild);
 
 /// Run ANALYZE against the db
 int analyze(sqlite3 *db);
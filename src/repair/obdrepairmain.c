@@ -19,47 +19,108 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
 
 #include "obdrepair.h"
+#include "repairtrips.h"
 
 #include "sqlite3.h"
 
+/// getopt_long long options
+static const struct option repairlongopts[] = {
+	{ "help", no_argument, NULL, 'h' }, ///< Print the help text
+	{ "gps-clock", no_argument, NULL, 'g' }, ///< Shift trips to match gps time
+	{ "jobs", required_argument, NULL, 'j' }, ///< Analysis threads
+	{ NULL, 0, NULL, 0 } ///< End
+};
+
+/// getopt() short options
+static const char repairshortopts[] = "hgj:";
+
 void printhelp(const char *argv0);
 
-int main(int argc, const char **argv) {
-	if(argc < 2 || 0 == strcmp("--help", argv[1]) ||
-				0 == strcmp("-h", argv[1])) {
+int main(int argc, char **argv) {
+	int optc;
+	int mustexit = 0;
+
+	/// Threads to analyse trips with
+	int jobs = 0;
+
+	/// Shift trip times to match gps time
+	int gpsclock = 0;
+
+	while ((optc = getopt_long (argc, argv, repairshortopts, repairlongopts, NULL)) != -1) {
+		switch (optc) {
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+			case 'g':
+				gpsclock = 1;
+				break;
+			case 'h':
+			default:
+				printhelp(argv[0]);
+				mustexit = 1;
+				break;
+		}
+	}
+	if(mustexit) exit(0);
+
+	if(optind >= argc) {
 		printhelp(argv[0]);
 		exit(0);
 	}
 
+	const char *dbfilename = argv[optind];
+
+	if(jobs <= 0) {
+		long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = (ncpus > 0) ? (int)ncpus : 1;
+	}
+
 	sqlite3 *db;
 	int rc;
 
-	if(SQLITE_OK != (rc = sqlite3_open_v2(argv[1], &db, SQLITE_OPEN_READWRITE, NULL))) {
-		fprintf(stderr, "Can't open database %s: %s\n", argv[1], sqlite3_errmsg(db));
+	if(SQLITE_OK != (rc = sqlite3_open_v2(dbfilename, &db, SQLITE_OPEN_READWRITE, NULL))) {
+		fprintf(stderr, "Can't open database %s: %s\n", dbfilename, sqlite3_errmsg(db));
 		sqlite3_close(db);
 		exit(1);
 	}
+	sqlite3_busy_timeout(db, REPAIR_BUSYTIMEOUT);
 
 	printf("About to check trip ends\n");
 	checktripends(db);
 	printf("Done checking trip ends\n");
 
+	// Rollups worked out before trips or times changed are wrong now
+	int rebuildrollups = 0;
+
 	printf("About to check trip ids on obd table\n");
-	checktripids(db, "obd");
+	if(0 < checktripids(db, dbfilename, "obd", jobs)) rebuildrollups = 1;
 	printf("About to check trip ids on gps table\n");
-	checktripids(db, "gps");
+	checktripids(db, dbfilename, "gps", jobs);
 	printf("Done checking tripids\n");
 
 	printf("About to check indices\n");
 	checkindices(db);
 	printf("Done checking indices\n");
 
+	// Half done last time means it was asked for last time
+	if(gpsclock || repairprogress_started(db, "gpsclock")) {
+		printf("About to check times against gps\n");
+		if(0 < checktimesagainstgps(db, dbfilename, jobs)) rebuildrollups = 1;
+		printf("Done checking times against gps\n");
+	}
+
 	printf("About to check ecu column on obd table\n");
 	checkobdecu(db);
 	printf("Done checking ecu column on obd table\n");
 
+	printf("About to check rollups\n");
+	checkrollups(db, rebuildrollups);
+	printf("Done checking rollups\n");
+
 	printf("About to run analyze\n");
 	analyze(db);
 	printf("Done running analyze\n");
@@ -68,6 +129,8 @@ int main(int argc, const char **argv) {
 	checkintegrity(db);
 	printf("Done running integrity check\n");
 
+	repairprogress_finish(db);
+
 	sqlite3_close(db);
 
 	printf("Done\n");
@@ -75,7 +138,8 @@ int main(int argc, const char **argv) {
 }
 
 void printhelp(const char *argv0) {
-	printf("Usage: %s <database>\n"
-			"Take a few best guesses at repairing an obdgpslogger log\n", argv0);
+	printf("Usage: %s [-j|--jobs <threads>] [-g|--gps-clock] <database>\n"
+			"Take a few best guesses at repairing an obdgpslogger log\n"
+			"Interrupted repairs pick up where they left off next run\n", argv0);
 }
 
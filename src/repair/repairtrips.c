@@ -0,0 +1,362 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Run a repair step trip by trip, resumably
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_REPAIRTHREADS
+#include <pthread.h>
+#endif //HAVE_REPAIRTHREADS
+
+#include "sqlite3.h"
+
+#include "repairtrips.h"
+
+/// Everything shared between the caller and the analysis threads
+struct repairtrips_work {
+	const struct repairstep *step; ///< What we're running
+	const char *dbfilename; ///< For the read-only connections
+	struct repairtrip *trips; ///< Trips to do
+	int ntrips; ///< Length of trips
+	char *results; ///< ntrips results, step->resultsize each
+	int *status; ///< Return value of analyse for each trip
+	int *done; ///< Indices of analysed trips, in the order they finished
+	int ndone; ///< Length of done
+	int next; ///< Next trip to hand out
+	int workersleft; ///< Threads still running
+#ifdef HAVE_REPAIRTHREADS
+	pthread_mutex_t lock; ///< Protects ndone, next, workersleft
+	pthread_cond_t cond; ///< Signalled when a trip is analysed or a worker exits
+#endif //HAVE_REPAIRTHREADS
+};
+
+static void repairtrips_lock(struct repairtrips_work *w) {
+#ifdef HAVE_REPAIRTHREADS
+	pthread_mutex_lock(&w->lock);
+#endif //HAVE_REPAIRTHREADS
+}
+
+static void repairtrips_unlock(struct repairtrips_work *w) {
+#ifdef HAVE_REPAIRTHREADS
+	pthread_mutex_unlock(&w->lock);
+#endif //HAVE_REPAIRTHREADS
+}
+
+/// Analyse trip i and queue it for the writer
+static void repairtrips_analyseone(struct repairtrips_work *w, sqlite3 *db, int i) {
+	w->status[i] = w->step->analyse(db, &w->trips[i],
+		w->results + i * w->step->resultsize, w->step->arg);
+
+	repairtrips_lock(w);
+	w->done[w->ndone++] = i;
+#ifdef HAVE_REPAIRTHREADS
+	pthread_cond_signal(&w->cond);
+#endif //HAVE_REPAIRTHREADS
+	repairtrips_unlock(w);
+}
+
+/// Hand out the next trip. -1 if there are none left
+static int repairtrips_nexttrip(struct repairtrips_work *w) {
+	int i;
+	repairtrips_lock(w);
+	i = w->next < w->ntrips ? w->next++ : -1;
+	repairtrips_unlock(w);
+	return i;
+}
+
+#ifdef HAVE_REPAIRTHREADS
+static void *repairtrips_worker(void *arg) {
+	struct repairtrips_work *w = (struct repairtrips_work *)arg;
+	sqlite3 *db;
+	int i;
+
+	if(SQLITE_OK != sqlite3_open_v2(w->dbfilename, &db, SQLITE_OPEN_READONLY, NULL)) {
+		fprintf(stderr, "Not Fatal: Couldn't open %s for analysis: %s\n", w->dbfilename, sqlite3_errmsg(db));
+	} else {
+		sqlite3_busy_timeout(db, REPAIR_BUSYTIMEOUT);
+		while(-1 != (i = repairtrips_nexttrip(w))) {
+			repairtrips_analyseone(w, db, i);
+		}
+	}
+	sqlite3_close(db);
+
+	pthread_mutex_lock(&w->lock);
+	w->workersleft--;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+#endif //HAVE_REPAIRTHREADS
+
+int repairprogress_init(sqlite3 *db) {
+	char *errmsg = NULL;
+	const char create_sql[] = "CREATE TABLE IF NOT EXISTS " REPAIRPROGRESS_TABLE
+		" (step TEXT, trip INTEGER, PRIMARY KEY (step, trip))";
+
+	if(SQLITE_OK != sqlite3_exec(db, create_sql, NULL, NULL, &errmsg)) {
+		fprintf(stderr, "Couldn't create progress table. SQL reported: %s\nSQL: \"%s\"\n", errmsg, create_sql);
+		sqlite3_free(errmsg);
+		return -1;
+	}
+	return 0;
+}
+
+int repairprogress_mark(sqlite3 *db, const char *step, int trip) {
+	sqlite3_stmt *stmt;
+	int rc;
+	const char insert_sql[] = "INSERT OR REPLACE INTO " REPAIRPROGRESS_TABLE " (step, trip) VALUES (?,?)";
+
+	if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, insert_sql, -1, &stmt, NULL))) {
+		fprintf(stderr,"Error preparing SQL: (%i) %s\nSQL: \"%s\"\n", rc, sqlite3_errmsg(db), insert_sql);
+		return -1;
+	}
+	sqlite3_bind_text(stmt, 1, step, -1, SQLITE_STATIC);
+	sqlite3_bind_int(stmt, 2, trip);
+	rc = sqlite3_step(stmt);
+	sqlite3_finalize(stmt);
+
+	if(SQLITE_DONE != rc) {
+		fprintf(stderr, "Couldn't record progress: %s\n", sqlite3_errmsg(db));
+		return -1;
+	}
+	return 0;
+}
+
+int repairprogress_started(sqlite3 *db, const char *step) {
+	sqlite3_stmt *stmt;
+	int started = 0;
+	const char select_sql[] = "SELECT 1 FROM " REPAIRPROGRESS_TABLE " WHERE step=? LIMIT 1";
+
+	if(SQLITE_OK != sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL)) {
+		return 0;
+	}
+	sqlite3_bind_text(stmt, 1, step, -1, SQLITE_STATIC);
+	if(SQLITE_ROW == sqlite3_step(stmt)) started = 1;
+	sqlite3_finalize(stmt);
+	return started;
+}
+
+void repairprogress_finish(sqlite3 *db) {
+	sqlite3_stmt *stmt;
+	int empty = 1;
+	const char select_sql[] = "SELECT 1 FROM " REPAIRPROGRESS_TABLE " LIMIT 1";
+
+	if(SQLITE_OK != sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL)) {
+		return;
+	}
+	if(SQLITE_ROW == sqlite3_step(stmt)) empty = 0;
+	sqlite3_finalize(stmt);
+
+	if(empty) {
+		sqlite3_exec(db, "DROP TABLE " REPAIRPROGRESS_TABLE, NULL, NULL, NULL);
+	} else {
+		printf("Some repairs didn't finish. Run again to resume them\n");
+	}
+}
+
+/// Load every trip the step hasn't finished
+/** \return number of trips, or -1 for error */
+static int repairtrips_load(sqlite3 *db, const char *step, struct repairtrip **trips) {
+	sqlite3_stmt *stmt;
+	int rc;
+	int n = 0, cap = 0;
+	const char select_sql[] = "SELECT tripid,start,end FROM trip "
+		"WHERE tripid NOT IN (SELECT trip FROM " REPAIRPROGRESS_TABLE " WHERE step=?) "
+		"ORDER BY tripid";
+
+	*trips = NULL;
+	if(SQLITE_OK != (rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, NULL))) {
+		fprintf(stderr,"Error preparing SQL: (%i) %s\nSQL: \"%s\"\n", rc, sqlite3_errmsg(db), select_sql);
+		return -1;
+	}
+	sqlite3_bind_text(stmt, 1, step, -1, SQLITE_STATIC);
+
+	while(SQLITE_ROW == sqlite3_step(stmt)) {
+		if(n >= cap) {
+			cap = cap?cap*2:64;
+			struct repairtrip *t = (struct repairtrip *)realloc(*trips, cap * sizeof(struct repairtrip));
+			if(NULL == t) {
+				sqlite3_finalize(stmt);
+				return -1;
+			}
+			*trips = t;
+		}
+		(*trips)[n].tripid = sqlite3_column_int(stmt, 0);
+		(*trips)[n].start = sqlite3_column_double(stmt, 1);
+		(*trips)[n].end = sqlite3_column_double(stmt, 2);
+		n++;
+	}
+	sqlite3_finalize(stmt);
+	return n;
+}
+
+/// Apply one analysed trip and checkpoint it, in one transaction
+/** \return -1 for error, else rows changed */
+static int repairtrips_applyone(sqlite3 *db, struct repairtrips_work *w, int i) {
+	int changed = 0;
+	const struct repairstep *step = w->step;
+
+	if(w->status[i] < 0) {
+		fprintf(stderr, "%s: couldn't analyse trip %i\n", step->name, w->trips[i].tripid);
+		return -1;
+	}
+
+	if(SQLITE_OK != sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL)) {
+		fprintf(stderr, "%s: couldn't start transaction: %s\n", step->name, sqlite3_errmsg(db));
+		return -1;
+	}
+
+	if(0 == w->status[i]) {
+		changed = step->apply(db, &w->trips[i], w->results + i * step->resultsize, step->arg);
+	}
+
+	if(changed < 0 || 0 != repairprogress_mark(db, step->name, w->trips[i].tripid)) {
+		sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+		return -1;
+	}
+
+	if(SQLITE_OK != sqlite3_exec(db, "COMMIT", NULL, NULL, NULL)) {
+		fprintf(stderr, "%s: couldn't commit trip %i: %s\n", step->name, w->trips[i].tripid, sqlite3_errmsg(db));
+		sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+		return -1;
+	}
+	return changed;
+}
+
+int repairtrips(sqlite3 *db, const char *dbfilename, int jobs, const struct repairstep *step) {
+	struct repairtrips_work w;
+	int applied = 0;
+	int changed = 0;
+	int failed = 0;
+	int lastpercent = -1;
+	int i;
+#ifdef HAVE_REPAIRTHREADS
+	pthread_t *threads = NULL;
+	int nthreads = 0;
+#endif //HAVE_REPAIRTHREADS
+
+	memset(&w, 0, sizeof(w));
+	w.step = step;
+	w.dbfilename = dbfilename;
+
+	sqlite3_busy_timeout(db, REPAIR_BUSYTIMEOUT);
+
+	if(0 != repairprogress_init(db)) return -1;
+
+	if(0 > (w.ntrips = repairtrips_load(db, step->name, &w.trips))) {
+		return -1;
+	}
+
+	w.results = (char *)calloc(w.ntrips + 1, step->resultsize);
+	w.status = (int *)calloc(w.ntrips + 1, sizeof(int));
+	w.done = (int *)calloc(w.ntrips + 1, sizeof(int));
+	if(NULL == w.results || NULL == w.status || NULL == w.done) {
+		fprintf(stderr, "%s: couldn't allocate memory for %i trips\n", step->name, w.ntrips);
+		failed = 1;
+		goto done;
+	}
+
+#ifdef HAVE_REPAIRTHREADS
+	pthread_mutex_init(&w.lock, NULL);
+	pthread_cond_init(&w.cond, NULL);
+
+	if(jobs > w.ntrips) jobs = w.ntrips;
+	if(jobs > 1 && NULL != (threads = (pthread_t *)calloc(jobs, sizeof(pthread_t)))) {
+		for(nthreads=0;nthreads<jobs;nthreads++) {
+			pthread_mutex_lock(&w.lock);
+			w.workersleft++;
+			pthread_mutex_unlock(&w.lock);
+			if(0 != pthread_create(&threads[nthreads], NULL, repairtrips_worker, &w)) {
+				perror("Not Fatal: Couldn't create analysis thread");
+				pthread_mutex_lock(&w.lock);
+				w.workersleft--;
+				pthread_mutex_unlock(&w.lock);
+				break;
+			}
+		}
+	}
+#endif //HAVE_REPAIRTHREADS
+
+	while(applied < w.ntrips) {
+		repairtrips_lock(&w);
+#ifdef HAVE_REPAIRTHREADS
+		while(applied == w.ndone && w.workersleft > 0) {
+			pthread_cond_wait(&w.cond, &w.lock);
+		}
+#endif //HAVE_REPAIRTHREADS
+		i = applied < w.ndone ? w.done[applied] : -1;
+		repairtrips_unlock(&w);
+
+		if(-1 == i) {
+			// No threads, or they've all gone; do it ourselves
+			if(-1 != (i = repairtrips_nexttrip(&w))) {
+				repairtrips_analyseone(&w, db, i);
+			}
+			continue;
+		}
+
+		int rc = repairtrips_applyone(db, &w, i);
+		if(rc < 0) {
+			failed = 1;
+		} else {
+			changed += rc;
+		}
+		applied++;
+
+		int percent = 100 * applied / w.ntrips;
+		if(percent / 10 != lastpercent / 10) {
+			printf("%s: %i/%i trips\n", step->name, applied, w.ntrips);
+			lastpercent = percent;
+		}
+	}
+
+#ifdef HAVE_REPAIRTHREADS
+	// Every trip was applied, so every worker's out of work
+	for(i=0;i<nthreads;i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_cond_destroy(&w.cond);
+	pthread_mutex_destroy(&w.lock);
+#endif //HAVE_REPAIRTHREADS
+
+	if(!failed) {
+		sqlite3_stmt *stmt;
+		const char delete_sql[] = "DELETE FROM " REPAIRPROGRESS_TABLE " WHERE step=?";
+		if(SQLITE_OK == sqlite3_prepare_v2(db, delete_sql, -1, &stmt, NULL)) {
+			sqlite3_bind_text(stmt, 1, step->name, -1, SQLITE_STATIC);
+			sqlite3_step(stmt);
+			sqlite3_finalize(stmt);
+		}
+	}
+
+done:
+	free(w.trips);
+	free(w.results);
+	free(w.status);
+	free(w.done);
+
+	return failed?-1:changed;
+}
+
@@ -0,0 +1,97 @@
+/* Copyright 2009 Gary Briggs
+
+This file is part of obdgpslogger.
+
+obdgpslogger is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+obdgpslogger is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+/** \file
+ \brief Run a repair step trip by trip, resumably
+ */
+#ifndef __REPAIRTRIPS_H
+#define __REPAIRTRIPS_H
+
+#include <stddef.h>
+#include "sqlite3.h"
+
+/// Table holding which trips each step has finished
+#define REPAIRPROGRESS_TABLE "repairprogress"
+
+/// How long to wait on a lock held by another connection, milliseconds
+#define REPAIR_BUSYTIMEOUT 600000
+
+/// One row from the trip table
+struct repairtrip {
+	int tripid; ///< trip.tripid
+	double start; ///< trip.start
+	double end; ///< trip.end. Negative if the trip never ended
+};
+
+/// Work out what needs doing to one trip
+/** May run on a worker thread, with its own read-only connection
+ \param db read-only connection to use
+ \param trip the trip to look at
+ \param result resultsize bytes for the apply function
+ \param arg from the repairstep
+ \return 0 if there's something to apply, >0 if not, -1 for error
+ */
+typedef int (*repairtrips_analyse)(sqlite3 *db, const struct repairtrip *trip, void *result, void *arg);
+
+/// Apply one trip's result
+/** Always runs on the caller's thread, inside a transaction
+ \return -1 for error, else the number of rows changed
+ */
+typedef int (*repairtrips_apply)(sqlite3 *db, const struct repairtrip *trip, const void *result, void *arg);
+
+/// A step that works one trip at a time
+struct repairstep {
+	const char *name; ///< Name it's checkpointed under
+	size_t resultsize; ///< Bytes analyse hands to apply
+	repairtrips_analyse analyse; ///< Read-only analysis
+	repairtrips_apply apply; ///< Writes
+	void *arg; ///< Passed to both
+};
+
+/// Create the progress table if it's not there
+/** \return 0 for success */
+int repairprogress_init(sqlite3 *db);
+
+/// Record that a step has done something that must be finished
+/** \param trip trip it's done, or -1 just to mark the step as started
+ \return 0 for success */
+int repairprogress_mark(sqlite3 *db, const char *step, int trip);
+
+/// Find out if a step was interrupted last time
+/** \return 1 if it has rows in the progress table, else 0 */
+int repairprogress_started(sqlite3 *db, const char *step);
+
+/// Drop the progress table if every step finished
+void repairprogress_finish(sqlite3 *db);
+
+/// Run a step against every trip it hasn't yet finished
+/** Trips are analysed by up to jobs threads, each with its own read-only
+  connection to dbfilename. Results are applied serially on db, one
+  transaction per trip along with its checkpoint. Once every trip is
+  done, the step's checkpoints are removed.
+ \param db read-write connection
+ \param dbfilename file db is open on
+ \param jobs number of analysis threads. <=1 for none
+ \return -1 for error, else the number of rows changed
+ */
+int repairtrips(sqlite3 *db, const char *dbfilename, int jobs, const struct repairstep *step);
+
+#endif // __REPAIRTRIPS_H
+
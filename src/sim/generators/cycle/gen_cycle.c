@@ -28,6 +28,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "datasource.h"
 #include "obdservicecommands.h"
+#include "obddecode.h"
 
 #define DEFAULT_CYCLE_S 30
 #define DEFAULT_CYCLE_GEARS 6
@@ -130,15 +131,15 @@ int cycle_simgen_getvalue(void *gen, unsigned int mode, unsigned int PID, unsign
 	}
 	float min = cmd->min_value;
 	float max = cmd->max_value;
-	OBDConvRevFunc conv = cmd->convrev;
+	const struct obddecode *dec = obdDecodeForPID(0x01, PID);
 
 	float cyclefraction = dt/g->cycle_length;
 	float val = min + cyclefraction * (max-min);
 
 	// RPM gets special treatment
 	if(NULL != cmd->db_column && 0 != strcmp(cmd->db_column, "rpm")) {
-		if(NULL == conv) return cmd->bytes_returned; // Can't usefully convert
-		return conv(val, A, B, C, D);
+		if(NULL == dec) return cmd->bytes_returned; // Can't usefully convert
+		return obdEncodeValueABCD(dec, val, A, B, C, D);
 	} else {
 		int rpm_min = 500;
 		int rpm_range = 6000;
@@ -151,8 +152,8 @@ int cycle_simgen_getvalue(void *gen, unsigned int mode, unsigned int PID, unsign
 		revs += rpm_min;
 
 		// fprintf(stderr, "rpm=%f, dt=%f\n", revs, dt);
-		if(NULL == conv) return 0; // Can't usefull convert
-		return conv(revs, A, B, C, D);
+		if(NULL == dec) return 0; // Can't usefull convert
+		return obdEncodeValueABCD(dec, revs, A, B, C, D);
 	}
 
 	return -1; // Shouldn't be able to get here
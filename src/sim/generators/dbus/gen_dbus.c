@@ -27,6 +27,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <dbus/dbus.h>
 
 #include "obdservicecommands.h"
+#include "obddecode.h"
 
 #include "datasource.h"
 
@@ -42,6 +43,7 @@ struct dbus_simvals {
 	int map_from; //< The first number in the message
 	unsigned int pid; //< Is mapped to this OBDII PID
 	struct obdservicecmd *pid_cmd; // Cache the cmd for this PID
+	const struct obddecode *pid_dec; // Cache how to encode this PID
 	float most_recent; //< The most recent value we saw for this PID
 	struct dbus_simvals *next; //< Yay linked lists
 };
@@ -131,6 +133,7 @@ int dbus_simgen_create(void **gen, const char *seed) {
 			v->map_from = map_from;
 			v->pid = map_to;
 			v->pid_cmd = cmd;
+			v->pid_dec = obdDecodeForPID(0x01, map_to);
 			v->most_recent = 0;
 			v->next = NULL;
 			if(NULL == simval_list) {
@@ -266,7 +269,8 @@ int dbus_simgen_getvalue(void *gen, unsigned int mode, unsigned int PID, unsigne
 	struct dbus_simvals *v = dbus_simgen_findsimval_to(gen, PID);
 	if(NULL == v) return 0;
 
-	return v->pid_cmd->convrev(v->most_recent, A, B, C, D);
+	if(NULL == v->pid_dec) return 0;
+	return obdEncodeValueABCD(v->pid_dec, v->most_recent, A, B, C, D);
 }
 
 int dbus_simgen_idle(void *gen, int idlems) {
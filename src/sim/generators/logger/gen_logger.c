@@ -30,6 +30,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include "sqlite3.h"
 
 #include "obdservicecommands.h"
+#include "obddecode.h"
 #include "datasource.h"
 
 /// This is the void * generator
@@ -238,7 +239,11 @@ int logger_simgen_getvalue(void *gen, unsigned int mode, unsigned int PID, unsig
 	sqlite3_step(select_stmt); // We only step once - that's all we asked for.
 
 	double val = sqlite3_column_double(select_stmt, 0);
-	int retval = cmd->convrev(val, A, B, C, D);
+	int retval = 0;
+	const struct obddecode *dec = obdDecodeForPID(0x01, PID);
+	if(NULL != dec) {
+		retval = obdEncodeValueABCD(dec, val, A, B, C, D);
+	}
 
 	sqlite3_finalize(select_stmt);
 
@@ -252,6 +252,16 @@ void main_loop(OBDSimPort *sp, struct simsettings *ss) {
 				sp->writeData(ss->e_linefeed?newline_crlf:newline_cr);
 				responsecount++;
 			}
+		} else if(0x06 == vals[0] || 0x09 == vals[0]) { // Diagnostic results, vehicle info
+			for(i=0;i<ss->ecu_count;i++) {
+				unsigned int payload[128];
+				int len = obdsim_extmodepayload(ss, &ss->ecus[i], vals[0], vals[1],
+					payload, sizeof(payload)/sizeof(payload[0]));
+				if(0 < len) {
+					responsecount += obdsim_writeframes(sp, ss, vals[0], vals[1], payload, len);
+				}
+			}
+			ecu_replycount = ss->ecu_count;
 		} else { // Two or more vals  mode0x01 => mode,pid[,possible optimisation]
 								// mode0x02 => mode,pid,frame
 
@@ -420,6 +430,157 @@ void main_loop(OBDSimPort *sp, struct simsettings *ss) {
 
 }
 
+/// Copy a string into a payload, NUL padded to len
+static int obdsim_putstring(unsigned int *payload, const char *str, int len) {
+	int i;
+	int slen = strlen(str);
+	for(i=0;i<len;i++) {
+		payload[i] = (i<slen)?(unsigned char)str[i]:0x00;
+	}
+	return len;
+}
+
+/// Is this protocol ISO 15765
+static int obdsim_iscan(struct simsettings *ss) {
+	return NULL == ss->e_protocol ||
+		OBDHEADER_CAN11 == ss->e_protocol->headertype ||
+		OBDHEADER_CAN29 == ss->e_protocol->headertype ||
+		OBDHEADER_NULL == ss->e_protocol->headertype;
+}
+
+int obdsim_extmodepayload(struct simsettings *ss, struct obdgen_ecu *ecu,
+	unsigned int mode, unsigned int pid, unsigned int *payload, int n) {
+
+	char str[32];
+	if(n < 64) return 0;
+
+	if(0x09 == mode) {
+		switch(pid) {
+			case 0x00: // 02, 04 and 0A supported
+				payload[0] = 0x50; payload[1] = 0x40; payload[2] = 0x00; payload[3] = 0x00;
+				return 4;
+			case 0x02:
+				snprintf(str, sizeof(str), "OBDSIM%011u", ecu->ecu_num);
+				payload[0] = 1;
+				return 1 + obdsim_putstring(payload+1, str, 17);
+			case 0x04:
+				snprintf(str, sizeof(str), "SIMCAL%02X", ecu->ecu_num & 0xFF);
+				payload[0] = 1;
+				return 1 + obdsim_putstring(payload+1, str, 16);
+			case 0x0A:
+				snprintf(str, sizeof(str), "ECM-OBDSim%u", ecu->ecu_num);
+				payload[0] = 1;
+				return 1 + obdsim_putstring(payload+1, str, 20);
+			default:
+				return 0;
+		}
+	}
+
+	// Mode 06 is only simulated the ISO 15765 way
+	if(0x06 == mode && obdsim_iscan(ss)) {
+		switch(pid) {
+			case 0x00: // 20 supported
+				payload[0] = 0x00; payload[1] = 0x00; payload[2] = 0x00; payload[3] = 0x01;
+				return 4;
+			case 0x20: // 21 supported
+				payload[0] = 0x80; payload[1] = 0x00; payload[2] = 0x00; payload[3] = 0x00;
+				return 4;
+			case 0x21: { // Catalyst monitor bank 1, two tests
+				const unsigned int tests[] = {
+					      0x80, 0x01, 0x01, 0x50, 0x00, 0x00, 0x03, 0x00,
+					0x21, 0x81, 0x01, 0x00, 0x10, 0x00, 0x00, 0x00, 0x20
+				};
+				memcpy(payload, tests, sizeof(tests));
+				return sizeof(tests)/sizeof(tests[0]);
+			}
+			default:
+				return 0;
+		}
+	}
+	return 0;
+}
+
+int obdsim_writeframes(OBDSimPort *sp, struct simsettings *ss,
+	unsigned int mode, unsigned int pid, const unsigned int *payload, int len) {
+
+	const char *sp_sep = ss->e_spaces?" ":"";
+	const char *newline = ss->e_linefeed?"\r\n":"\r";
+	char response[256];
+	char shortbuf[16];
+	int lines = 0;
+	int i;
+
+	if(obdsim_iscan(ss)) {
+		if(len <= 5) { // Fits in a single frame
+			snprintf(response, sizeof(response), "%02X%s%02X", mode+0x40, sp_sep, pid);
+			for(i=0;i<len;i++) {
+				snprintf(shortbuf, sizeof(shortbuf), "%s%02X", sp_sep, payload[i]);
+				strcat(response, shortbuf);
+			}
+			sp->writeData(response);
+			sp->writeData(newline);
+			return 1;
+		}
+
+		snprintf(response, sizeof(response), "%03X", len+2);
+		sp->writeData(response);
+		sp->writeData(newline);
+		lines++;
+
+		// First frame has six bytes including the echo, the rest seven
+		unsigned int message[256];
+		int msglen = 0;
+		message[msglen++] = mode+0x40;
+		message[msglen++] = pid;
+		for(i=0;i<len && msglen<(int)(sizeof(message)/sizeof(message[0]));i++) {
+			message[msglen++] = payload[i];
+		}
+		int seq = 0;
+		int pos = 0;
+		while(pos < msglen) {
+			int framebytes = (0 == seq)?6:7;
+			snprintf(response, sizeof(response), "%X:", seq & 0x0F);
+			for(i=0;i<framebytes && pos<msglen;i++, pos++) {
+				snprintf(shortbuf, sizeof(shortbuf), "%s%02X", sp_sep, message[pos]);
+				strcat(response, shortbuf);
+			}
+			sp->writeData(response);
+			sp->writeData(newline);
+			lines++;
+			seq++;
+		}
+		return lines;
+	}
+
+	if(0x09 != mode || len <= 5) {
+		snprintf(response, sizeof(response), "%02X%s%02X", mode+0x40, sp_sep, pid);
+		for(i=0;i<len && i<5;i++) {
+			snprintf(shortbuf, sizeof(shortbuf), "%s%02X", sp_sep, payload[i]);
+			strcat(response, shortbuf);
+		}
+		sp->writeData(response);
+		sp->writeData(newline);
+		return 1;
+	}
+
+	// Legacy mode 09; drop the count, pad the front out to four byte messages
+	int datalen = len - 1;
+	int padding = (4 - datalen%4) % 4;
+	int seq;
+	for(seq=1; (seq-1)*4 < datalen+padding; seq++) {
+		snprintf(response, sizeof(response), "%02X%s%02X%s%02X", mode+0x40, sp_sep, pid, sp_sep, seq);
+		for(i=0;i<4;i++) {
+			int idx = (seq-1)*4 + i - padding;
+			snprintf(shortbuf, sizeof(shortbuf), "%s%02X", sp_sep, (idx<0)?0x00:payload[1+idx]);
+			strcat(response, shortbuf);
+		}
+		sp->writeData(response);
+		sp->writeData(newline);
+		lines++;
+	}
+	return lines;
+}
+
 void obdsim_freezeframes(struct obdgen_ecu *ecus, int ecu_count) {
 	int i;
 	for(i=0;i<ecu_count;i++) {
@@ -47,6 +47,29 @@ int parse_ATcmd(struct simsettings *ss, OBDSimPort *sp, char *line, char *respon
 int render_obdheader(char *buf, size_t buflen, struct obdiiprotocol *proto,
 	struct obdgen_ecu *ecu, unsigned int messagelen, int spaces, int dlc);
 
+/// Get the payload an ecu returns for a mode 06 or 09 request
+/** Everything after the mode and pid echo, ISO 15765 style [ie, mode 09
+     items are preceded by a count]
+    \param ss the overall sim state
+    \param ecu the ecu being asked
+    \param mode the request mode
+    \param pid the pid or mid asked for
+    \param payload filled with the payload
+    \param n space available in payload
+    \return number of bytes in payload, or zero for NO DATA
+*/
+int obdsim_extmodepayload(struct simsettings *ss, struct obdgen_ecu *ecu,
+	unsigned int mode, unsigned int pid, unsigned int *payload, int n);
+
+/// Write a response that may need several frames
+/** ISO 15765 protocols get a multi-frame message the way an ELM327 shows
+     it with headers off. Older protocols get a line per four bytes with a
+     sequence number, the way mode 09 works on them
+    \return number of lines written
+*/
+int obdsim_writeframes(OBDSimPort *sp, struct simsettings *ss,
+	unsigned int mode, unsigned int pid, const unsigned int *payload, int len);
+
 /// Update the freeze frame info for all the ecus
 void obdsim_freezeframes(struct obdgen_ecu *ecus, int ecucount);
 
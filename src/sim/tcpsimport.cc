@@ -23,6 +23,7 @@ along with obdgpslogger.  If not, see <http://www.gnu.org/licenses/>.
 #include <netinet/in.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 	  
 #include "simport.h"
 #include "obdsim.h"
@@ -131,9 +132,9 @@ char* TCPSimPort::readLine() {
 	}
 
 	if(readbuf_pos > 0) {
-		char* line_end = strnstr(readbuf, "\r", readbuf_pos);
+		char* line_end = (char *)memchr(readbuf, '\r', readbuf_pos);
 		if(line_end == NULL) {
-			line_end = strnstr(readbuf, "\n", readbuf_pos);
+			line_end = (char *)memchr(readbuf, '\n', readbuf_pos);
 		}
 		
 		if(line_end != NULL) {